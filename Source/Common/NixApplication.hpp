@@ -10,8 +10,12 @@
 
 #pragma once
 #include <cstdint>
+#include <cstdio>
 #include <string> 
 #include "../ThirdPart/Nix/Timer/Timer.h"
+#include "../ThirdPart/Nix/Profiler/Profiler.h"
+#include "../ThirdPart/Nix/Profiler/TimeHistogram.h"
+#include "../ThirdPart/Nix/IO/AsyncReader.h"
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -23,9 +27,6 @@ namespace Nix {
     class IArchive;
 }
 
-static int frameCount = 0;
-static float timeElapsed = 0.0f;
-
 class NixApplication {
     
 public:
@@ -61,28 +62,58 @@ protected:
     bool _appPaused = false;
     uint32_t _width = 0;
     uint32_t _height = 0;
+    std::string _tracePath;
+    uint32_t _traceFrames = 0;
+    // frame statistics
+    uint32_t _frameCount = 0;
+    int64_t _statsElapsed = 0;          // nanoseconds, last title update
+    Nix::TimeHistogram _frameTimes;
+    Nix::TimeHistogram _windowTimes;    // the frames since the last title update
+    std::string _frameStatsPath;
+    uint32_t _frameLimit = 0;
+    // asset streaming, finished reads call back at the start of the frame
+    Nix::AsyncReader _asyncReader;
 
 protected:
     void calculateFrameStats()
     {
-        frameCount++;
+        _frameCount++;
+        _frameTimes.record((uint64_t)_timer.deltaNanoseconds());
+        _windowTimes.record((uint64_t)_timer.deltaNanoseconds());
 
-        if(_timer.totalTime() - timeElapsed >= 1.0f) {
-            float fps = (float)frameCount;
+        if(_timer.totalNanoseconds() - _statsElapsed >= 1000000000) {
+            float fps = (float)_frameCount;
             auto mspf = 1000.0f / fps;
 
             auto fpsStr = std::to_string(fps);
             auto mspfStr = std::to_string(mspf);
+            // over the same second as fps, the session percentiles are in the summary on exit
+            auto p99Str = std::to_string(_windowTimes.percentile(99.0) * 1e-6);
             
             std::string title(title());
-            auto text = title + "    fps: " + fpsStr + "    mspf: " + mspfStr;
+            auto text = title + "    fps: " + fpsStr + "    mspf: " + mspfStr + "    p99: " + p99Str;
             SetWindowTextA((HWND)_hwnd, text.c_str());
             // printf("%s\n", text.c_str());
 
-            frameCount = 0;
-            timeElapsed += 1.0f;
+            _frameCount = 0;
+            _windowTimes.reset();
+            _statsElapsed += 1000000000;
         }
     };
+
+    void reportFrameStats()
+    {
+        if(_frameLimit) {
+            printf("%s\n", _frameTimes.summary().c_str());
+            fflush(stdout);
+        }
+        if(_frameStatsPath.empty()) return;
+        size_t dot = _frameStatsPath.find_last_of('.');
+        if(dot != std::string::npos && _frameStatsPath.compare(dot, std::string::npos, ".json") == 0)
+            _frameTimes.writeJson(_frameStatsPath);
+        else
+            _frameTimes.writeCsv(_frameStatsPath);
+    }
     
 
 public:
@@ -105,6 +136,26 @@ public:
     virtual void onMouseEvent(eMouseButton btn, eMouseEvent event, int x, int y) {};
 
 public:
+    // starts the streaming threads on `archive`, called before `initialize` so that it can already
+    // issue reads
+    bool initializeAsyncReader(Nix::IArchive *archive, uint32_t threadCount = 2) {
+        return _asyncReader.initialize(archive, threadCount);
+    }
+    inline Nix::AsyncReader &asyncReader() { return _asyncReader; }
+    // records the next `frames` frames and writes them to `path` as a Chrome trace
+    void captureTrace(const std::string &path, uint32_t frames) {
+        // a capture of no frames would never be written
+        if(!frames) return;
+        _tracePath = path;
+        _traceFrames = frames;
+        Nix::SharedProfiler().beginCapture();
+    }
+    // frame time percentiles are written to `path` when run returns, as JSON for a .json path
+    // and CSV otherwise
+    void recordFrameStats(const std::string &path) { _frameStatsPath = path; }
+    // regression runs : quit after `frames` frames and print the frame time summary
+    void setFrameLimit(uint32_t frames) { _frameLimit = frames; }
+    const Nix::TimeHistogram &frameTimes() const { return _frameTimes; }
     inline Nix::Timer &getTimer() { return _timer; }
     inline void setAppPaused(const bool isPaused) { _appPaused = isPaused; }
     inline bool isAppPaused() const { return _appPaused; }
@@ -148,8 +199,25 @@ public:
                 _timer.tick();
                 if(!_appPaused) {
                     calculateFrameStats();
-                    tick(_timer.deltaTime());
-                    draw();
+                    {
+                        NIX_PROFILE_SCOPE("io");
+                        _asyncReader.poll();
+                    }
+                    {
+                        NIX_PROFILE_SCOPE("tick");
+                        tick(_timer.deltaTime());
+                    }
+                    {
+                        NIX_PROFILE_SCOPE("draw");
+                        draw();
+                    }
+                    NIX_PROFILE_FRAME();
+                    if(_traceFrames && --_traceFrames == 0) {
+                        Nix::SharedProfiler().endCapture(_tracePath);
+                    }
+                    if(_frameLimit && _frameTimes.count() == _frameLimit) {
+                        PostQuitMessage(0);
+                    }
                     // printf("calc Frame stats run ... \n");
                 }
                 else {
@@ -160,6 +228,9 @@ public:
             }
         }
 
+        // reads still in flight are dropped, their callbacks would outlive the samples' resources
+        _asyncReader.shutdown();
+        reportFrameStats();
         return (int)msg.wParam;
     };
 };
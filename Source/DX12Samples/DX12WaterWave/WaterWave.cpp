@@ -430,6 +430,7 @@ void WaterWave::updateCamera(float dt)
 
 void WaterWave::updateObjectConstantBuffers(float dt)
 {
+    NIX_PROFILE_SCOPE("WaterWave::updateObjectConstantBuffers");
     auto currObjectCb = _currFrameResource->_objectConstantBuffer.get();
     for(auto &e : _allRenderItems)
     {
@@ -1,4 +1,5 @@
 #include "Waves.hpp"
+#include "../ThirdPart/Nix/Profiler/Profiler.h"
 #include <ppl.h>
 #include <algorithm>
 #include <cassert>
@@ -121,6 +122,7 @@ float Waves::depth() const
 
 void Waves::update(float dt)
 {
+    NIX_PROFILE_SCOPE("Waves::update");
     // static float t = 0;
 
     // t += dt;
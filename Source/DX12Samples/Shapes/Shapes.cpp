@@ -486,6 +486,7 @@ void Shapes::updateCamera(float dt)
 
 void Shapes::updateObjectConstantBuffers(float dt)
 {
+    NIX_PROFILE_SCOPE("Shapes::updateObjectConstantBuffers");
     auto currObjectCb = _currFrameResource->_objectConstantBuffer.get();
     for(auto &e : _allRenderItems)
     {
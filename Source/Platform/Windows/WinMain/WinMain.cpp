@@ -45,6 +45,39 @@ int APIENTRY wWinMain
 	}
 
 	HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_EMPLTYWINDOW));
+	// --trace <file> [frames] : writes a Chrome trace of the first frames
+	// --frames <n> : quits after n frames and prints the frame time summary to the console
+	// --frame-stats <file> : writes the frame time percentiles on exit, .json or .csv
+	int argc = 0;
+	LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+	for (int i = 1; argv && i < argc; ++i) {
+		if (wcscmp(argv[i], L"--trace") == 0 && i + 1 < argc) {
+			char tracePath[MAX_PATH];
+			WideCharToMultiByte(CP_ACP, 0, argv[++i], -1, tracePath, MAX_PATH, NULL, NULL);
+			uint32_t frames = 300;
+			if (i + 1 < argc && iswdigit(argv[i + 1][0])) {
+				// 0 keeps the default
+				uint32_t requested = (uint32_t)_wtoi(argv[++i]);
+				if (requested) {
+					frames = requested;
+				}
+			}
+			object->captureTrace(tracePath, frames);
+		}
+		else if (wcscmp(argv[i], L"--frames") == 0 && i + 1 < argc) {
+			object->setFrameLimit((uint32_t)_wtoi(argv[++i]));
+			// a GUI process has no console of its own, report to the one that started it
+			if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+				freopen("CONOUT$", "w", stdout);
+			}
+		}
+		else if (wcscmp(argv[i], L"--frame-stats") == 0 && i + 1 < argc) {
+			char statsPath[MAX_PATH];
+			WideCharToMultiByte(CP_ACP, 0, argv[++i], -1, statsPath, MAX_PATH, NULL, NULL);
+			object->recordFrameStats(statsPath);
+		}
+	}
+	LocalFree(argv);
 	//
 	return object->run();
 }
@@ -102,6 +135,7 @@ BOOL InitInstance(HINSTANCE hInstance, int nCmdShow)
 	}
 	assetRoot.append("/../../");
 	auto archieve = Nix::CreateStdArchieve( assetRoot );
+	object->initializeAsyncReader(archieve);
     if(!object->initialize(hWnd, archieve)) {
 		return FALSE;
 	}
@@ -1,15 +1,151 @@
 #include "Archive.h"
+#include "Directory.h"
+#include "FileWriter.h"
+#include "WorkerPool.h"
 #include <memory>
-#include "../string/Path.h"
+#include <string.h>
+#include "../String/Path.h"
+#include "../String/Hash.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#endif
 
 namespace Nix
 {
+    // chunk size of transfers that have to go through an intermediate buffer
+    static const size_t TransferChunkSize = 256 * 1024;
+
+    // threads used to prefetch or hash several files at once, the calling one included
+    static const uint32_t MaxArchiveWorkers = 8;
+
+    // at most this many adjacent ranges are merged into one vectored read
+    static const size_t MaxCoalescedRanges = 64;
+
+    class StdFile;
+    static size_t TransferStdFile( StdFile* _dst, StdFile* _src, size_t _bytes );
+
+    // clips [_offset, _offset + _bytes) to a file of `_size` bytes
+    static inline size_t ClipRange( uint64_t _offset, size_t _bytes, uint64_t _size )
+    {
+        if( _offset >= _size )
+            return 0;
+        return _bytes > _size - _offset ? (size_t)( _size - _offset ) : _bytes;
+    }
+
+    size_t IFile::readv( IoRange* _ranges, size_t _count )
+    {
+        uint64_t position = tell();
+        size_t total = 0;
+        for( size_t i = 0; i < _count; ++i )
+        {
+            IoRange& range = _ranges[i];
+            range.bytesRead = 0;
+            if( seek( SeekSet, (int64_t)range.offset ) && tell() == range.offset )
+                range.bytesRead = read( range.size, range.buffer );
+            total += range.bytesRead;
+        }
+        seek( SeekSet, (int64_t)position );
+        return total;
+    }
+
+    // positional I/O on native handles, neither reads nor moves a shared file cursor
+#ifdef _WIN32
+    typedef HANDLE NativeFile;
+    static const NativeFile InvalidNativeFile = INVALID_HANDLE_VALUE;
+#else
+    typedef int NativeFile;
+    static const NativeFile InvalidNativeFile = -1;
+#endif
+
+    static size_t ReadAt( NativeFile _file, void* out_, size_t _bytes, uint64_t _offset )
+    {
+        size_t done = 0;
+        while( done < _bytes )
+        {
+#ifdef _WIN32
+            size_t left = _bytes - done;
+            DWORD bytes = left > 0x40000000 ? 0x40000000 : (DWORD)left;
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = (DWORD)( _offset + done );
+            overlapped.OffsetHigh = (DWORD)( ( _offset + done ) >> 32 );
+            DWORD readReal = 0;
+            if( !ReadFile( _file, (char*)out_ + done, bytes, &readReal, &overlapped ) || !readReal )
+                break;
+#else
+            ssize_t readReal = pread( _file, (char*)out_ + done, _bytes - done, (off_t)( _offset + done ) );
+            if( readReal < 0 && errno == EINTR )
+                continue;
+            if( readReal <= 0 )
+                break;
+#endif
+            done += (size_t)readReal;
+        }
+        return done;
+    }
+
+    static size_t WriteAt( NativeFile _file, const void* _in, size_t _bytes, uint64_t _offset )
+    {
+        size_t done = 0;
+        while( done < _bytes )
+        {
+#ifdef _WIN32
+            size_t left = _bytes - done;
+            DWORD bytes = left > 0x40000000 ? 0x40000000 : (DWORD)left;
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = (DWORD)( _offset + done );
+            overlapped.OffsetHigh = (DWORD)( ( _offset + done ) >> 32 );
+            DWORD writeReal = 0;
+            if( !WriteFile( _file, (const char*)_in + done, bytes, &writeReal, &overlapped ) || !writeReal )
+                break;
+#else
+            ssize_t writeReal = pwrite( _file, (const char*)_in + done, _bytes - done, (off_t)( _offset + done ) );
+            if( writeReal < 0 && errno == EINTR )
+                continue;
+            if( writeReal <= 0 )
+                break;
+#endif
+            done += (size_t)writeReal;
+        }
+        return done;
+    }
+
+    static void CloseNativeFile( NativeFile _file )
+    {
+#ifdef _WIN32
+        CloseHandle( _file );
+#else
+        ::close( _file );
+#endif
+    }
+
+    // Sequential reads below this size go through the file's read buffer, larger ones and reads
+    // after a seek go straight to the caller.
+    static const size_t StdFileBufferSize = 64 * 1024;
+
+    // File on a native handle with 64 bit offsets. `read` and `write` work at the file's own
+    // cursor with positional I/O, `readv` doesn't touch it at all : threads sharing a file
+    // don't need to lock around `readv`.
     class StdFile: public IFile
     {
         friend class StdArchive;
+        friend size_t TransferStdFile( StdFile* _dst, StdFile* _src, size_t _bytes );
     private:
-        FILE* _handle = nullptr;
-		size_t _size = 0;
+        NativeFile _handle = InvalidNativeFile;
+        uint64_t _size = 0;
+        uint64_t _position = 0;
+        //
+        std::unique_ptr<uint8_t[]> _buffer;
+        uint64_t _bufferOffset = 0;     // file offset of the first buffered byte
+        size_t _bufferSize = 0;         // valid bytes in `_buffer`
+        uint64_t _readEnd = 0;          // where the previous read stopped, reads from there are sequential
         //
         StdFile()
         {
@@ -19,13 +155,20 @@ namespace Nix
 		StdFile(StdFile&& _file) {
 			this->_handle = _file._handle;
 			this->_size = _file._size;
-			_file._handle = nullptr;
+			this->_position = _file._position;
+			this->_buffer = std::move(_file._buffer);
+			this->_bufferOffset = _file._bufferOffset;
+			this->_bufferSize = _file._bufferSize;
+			this->_readEnd = _file._readEnd;
+			_file._handle = InvalidNativeFile;
 			_file._size = 0;
+			_file._position = 0;
+			_file._bufferSize = 0;
 		}
 
 		virtual size_t size()
 		{
-			return _size;
+			return (size_t)_size;
 		}
 
         virtual bool readable() override
@@ -45,66 +188,149 @@ namespace Nix
 
         virtual size_t read( size_t _bytes, IFile* out_ ) 
         {
-            char chunk[64];
-            size_t bytesLeft = _bytes;
-            size_t roundRead = 0;
-            do
+            return TransferFile( out_, this, _bytes );
+        }
+
+        virtual size_t read( size_t _bytes, void* out_ )
+        {
+            uint8_t* out = (uint8_t*)out_;
+            size_t total = ClipRange( _position, _bytes, _size );
+            size_t done = 0;
+            while( done < total )
             {
-                roundRead = bytesLeft > sizeof(chunk) ? sizeof(chunk) : bytesLeft;
-                size_t readReal = fread( chunk, 1, sizeof(chunk), _handle);
-                bytesLeft -= readReal;
-                out_->write( readReal, chunk );
-                if( readReal != roundRead )
+                if( _position >= _bufferOffset && _position < _bufferOffset + _bufferSize )
+                {
+                    size_t inBuffer = (size_t)( _position - _bufferOffset );
+                    size_t chunk = _bufferSize - inBuffer;
+                    chunk = chunk > total - done ? total - done : chunk;
+                    memcpy( out + done, _buffer.get() + inBuffer, chunk );
+                    _position += chunk;
+                    done += chunk;
+                    continue;
+                }
+                size_t left = total - done;
+                // only sequential reads fill the buffer, a lookup after a seek would pull a whole
+                // buffer for a few bytes
+                if( left >= StdFileBufferSize || _position != _readEnd )
+                {
+                    size_t readReal = ReadAt( _handle, out + done, left, _position );
+                    _position += readReal;
+                    done += readReal;
+                    break;
+                }
+                if( !_buffer )
+                    _buffer.reset( new uint8_t[StdFileBufferSize] );
+                _bufferOffset = _position;
+                _bufferSize = ReadAt( _handle, _buffer.get(), StdFileBufferSize, _position );
+                if( !_bufferSize )
                     break;
             }
-            while( bytesLeft );
-            return _bytes - bytesLeft;
+            _readEnd = _position;
+            return done;
         }
 
-        virtual size_t read( size_t _bytes, void* out_ )
+        virtual size_t readv( IoRange* _ranges, size_t _count ) override
         {
-            return fread( out_, 1, _bytes, _handle );
+            size_t total = 0;
+            size_t i = 0;
+            while( i < _count )
+            {
+                size_t end = i + 1;
+#if defined(__linux__)
+                // adjacent ranges go down in a single vectored read
+                while( end < _count && end - i < MaxCoalescedRanges && _ranges[end].offset == _ranges[end - 1].offset + _ranges[end - 1].size )
+                    ++end;
+                if( end - i > 1 )
+                {
+                    struct iovec vectors[MaxCoalescedRanges];
+                    for( size_t j = i; j < end; ++j )
+                    {
+                        vectors[j - i].iov_base = _ranges[j].buffer;
+                        vectors[j - i].iov_len = _ranges[j].size;
+                    }
+                    ssize_t readReal = preadv( _handle, vectors, (int)( end - i ), (off_t)_ranges[i].offset );
+                    size_t bytesLeft = readReal > 0 ? (size_t)readReal : 0;
+                    bool endOfFile = readReal <= 0;
+                    for( size_t j = i; j < end; ++j )
+                    {
+                        IoRange& range = _ranges[j];
+                        range.bytesRead = bytesLeft > range.size ? range.size : bytesLeft;
+                        bytesLeft -= range.bytesRead;
+                        // a short read is finished range by range, it stops at the end of the file
+                        if( !endOfFile && range.bytesRead < range.size )
+                        {
+                            size_t more = range.size - range.bytesRead;
+                            size_t readMore = ReadAt( _handle, (char*)range.buffer + range.bytesRead, more, range.offset + range.bytesRead );
+                            range.bytesRead += readMore;
+                            endOfFile = readMore != more;
+                        }
+                        total += range.bytesRead;
+                    }
+                    i = end;
+                    continue;
+                }
+#endif
+                IoRange& range = _ranges[i];
+                range.bytesRead = ReadAt( _handle, range.buffer, range.size, range.offset );
+                total += range.bytesRead;
+                i = end;
+            }
+            return total;
         }
 
         virtual size_t write( size_t _bytes, IFile* _in )
         {
-            char chunk[64];
-            size_t bytesLeft = _bytes;
-            size_t roundWrite = 0;
-            do
-            {
-                roundWrite = bytesLeft > sizeof(chunk) ? sizeof(chunk) : bytesLeft;
-                size_t writeReal = _in->read( roundWrite, chunk );
-                bytesLeft -= writeReal;
-                fwrite( chunk, 1, writeReal, _handle );
-                if( writeReal != roundWrite )
-                    break;
-            }
-            while( bytesLeft );
-            return _bytes - bytesLeft;
+            return TransferFile( this, _in, _bytes );
         }
 
         virtual size_t write( size_t _bytes, const void* _in )
         {
-            return fwrite(_in, 1, _bytes, _handle);
+            size_t writeReal = WriteAt( _handle, _in, _bytes, _position );
+            dropBuffer( _position, writeReal );
+            _position += writeReal;
+            _size = _position > _size ? _position : _size;
+            return writeReal;
         }
 
-        virtual size_t tell()
+        virtual uint64_t tell()
         {
-            return ftell(_handle);
+            return _position;
         }
 
-        virtual bool seek( SeekFlag _flag, long _offset )
+        // may move past the end, a write there extends the file
+        virtual bool seek( SeekFlag _flag, int64_t _offset )
         {
-            return fseek( _handle, _offset, _flag) != 0;
+            int64_t position = 0;
+            switch( _flag )
+            {
+                case SeekFlag::SeekCur:
+                    position = (int64_t)_position + _offset;
+                    break;
+                case SeekFlag::SeekEnd:
+                    position = (int64_t)_size + _offset;
+                    break;
+                case SeekFlag::SeekSet:
+                    position = _offset;
+            }
+            if( position < 0 )
+                return false;
+            _position = (uint64_t)position;
+            return true;
         }
         //
         virtual void release()
         {
-            if( _handle )
-                fclose( _handle );
+            if( _handle != InvalidNativeFile )
+                CloseNativeFile( _handle );
             delete this;
         }
+    private:
+        // forgets the buffered bytes when [_offset, _offset + _bytes) was overwritten
+        void dropBuffer( uint64_t _offset, uint64_t _bytes )
+        {
+            if( _offset < _bufferOffset + _bufferSize && _bufferOffset < _offset + _bytes )
+                _bufferSize = 0;
+        }
     };
 
     class MemFile: public IFile
@@ -113,8 +339,8 @@ namespace Nix
 		friend IFile* CreateMemoryBuffer(size_t _length, MemoryFreeCB _cb);
     private:
         void* _raw;
-        long _size;
-        long _position;
+        size_t _size;
+        size_t _position;
         MemoryFreeCB _destructor = nullptr;
     public:
         MemFile()
@@ -140,23 +366,7 @@ namespace Nix
 
         virtual size_t read( size_t _bytes, IFile* out_ )
         {
-            char chunk[64];
-            size_t bytesLeft = _bytes;
-            size_t roundRead = 0;
-            do
-            {
-                size_t memLeft = (_size - _position);
-                roundRead = bytesLeft > sizeof(chunk) ? sizeof(chunk) : bytesLeft;
-                size_t readReal = roundRead > memLeft ? memLeft : roundRead;
-                memcpy( chunk, (char*)_raw + _position, readReal );
-                _position += readReal;
-                bytesLeft -= readReal;
-                out_->write( readReal, chunk );
-                if( readReal != roundRead )
-                    break;
-            }
-            while( bytesLeft );
-            return _bytes - bytesLeft;
+            return TransferFile( out_, this, _bytes );
         }
 
         virtual size_t read( size_t _bytes, void* out_ )
@@ -164,16 +374,26 @@ namespace Nix
             size_t memLeft = (_size - _position);
             size_t readReal = _bytes > memLeft ? memLeft : _bytes; 
             memcpy( out_, (char*)_raw + _position, readReal);
+            _position += readReal;
             return readReal;
         }
 
+        virtual size_t readv( IoRange* _ranges, size_t _count ) override
+        {
+            size_t total = 0;
+            for( size_t i = 0; i < _count; ++i )
+            {
+                IoRange& range = _ranges[i];
+                range.bytesRead = ClipRange( range.offset, range.size, _size );
+                memcpy( range.buffer, (char*)_raw + range.offset, range.bytesRead );
+                total += range.bytesRead;
+            }
+            return total;
+        }
+
         virtual size_t write( size_t _bytes, IFile* _in )
         {
-            size_t sizeWrite = (_size - _position);
-            sizeWrite = sizeWrite > _bytes? _bytes:sizeWrite;
-            auto nRead = _in->read( sizeWrite,  (char*)_raw + _position);
-            _position += nRead;
-            return nRead;
+            return TransferFile( this, _in, _bytes );
         }
 
         virtual size_t write( size_t _bytes, const void* _in )
@@ -185,33 +405,35 @@ namespace Nix
             return sizeWrite;
         }
 
-        virtual size_t tell()
+        virtual uint64_t tell()
         {
             return _position;
         }
 
-        virtual bool seek( SeekFlag _flag, long _offset )
+        virtual bool seek( SeekFlag _flag, int64_t _offset )
         {
+            int64_t position = (int64_t)_position;
             switch( _flag)
             {
                 case SeekFlag::SeekCur:
-                    _position += _offset;
+                    position += _offset;
                     break;
                 case SeekFlag::SeekEnd:
-                    _position = _size + _offset;
+                    position = (int64_t)_size + _offset;
                     break;
                 case SeekFlag::SeekSet:
-                    _position = _offset;
+                    position = _offset;
             }
 
-            if(_position < 0 )
+            if(position < 0 )
             {
-                _position = 0;
+                position = 0;
             }
-            else if( _position > _size )
+            else if( (uint64_t)position > _size )
             {
-                _position  = _size;
+                position  = (int64_t)_size;
             }
+            _position = (size_t)position;
             return true;
         }
 
@@ -232,6 +454,111 @@ namespace Nix
         }
     };
 
+    class BlobFile: public IFile
+    {
+        friend IFile* CreateBlobView( IBlob* _blob, size_t _offset, size_t _length );
+    private:
+        IBlob* _blob = nullptr;
+        const char* _raw = nullptr;
+        size_t _size = 0;
+        size_t _position = 0;
+    public:
+        virtual bool readable() override
+        {
+            return true;
+        }
+
+        virtual bool writable() override
+        {
+            return false;
+        }
+
+        virtual bool seekable() override
+        {
+            return true;
+        }
+
+        virtual size_t read( size_t _bytes, IFile* out_ ) override
+        {
+            return TransferFile( out_, this, _bytes );
+        }
+
+        virtual size_t read( size_t _bytes, void* out_ ) override
+        {
+            size_t memLeft = _size - _position;
+            size_t readReal = _bytes > memLeft ? memLeft : _bytes;
+            memcpy( out_, _raw + _position, readReal );
+            _position += readReal;
+            return readReal;
+        }
+
+        virtual size_t readv( IoRange* _ranges, size_t _count ) override
+        {
+            size_t total = 0;
+            for( size_t i = 0; i < _count; ++i )
+            {
+                IoRange& range = _ranges[i];
+                range.bytesRead = ClipRange( range.offset, range.size, _size );
+                memcpy( range.buffer, _raw + range.offset, range.bytesRead );
+                total += range.bytesRead;
+            }
+            return total;
+        }
+
+        virtual size_t write( size_t, IFile* ) override
+        {
+            return 0;
+        }
+
+        virtual size_t write( size_t, const void* ) override
+        {
+            return 0;
+        }
+
+        virtual uint64_t tell() override
+        {
+            return _position;
+        }
+
+        virtual bool seek( SeekFlag _flag, int64_t _offset ) override
+        {
+            int64_t position = (int64_t)_position;
+            switch( _flag )
+            {
+                case SeekFlag::SeekCur:
+                    position += _offset;
+                    break;
+                case SeekFlag::SeekEnd:
+                    position = (int64_t)_size + _offset;
+                    break;
+                case SeekFlag::SeekSet:
+                    position = _offset;
+            }
+            if( position < 0 )
+                position = 0;
+            else if( (uint64_t)position > _size )
+                position = (int64_t)_size;
+            _position = (size_t)position;
+            return true;
+        }
+
+        virtual size_t size() override
+        {
+            return _size;
+        }
+
+        virtual const void* constData() const override
+        {
+            return _raw;
+        }
+
+        virtual void release() override
+        {
+            _blob->release();
+            delete this;
+        }
+    };
+
     class StdArchive: public IArchive
     {
     friend IArchive* CreateStdArchieve( const std::string& _path );
@@ -239,39 +566,224 @@ namespace Nix
         std::string _root;
         //
         virtual IFile* open( const std::string& _path, uint8_t _memoryMode = 0) override;
+        virtual IFile* open( PathId _path, uint8_t _memoryMode = 0) override;
+        // `_path` is the full, normalized path
+        IFile* openNative( const std::string& _path, uint8_t _memoryMode );
 		virtual bool save(const std::string& _path, const void * _data, size_t _length) override;
 		virtual const char * root() {
 			return _root.c_str();
 		}
         //
+        virtual bool list(const std::string& _directory, std::vector<FileInfo>& files_, uint32_t _flags) override;
+        virtual bool fileInfo(const std::string& _path, FileInfo& info_) override;
+        virtual void prefetch(const std::vector<std::string>& _paths) override;
+        //
         virtual void release() override;
         //
     };
 
+	IFile* IArchive::open(PathId _path, uint8_t _memoryMode)
+	{
+		const std::string& path = SharedPathTable().path(_path);
+		if (path.empty()) {
+			return nullptr;
+		}
+		return open(path, _memoryMode);
+	}
+
+	bool IArchive::fileInfo(const std::string& _path, FileInfo& info_)
+	{
+		std::string path = FormatFilePath(_path);
+		size_t slash = path.find_last_of('/');
+		std::vector<FileInfo> files;
+		if (!list(slash == std::string::npos ? std::string() : path.substr(0, slash), files, 0)) {
+			return false;
+		}
+		for (auto& file : files) {
+			if (file.path == path) {
+				info_ = file;
+				info_.hash = 0;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// APHasher only suits short keys : its state collapses on long inputs
+	uint64_t HashFileContent(const void* _data, size_t _length)
+	{
+		return Hash64(_data, _length);
+	}
+
+#if !defined(__linux__)
+	// Asks the OS to read a mapped file in ahead of use, without waiting for it. Windows 8 and
+	// later take PrefetchVirtualMemory, older Windows gets the pages touched one by one instead.
+	static void PrefetchMapping(const void* _data, size_t _size)
+	{
+#ifdef _WIN32
+		struct range_entry_t {
+			PVOID address;
+			SIZE_T size;
+		};
+		typedef BOOL(WINAPI* PrefetchVirtualMemoryFn)(HANDLE, ULONG_PTR, range_entry_t*, ULONG);
+		static const PrefetchVirtualMemoryFn prefetchVirtualMemory = (PrefetchVirtualMemoryFn)GetProcAddress(GetModuleHandleA("kernel32.dll"), "PrefetchVirtualMemory");
+		range_entry_t range = { (PVOID)_data, _size };
+		if (prefetchVirtualMemory && prefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0)) {
+			return;
+		}
+		volatile uint8_t sink = 0;
+		for (size_t offset = 0; offset < _size; offset += 4096) {
+			sink += ((const uint8_t*)_data)[offset];
+		}
+#else
+		madvise((void*)_data, _size, MADV_WILLNEED);
+#endif
+	}
+#endif
+
+	bool StdArchive::list(const std::string& _directory, std::vector<FileInfo>& files_, uint32_t _flags)
+	{
+		std::vector<DirectoryEntry> entries;
+		if (!ListDirectory(_root, FormatFilePath(_directory), (_flags & ListRecursive) != 0, entries)) {
+			return false;
+		}
+		size_t first = files_.size();
+		files_.resize(first + entries.size());
+		for (size_t i = 0; i < entries.size(); ++i) {
+			FileInfo& info = files_[first + i];
+			info.path = std::move(entries[i].path);
+			info.size = entries[i].size;
+			info.modifiedTime = entries[i].modifiedTime;
+			info.hash = 0;
+		}
+		if (_flags & ListContentHash) {
+			ParallelFor(entries.size(), [&](size_t _index) {
+				FileInfo& info = files_[first + _index];
+				IBlob* blob = MapFileToMemory(_root + info.path);
+				if (blob) {
+					info.hash = HashFileContent(blob->data(), blob->size());
+					blob->release();
+				}
+			}, MaxArchiveWorkers - 1);
+		}
+		return true;
+	}
+
+	bool StdArchive::fileInfo(const std::string& _path, FileInfo& info_)
+	{
+		DirectoryEntry entry;
+		if (!StatFile(FormatFilePath(_root + _path), entry)) {
+			return false;
+		}
+		info_.path = FormatFilePath(_path);
+		info_.size = entry.size;
+		info_.modifiedTime = entry.modifiedTime;
+		info_.hash = 0;
+		return true;
+	}
+
+	void StdArchive::prefetch(const std::vector<std::string>& _paths)
+	{
+		ParallelFor(_paths.size(), [&](size_t _index) {
+			std::string path = FormatFilePath(_root + _paths[_index]);
+#if defined(__linux__)
+			// only queues the readahead, the kernel reads in the background
+			int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd >= 0) {
+				posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+				::close(fd);
+			}
+#else
+			// the hint goes through a mapping, the pages it reads stay in the OS cache once unmapped
+			IBlob* blob = MapFileToMemory(path);
+			if (blob) {
+				PrefetchMapping(blob->data(), blob->size());
+				blob->release();
+			}
+#endif
+		}, MaxArchiveWorkers - 1);
+	}
+
 	IFile* StdArchive::open(const std::string& _path, uint8_t _memoryMode)
 	{
-		std::string fullpath = _root;
-		fullpath.append(_path);
-		auto path = FormatFilePath(fullpath);
-		auto fh = fopen(path.c_str(), "rb+");
-		if (!fh) {
+		std::string path = _root;
+		path.append(_path);
+		path.resize(NormalizePath(&path[0], path.length()));
+		return openNative(path, _memoryMode);
+	}
+
+	IFile* StdArchive::open(PathId _path, uint8_t _memoryMode)
+	{
+		// the root and the interned path are both normalized already
+		const std::string& relative = SharedPathTable().path(_path);
+		if (relative.empty()) {
+			return nullptr;
+		}
+		std::string path;
+		path.reserve(_root.length() + relative.length());
+		path.append(_root);
+		path.append(relative);
+		return openNative(path, _memoryMode);
+	}
+
+	IFile* StdArchive::openNative(const std::string& path, uint8_t _memoryMode)
+	{
+		if (_memoryMode == MemoryModeMapped) {
+			IBlob* blob = MapFileToMemory(path);
+			if (!blob) {
+				return nullptr;
+			}
+			IFile* file = CreateBlobView(blob, 0, blob->size());
+			blob->release();
+			return file;
+		}
+#ifdef _WIN32
+		HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (handle == INVALID_HANDLE_VALUE) {
+			// read-only files still open for reading
+			handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		}
+		LARGE_INTEGER fileSize;
+		if (handle == INVALID_HANDLE_VALUE) {
+			return nullptr;
+		}
+		if (!GetFileSizeEx(handle, &fileSize)) {
+			CloseHandle(handle);
+			return nullptr;
+		}
+		uint64_t size = (uint64_t)fileSize.QuadPart;
+#else
+		int handle = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+		if (handle < 0) {
+			// read-only files still open for reading
+			handle = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		}
+		struct stat st;
+		if (handle < 0) {
 			return nullptr;
-		}			
-		fseek(fh, 0, SEEK_SET);
-		size_t set = ftell(fh);
-		fseek(fh, 0, SEEK_END);
-		size_t size = ftell(fh) - set;
-		fseek(fh, 0, SEEK_SET);
+		}
+		if (fstat(handle, &st) != 0 || !S_ISREG(st.st_mode)) {
+			::close(handle);
+			return nullptr;
+		}
+		uint64_t size = (uint64_t)st.st_size;
+#endif
 		if (!_memoryMode) {
 			StdFile* file = new StdFile();
 			file->_size = size;
-			file->_handle = fh;
+			file->_handle = handle;
 			return file;
 		} else {
-			void* mem = malloc(size);
-			fread(mem, 1, size, fh);
-			IFile* file = CreateMemoryBuffer(mem, size);
-			fclose(fh);
+			void* mem = malloc((size_t)size ? (size_t)size : 1);
+			size_t readReal = ReadAt(handle, mem, (size_t)size, 0);
+			CloseNativeFile(handle);
+			if (readReal != size) {
+				free(mem);
+				return nullptr;
+			}
+			IFile* file = CreateMemoryBuffer(mem, (size_t)size, [](void* _ptr) {
+				free(_ptr);
+			});
 			return file;
 		}
 		return nullptr;
@@ -281,13 +793,8 @@ namespace Nix
 		std::string fullpath = _root;
 		fullpath.append(_path);
 		auto path = FormatFilePath(fullpath);
-		auto fh = fopen(path.c_str(), "wb");
-		if (!fh) {
-			return false;
-		}
-		fwrite(_data, 1, _length, fh);
-		fclose(fh);
-		return true;
+		// written aside and renamed, a crash never leaves a truncated file behind
+		return SaveFileAtomic(path, _data, _length);
 	}
 
     void StdArchive::release()
@@ -324,6 +831,97 @@ namespace Nix
 		return buffer;
 	}
 
+	// copy_file_range between the descriptors, at both files' own cursors
+	static size_t TransferStdFile(StdFile* _dst, StdFile* _src, size_t _bytes)
+	{
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 27)
+		loff_t inOffset = (loff_t)_src->_position;
+		loff_t outOffset = (loff_t)_dst->_position;
+		size_t bytes = ClipRange(_src->_position, _bytes, _src->_size);
+		size_t done = 0;
+		while (done < bytes) {
+			ssize_t copied = copy_file_range(_src->_handle, &inOffset, _dst->_handle, &outOffset, bytes - done, 0);
+			if (copied <= 0) {
+				// EOF, or the kernel / file system can't do it : the caller falls back to buffers
+				break;
+			}
+			done += (size_t)copied;
+		}
+		_dst->dropBuffer(_dst->_position, done);
+		_src->_position = (uint64_t)inOffset;
+		_dst->_position = (uint64_t)outOffset;
+		if (_dst->_position > _dst->_size) {
+			_dst->_size = _dst->_position;
+		}
+		return done;
+#else
+		(void)_dst; (void)_src; (void)_bytes;
+		return 0;
+#endif
+	}
+
+	size_t TransferFile(IFile* _dst, IFile* _src, size_t _bytes)
+	{
+		if (!_dst || !_src || !_bytes) {
+			return 0;
+		}
+		// memory backed source : one write straight out of its memory
+		if (const char* data = (const char*)_src->constData()) {
+			uint64_t position = _src->tell();
+			size_t left = ClipRange(position, _bytes, _src->size());
+			size_t bytes = _bytes > left ? left : _bytes;
+			size_t written = _dst->write(bytes, data + position);
+			_src->seek(SeekCur, (int64_t)written);
+			return written;
+		}
+		// memory backed destination : one read straight into its memory
+		if (_dst->writable()) {
+			if (char* data = (char*)_dst->constData()) {
+				uint64_t position = _dst->tell();
+				size_t left = ClipRange(position, _bytes, _dst->size());
+				size_t bytes = _bytes > left ? left : _bytes;
+				size_t read = _src->read(bytes, data + position);
+				_dst->seek(SeekCur, (int64_t)read);
+				return read;
+			}
+		}
+		size_t done = 0;
+		StdFile* stdDst = dynamic_cast<StdFile*>(_dst);
+		StdFile* stdSrc = dynamic_cast<StdFile*>(_src);
+		if (stdDst && stdSrc) {
+			done = TransferStdFile(stdDst, stdSrc, _bytes);
+		}
+		if (done == _bytes) {
+			return done;
+		}
+		size_t chunkSize = _bytes - done < TransferChunkSize ? _bytes - done : TransferChunkSize;
+		std::unique_ptr<char[]> chunk(new char[chunkSize]);
+		while (done < _bytes) {
+			size_t round = _bytes - done < chunkSize ? _bytes - done : chunkSize;
+			size_t read = _src->read(round, chunk.get());
+			size_t written = _dst->write(read, chunk.get());
+			done += written;
+			if (read != round || written != read) {
+				break;
+			}
+		}
+		return done;
+	}
+
+	IFile* CreateBlobView(IBlob* _blob, size_t _offset, size_t _length)
+	{
+		if (!_blob || _offset > _blob->size() || _length > _blob->size() - _offset) {
+			return nullptr;
+		}
+		BlobFile* file = new BlobFile();
+		_blob->retain();
+		file->_blob = _blob;
+		file->_raw = (const char*)_blob->data() + _offset;
+		file->_size = _length;
+		file->_position = 0;
+		return file;
+	}
+
     bool TextReader::openFile( Nix::IArchive* _arch, const std::string& _filepath)
     {
         if (_textMemory)
@@ -13,6 +13,8 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string>
+#include <vector>
+#include "../String/Path.h"
 
 namespace Nix
 {
@@ -23,20 +25,42 @@ namespace Nix
       SeekSet  
     };
 
+    // `memoryMode` of IArchive::open
+    enum MemoryMode
+    {
+      MemoryModeStream = 0, // read through the file handle
+      MemoryModeCopy,       // whole file read into a memory buffer
+      MemoryModeMapped      // read-only view of a file mapping, pages are loaded on first touch
+    };
+
+    // one region of a vectored read
+    struct IoRange
+    {
+        uint64_t offset;    // absolute offset in the file
+        size_t size;
+        void *buffer;       // receives `size` bytes
+        size_t bytesRead;   // set by `readv`, less than `size` past the end of the file
+    };
+
     struct IFile
     {   
         /* data */
         typedef void (*MemoryFreeCB)(void *);
         virtual size_t read(size_t bytes, IFile *out) = 0;
         virtual size_t read(size_t bytes, void *out) = 0;
+        // Reads every range at its absolute offset, returns the total bytes read.
+        // Does not use nor move the `seek` cursor, so several threads may `readv` the same file
+        // at once for files that override it (StdFile, memory files). The default goes through
+        // seek + read and restores the cursor, it is not thread safe.
+        virtual size_t readv(IoRange *ranges, size_t count);
         virtual bool readable() = 0;
         
         virtual size_t write(size_t bytes, IFile *out) = 0;
         virtual size_t write(size_t bytes, const void *out) = 0;
         virtual bool writable() =0 ;
         
-        virtual size_t tell() = 0;
-        virtual bool seek(SeekFlag flag, long offset) = 0;
+        virtual uint64_t tell() = 0;
+        virtual bool seek(SeekFlag flag, int64_t offset) = 0;
         virtual bool seekable() = 0;
 
         virtual const void *constData() const { return nullptr; }
@@ -47,15 +71,53 @@ namespace Nix
 
     };
 
+    // reference counted, read-only memory shared by several IFile views
+    struct IBlob
+    {
+        virtual const void *data() const = 0;
+        virtual size_t size() const = 0;
+        virtual void retain() = 0;
+        virtual void release() = 0;
+
+        virtual ~IBlob() {}
+    };
+
+    // `flags` of IArchive::list
+    enum ListFlag
+    {
+      ListRecursive = 0x1,      // walk sub directories
+      ListContentHash = 0x2     // fill FileInfo::hash, this reads every listed file
+    };
+
+    struct FileInfo
+    {
+        std::string path;       // relative to the archive root, '/' separated
+        uint64_t size;
+        uint64_t modifiedTime;  // seconds since 1970-01-01 UTC, 0 when the archive has none, a pak's own for its entries
+        uint64_t hash;          // HashFileContent of the content with ListContentHash, 0 otherwise
+    };
+
     class IArchive
     {
       public:
         //OPEN
         virtual IFile *open(const std::string &path, uint8_t memoryMode = 0) = 0;
+        // opens a path interned in SharedPathTable(), archives override it to skip normalizing
+        // and hashing the path again. The default opens the interned string.
+        virtual IFile *open(PathId path, uint8_t memoryMode = 0);
         //SAVE
         virtual bool save(const std::string &path, const void *data, size_t length) = 0;
         virtual const char *root() = 0;
-        //TODO: LIST
+        //LIST
+        // appends the files under `directory` ("" for the root) to `files_`
+        virtual bool list(const std::string & /*directory*/, std::vector<FileInfo> & /*files_*/, uint32_t /*flags*/ = ListRecursive) { return false; }
+        // size and modified time of one file, `info_.hash` is 0. The default lists the file's
+        // directory and looks the file up.
+        virtual bool fileInfo(const std::string &path, FileInfo &info_);
+        // Hints that the files will be opened soon so that the OS reads them into its cache.
+        // Files are handled in parallel, where the OS has a readahead hint the call returns as
+        // soon as it is issued.
+        virtual void prefetch(const std::vector<std::string> & /*paths*/) {}
         //TODO: Delete
         //TODO: Create
         //TODO: Destory
@@ -70,6 +132,19 @@ namespace Nix
         free(ptr);
     });
 
+    // 64 bit hash of file content used by listings and caches
+    uint64_t HashFileContent(const void *data, size_t length);
+
+    // Moves `bytes` from the current position of `src` to the current position of `dst` and
+    // advances both, returns the bytes moved. Copies straight from/into memory backed files,
+    // uses copy_file_range between two std files where available, large chunks otherwise.
+    size_t TransferFile(IFile *dst, IFile *src, size_t bytes);
+
+    // maps a whole file read-only, returns nullptr when the file can't be opened
+    IBlob *MapFileToMemory(const std::string &path);
+    // read-only file over [offset, offset + length) of the blob, constData() points into the blob
+    IFile *CreateBlobView(IBlob *blob, size_t offset, size_t length);
+
     class TextReader
     {
         private:
@@ -0,0 +1,177 @@
+#include "AsyncReader.h"
+
+namespace Nix
+{
+    bool AsyncReader::initialize(IArchive *archive, uint32_t threadCount)
+    {
+        if (!archive || !threadCount || !_threads.empty())
+            return false;
+        _archive = archive;
+        _quit = false;
+        for (uint32_t i = 0; i < threadCount; ++i)
+            _threads.emplace_back(&AsyncReader::worker, this);
+        return true;
+    }
+
+    void AsyncReader::shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_requestMutex);
+            _quit = true;
+        }
+        _requestCondition.notify_all();
+        for (auto &thread : _threads)
+            thread.join();
+        _threads.clear();
+        //
+        for (auto &pending : _pending)
+        {
+            if (pending.second)
+                pending.second->set_value(nullptr);
+        }
+        _pending.clear();
+        _requests = std::priority_queue<request_t>();
+        std::lock_guard<std::mutex> lock(_completionMutex);
+        for (auto &completion : _completions)
+        {
+            if (completion.file)
+                completion.file->release();
+        }
+        _completions.clear();
+    }
+
+    uint64_t AsyncReader::readAsync(const std::string &_path, size_t _offset, size_t _length, AsyncReadCB _callback, AsyncPriority _priority)
+    {
+        request_t request;
+        request.priority = (uint8_t)_priority;
+        request.path = _path;
+        request.offset = _offset;
+        request.length = _length;
+        request.callback = std::move(_callback);
+        return enqueue(std::move(request));
+    }
+
+    std::future<IFile *> AsyncReader::readAsync(const std::string &_path, size_t _offset, size_t _length, AsyncPriority _priority)
+    {
+        uint64_t requestId;
+        return readAsync(_path, _offset, _length, requestId, _priority);
+    }
+
+    std::future<IFile *> AsyncReader::readAsync(const std::string &_path, size_t _offset, size_t _length, uint64_t &requestId_, AsyncPriority _priority)
+    {
+        request_t request;
+        request.priority = (uint8_t)_priority;
+        request.path = _path;
+        request.offset = _offset;
+        request.length = _length;
+        request.promise = std::make_shared<std::promise<IFile *>>();
+        std::future<IFile *> future = request.promise->get_future();
+        requestId_ = enqueue(std::move(request));
+        return future;
+    }
+
+    bool AsyncReader::cancel(uint64_t _requestId)
+    {
+        std::lock_guard<std::mutex> lock(_requestMutex);
+        auto it = _pending.find(_requestId);
+        if (it == _pending.end())
+            return false;
+        // the request stays in the queue until a worker pops it, its future must not wait for that
+        if (it->second)
+            it->second->set_value(nullptr);
+        _pending.erase(it);
+        return true;
+    }
+
+    size_t AsyncReader::poll(size_t _maxCompletions)
+    {
+        size_t count = 0;
+        while (count < _maxCompletions)
+        {
+            completion_t completion;
+            {
+                std::lock_guard<std::mutex> lock(_completionMutex);
+                if (_completions.empty())
+                    break;
+                completion = std::move(_completions.front());
+                _completions.pop_front();
+            }
+            if (completion.callback)
+                completion.callback(completion.id, completion.file);
+            else if (completion.file)
+                completion.file->release();
+            ++count;
+        }
+        return count;
+    }
+
+    uint64_t AsyncReader::enqueue(request_t &&_request)
+    {
+        uint64_t id;
+        {
+            std::lock_guard<std::mutex> lock(_requestMutex);
+            id = _nextId++;
+            _request.id = id;
+            _pending.emplace(id, _request.promise);
+            _requests.push(std::move(_request));
+        }
+        _requestCondition.notify_one();
+        return id;
+    }
+
+    void AsyncReader::worker()
+    {
+        for (;;)
+        {
+            request_t request;
+            {
+                std::unique_lock<std::mutex> lock(_requestMutex);
+                _requestCondition.wait(lock, [this]() { return _quit || !_requests.empty(); });
+                if (_quit)
+                    return;
+                request = _requests.top();
+                _requests.pop();
+                // cancelled while waiting in the queue, `cancel` has resolved the future
+                if (!_pending.erase(request.id))
+                    continue;
+            }
+            IFile *file = execute(request);
+            if (request.promise)
+            {
+                request.promise->set_value(file);
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(_completionMutex);
+            _completions.push_back({request.id, file, std::move(request.callback)});
+        }
+    }
+
+    IFile *AsyncReader::execute(const request_t &_request)
+    {
+        IFile *source = _archive->open(_request.path, MemoryModeStream);
+        if (!source)
+            return nullptr;
+        size_t size = source->size();
+        if (_request.offset > size)
+        {
+            source->release();
+            return nullptr;
+        }
+        size_t length = _request.length ? _request.length : size - _request.offset;
+        if (length > size - _request.offset)
+            length = size - _request.offset;
+        IFile *memory = CreateMemoryBuffer(length);
+        if (_request.offset)
+            source->seek(SeekSet, (int64_t)_request.offset);
+        // MemFile reads the source straight into its own buffer
+        size_t bytesRead = length ? memory->write(length, source) : 0;
+        memory->seek(SeekSet, 0);
+        source->release();
+        if (bytesRead != length)
+        {
+            memory->release();
+            return nullptr;
+        }
+        return memory;
+    }
+} // namespace Nix
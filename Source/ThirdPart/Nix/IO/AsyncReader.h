@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Archive.h"
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <queue>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+
+namespace Nix
+{
+    enum AsyncPriority
+    {
+        AsyncPriorityLow = 0,
+        AsyncPriorityNormal,
+        AsyncPriorityHigh
+    };
+
+    // `file` holds the bytes that were read (nullptr on failure), the callback owns it and must release it
+    typedef std::function<void(uint64_t requestId, IFile *file)> AsyncReadCB;
+
+    // Reads ranges of archive files on a small pool of I/O threads.
+    // Callbacks are not called on the I/O threads : finished requests wait in a completion
+    // queue until `poll` is called, typically once per frame from the thread that ticks the app.
+    // The archive must be safe to `open` from several threads, StdArchive is.
+    class AsyncReader
+    {
+    private:
+        struct request_t
+        {
+            uint64_t id;
+            uint8_t priority;
+            std::string path;
+            size_t offset;
+            size_t length;
+            AsyncReadCB callback;
+            std::shared_ptr<std::promise<IFile *>> promise;
+
+            bool operator<(const request_t &other) const
+            {
+                // higher priority first, then first come first served
+                if (priority != other.priority)
+                    return priority < other.priority;
+                return id > other.id;
+            }
+        };
+        struct completion_t
+        {
+            uint64_t id;
+            IFile *file;
+            AsyncReadCB callback;
+        };
+
+        IArchive *_archive = nullptr;
+        std::vector<std::thread> _threads;
+        std::mutex _requestMutex;
+        std::condition_variable _requestCondition;
+        std::priority_queue<request_t> _requests;
+        // queued requests that were not cancelled, with the promise of the future flavour
+        std::unordered_map<uint64_t, std::shared_ptr<std::promise<IFile *>>> _pending;
+        uint64_t _nextId = 1;
+        bool _quit = false;
+        //
+        std::mutex _completionMutex;
+        std::deque<completion_t> _completions;
+
+    public:
+        AsyncReader() {}
+        AsyncReader(const AsyncReader &) = delete;
+        AsyncReader &operator=(const AsyncReader &) = delete;
+        ~AsyncReader() { shutdown(); }
+
+        bool initialize(IArchive *archive, uint32_t threadCount = 2);
+        // stops the I/O threads, pending requests are dropped and finished ones are released
+        void shutdown();
+
+        // `length` 0 reads to the end of the file, returns the request id
+        uint64_t readAsync(const std::string &path, size_t offset, size_t length, AsyncReadCB callback, AsyncPriority priority = AsyncPriorityNormal);
+        // future flavour, it is fulfilled on the I/O thread and does not go through `poll`
+        std::future<IFile *> readAsync(const std::string &path, size_t offset, size_t length, AsyncPriority priority = AsyncPriorityNormal);
+        // same, `requestId_` receives the id to pass to `cancel`
+        std::future<IFile *> readAsync(const std::string &path, size_t offset, size_t length, uint64_t &requestId_, AsyncPriority priority = AsyncPriorityNormal);
+        // drops a request that has not been started yet, its future resolves to nullptr right away
+        bool cancel(uint64_t requestId);
+        // calls the callbacks of at most `maxCompletions` finished requests, returns how many ran
+        size_t poll(size_t maxCompletions = (size_t)-1);
+
+    private:
+        uint64_t enqueue(request_t &&request);
+        void worker();
+        IFile *execute(const request_t &request);
+    };
+} // namespace Nix
@@ -0,0 +1,387 @@
+#include "CachedArchive.h"
+#include "../String/Path.h"
+#include <atomic>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace Nix
+{
+    static const char* CacheIndexName = "index.txt";
+
+    // blob owning a malloc'ed buffer
+    class HeapBlob: public IBlob
+    {
+    private:
+        void* _data;
+        size_t _size;
+        std::atomic<uint32_t> _refCount;
+
+        ~HeapBlob()
+        {
+            free( _data );
+        }
+    public:
+        HeapBlob( size_t _length )
+        : _data( malloc( _length ? _length : 1 ) )
+        , _size( _length )
+        , _refCount( 1 )
+        {
+        }
+
+        void* mutableData()
+        {
+            return _data;
+        }
+
+        virtual const void* data() const override
+        {
+            return _data;
+        }
+
+        virtual size_t size() const override
+        {
+            return _size;
+        }
+
+        virtual void retain() override
+        {
+            _refCount.fetch_add( 1, std::memory_order_relaxed );
+        }
+
+        virtual void release() override
+        {
+            if( _refCount.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+                delete this;
+        }
+    };
+
+    static std::string CacheBlobName( uint64_t _hash )
+    {
+        char name[32];
+        snprintf( name, sizeof(name), "%016llx.blob", (unsigned long long)_hash );
+        return name;
+    }
+
+    CachedArchive::~CachedArchive()
+    {
+        for( auto& blob : _blobs )
+            blob.second.blob->release();
+    }
+
+    IFile* CachedArchive::openResident( uint64_t _hash )
+    {
+        auto blobIter = _blobs.find( _hash );
+        if( blobIter == _blobs.end() )
+            return nullptr;
+        _lru.splice( _lru.begin(), _lru, blobIter->second.lru );
+        ++_stats.hits;
+        IBlob* blob = blobIter->second.blob;
+        return CreateBlobView( blob, 0, blob->size() );
+    }
+
+    IFile* CachedArchive::open( const std::string& _path, uint8_t )
+    {
+        std::string path = FormatFilePath( _path );
+        path_entry_t known = {};
+        bool knownPath = false;
+        bool indexed = false;       // known from the disk index, not checked yet
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            auto pathIter = _paths.find( path );
+            if( pathIter != _paths.end() )
+            {
+                known = pathIter->second;
+                knownPath = known.verified;
+                indexed = !known.verified;
+                if( knownPath )
+                {
+                    if( IFile* view = openResident( known.hash ) )
+                        return view;
+                }
+            }
+        }
+        // a path from an earlier run is checked against the wrapped archive once
+        FileInfo info;
+        bool described = false;
+        if( indexed )
+        {
+            described = _source->fileInfo( _path, info );
+            bool current = described && info.size == known.size && info.modifiedTime == known.modifiedTime;
+            std::lock_guard<std::mutex> lock( _mutex );
+            auto pathIter = _paths.find( path );
+            if( pathIter != _paths.end() && !pathIter->second.verified )
+            {
+                if( current )
+                    pathIter->second.verified = true;
+                else
+                    _paths.erase( pathIter );
+            }
+            if( current )
+            {
+                knownPath = true;
+                if( IFile* view = openResident( known.hash ) )
+                    return view;
+            }
+        }
+        // loading happens outside of the lock, two threads racing on the same file both load
+        // it and `insert` keeps the first one
+        IBlob* blob = nullptr;
+        if( knownPath && !_diskDirectory.empty() )
+        {
+            blob = loadFromDisk( known.hash );
+            if( blob )
+            {
+                std::lock_guard<std::mutex> lock( _mutex );
+                ++_stats.diskHits;
+            }
+        }
+        if( !blob )
+        {
+            // described before reading : a change in between shows as a mismatch next run
+            if( !described )
+                described = _source->fileInfo( _path, info );
+            IFile* file = _source->open( _path );
+            if( !file )
+                return nullptr;
+            HeapBlob* heapBlob = new HeapBlob( file->size() );
+            size_t bytes = file->read( file->size(), heapBlob->mutableData() );
+            bool complete = bytes == file->size();
+            file->release();
+            if( !complete )
+            {
+                heapBlob->release();
+                return nullptr;
+            }
+            blob = heapBlob;
+            known.hash = HashFileContent( blob->data(), blob->size() );
+            known.size = described ? info.size : 0;
+            known.modifiedTime = described ? info.modifiedTime : 0;
+            if( !_diskDirectory.empty() )
+                storeToDisk( path, described ? &info : nullptr, known.hash, blob );
+            std::lock_guard<std::mutex> lock( _mutex );
+            ++_stats.misses;
+        }
+        known.verified = true;
+        IBlob* cached = insert( path, known, blob );
+        IFile* view = CreateBlobView( cached, 0, cached->size() );
+        cached->release();
+        return view;
+    }
+
+    bool CachedArchive::save( const std::string& _path, const void* _data, size_t _length )
+    {
+        invalidate( _path );
+        return _source->save( _path, _data, _length );
+    }
+
+    bool CachedArchive::list( const std::string& _directory, std::vector<FileInfo>& files_, uint32_t _flags )
+    {
+        return _source->list( _directory, files_, _flags );
+    }
+
+    bool CachedArchive::fileInfo( const std::string& _path, FileInfo& info_ )
+    {
+        return _source->fileInfo( _path, info_ );
+    }
+
+    void CachedArchive::prefetch( const std::vector<std::string>& _files )
+    {
+        std::vector<std::string> missing;
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            for( auto& path : _files )
+            {
+                auto pathIter = _paths.find( FormatFilePath( path ) );
+                if( pathIter == _paths.end() || _blobs.find( pathIter->second.hash ) == _blobs.end() )
+                    missing.push_back( path );
+            }
+        }
+        if( !missing.empty() )
+            _source->prefetch( missing );
+    }
+
+    void CachedArchive::release()
+    {
+        delete this;
+    }
+
+    void CachedArchive::invalidate( const std::string& _path )
+    {
+        std::string path = FormatFilePath( _path );
+        std::lock_guard<std::mutex> lock( _mutex );
+        // the blob may be shared with other paths, it simply ages out of the LRU
+        _paths.erase( path );
+        // the next run must not pick up the indexed copy either
+        if( !_diskDirectory.empty() )
+            appendToIndex( "- " + path );
+    }
+
+    void CachedArchive::clear()
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        for( auto& blob : _blobs )
+            blob.second.blob->release();
+        _blobs.clear();
+        _lru.clear();
+        _stats.residentBytes = 0;
+        _stats.blobCount = 0;
+    }
+
+    CachedArchiveStats CachedArchive::stats()
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        return _stats;
+    }
+
+    IBlob* CachedArchive::insert( const std::string& _path, const path_entry_t& _entry, IBlob* _blob )
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _paths[_path] = _entry;
+        auto blobIter = _blobs.find( _entry.hash );
+        if( blobIter != _blobs.end() )
+        {
+            // same content loaded through another path or by another thread
+            _blob->release();
+            _lru.splice( _lru.begin(), _lru, blobIter->second.lru );
+            blobIter->second.blob->retain();
+            return blobIter->second.blob;
+        }
+        _lru.push_front( _entry.hash );
+        blob_entry_t entry = { _blob, _lru.begin() };
+        _blobs[_entry.hash] = entry;
+        _stats.residentBytes += _blob->size();
+        ++_stats.blobCount;
+        _blob->retain();
+        trim();
+        return _blob;
+    }
+
+    void CachedArchive::trim()
+    {
+        while( _stats.residentBytes > _memoryBudget && !_lru.empty() )
+        {
+            auto blobIter = _blobs.find( _lru.back() );
+            _lru.pop_back();
+            _stats.residentBytes -= blobIter->second.blob->size();
+            --_stats.blobCount;
+            ++_stats.evictions;
+            blobIter->second.blob->release();
+            _blobs.erase( blobIter );
+        }
+    }
+
+    IBlob* CachedArchive::loadFromDisk( uint64_t _hash )
+    {
+        IBlob* blob = MapFileToMemory( _diskDirectory + CacheBlobName( _hash ) );
+        if( !blob )
+            return nullptr;
+        // a truncated or tampered cache file is dropped
+        if( HashFileContent( blob->data(), blob->size() ) != _hash )
+        {
+            blob->release();
+            return nullptr;
+        }
+        return blob;
+    }
+
+    void CachedArchive::storeToDisk( const std::string& _path, const FileInfo* _info, uint64_t _hash, const IBlob* _blob )
+    {
+        std::string blobPath = _diskDirectory + CacheBlobName( _hash );
+        FILE* existing = fopen( blobPath.c_str(), "rb" );
+        if( existing )
+        {
+            fclose( existing );
+        }
+        else
+        {
+            // written aside and renamed so that a crash never leaves a partial blob behind
+            std::string tempPath = blobPath + ".tmp";
+            FILE* fh = fopen( tempPath.c_str(), "wb" );
+            if( !fh )
+                return;
+            bool written = fwrite( _blob->data(), 1, _blob->size(), fh ) == _blob->size();
+            written = fclose( fh ) == 0 && written;
+            if( !written || rename( tempPath.c_str(), blobPath.c_str() ) != 0 )
+            {
+                remove( tempPath.c_str() );
+                return;
+            }
+        }
+        // a path whose source can't be checked later only leaves its blob behind
+        if( !_info )
+            return;
+        char fields[80];
+        snprintf( fields, sizeof(fields), "+ %016llx %llu %llu ", (unsigned long long)_hash,
+            (unsigned long long)_info->size, (unsigned long long)_info->modifiedTime );
+        std::lock_guard<std::mutex> lock( _mutex );
+        appendToIndex( fields + _path );
+    }
+
+    // Index lines, later ones override earlier ones when the index is loaded :
+    //   + <hash> <size> <modified time> <path>     content of `path`
+    //   - <path>                                   `path` was invalidated
+    void CachedArchive::appendToIndex( const std::string& _line )
+    {
+        std::string indexPath = _diskDirectory + CacheIndexName;
+        FILE* index = fopen( indexPath.c_str(), "ab" );
+        if( index )
+        {
+            fprintf( index, "%s\n", _line.c_str() );
+            fclose( index );
+        }
+    }
+
+    void CachedArchive::loadDiskIndex()
+    {
+        std::string indexPath = _diskDirectory + CacheIndexName;
+        FILE* index = fopen( indexPath.c_str(), "rb" );
+        if( !index )
+            return;
+        char line[1024];
+        while( fgets( line, sizeof(line), index ) )
+        {
+            size_t length = strlen( line );
+            while( length && ( line[length - 1] == '\n' || line[length - 1] == '\r' ) )
+                line[--length] = 0;
+            if( length > 2 && line[0] == '-' && line[1] == ' ' )
+            {
+                _paths.erase( line + 2 );
+                continue;
+            }
+            unsigned long long hash, size, modifiedTime;
+            int pathStart = 0;
+            if( sscanf( line, "+ %16llx %llu %llu %n", &hash, &size, &modifiedTime, &pathStart ) != 3 || !pathStart || !line[pathStart] )
+                continue;
+            // checked against the wrapped archive on first use
+            path_entry_t entry = { hash, size, modifiedTime, false };
+            _paths[line + pathStart] = entry;
+        }
+        fclose( index );
+    }
+
+    CachedArchive* CreateCachedArchive( IArchive* _source, size_t _memoryBudget, const std::string& _diskCacheDirectory )
+    {
+        if( !_source )
+            return nullptr;
+        CachedArchive* archive = new CachedArchive();
+        archive->_source = _source;
+        archive->_memoryBudget = _memoryBudget;
+        if( !_diskCacheDirectory.empty() )
+        {
+            archive->_diskDirectory = FormatFilePath( _diskCacheDirectory );
+#ifdef _WIN32
+            CreateDirectoryA( archive->_diskDirectory.c_str(), NULL );
+#else
+            mkdir( archive->_diskDirectory.c_str(), 0755 );
+#endif
+            archive->_diskDirectory.push_back( '/' );
+            archive->loadDiskIndex();
+        }
+        return archive;
+    }
+}
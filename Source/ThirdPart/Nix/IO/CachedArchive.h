@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Archive.h"
+#include <mutex>
+#include <list>
+#include <unordered_map>
+
+namespace Nix
+{
+    struct CachedArchiveStats
+    {
+        uint64_t hits;          // opens served from memory
+        uint64_t diskHits;      // opens served from the on-disk cache
+        uint64_t misses;        // opens that went to the wrapped archive
+        uint64_t evictions;
+        size_t residentBytes;
+        size_t blobCount;
+    };
+
+    // Content addressed cache in front of any archive.
+    // Files are loaded once, hashed and kept as shared read-only blobs in an LRU bounded by
+    // `memoryBudget` bytes. Paths map to content hashes, so identical files share one blob and
+    // a repeat open is a view of the cached blob that does not touch the file system.
+    // With a disk cache directory the loaded content is also written there under its hash,
+    // and the path index is kept across runs : a later run maps the cached copy instead of
+    // going to the wrapped archive, which pays off for decoded (e.g. compressed pak) content.
+    // The index records the size and modified time the wrapped archive reported, a path from
+    // an earlier run is used only while they still match. Within a run the cache does not
+    // watch the wrapped archive, `invalidate` drops a path that changed.
+    // Opens always return read-only views, whatever `memoryMode` asks for.
+    // The wrapped archive is not owned and must outlive the cache.
+    class CachedArchive: public IArchive
+    {
+        friend CachedArchive *CreateCachedArchive(IArchive *source, size_t memoryBudget, const std::string &diskCacheDirectory);
+    private:
+        struct blob_entry_t
+        {
+            IBlob *blob;
+            std::list<uint64_t>::iterator lru;
+        };
+        struct path_entry_t
+        {
+            uint64_t hash;
+            uint64_t size;          // as the wrapped archive reported it when the path was loaded
+            uint64_t modifiedTime;
+            bool verified;          // false for paths read from the disk index until checked
+        };
+
+        IArchive *_source = nullptr;
+        size_t _memoryBudget = 0;
+        std::string _diskDirectory;                     // empty without disk cache, '/' terminated otherwise
+        std::mutex _mutex;
+        std::unordered_map<std::string, path_entry_t> _paths; // normalized path -> content
+        std::unordered_map<uint64_t, blob_entry_t> _blobs;
+        std::list<uint64_t> _lru;                       // most recently used first
+        CachedArchiveStats _stats = {};
+
+        CachedArchive() {}
+        ~CachedArchive();
+
+    public:
+        using IArchive::open;
+        virtual IFile *open(const std::string &path, uint8_t memoryMode = 0) override;
+        // writes through to the wrapped archive and drops the cached content of `path`
+        virtual bool save(const std::string &path, const void *data, size_t length) override;
+        virtual const char *root() override { return _source->root(); }
+        virtual bool list(const std::string &directory, std::vector<FileInfo> &files_, uint32_t flags = ListRecursive) override;
+        virtual bool fileInfo(const std::string &path, FileInfo &info_) override;
+        // forwards the paths that are not resident to the wrapped archive
+        virtual void prefetch(const std::vector<std::string> &paths) override;
+        virtual void release() override;
+
+        // forgets `path`, in the disk index as well
+        void invalidate(const std::string &path);
+        // drops every blob held in memory, the disk cache is kept
+        void clear();
+        CachedArchiveStats stats();
+
+    private:
+        // with the lock held, a view of the resident blob of `hash` or nullptr
+        IFile *openResident(uint64_t hash);
+        IBlob *loadFromDisk(uint64_t hash);
+        // `info` is null when the wrapped archive can't describe the path, it is not indexed then
+        void storeToDisk(const std::string &path, const FileInfo *info, uint64_t hash, const IBlob *blob);
+        void appendToIndex(const std::string &line);
+        void loadDiskIndex();
+        // takes the lock, returns the blob the cache holds for `entry.hash` (retained) after inserting `blob`
+        IBlob *insert(const std::string &path, const path_entry_t &entry, IBlob *blob);
+        void trim();
+    };
+
+    // `memoryBudget` bounds the bytes of blobs kept alive by the cache itself, views handed out
+    // keep their blob alive past eviction
+    CachedArchive *CreateCachedArchive(IArchive *source, size_t memoryBudget, const std::string &diskCacheDirectory = std::string());
+} // namespace Nix
@@ -0,0 +1,558 @@
+#include "Compression.h"
+#include "WorkerPool.h"
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+namespace Nix
+{
+    static const size_t Lz4MinMatch = 4;
+    static const size_t Lz4LastLiterals = 5;    // the last 5 bytes are always literals
+    static const size_t Lz4MatchFindLimit = 12; // no match may start within the last 12 bytes
+    static const uint32_t Lz4HashLog = 12;
+
+    static inline uint32_t Read32( const uint8_t* _p )
+    {
+        uint32_t v;
+        memcpy( &v, _p, sizeof(v) );
+        return v;
+    }
+
+    static inline uint32_t Lz4Hash( uint32_t _sequence )
+    {
+        return ( _sequence * 2654435761U ) >> ( 32 - Lz4HashLog );
+    }
+
+    size_t Lz4CompressBound( size_t _size )
+    {
+        return _size + _size / 255 + 16;
+    }
+
+    static bool Lz4WriteLength( uint8_t*& op_, const uint8_t* _oend, size_t _length )
+    {
+        while( _length >= 255 )
+        {
+            if( op_ >= _oend )
+                return false;
+            *op_++ = 255;
+            _length -= 255;
+        }
+        if( op_ >= _oend )
+            return false;
+        *op_++ = (uint8_t)_length;
+        return true;
+    }
+
+    static bool Lz4WriteSequence( uint8_t*& op_, const uint8_t* _oend, const uint8_t* _literals, size_t _literalLength, size_t _offset, size_t _matchLength )
+    {
+        if( op_ >= _oend )
+            return false;
+        uint8_t* token = op_++;
+        *token = (uint8_t)( ( _literalLength >= 15 ? 15 : _literalLength ) << 4 );
+        if( _literalLength >= 15 && !Lz4WriteLength( op_, _oend, _literalLength - 15 ) )
+            return false;
+        if( (size_t)( _oend - op_ ) < _literalLength )
+            return false;
+        memcpy( op_, _literals, _literalLength );
+        op_ += _literalLength;
+        if( !_matchLength )
+            return true; // last sequence, literals only
+        if( _oend - op_ < 2 )
+            return false;
+        *op_++ = (uint8_t)( _offset & 0xff );
+        *op_++ = (uint8_t)( _offset >> 8 );
+        size_t code = _matchLength - Lz4MinMatch;
+        *token |= (uint8_t)( code >= 15 ? 15 : code );
+        if( code >= 15 && !Lz4WriteLength( op_, _oend, code - 15 ) )
+            return false;
+        return true;
+    }
+
+    size_t Lz4CompressBlock( const void* _src, size_t _srcSize, void* _dst, size_t _dstCapacity )
+    {
+        const uint8_t* src = (const uint8_t*)_src;
+        const uint8_t* ip = src;
+        const uint8_t* anchor = src;
+        const uint8_t* iend = src + _srcSize;
+        uint8_t* op = (uint8_t*)_dst;
+        const uint8_t* oend = op + _dstCapacity;
+        if( _srcSize > Lz4MatchFindLimit )
+        {
+            const uint8_t* mflimit = iend - Lz4MatchFindLimit;
+            const uint8_t* matchlimit = iend - Lz4LastLiterals;
+            uint32_t table[1 << Lz4HashLog];
+            memset( table, 0xff, sizeof(table) );
+            while( ip < mflimit )
+            {
+                uint32_t sequence = Read32( ip );
+                uint32_t hash = Lz4Hash( sequence );
+                uint32_t candidate = table[hash];
+                table[hash] = (uint32_t)( ip - src );
+                if( candidate == 0xffffffff || (size_t)( ip - src ) - candidate > 65535 || Read32( src + candidate ) != sequence )
+                {
+                    ++ip;
+                    continue;
+                }
+                const uint8_t* ref = src + candidate;
+                const uint8_t* matchEnd = ip + Lz4MinMatch;
+                const uint8_t* refEnd = ref + Lz4MinMatch;
+                while( matchEnd < matchlimit && *matchEnd == *refEnd )
+                {
+                    ++matchEnd;
+                    ++refEnd;
+                }
+                if( !Lz4WriteSequence( op, oend, anchor, ip - anchor, ip - ref, matchEnd - ip ) )
+                    return 0;
+                ip = anchor = matchEnd;
+            }
+        }
+        if( !Lz4WriteSequence( op, oend, anchor, iend - anchor, 0, 0 ) )
+            return 0;
+        return op - (uint8_t*)_dst;
+    }
+
+    bool Lz4DecompressBlock( const void* _src, size_t _srcSize, void* _dst, size_t _dstSize )
+    {
+        const uint8_t* ip = (const uint8_t*)_src;
+        const uint8_t* iend = ip + _srcSize;
+        uint8_t* dst = (uint8_t*)_dst;
+        uint8_t* op = dst;
+        uint8_t* oend = dst + _dstSize;
+        while( ip < iend )
+        {
+            uint8_t token = *ip++;
+            size_t literalLength = token >> 4;
+            if( literalLength == 15 )
+            {
+                uint8_t s;
+                do
+                {
+                    if( ip >= iend )
+                        return false;
+                    s = *ip++;
+                    literalLength += s;
+                }
+                while( s == 255 );
+            }
+            // short literal runs copy a fixed 16 bytes when both buffers have room for it, the
+            // bytes past the run are overwritten by what follows
+            if( literalLength <= 16 && iend - ip >= 16 && oend - op >= 16 )
+            {
+                memcpy( op, ip, 16 );
+            }
+            else
+            {
+                if( (size_t)( iend - ip ) < literalLength || (size_t)( oend - op ) < literalLength )
+                    return false;
+                memcpy( op, ip, literalLength );
+            }
+            ip += literalLength;
+            op += literalLength;
+            if( ip == iend )
+                break; // the last sequence has no match
+            if( iend - ip < 2 )
+                return false;
+            size_t offset = ip[0] | ( (size_t)ip[1] << 8 );
+            ip += 2;
+            if( !offset || offset > (size_t)( op - dst ) )
+                return false;
+            size_t matchLength = token & 0xf;
+            if( matchLength == 15 )
+            {
+                uint8_t s;
+                do
+                {
+                    if( ip >= iend )
+                        return false;
+                    s = *ip++;
+                    matchLength += s;
+                }
+                while( s == 255 );
+            }
+            matchLength += Lz4MinMatch;
+            if( (size_t)( oend - op ) < matchLength )
+                return false;
+            const uint8_t* match = op - offset;
+            if( offset >= 16 && (size_t)( oend - op ) >= matchLength + 16 )
+            {
+                // 16 byte chunks, each reads output written before it, the last one may run past
+                // the match into room the next sequence overwrites
+                for( size_t i = 0; i < matchLength; i += 16 )
+                    memcpy( op + i, match + i, 16 );
+            }
+            else if( offset >= matchLength )
+            {
+                memcpy( op, match, matchLength );
+            }
+            else if( offset >= 8 )
+            {
+                // the match overlaps its own output, but an 8 byte chunk never reads what it writes
+                size_t i = 0;
+                for( ; i + 8 <= matchLength; i += 8 )
+                    memcpy( op + i, match + i, 8 );
+                for( ; i < matchLength; ++i )
+                    op[i] = match[i];
+            }
+            else if( offset == 1 )
+            {
+                memset( op, match[0], matchLength );
+            }
+            else
+            {
+                // short repeating patterns, byte by byte
+                for( size_t i = 0; i < matchLength; ++i )
+                    op[i] = match[i];
+            }
+            op += matchLength;
+        }
+        return op == oend;
+    }
+
+    bool CompressBlocks( const void* _data, size_t _size, uint32_t _blockSize, std::vector<uint8_t>& compressed_ )
+    {
+        if( !_blockSize )
+            return false;
+        const uint8_t* data = (const uint8_t*)_data;
+        uint32_t blockCount = (uint32_t)( ( _size + _blockSize - 1 ) / _blockSize );
+        compressed_header_t header;
+        memset( &header, 0, sizeof(header) );
+        header.magic = CompressedMagic;
+        header.blockSize = _blockSize;
+        header.rawSize = _size;
+        header.blockCount = blockCount;
+        size_t tableSize = sizeof(uint64_t) * ( blockCount + 1 );
+        compressed_.resize( sizeof(header) + tableSize );
+        memcpy( compressed_.data(), &header, sizeof(header) );
+        std::vector<uint64_t> offsets( blockCount + 1, 0 );
+        std::vector<uint8_t> scratch( Lz4CompressBound( _blockSize ) );
+        for( uint32_t i = 0; i < blockCount; ++i )
+        {
+            size_t rawSize = std::min<size_t>( _blockSize, _size - (size_t)i * _blockSize );
+            const uint8_t* raw = data + (size_t)i * _blockSize;
+            size_t packed = Lz4CompressBlock( raw, rawSize, scratch.data(), scratch.size() );
+            if( packed && packed < rawSize )
+                compressed_.insert( compressed_.end(), scratch.begin(), scratch.begin() + packed );
+            else
+                compressed_.insert( compressed_.end(), raw, raw + rawSize ); // not worth it, store it
+            offsets[i + 1] = compressed_.size() - sizeof(header) - tableSize;
+        }
+        memcpy( compressed_.data() + sizeof(header), offsets.data(), tableSize );
+        return true;
+    }
+
+    struct container_t
+    {
+        compressed_header_t header;
+        const uint64_t* offsets;
+        uint64_t dataStart;     // offset of the first block from the container start
+    };
+
+    static bool ParseContainer( const void* _data, size_t _size, container_t& container_ )
+    {
+        if( _size < sizeof(compressed_header_t) )
+            return false;
+        memcpy( &container_.header, _data, sizeof(compressed_header_t) );
+        const compressed_header_t& header = container_.header;
+        if( header.magic != CompressedMagic || !header.blockSize )
+            return false;
+        // blockCount blocks hold rawSize : every block but the last is full and the last one is
+        // not empty. Both factors are 32 bit, the products can't overflow.
+        uint64_t capacity = (uint64_t)header.blockCount * header.blockSize;
+        if( header.rawSize > capacity || ( header.blockCount && header.rawSize <= capacity - header.blockSize ) )
+            return false;
+        if( header.rawSize > (uint64_t)SIZE_MAX )
+            return false;
+        uint64_t tableSize = sizeof(uint64_t) * ( (uint64_t)header.blockCount + 1 );
+        if( tableSize > _size - sizeof(compressed_header_t) )
+            return false;
+        container_.offsets = (const uint64_t*)( (const uint8_t*)_data + sizeof(compressed_header_t) );
+        container_.dataStart = sizeof(compressed_header_t) + tableSize;
+        return true;
+    }
+
+    static bool ValidateOffsets( const container_t& _container, uint64_t _size )
+    {
+        const uint64_t* offsets = _container.offsets;
+        if( offsets[0] != 0 || offsets[_container.header.blockCount] > _size - _container.dataStart )
+            return false;
+        for( uint32_t i = 0; i < _container.header.blockCount; ++i )
+        {
+            if( offsets[i + 1] < offsets[i] )
+                return false;
+        }
+        return true;
+    }
+
+    static size_t BlockRawSize( const compressed_header_t& _header, uint32_t _block )
+    {
+        uint64_t begin = (uint64_t)_block * _header.blockSize;
+        return (size_t)std::min<uint64_t>( _header.blockSize, _header.rawSize - begin );
+    }
+
+    // `_blocks` holds the stored bytes of blocks [_first, _first + _count), starting at offsets[_first]
+    static bool DecodeBlocks( const compressed_header_t& _header, const uint64_t* _offsets, const uint8_t* _blocks, uint32_t _first, uint32_t _count, uint8_t* dst_ )
+    {
+        auto decode = [&]( uint32_t _block ) -> bool {
+            const uint8_t* stored = _blocks + ( _offsets[_block] - _offsets[_first] );
+            size_t storedSize = (size_t)( _offsets[_block + 1] - _offsets[_block] );
+            size_t rawSize = BlockRawSize( _header, _block );
+            uint8_t* dst = dst_ + (size_t)( _block - _first ) * _header.blockSize;
+            if( storedSize == rawSize )
+            {
+                memcpy( dst, stored, rawSize );
+                return true;
+            }
+            return Lz4DecompressBlock( stored, storedSize, dst, rawSize );
+        };
+        if( _count <= 1 )
+            return !_count || decode( _first );
+        std::atomic<bool> failed( false );
+        ParallelFor( _count, [&]( size_t _index ) {
+            if( !failed && !decode( _first + (uint32_t)_index ) )
+                failed = true;
+        });
+        return !failed;
+    }
+
+    bool IsCompressedContainer( const void* _data, size_t _size )
+    {
+        container_t container;
+        return ParseContainer( _data, _size, container );
+    }
+
+    IFile* DecompressToMemory( const void* _data, size_t _size )
+    {
+        container_t container;
+        if( !ParseContainer( _data, _size, container ) || !ValidateOffsets( container, _size ) )
+            return nullptr;
+        size_t rawSize = (size_t)container.header.rawSize;
+        void* raw = malloc( rawSize ? rawSize : 1 );
+        if( !raw )
+            return nullptr;
+        const uint8_t* blocks = (const uint8_t*)_data + container.dataStart;
+        if( !DecodeBlocks( container.header, container.offsets, blocks, 0, container.header.blockCount, (uint8_t*)raw ) )
+        {
+            free( raw );
+            return nullptr;
+        }
+        return CreateMemoryBuffer( raw, rawSize, []( void* _ptr ) {
+            free( _ptr );
+        });
+    }
+
+    class CompressedFile: public IFile
+    {
+        friend IFile* CreateCompressedFile( IFile* _compressed );
+    private:
+        IFile* _source = nullptr;
+        const uint8_t* _sourceData = nullptr;   // set when the source lives in memory
+        compressed_header_t _header;
+        std::vector<uint64_t> _offsets;
+        uint64_t _dataStart = 0;
+        size_t _position = 0;
+        //
+        std::vector<uint8_t> _block;            // last decoded block
+        uint32_t _cachedBlock = 0xffffffff;
+        std::vector<uint8_t> _scratch;          // stored bytes read from a streamed source
+
+        const uint8_t* loadStored( uint32_t _first, uint32_t _count )
+        {
+            uint64_t begin = _offsets[_first];
+            uint64_t end = _offsets[_first + _count];
+            if( _sourceData )
+                return _sourceData + _dataStart + begin;
+            _scratch.resize( (size_t)( end - begin ) );
+            if( !_source->seek( SeekSet, (int64_t)( _dataStart + begin ) ) )
+                return nullptr;
+            if( _source->read( _scratch.size(), _scratch.data() ) != _scratch.size() )
+                return nullptr;
+            return _scratch.data();
+        }
+
+        bool cacheBlock( uint32_t _index )
+        {
+            if( _cachedBlock == _index )
+                return true;
+            _cachedBlock = 0xffffffff;
+            const uint8_t* stored = loadStored( _index, 1 );
+            if( !stored )
+                return false;
+            _block.resize( _header.blockSize );
+            if( !DecodeBlocks( _header, _offsets.data(), stored, _index, 1, _block.data() ) )
+                return false;
+            _cachedBlock = _index;
+            return true;
+        }
+
+    public:
+        virtual bool readable() override
+        {
+            return true;
+        }
+
+        virtual bool writable() override
+        {
+            return false;
+        }
+
+        virtual bool seekable() override
+        {
+            return true;
+        }
+
+        virtual size_t read( size_t _bytes, IFile* out_ ) override
+        {
+            size_t total = std::min<size_t>( _bytes, size() - _position );
+            size_t done = 0;
+            while( done < total )
+            {
+                uint32_t index = (uint32_t)( _position / _header.blockSize );
+                size_t inBlock = _position % _header.blockSize;
+                if( !cacheBlock( index ) )
+                    break;
+                size_t chunk = std::min<size_t>( BlockRawSize( _header, index ) - inBlock, total - done );
+                size_t written = out_->write( chunk, _block.data() + inBlock );
+                _position += written;
+                done += written;
+                if( written != chunk )
+                    break;
+            }
+            return done;
+        }
+
+        virtual size_t read( size_t _bytes, void* out_ ) override
+        {
+            uint8_t* out = (uint8_t*)out_;
+            size_t total = std::min<size_t>( _bytes, size() - _position );
+            size_t done = 0;
+            while( done < total )
+            {
+                uint32_t index = (uint32_t)( _position / _header.blockSize );
+                size_t inBlock = _position % _header.blockSize;
+                // whole blocks covered by the request are decoded in parallel straight into `out_`
+                uint32_t wholeBlocks = 0;
+                if( !inBlock )
+                {
+                    while( index + wholeBlocks < _header.blockCount
+                        && (uint64_t)( wholeBlocks ) * _header.blockSize + BlockRawSize( _header, index + wholeBlocks ) <= total - done )
+                    {
+                        ++wholeBlocks;
+                    }
+                }
+                if( wholeBlocks >= 2 )
+                {
+                    const uint8_t* stored = loadStored( index, wholeBlocks );
+                    if( !stored || !DecodeBlocks( _header, _offsets.data(), stored, index, wholeBlocks, out + done ) )
+                        break;
+                    size_t bytes = (size_t)( (uint64_t)( wholeBlocks - 1 ) * _header.blockSize ) + BlockRawSize( _header, index + wholeBlocks - 1 );
+                    _position += bytes;
+                    done += bytes;
+                    continue;
+                }
+                if( !cacheBlock( index ) )
+                    break;
+                size_t chunk = std::min<size_t>( BlockRawSize( _header, index ) - inBlock, total - done );
+                memcpy( out + done, _block.data() + inBlock, chunk );
+                _position += chunk;
+                done += chunk;
+            }
+            return done;
+        }
+
+        virtual size_t write( size_t, IFile* ) override
+        {
+            return 0;
+        }
+
+        virtual size_t write( size_t, const void* ) override
+        {
+            return 0;
+        }
+
+        virtual uint64_t tell() override
+        {
+            return _position;
+        }
+
+        virtual bool seek( SeekFlag _flag, int64_t _offset ) override
+        {
+            int64_t position = (int64_t)_position;
+            switch( _flag )
+            {
+                case SeekFlag::SeekCur:
+                    position += _offset;
+                    break;
+                case SeekFlag::SeekEnd:
+                    position = (int64_t)size() + _offset;
+                    break;
+                case SeekFlag::SeekSet:
+                    position = _offset;
+            }
+            if( position < 0 )
+                position = 0;
+            else if( (uint64_t)position > size() )
+                position = (int64_t)size();
+            _position = (size_t)position;
+            return true;
+        }
+
+        virtual size_t size() override
+        {
+            return (size_t)_header.rawSize;
+        }
+
+        virtual void release() override
+        {
+            _source->release();
+            delete this;
+        }
+    };
+
+    IFile* CreateCompressedFile( IFile* _compressed )
+    {
+        if( !_compressed )
+            return nullptr;
+        size_t size = _compressed->size();
+        const uint8_t* data = (const uint8_t*)_compressed->constData();
+        container_t container;
+        std::vector<uint8_t> head;
+        if( !data )
+        {
+            // read header and block table from the stream
+            head.resize( std::min<size_t>( size, sizeof(compressed_header_t) ) );
+            _compressed->seek( SeekSet, 0 );
+            if( _compressed->read( head.size(), head.data() ) != head.size() || !ParseContainer( head.data(), size, container ) )
+            {
+                _compressed->release();
+                return nullptr;
+            }
+            head.resize( (size_t)container.dataStart );
+            size_t tableSize = head.size() - sizeof(compressed_header_t);
+            if( _compressed->read( tableSize, head.data() + sizeof(compressed_header_t) ) != tableSize )
+            {
+                _compressed->release();
+                return nullptr;
+            }
+            ParseContainer( head.data(), size, container );
+        }
+        else if( !ParseContainer( data, size, container ) )
+        {
+            _compressed->release();
+            return nullptr;
+        }
+        if( !ValidateOffsets( container, size ) )
+        {
+            _compressed->release();
+            return nullptr;
+        }
+        CompressedFile* file = new CompressedFile();
+        file->_source = _compressed;
+        file->_sourceData = data;
+        file->_header = container.header;
+        file->_offsets.assign( container.offsets, container.offsets + container.header.blockCount + 1 );
+        file->_dataStart = container.dataStart;
+        return file;
+    }
+} // namespace Nix
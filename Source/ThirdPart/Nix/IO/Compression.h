@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Archive.h"
+#include <vector>
+
+namespace Nix
+{
+    // Block compressed container, all values little endian :
+    //   compressed_header_t | uint64_t blockOffsets[blockCount + 1] | blocks
+    // Offsets are relative to the first block. Every block but the last holds `blockSize` raw
+    // bytes, a block whose stored size equals its raw size is kept uncompressed.
+    static const uint32_t CompressedMagic = 0x504D434E; // "NCMP"
+    static const uint32_t DefaultCompressedBlockSize = 64 * 1024;
+
+    struct compressed_header_t
+    {
+        uint32_t magic;
+        uint32_t blockSize;
+        uint64_t rawSize;
+        uint32_t blockCount;
+        uint32_t reserved;
+    };
+
+    // LZ4 block format codec, the output is readable by any LZ4 block decoder
+    size_t Lz4CompressBound(size_t size);
+    // returns the compressed size, 0 when `dst` is too small
+    size_t Lz4CompressBlock(const void *src, size_t srcSize, void *dst, size_t dstCapacity);
+    // returns false on malformed input or when the output does not fill exactly `dstSize` bytes
+    bool Lz4DecompressBlock(const void *src, size_t srcSize, void *dst, size_t dstSize);
+
+    // builds a container out of `size` bytes
+    bool CompressBlocks(const void *data, size_t size, uint32_t blockSize, std::vector<uint8_t> &compressed_);
+    bool IsCompressedContainer(const void *data, size_t size);
+    // Streams a container : `read` decompresses one block at a time and `seek` jumps through
+    // the block index. Reads that cover several whole blocks decode them in parallel straight
+    // into the destination. Takes ownership of `compressed`, which must be seekable.
+    IFile *CreateCompressedFile(IFile *compressed);
+    // decodes a whole container into a memory buffer, blocks are decoded in parallel
+    IFile *DecompressToMemory(const void *data, size_t size);
+} // namespace Nix
@@ -0,0 +1,103 @@
+#include "Directory.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace Nix
+{
+    static std::string JoinPath( const std::string& _a, const std::string& _b )
+    {
+        if( _a.empty() )
+            return _b;
+        if( _b.empty() )
+            return _a;
+        if( _a.back() == '/' || _a.back() == '\\' )
+            return _a + _b;
+        return _a + "/" + _b;
+    }
+
+    bool ListDirectory( const std::string& _root, const std::string& _directory, bool _recursive, std::vector<DirectoryEntry>& entries_ )
+    {
+        std::string fullpath = JoinPath( _root, _directory );
+#ifdef _WIN32
+        WIN32_FIND_DATAA data;
+        HANDLE find = FindFirstFileA( JoinPath( fullpath, "*" ).c_str(), &data );
+        if( find == INVALID_HANDLE_VALUE )
+            return false;
+        do
+        {
+            std::string name = data.cFileName;
+            if( name == "." || name == ".." )
+                continue;
+            std::string relative = JoinPath( _directory, name );
+            if( data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+            {
+                if( _recursive )
+                    ListDirectory( _root, relative, true, entries_ );
+                continue;
+            }
+            // FILETIME counts 100ns ticks since 1601-01-01
+            uint64_t ticks = ( (uint64_t)data.ftLastWriteTime.dwHighDateTime << 32 ) | data.ftLastWriteTime.dwLowDateTime;
+            DirectoryEntry entry;
+            entry.path = relative;
+            entry.size = ( (uint64_t)data.nFileSizeHigh << 32 ) | data.nFileSizeLow;
+            entry.modifiedTime = ticks / 10000000ULL - 11644473600ULL;
+            entries_.push_back( entry );
+        }
+        while( FindNextFileA( find, &data ) );
+        FindClose( find );
+#else
+        DIR* dir = opendir( fullpath.c_str() );
+        if( !dir )
+            return false;
+        while( struct dirent* item = readdir( dir ) )
+        {
+            std::string name = item->d_name;
+            if( name == "." || name == ".." )
+                continue;
+            std::string relative = JoinPath( _directory, name );
+            struct stat st;
+            if( stat( JoinPath( _root, relative ).c_str(), &st ) != 0 )
+                continue;
+            if( S_ISDIR( st.st_mode ) )
+            {
+                if( _recursive )
+                    ListDirectory( _root, relative, true, entries_ );
+                continue;
+            }
+            if( !S_ISREG( st.st_mode ) )
+                continue;
+            DirectoryEntry entry;
+            entry.path = relative;
+            entry.size = (uint64_t)st.st_size;
+            entry.modifiedTime = (uint64_t)st.st_mtime;
+            entries_.push_back( entry );
+        }
+        closedir( dir );
+#endif
+        return true;
+    }
+
+    bool StatFile( const std::string& _path, DirectoryEntry& entry_ )
+    {
+#ifdef _WIN32
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if( !GetFileAttributesExA( _path.c_str(), GetFileExInfoStandard, &data ) || ( data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) )
+            return false;
+        uint64_t ticks = ( (uint64_t)data.ftLastWriteTime.dwHighDateTime << 32 ) | data.ftLastWriteTime.dwLowDateTime;
+        entry_.size = ( (uint64_t)data.nFileSizeHigh << 32 ) | data.nFileSizeLow;
+        entry_.modifiedTime = ticks / 10000000ULL - 11644473600ULL;
+#else
+        struct stat st;
+        if( stat( _path.c_str(), &st ) != 0 || !S_ISREG( st.st_mode ) )
+            return false;
+        entry_.size = (uint64_t)st.st_size;
+        entry_.modifiedTime = (uint64_t)st.st_mtime;
+#endif
+        return true;
+    }
+} // namespace Nix
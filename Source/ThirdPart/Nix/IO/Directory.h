@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Nix
+{
+    struct DirectoryEntry
+    {
+        std::string path;       // relative to the listed root, '/' separated
+        uint64_t size;
+        uint64_t modifiedTime;  // seconds since 1970-01-01 UTC
+    };
+
+    // appends the regular files under `root`/`directory` to `entries_`, sub directories are
+    // walked when `recursive` is set
+    bool ListDirectory(const std::string &root, const std::string &directory, bool recursive, std::vector<DirectoryEntry> &entries_);
+    // size and modification time of the regular file at `path`, `entry_.path` is left untouched
+    bool StatFile(const std::string &path, DirectoryEntry &entry_);
+} // namespace Nix
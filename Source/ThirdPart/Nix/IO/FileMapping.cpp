@@ -0,0 +1,120 @@
+#include "Archive.h"
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Nix
+{
+    class FileMappingBlob: public IBlob
+    {
+        friend IBlob* MapFileToMemory( const std::string& _path );
+    private:
+        const void* _data = nullptr;
+        size_t _size = 0;
+        std::atomic<uint32_t> _refCount;
+#ifdef _WIN32
+        HANDLE _file = INVALID_HANDLE_VALUE;
+        HANDLE _mapping = NULL;
+#endif
+        FileMappingBlob()
+        : _refCount(1)
+        {
+        }
+
+        ~FileMappingBlob()
+        {
+#ifdef _WIN32
+            if( _data )
+                UnmapViewOfFile( _data );
+            if( _mapping )
+                CloseHandle( _mapping );
+            if( _file != INVALID_HANDLE_VALUE )
+                CloseHandle( _file );
+#else
+            if( _data )
+                munmap( (void*)_data, _size );
+#endif
+        }
+    public:
+        virtual const void* data() const override
+        {
+            return _data;
+        }
+
+        virtual size_t size() const override
+        {
+            return _size;
+        }
+
+        virtual void retain() override
+        {
+            _refCount.fetch_add( 1, std::memory_order_relaxed );
+        }
+
+        virtual void release() override
+        {
+            if( _refCount.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+                delete this;
+        }
+    };
+
+    IBlob* MapFileToMemory( const std::string& _path )
+    {
+        FileMappingBlob* blob = new FileMappingBlob();
+#ifdef _WIN32
+        blob->_file = CreateFileA( _path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+        LARGE_INTEGER size;
+        if( blob->_file == INVALID_HANDLE_VALUE || !GetFileSizeEx( blob->_file, &size ) )
+        {
+            blob->release();
+            return nullptr;
+        }
+        blob->_size = (size_t)size.QuadPart;
+        if( blob->_size )
+        {
+            // an empty file can't be mapped, it is served as an empty blob
+            blob->_mapping = CreateFileMappingA( blob->_file, NULL, PAGE_READONLY, 0, 0, NULL );
+            blob->_data = blob->_mapping ? MapViewOfFile( blob->_mapping, FILE_MAP_READ, 0, 0, 0 ) : nullptr;
+            if( !blob->_data )
+            {
+                blob->release();
+                return nullptr;
+            }
+        }
+#else
+        int fd = ::open( _path.c_str(), O_RDONLY );
+        struct stat st;
+        if( fd < 0 || fstat( fd, &st ) != 0 )
+        {
+            if( fd >= 0 )
+                ::close( fd );
+            blob->release();
+            return nullptr;
+        }
+        blob->_size = (size_t)st.st_size;
+        if( blob->_size )
+        {
+            void* ptr = mmap( nullptr, blob->_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if( ptr == MAP_FAILED )
+            {
+                ::close( fd );
+                blob->_size = 0;
+                blob->release();
+                return nullptr;
+            }
+            blob->_data = ptr;
+        }
+        // the mapping keeps the file alive
+        ::close( fd );
+#endif
+        return blob;
+    }
+
+}
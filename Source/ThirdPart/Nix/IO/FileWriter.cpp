@@ -0,0 +1,435 @@
+#include "FileWriter.h"
+#include "Compression.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#endif
+
+namespace Nix
+{
+    static const size_t WriterBufferSize = 1024 * 1024;
+    static const size_t WriterBufferAlignment = 4096;
+
+#ifdef _WIN32
+    typedef HANDLE WriterHandle;
+#else
+    typedef int WriterHandle;
+#endif
+
+    // writes all `_length` bytes at the file pointer, false on an error or a full disk
+    static bool WriteAll( WriterHandle _file, const uint8_t* _data, size_t _length )
+    {
+        while( _length )
+        {
+#ifdef _WIN32
+            DWORD bytes = 0;
+            DWORD chunk = _length > 0x40000000 ? 0x40000000 : (DWORD)_length;
+            if( !WriteFile( _file, _data, chunk, &bytes, NULL ) || !bytes )
+                return false;
+#else
+            ssize_t bytes = ::write( _file, _data, _length );
+            if( bytes <= 0 )
+                return false;
+#endif
+            _data += bytes;
+            _length -= (size_t)bytes;
+        }
+        return true;
+    }
+
+    bool FileWriter::open( const std::string& _path, uint32_t _flags )
+    {
+        abort();
+        _finalPath = _path;
+        _tempPath = _path + ".tmp";
+        _options = _flags;
+        _failed = false;
+        _buffered = 0;
+        _rawSize = 0;
+        _block.clear();
+        _blockOffsets.assign( 1, 0 );
+#ifdef _WIN32
+        HANDLE handle = CreateFileA( _tempPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+        if( handle == INVALID_HANDLE_VALUE )
+            return false;
+        _handle = handle;
+#else
+        _fd = ::open( _tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+        if( _fd < 0 )
+            return false;
+#endif
+        if( !_storage )
+        {
+            _storage.reset( new uint8_t[WriterBufferSize + WriterBufferAlignment] );
+            uintptr_t address = (uintptr_t)_storage.get();
+            _buffer = (uint8_t*)( ( address + WriterBufferAlignment - 1 ) & ~(uintptr_t)( WriterBufferAlignment - 1 ) );
+        }
+        if( _options & FileWriterCompress )
+        {
+            if( !openBlocks() )
+            {
+                abort();
+                return false;
+            }
+            _packed.resize( Lz4CompressBound( DefaultCompressedBlockSize ) );
+        }
+        return true;
+    }
+
+    bool FileWriter::openBlocks()
+    {
+        // the scratch file goes away by itself, whether the writer commits, aborts or the process dies
+        std::string path = _finalPath + ".blocks.tmp";
+#ifdef _WIN32
+        HANDLE handle = CreateFileA( path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL );
+        if( handle == INVALID_HANDLE_VALUE )
+            return false;
+        _blocksHandle = handle;
+#else
+        _blocksFd = ::open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600 );
+        if( _blocksFd < 0 )
+            return false;
+        unlink( path.c_str() );
+#endif
+        return true;
+    }
+
+    bool FileWriter::opened() const
+    {
+#ifdef _WIN32
+        return _handle != nullptr;
+#else
+        return _fd >= 0;
+#endif
+    }
+
+    bool FileWriter::write( const void* _data, size_t _length )
+    {
+        if( !opened() || _failed )
+            return false;
+        if( !( _options & FileWriterCompress ) )
+            return bufferBytes( _data, _length );
+        const uint8_t* data = (const uint8_t*)_data;
+        while( _length )
+        {
+            size_t room = DefaultCompressedBlockSize - _block.size();
+            size_t bytes = _length < room ? _length : room;
+            _block.insert( _block.end(), data, data + bytes );
+            data += bytes;
+            _length -= bytes;
+            _rawSize += bytes;
+            if( _block.size() == DefaultCompressedBlockSize )
+                appendBlock();
+        }
+        return !_failed;
+    }
+
+    bool FileWriter::patch( uint64_t _offset, const void* _data, size_t _length )
+    {
+        if( !opened() || _failed || ( _options & FileWriterCompress ) || !flushBuffer() )
+            return false;
+        const uint8_t* data = (const uint8_t*)_data;
+        while( _length )
+        {
+#ifdef _WIN32
+            OVERLAPPED overlapped;
+            memset( &overlapped, 0, sizeof(overlapped) );
+            overlapped.Offset = (DWORD)_offset;
+            overlapped.OffsetHigh = (DWORD)( _offset >> 32 );
+            DWORD bytes = 0;
+            if( !WriteFile( (HANDLE)_handle, data, (DWORD)_length, &bytes, &overlapped ) || !bytes )
+            {
+                _failed = true;
+                return false;
+            }
+#else
+            ssize_t bytes = ::pwrite( _fd, data, _length, (off_t)_offset );
+            if( bytes <= 0 )
+            {
+                _failed = true;
+                return false;
+            }
+#endif
+            data += bytes;
+            _offset += (uint64_t)bytes;
+            _length -= (size_t)bytes;
+        }
+#ifdef _WIN32
+        // a positioned write moves the file pointer, appends continue at the end
+        LARGE_INTEGER zero;
+        zero.QuadPart = 0;
+        if( !SetFilePointerEx( (HANDLE)_handle, zero, NULL, FILE_END ) )
+        {
+            _failed = true;
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    void FileWriter::appendBlock()
+    {
+        if( _block.empty() || _failed )
+            return;
+        const uint8_t* data = _packed.data();
+        size_t size = Lz4CompressBlock( _block.data(), _block.size(), _packed.data(), _packed.size() );
+        if( !size || size >= _block.size() )
+        {
+            // not worth it, stored as is
+            data = _block.data();
+            size = _block.size();
+        }
+#ifdef _WIN32
+        bool written = WriteAll( (HANDLE)_blocksHandle, data, size );
+#else
+        bool written = WriteAll( _blocksFd, data, size );
+#endif
+        _failed = _failed || !written;
+        _blockOffsets.push_back( _blockOffsets.back() + size );
+        _block.clear();
+    }
+
+    bool FileWriter::copyBlocks()
+    {
+        if( !flushBuffer() )
+            return false;
+        // read back through the write buffer, one buffer at a time
+#ifdef _WIN32
+        LARGE_INTEGER zero;
+        zero.QuadPart = 0;
+        _failed = !SetFilePointerEx( (HANDLE)_blocksHandle, zero, NULL, FILE_BEGIN );
+#else
+        _failed = lseek( _blocksFd, 0, SEEK_SET ) != 0;
+#endif
+        uint64_t left = _blockOffsets.back();
+        while( !_failed && left )
+        {
+            size_t chunk = left < WriterBufferSize ? (size_t)left : WriterBufferSize;
+#ifdef _WIN32
+            DWORD bytes = 0;
+            if( !ReadFile( (HANDLE)_blocksHandle, _buffer, (DWORD)chunk, &bytes, NULL ) || !bytes )
+#else
+            ssize_t bytes = ::read( _blocksFd, _buffer, chunk );
+            if( bytes <= 0 )
+#endif
+            {
+                _failed = true;
+                break;
+            }
+            _buffered = (size_t)bytes;
+            left -= (uint64_t)bytes;
+            flushBuffer();
+        }
+        return !_failed;
+    }
+
+    bool FileWriter::bufferBytes( const void* _data, size_t _length )
+    {
+        const uint8_t* data = (const uint8_t*)_data;
+        while( _length )
+        {
+            size_t room = WriterBufferSize - _buffered;
+            size_t bytes = _length < room ? _length : room;
+            memcpy( _buffer + _buffered, data, bytes );
+            _buffered += bytes;
+            data += bytes;
+            _length -= bytes;
+            if( _buffered == WriterBufferSize && !flushBuffer() )
+                return false;
+        }
+        return true;
+    }
+
+    bool FileWriter::flushBuffer()
+    {
+#ifdef _WIN32
+        bool written = WriteAll( (HANDLE)_handle, _buffer, _buffered );
+#else
+        bool written = WriteAll( _fd, _buffer, _buffered );
+#endif
+        if( !written )
+        {
+            _failed = true;
+            return false;
+        }
+        _buffered = 0;
+        return true;
+    }
+
+    void FileWriter::closeHandle()
+    {
+#ifdef _WIN32
+        if( _handle )
+            CloseHandle( (HANDLE)_handle );
+        _handle = nullptr;
+        if( _blocksHandle )
+            CloseHandle( (HANDLE)_blocksHandle );
+        _blocksHandle = nullptr;
+#else
+        if( _fd >= 0 )
+            ::close( _fd );
+        _fd = -1;
+        if( _blocksFd >= 0 )
+            ::close( _blocksFd );
+        _blocksFd = -1;
+#endif
+    }
+
+    bool FileWriter::commit()
+    {
+        if( !opened() )
+            return false;
+        if( !_failed && ( _options & FileWriterCompress ) )
+        {
+            appendBlock();
+            compressed_header_t header;
+            memset( &header, 0, sizeof(header) );
+            header.magic = CompressedMagic;
+            header.blockSize = DefaultCompressedBlockSize;
+            header.rawSize = _rawSize;
+            header.blockCount = (uint32_t)( _blockOffsets.size() - 1 );
+            if( !_failed && bufferBytes( &header, sizeof(header) ) && bufferBytes( _blockOffsets.data(), _blockOffsets.size() * sizeof(uint64_t) ) )
+                copyBlocks();
+        }
+        bool succeeded = !_failed && flushBuffer();
+#ifdef _WIN32
+        if( succeeded && !( _options & FileWriterNoSync ) )
+            succeeded = FlushFileBuffers( (HANDLE)_handle ) != 0;
+        closeHandle();
+        succeeded = succeeded && MoveFileExA( _tempPath.c_str(), _finalPath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#else
+        if( succeeded && !( _options & FileWriterNoSync ) )
+            succeeded = fsync( _fd ) == 0;
+        closeHandle();
+        succeeded = succeeded && rename( _tempPath.c_str(), _finalPath.c_str() ) == 0;
+        if( succeeded && !( _options & FileWriterNoSync ) )
+        {
+            // the rename itself is only durable once the directory is synced
+            size_t slash = _finalPath.find_last_of( '/' );
+            std::string directory = slash == std::string::npos ? std::string( "." ) : _finalPath.substr( 0, slash ? slash : 1 );
+            int fd = ::open( directory.c_str(), O_RDONLY );
+            if( fd >= 0 )
+            {
+                fsync( fd );
+                ::close( fd );
+            }
+        }
+#endif
+        if( !succeeded )
+            remove( _tempPath.c_str() );
+        return succeeded;
+    }
+
+    void FileWriter::abort()
+    {
+        if( !opened() )
+            return;
+        closeHandle();
+        remove( _tempPath.c_str() );
+        _buffered = 0;
+        _block.clear();
+    }
+
+    bool SaveFileAtomic( const std::string& _path, const void* _data, size_t _length, uint32_t _flags )
+    {
+        FileWriter writer;
+        if( !writer.open( _path, _flags ) )
+            return false;
+        if( !writer.write( _data, _length ) )
+            return false;
+        return writer.commit();
+    }
+
+    bool AsyncWriter::initialize()
+    {
+        if( _thread.joinable() )
+            return false;
+        _quit = false;
+        _thread = std::thread( [this]() {
+            worker();
+        });
+        return true;
+    }
+
+    void AsyncWriter::shutdown()
+    {
+        if( !_thread.joinable() )
+            return;
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _quit = true;
+        }
+        _condition.notify_all();
+        _thread.join();
+    }
+
+    std::future<bool> AsyncWriter::saveAsync( const std::string& _path, std::vector<uint8_t>&& _data, uint32_t _flags )
+    {
+        request_t request;
+        request.path = _path;
+        request.data = std::move( _data );
+        request.flags = _flags;
+        std::future<bool> future = request.promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            if( !_thread.joinable() || _quit )
+            {
+                request.promise.set_value( false );
+                return future;
+            }
+            _requests.push_back( std::move( request ) );
+        }
+        _condition.notify_one();
+        return future;
+    }
+
+    std::future<bool> AsyncWriter::saveAsync( const std::string& _path, const void* _data, size_t _length, uint32_t _flags )
+    {
+        const uint8_t* data = (const uint8_t*)_data;
+        return saveAsync( _path, std::vector<uint8_t>( data, data + _length ), _flags );
+    }
+
+    void AsyncWriter::flush()
+    {
+        std::unique_lock<std::mutex> lock( _mutex );
+        _idleCondition.wait( lock, [this]() {
+            return _requests.empty() && !_busy;
+        });
+    }
+
+    void AsyncWriter::worker()
+    {
+        FileWriter writer;
+        for( ;; )
+        {
+            request_t request;
+            {
+                std::unique_lock<std::mutex> lock( _mutex );
+                _condition.wait( lock, [this]() {
+                    return _quit || !_requests.empty();
+                });
+                // queued saves are still carried out on shutdown
+                if( _requests.empty() )
+                    return;
+                request = std::move( _requests.front() );
+                _requests.pop_front();
+                _busy = true;
+            }
+            bool succeeded = writer.open( request.path, request.flags )
+                && writer.write( request.data.data(), request.data.size() )
+                && writer.commit();
+            writer.abort();
+            request.promise.set_value( succeeded );
+            {
+                std::lock_guard<std::mutex> lock( _mutex );
+                _busy = false;
+            }
+            _idleCondition.notify_all();
+        }
+    }
+}
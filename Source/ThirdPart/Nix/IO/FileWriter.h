@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Archive.h"
+#include <memory>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <vector>
+
+namespace Nix
+{
+    enum FileWriterFlag
+    {
+        FileWriterCompress = 0x1,   // store a block compressed container, see Compression.h
+        FileWriterNoSync = 0x2      // skip the fsync before the rename, for scratch files
+    };
+
+    // Streams a file into `<path>.tmp` through a large page aligned buffer. `commit` flushes it,
+    // syncs it to the disk and renames it over `path`, so readers see either the previous file
+    // or the whole new one, never a partial write. A writer that is not committed leaves the
+    // target untouched and removes its temp file.
+    class FileWriter
+    {
+    private:
+        std::string _finalPath;
+        std::string _tempPath;
+#ifdef _WIN32
+        void *_handle = nullptr;
+#else
+        int _fd = -1;
+#endif
+        std::unique_ptr<uint8_t[]> _storage;
+        uint8_t *_buffer = nullptr;     // `_storage` aligned to the page size
+        size_t _buffered = 0;
+        uint32_t _options = 0;
+        bool _failed = false;
+        // compression : the container starts with the block index, so blocks are compressed as
+        // they fill and written to a scratch file, commit writes the header and the index and
+        // copies the blocks after them. Memory use stays at one block whatever the file size.
+#ifdef _WIN32
+        void *_blocksHandle = nullptr;
+#else
+        int _blocksFd = -1;
+#endif
+        std::vector<uint8_t> _block;
+        std::vector<uint8_t> _packed;
+        std::vector<uint64_t> _blockOffsets;
+        uint64_t _rawSize = 0;
+
+    public:
+        FileWriter() {}
+        FileWriter(const FileWriter &) = delete;
+        FileWriter &operator=(const FileWriter &) = delete;
+        ~FileWriter() { abort(); }
+
+        bool open(const std::string &path, uint32_t flags = 0);
+        bool write(const void *data, size_t length);
+        // overwrites bytes written earlier, for headers that are only known at the end, later
+        // writes still append. Not available with FileWriterCompress.
+        bool patch(uint64_t offset, const void *data, size_t length);
+        // returns false and keeps the previous file when anything failed along the way
+        bool commit();
+        void abort();
+        bool opened() const;
+
+    private:
+        bool openBlocks();
+        void appendBlock();
+        bool copyBlocks();
+        bool bufferBytes(const void *data, size_t length);
+        bool flushBuffer();
+        void closeHandle();
+    };
+
+    // writes `length` bytes to `path` through a FileWriter
+    bool SaveFileAtomic(const std::string &path, const void *data, size_t length, uint32_t flags = 0);
+
+    // Runs saves on a background thread, in submission order. The returned future is the
+    // completion handle, it holds the result of the commit.
+    class AsyncWriter
+    {
+    private:
+        struct request_t
+        {
+            std::string path;
+            std::vector<uint8_t> data;
+            uint32_t flags;
+            std::promise<bool> promise;
+        };
+
+        std::thread _thread;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        std::condition_variable _idleCondition;
+        std::deque<request_t> _requests;
+        bool _busy = false;
+        bool _quit = false;
+
+    public:
+        AsyncWriter() {}
+        AsyncWriter(const AsyncWriter &) = delete;
+        AsyncWriter &operator=(const AsyncWriter &) = delete;
+        ~AsyncWriter() { shutdown(); }
+
+        bool initialize();
+        // finishes the queued saves before returning
+        void shutdown();
+
+        // the writer takes the data over, the caller keeps no reference to it
+        std::future<bool> saveAsync(const std::string &path, std::vector<uint8_t> &&data, uint32_t flags = 0);
+        std::future<bool> saveAsync(const std::string &path, const void *data, size_t length, uint32_t flags = 0);
+        // blocks until every queued save is done
+        void flush();
+
+    private:
+        void worker();
+    };
+} // namespace Nix
@@ -0,0 +1,392 @@
+#include "PakArchive.h"
+#include "Directory.h"
+#include "Compression.h"
+#include "FileWriter.h"
+#include "../String/Path.h"
+#include "../String/Encoding.h"
+#include "../String/Hash.h"
+#include <algorithm>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Nix
+{
+    static_assert( sizeof(pak_header_t) == 40, "pak header layout changed" );
+    static_assert( sizeof(pak_entry_t) == 48, "pak entry layout changed" );
+
+    uint64_t PakPathHash( const char* _path, size_t _length )
+    {
+        // must stay the hash the path table caches, PathId lookups reuse it
+        return PathHash( _path, _length );
+    }
+
+    static uint64_t PakPathHash( const char* _path, size_t _length, uint32_t _version )
+    {
+        if( _version >= 3 )
+            return PakPathHash( _path, _length );
+        // version 1 and 2 paks sorted their table by the APHasher of the path
+        APHasher hasher;
+        hasher.hash( _path, _length );
+        return hasher;
+    }
+
+    static uint64_t PakContentHash( const void* _data, size_t _length, uint32_t _version )
+    {
+        if( _version >= 2 )
+            return Hash64( _data, _length );
+        // version 1 paks were checksummed with APHasher
+        APHasher hasher;
+        hasher.hash( _data, _length );
+        return hasher;
+    }
+
+    class PakArchive: public IArchive
+    {
+        friend IArchive* CreatePakArchive( const std::string& _path, bool _verifyChecksums );
+    private:
+        std::string _root;
+        IBlob* _mapping = nullptr;
+        const pak_entry_t* _entries = nullptr;
+        uint32_t _entryCount = 0;
+        const char* _names = nullptr;
+        bool _verifyChecksums = false;
+        uint32_t _version = PakVersion;
+        uint64_t _modifiedTime = 0;     // of the pak file, every entry reports it
+        //
+        // `_path` is normalized, `_hash` its PakPathHash
+        const pak_entry_t* find( const char* _path, size_t _length, uint64_t _hash ) const
+        {
+            const pak_entry_t* end = _entries + _entryCount;
+            const pak_entry_t* entry = std::lower_bound( _entries, end, _hash, []( const pak_entry_t& _entry, uint64_t _hash ) {
+                return _entry.hash < _hash;
+            });
+            // entries with colliding hashes are adjacent, the name decides
+            for( ; entry != end && entry->hash == _hash; ++entry )
+            {
+                if( entry->nameLength == _length && !memcmp( _names + entry->nameOffset, _path, _length ) )
+                    return entry;
+            }
+            return nullptr;
+        }
+
+        const pak_entry_t* find( const std::string& _path ) const
+        {
+            std::string path = _path;
+            if( !path.empty() )
+                path.resize( NormalizePath( &path[0], path.length() ) );
+            return find( path.c_str(), path.length(), PakPathHash( path.c_str(), path.length(), _version ) );
+        }
+
+        // the pak names are normalized the way the table is, its cached hash is the pak hash
+        // from version 3 on
+        const pak_entry_t* find( PathId _path ) const
+        {
+            const PathTable& table = SharedPathTable();
+            const std::string& path = table.path( _path );
+            if( path.empty() )
+                return nullptr;
+            uint64_t hash = _version >= 3 ? table.hash( _path ) : PakPathHash( path.c_str(), path.length(), _version );
+            return find( path.c_str(), path.length(), hash );
+        }
+
+        // the size `open` serves, compressed entries hold at least a container header (checked
+        // when the pak is opened)
+        uint64_t servedSize( const pak_entry_t& _entry ) const
+        {
+            if( !( _entry.flags & PakEntryCompressed ) )
+                return _entry.size;
+            return ( (const compressed_header_t*)( (const char*)_mapping->data() + _entry.offset ) )->rawSize;
+        }
+
+        virtual IFile* open( const std::string& _path, uint8_t _memoryMode = 0 ) override
+        {
+            return openEntry( find( _path ), _memoryMode );
+        }
+
+        virtual IFile* open( PathId _path, uint8_t _memoryMode = 0 ) override
+        {
+            return openEntry( find( _path ), _memoryMode );
+        }
+
+        IFile* openEntry( const pak_entry_t* _entry, uint8_t _memoryMode )
+        {
+            if( !_entry )
+                return nullptr;
+            const char* data = (const char*)_mapping->data() + _entry->offset;
+            if( _verifyChecksums && ( _entry->flags & PakEntryChecksum ) )
+            {
+                if( PakContentHash( data, (size_t)_entry->size, _version ) != _entry->checksum )
+                    return nullptr;
+            }
+            if( _entry->flags & PakEntryCompressed )
+            {
+                if( _memoryMode == MemoryModeStream )
+                    return CreateCompressedFile( CreateBlobView( _mapping, (size_t)_entry->offset, (size_t)_entry->size ) );
+                return DecompressToMemory( data, (size_t)_entry->size );
+            }
+            return CreateBlobView( _mapping, (size_t)_entry->offset, (size_t)_entry->size );
+        }
+
+        virtual bool save( const std::string&, const void*, size_t ) override
+        {
+            return false;
+        }
+
+        virtual const char* root() override
+        {
+            return _root.c_str();
+        }
+
+        virtual bool list( const std::string& _directory, std::vector<FileInfo>& files_, uint32_t _flags ) override
+        {
+            std::string prefix = FormatFilePath( _directory );
+            if( !prefix.empty() )
+                prefix.push_back( '/' );
+            size_t first = files_.size();
+            for( uint32_t i = 0; i < _entryCount; ++i )
+            {
+                const pak_entry_t& entry = _entries[i];
+                const char* name = _names + entry.nameOffset;
+                if( entry.nameLength <= prefix.length() || memcmp( name, prefix.c_str(), prefix.length() ) )
+                    continue;
+                if( !( _flags & ListRecursive ) && memchr( name + prefix.length(), '/', entry.nameLength - prefix.length() ) )
+                    continue;
+                const char* data = (const char*)_mapping->data() + entry.offset;
+                FileInfo info;
+                info.path.assign( name, entry.nameLength );
+                info.size = servedSize( entry );
+                info.modifiedTime = _modifiedTime;
+                info.hash = 0;
+                if( entry.flags & PakEntryCompressed )
+                {
+                    if( _flags & ListContentHash )
+                    {
+                        IFile* file = DecompressToMemory( data, (size_t)entry.size );
+                        if( file )
+                        {
+                            info.hash = HashFileContent( file->constData(), file->size() );
+                            file->release();
+                        }
+                    }
+                }
+                else if( _flags & ListContentHash )
+                {
+                    // version 2 checksums are already the content hash of stored entries
+                    if( _version >= 2 && ( entry.flags & PakEntryChecksum ) )
+                        info.hash = entry.checksum;
+                    else
+                        info.hash = HashFileContent( data, (size_t)entry.size );
+                }
+                files_.push_back( std::move( info ) );
+            }
+            // the table is in hash order
+            std::sort( files_.begin() + first, files_.end(), []( const FileInfo& _a, const FileInfo& _b ) {
+                return _a.path < _b.path;
+            });
+            return true;
+        }
+
+        virtual bool fileInfo( const std::string& _path, FileInfo& info_ ) override
+        {
+            const pak_entry_t* entry = find( _path );
+            if( !entry )
+                return false;
+            info_.path.assign( _names + entry->nameOffset, entry->nameLength );
+            info_.size = servedSize( *entry );
+            info_.modifiedTime = _modifiedTime;
+            info_.hash = 0;
+            return true;
+        }
+
+        // the entries are ranges of the pak mapping, the kernel is asked to page them in
+        virtual void prefetch( const std::vector<std::string>& _paths ) override
+        {
+            char* base = (char*)_mapping->data();
+#ifdef _WIN32
+            std::vector<WIN32_MEMORY_RANGE_ENTRY> ranges;
+            for( auto& path : _paths )
+            {
+                const pak_entry_t* entry = find( path );
+                if( !entry || !entry->size )
+                    continue;
+                WIN32_MEMORY_RANGE_ENTRY range;
+                range.VirtualAddress = base + entry->offset;
+                range.NumberOfBytes = (SIZE_T)entry->size;
+                ranges.push_back( range );
+            }
+            if( !ranges.empty() )
+                PrefetchVirtualMemory( GetCurrentProcess(), ranges.size(), ranges.data(), 0 );
+#else
+            size_t pageSize = (size_t)sysconf( _SC_PAGESIZE );
+            for( auto& path : _paths )
+            {
+                const pak_entry_t* entry = find( path );
+                if( !entry || !entry->size )
+                    continue;
+                size_t begin = (size_t)entry->offset & ~( pageSize - 1 );
+                size_t end = (size_t)( entry->offset + entry->size );
+                madvise( base + begin, end - begin, MADV_WILLNEED );
+            }
+#endif
+        }
+
+        virtual void release() override
+        {
+            if( _mapping )
+                _mapping->release();
+            delete this;
+        }
+    };
+
+    IArchive* CreatePakArchive( const std::string& _path, bool _verifyChecksums )
+    {
+        IBlob* mapping = MapFileToMemory( FormatFilePath( _path ) );
+        if( !mapping )
+            return nullptr;
+        const char* base = (const char*)mapping->data();
+        size_t size = mapping->size();
+        const pak_header_t* header = (const pak_header_t*)base;
+        bool valid = size >= sizeof(pak_header_t)
+            && header->magic == PakMagic
+            && header->version >= 1 && header->version <= PakVersion
+            && header->tocOffset <= size
+            && (uint64_t)header->entryCount * sizeof(pak_entry_t) <= size - header->tocOffset
+            && header->namesOffset <= size
+            && header->namesSize <= size - header->namesOffset;
+        const pak_entry_t* entries = valid ? (const pak_entry_t*)( base + header->tocOffset ) : nullptr;
+        for( uint32_t i = 0; valid && i < header->entryCount; ++i )
+        {
+            valid = entries[i].offset <= size && entries[i].size <= size - entries[i].offset
+                && (uint64_t)entries[i].nameOffset + entries[i].nameLength <= header->namesSize
+                && ( !( entries[i].flags & PakEntryCompressed ) || entries[i].size >= sizeof(compressed_header_t) );
+        }
+        if( !valid )
+        {
+            mapping->release();
+            return nullptr;
+        }
+        PakArchive* arch = new PakArchive();
+        arch->_root = FormatFilePath( _path );
+        arch->_mapping = mapping;
+        arch->_entries = entries;
+        arch->_entryCount = header->entryCount;
+        arch->_names = base + header->namesOffset;
+        arch->_verifyChecksums = _verifyChecksums;
+        arch->_version = header->version;
+        DirectoryEntry stat;
+        if( StatFile( arch->_root, stat ) )
+            arch->_modifiedTime = stat.modifiedTime;
+        return arch;
+    }
+
+    bool BuildPakArchive( const std::string& _directory, const std::string& _pakPath, uint32_t _alignment, bool _checksums, bool _compress )
+    {
+        if( !_alignment || ( _alignment & ( _alignment - 1 ) ) )
+            return false;
+        std::vector<DirectoryEntry> files;
+        std::string root = FormatFilePath( _directory );
+        if( !ListDirectory( root, "", true, files ) )
+            return false;
+        std::sort( files.begin(), files.end(), []( const DirectoryEntry& _a, const DirectoryEntry& _b ) {
+            return _a.path < _b.path;
+        });
+        // built aside and renamed over the previous pak only once every write went through
+        FileWriter pak;
+        if( !pak.open( FormatFilePath( _pakPath ) ) )
+            return false;
+        //
+        pak_header_t header;
+        memset( &header, 0, sizeof(header) );
+        bool succeeded = pak.write( &header, sizeof(header) );
+        uint64_t position = sizeof(header);
+        std::vector<pak_entry_t> entries;
+        std::string names;
+        std::vector<char> content;
+        std::vector<uint8_t> compressed;
+        static const char padding[4096] = {};
+        for( auto& file : files )
+        {
+            if( !succeeded )
+                break;
+            std::string name = FormatFilePath( file.path );
+            FILE* fh = fopen( ( root + "/" + file.path ).c_str(), "rb" );
+            if( !fh )
+            {
+                succeeded = false;
+                break;
+            }
+            content.resize( (size_t)file.size );
+            size_t bytesRead = content.empty() ? 0 : fread( content.data(), 1, content.size(), fh );
+            fclose( fh );
+            if( bytesRead != content.size() )
+            {
+                succeeded = false;
+                break;
+            }
+            uint32_t flags = 0;
+            if( _compress && !content.empty() )
+            {
+                CompressBlocks( content.data(), content.size(), DefaultCompressedBlockSize, compressed );
+                if( compressed.size() < content.size() )
+                {
+                    content.assign( compressed.begin(), compressed.end() );
+                    flags |= PakEntryCompressed;
+                }
+            }
+            uint64_t aligned = ( position + _alignment - 1 ) & ~(uint64_t)( _alignment - 1 );
+            for( uint64_t pad = aligned - position; pad && succeeded; )
+            {
+                size_t chunk = pad > sizeof(padding) ? sizeof(padding) : (size_t)pad;
+                succeeded = pak.write( padding, chunk );
+                pad -= chunk;
+            }
+            succeeded = succeeded && pak.write( content.data(), content.size() );
+            pak_entry_t entry;
+            memset( &entry, 0, sizeof(entry) );
+            entry.hash = PakPathHash( name.c_str(), name.length() );
+            entry.offset = aligned;
+            entry.size = content.size();
+            entry.nameOffset = (uint32_t)names.length();
+            entry.nameLength = (uint32_t)name.length();
+            entry.flags = flags;
+            if( _checksums )
+            {
+                entry.checksum = PakContentHash( content.data(), content.size(), PakVersion );
+                entry.flags |= PakEntryChecksum;
+            }
+            names.append( name );
+            entries.push_back( entry );
+            position = aligned + content.size();
+        }
+        if( succeeded )
+        {
+            std::stable_sort( entries.begin(), entries.end(), []( const pak_entry_t& _a, const pak_entry_t& _b ) {
+                return _a.hash < _b.hash;
+            });
+            header.magic = PakMagic;
+            header.version = PakVersion;
+            header.entryCount = (uint32_t)entries.size();
+            header.alignment = _alignment;
+            header.tocOffset = ( position + 7 ) & ~(uint64_t)7;
+            header.namesOffset = header.tocOffset + entries.size() * sizeof(pak_entry_t);
+            header.namesSize = names.length();
+            succeeded = pak.write( padding, (size_t)( header.tocOffset - position ) )
+                && pak.write( entries.data(), entries.size() * sizeof(pak_entry_t) )
+                && pak.write( names.data(), names.length() )
+                && pak.patch( 0, &header, sizeof(header) );
+        }
+        // a failed build leaves the previous pak in place
+        if( !succeeded )
+        {
+            pak.abort();
+            return false;
+        }
+        return pak.commit();
+    }
+} // namespace Nix
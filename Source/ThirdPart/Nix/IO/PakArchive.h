@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Archive.h"
+
+namespace Nix
+{
+    // Pak file layout, all values little endian :
+    //   pak_header_t | entry data, each aligned to `alignment` | pak_entry_t[entryCount] | names
+    // The entry table is sorted by the hash of the normalized entry path.
+    static const uint32_t PakMagic = 0x4B41504E; // "NPAK"
+    static const uint32_t PakVersion = 3;   // 3 : Hash64 path hashes, 2 : Hash64 checksums, 1 : APHasher checksums
+
+    enum PakEntryFlag
+    {
+        PakEntryChecksum = 0x1,
+        PakEntryCompressed = 0x2,   // the entry is a block compressed container, see Compression.h
+    };
+
+    struct pak_header_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t alignment;
+        uint64_t tocOffset;
+        uint64_t namesOffset;
+        uint64_t namesSize;
+    };
+
+    struct pak_entry_t
+    {
+        uint64_t hash;          // Hash64 of the normalized path, APHasher before version 3
+        uint64_t offset;
+        uint64_t size;          // stored size
+        uint64_t checksum;      // Hash64 of the stored bytes, valid with PakEntryChecksum
+        uint32_t nameOffset;    // into the names block
+        uint32_t nameLength;
+        uint32_t flags;
+        uint32_t reserved;
+    };
+
+    // Read-only archive over a single pak file. The pak is mapped once, so opening an entry is
+    // one table lookup and returns a view into the mapping, whatever `memoryMode` asks for.
+    // Compressed entries are decoded transparently : MemoryModeStream streams them block by
+    // block, the other modes decode the whole entry in parallel into a memory buffer.
+    // With `verifyChecksums` every open re-hashes the entry and fails on a mismatch.
+    IArchive *CreatePakArchive(const std::string &pakPath, bool verifyChecksums = false);
+    // packs every file under `directory` into `pakPath`, `alignment` must be a power of two
+    // with `compress`, files are stored block compressed whenever that makes them smaller
+    bool BuildPakArchive(const std::string &directory, const std::string &pakPath, uint32_t alignment = 64, bool checksums = true, bool compress = false);
+    // hash used for the pak table, `path` must already be normalized
+    uint64_t PakPathHash(const char *path, size_t length);
+} // namespace Nix
@@ -0,0 +1,125 @@
+#include "WorkerPool.h"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+namespace Nix
+{
+    class WorkerPool
+    {
+    private:
+        std::vector<std::thread> _threads;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        std::deque<std::function<void()>> _tasks;
+        bool _quit = false;
+
+        WorkerPool()
+        {
+            uint32_t threadCount = std::thread::hardware_concurrency();
+            threadCount = threadCount > 1 ? threadCount - 1 : 1;
+            for( uint32_t i = 0; i < threadCount; ++i )
+                _threads.emplace_back( [this]() { worker(); } );
+        }
+
+        void worker()
+        {
+            for( ;; )
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock( _mutex );
+                    _condition.wait( lock, [this]() { return _quit || !_tasks.empty(); } );
+                    if( _quit )
+                        return;
+                    task = std::move( _tasks.front() );
+                    _tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+    public:
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock( _mutex );
+                _quit = true;
+            }
+            _condition.notify_all();
+            for( auto& thread : _threads )
+                thread.join();
+        }
+
+        static WorkerPool& Shared()
+        {
+            static WorkerPool pool;
+            return pool;
+        }
+
+        uint32_t threadCount() const { return (uint32_t)_threads.size(); }
+
+        void post( std::function<void()>&& _task, uint32_t _copies )
+        {
+            {
+                std::lock_guard<std::mutex> lock( _mutex );
+                for( uint32_t i = 0; i < _copies; ++i )
+                    _tasks.push_back( _task );
+            }
+            _copies > 1 ? _condition.notify_all() : _condition.notify_one();
+        }
+    };
+
+    // one ParallelFor call, shared with the helpers that may start after it returned
+    struct parallel_job_t
+    {
+        const std::function<void( size_t )>* task;     // only called for claimed indices
+        size_t count;
+        std::atomic<size_t> next;
+        std::mutex mutex;
+        std::condition_variable condition;
+        size_t done = 0;
+
+        // claims indices until none is left
+        void run()
+        {
+            size_t finished = 0;
+            for( size_t i = next++; i < count; i = next++ )
+            {
+                ( *task )( i );
+                ++finished;
+            }
+            if( !finished )
+                return;
+            std::lock_guard<std::mutex> lock( mutex );
+            done += finished;
+            if( done == count )
+                condition.notify_all();
+        }
+    };
+
+    void ParallelFor( size_t _count, const std::function<void( size_t )>& _task, uint32_t _maxHelpers )
+    {
+        if( _count <= 1 || !_maxHelpers )
+        {
+            for( size_t i = 0; i < _count; ++i )
+                _task( i );
+            return;
+        }
+        WorkerPool& pool = WorkerPool::Shared();
+        std::shared_ptr<parallel_job_t> job = std::make_shared<parallel_job_t>();
+        job->task = &_task;
+        job->count = _count;
+        job->next = 0;
+        uint32_t helpers = std::min<uint32_t>( std::min( pool.threadCount(), _maxHelpers ), (uint32_t)std::min<size_t>( _count - 1, UINT32_MAX ) );
+        pool.post( [job]() { job->run(); }, helpers );
+        job->run();
+        std::unique_lock<std::mutex> lock( job->mutex );
+        job->condition.wait( lock, [&]() { return job->done == job->count; } );
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+namespace Nix
+{
+    // Runs `task(i)` for every i in [0, count) on the calling thread and on up to `maxHelpers`
+    // threads of the pool the IO code shares (block decoding, content hashing, prefetching).
+    // The pool starts on first use with one thread less than the CPU count. The calling thread
+    // works too and never waits for a helper that has not picked the loop up, so a busy pool
+    // makes a loop slower but cannot stall it, and tasks may run loops of their own.
+    void ParallelFor(size_t count, const std::function<void(size_t)> &task, uint32_t maxHelpers = UINT32_MAX);
+} // namespace Nix
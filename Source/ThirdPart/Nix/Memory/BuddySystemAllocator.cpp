@@ -1,168 +1,428 @@
 #include "BuddySystemAllocator.h"
 #include <cassert>
+#include <algorithm>
+#include <functional>
+#include <string.h>
+
+#if NIX_BUDDY_ALLOCATOR_STATS
+#define NIX_BUDDY_STAT(...) __VA_ARGS__
+#else
+#define NIX_BUDDY_STAT(...)
+#endif
 
 namespace Nix {
 
 	bool BuddySystemAllocator::initialize(size_t _wholeSize, size_t _minSize) {
+		if (!_minSize || _wholeSize < _minSize) {
+			return false;
+		}
+		// the deepest layer is the last one whose node size is still not smaller than `_minSize`
 		size_t layer = 0;
-		size_t miniCount = 1;
-		while (miniCount< (_wholeSize/_minSize) ) {
+		while ((_wholeSize >> (layer + 1)) >= _minSize) {
 			++layer;
-			miniCount = (size_t)1 << layer;
 		}
-		size_t fullCount = miniCount * 2;
+		size_t fullCount = (size_t)2 << layer;
+		if (fullCount - 1 > UINT32_MAX) {
+			// free list links are 32-bit, that still covers 2^31 blocks of `_minSize`
+			return false;
+		}
 		m_minSize = _minSize;
+		m_maxLayer = layer;
 		m_maxIndex = fullCount - 1;
 		m_capacity = _wholeSize;
-		m_nodeTable.resize(fullCount);
-		m_nodeTable[0].hasChild = false;
-		m_nodeTable[0].free = true;
-		m_nodeTable[1] = m_nodeTable[0];
+		m_nodeTable.assign(fullCount, node_t());
 		for (size_t i = 0; i < m_nodeTable.size(); ++i) {
 			m_nodeTable[i].nodeType = (i & 0x1);
 		}
+		m_freeHeads.assign(m_maxLayer + 1, 0);
+		m_freePrev.assign(fullCount, 0);
+		m_freeNext.assign(fullCount, 0);
+#if NIX_BUDDY_ALLOCATOR_STATS
+		m_requestedSizes.assign(fullCount, 0);
+		m_bytesInUse = m_bytesRequested = m_liveAllocations = 0;
+		m_allocationCount = m_failedAllocationCount = m_freeCount = 0;
+#endif
+		// at the beginning the root node is the only free block
+		pushFree(1, 0);
 		return true;
 	}
 
-	bool BuddySystemAllocator::allocate(size_t _size, size_t& offset_, uint16_t& id_) {
-		struct alloc_t {
-			size_t layer;
-			size_t index;
-		};
-		std::vector<alloc_t> allocs;
-		allocs.push_back({ 0, 1 });
-		while (!allocs.empty()) {
-			
-			alloc_t alloc = allocs.back();
-			allocs.pop_back();
-
-			node_t& node = m_nodeTable[alloc.index];
-			if (node.free) {
-				size_t nodeSize = m_capacity >> alloc.layer;
-				if (_size < nodeSize >> 1 && (nodeSize >> 1) >= m_minSize ) {
-					// can alloc from it's child node!
-					if (!node.hasChild) {
-						node.hasChild = true;
-						node.leftFree = node.rightFree = true;
-						m_nodeTable[alloc.index * 2].free = true;
-						m_nodeTable[alloc.index * 2].hasChild = false;
-						m_nodeTable[alloc.index * 2 + 1].free = true;
-						m_nodeTable[alloc.index * 2 + 1].hasChild = false;
-					}
-					if (node.rightFree) {
-						allocs.push_back({ alloc.layer + 1, alloc.index * 2 + 1 });
-					}
-					if (node.leftFree) {
-						allocs.push_back({ alloc.layer + 1, alloc.index * 2 });
-					}
-				} else {
-					// this node is just fit for the allocation size
-					if (!node.hasChild) {
-						if (alloc.index > m_maxIndex) {
-							return false;
-						}
-						// allocate successfully!
-						size_t layerStartIndex = ((size_t)1 << alloc.layer);
-						size_t& divideTimes = layerStartIndex;
-						offset_ = (alloc.index - layerStartIndex) * (m_capacity / divideTimes);
-						id_ = alloc.index;
-						updateTableForAllocate(node, alloc.layer, alloc.index);
-						return m_capacity >> alloc.layer;
-					}
-					else if (node.hasChild) {
-						continue;
-					}
-				}
-			} else {
-				continue;
+	bool BuddySystemAllocator::allocate(size_t _size, size_t& offset_, BuddyHandle& handle_) {
+		if (!_size || _size > m_capacity) {
+			NIX_BUDDY_STAT(++m_failedAllocationCount;)
+			return false;
+		}
+		size_t targetLayer = layerForSize(_size);
+		// find the smallest free block that can hold `_size`, walking up from the fitting layer
+		size_t layer = targetLayer;
+		while (!m_freeHeads[layer]) {
+			if (!layer) {
+				NIX_BUDDY_STAT(++m_failedAllocationCount;)
+				return false;
 			}
+			--layer;
 		}
-		return false;
+		size_t index = popFree(layer);
+		updateTableForAllocate(index, layer, targetLayer, index);
+		size_t layerStartIndex = ((size_t)1 << targetLayer);
+		offset_ = (index - layerStartIndex) * (m_capacity >> targetLayer);
+		handle_ = makeHandle(index, m_nodeTable[index].generation);
+		NIX_BUDDY_STAT(
+			m_requestedSizes[index] = _size;
+			m_bytesInUse += m_capacity >> targetLayer;
+			m_bytesRequested += _size;
+			++m_liveAllocations;
+			++m_allocationCount;
+		)
+		return true;
 	}
 
-	bool BuddySystemAllocator::free(uint16_t _id) {
-		assert(_id < m_nodeTable.size());
-		size_t layer = 0;
-		uint16_t v = _id;
-		while (v != 1) {
-			layer++;
-			v = v >> 1;
+	bool BuddySystemAllocator::free(BuddyHandle _handle) {
+		if (!validate(_handle)) {
+			assert(false && "invalid buddy handle or double free");
+			return false;
+		}
+		size_t index = indexOfHandle(_handle);
+		recordFree(index);
+		return updateTableForFree(index, layerOfIndex(index));
+	}
+
+	bool BuddySystemAllocator::allocateBatch(const size_t* _sizes, size_t _count, BuddyAllocation* allocations_) {
+		// serve the largest blocks first: their splits leave buddies on the deeper free lists
+		// that the smaller blocks of the batch pick up without climbing the tree again
+		m_batchOrder.resize(_count);
+		for (size_t i = 0; i < _count; ++i) {
+			m_batchOrder[i] = i;
+		}
+		std::sort(m_batchOrder.begin(), m_batchOrder.end(), [_sizes](size_t _a, size_t _b) {
+			return _sizes[_a] > _sizes[_b];
+		});
+		for (size_t i = 0; i < _count; ++i) {
+			size_t request = m_batchOrder[i];
+			BuddyAllocation& allocation = allocations_[request];
+			allocation.size = _sizes[request];
+			if (!allocate(_sizes[request], allocation.offset, allocation.handle)) {
+				// roll back, the batch is all or nothing and counts as the one failed allocation
+				for (size_t j = 0; j < i; ++j) {
+					free(allocations_[m_batchOrder[j]].handle);
+				}
+				NIX_BUDDY_STAT(
+					m_allocationCount -= i;
+					m_freeCount -= i;
+				)
+				// including the requests that were never attempted
+				for (size_t j = 0; j < _count; ++j) {
+					allocations_[j].handle = InvalidBuddyHandle;
+				}
+				return false;
+			}
 		}
-		node_t& node = m_nodeTable[_id];
-		updateTableForFree(node, layer, _id);
 		return true;
 	}
 
-	bool BuddySystemAllocator::updateTableForAllocate(node_t& _node, size_t _layer, size_t _index )
-	{
-		_node.free = false;
-		_node.hasChild = false;
-		_node.leftFree = _node.rightFree = false;
-
-		if (_layer) {
-			node_t& parentNode = m_nodeTable[_index / 2];
-			if (_node.nodeType == LeftNode) {
-				parentNode.leftFree = false;
+	void BuddySystemAllocator::freeBatch(const BuddyAllocation* _allocations, size_t _count) {
+		m_batchPending.clear();
+		for (size_t i = 0; i < _count; ++i) {
+			BuddyHandle handle = _allocations[i].handle;
+			if (!validate(handle)) {
+				assert(false && "invalid buddy handle or double free");
+				continue;
+			}
+			size_t index = indexOfHandle(handle);
+			recordFree(index);
+			m_nodeTable[index].allocated = false;
+			m_batchPending.push_back((uint32_t)index);
+		}
+		if (m_batchPending.empty()) {
+			return;
+		}
+		// indices of a deeper layer are always larger, descending order walks the tree bottom up
+		std::sort(m_batchPending.begin(), m_batchPending.end(), std::greater<uint32_t>());
+		size_t cursor = 0;
+		size_t layer = layerOfIndex(m_batchPending[0]);
+		m_batchParents.clear();
+		for (;;) {
+			// blocks to release on this layer : freed blocks of the batch plus merged parents of the layer below
+			m_batchLevel.clear();
+			size_t parent = 0;
+			while (cursor < m_batchPending.size() && layerOfIndex(m_batchPending[cursor]) == layer) {
+				while (parent < m_batchParents.size() && m_batchParents[parent] > m_batchPending[cursor]) {
+					m_batchLevel.push_back(m_batchParents[parent++]);
+				}
+				m_batchLevel.push_back(m_batchPending[cursor++]);
+			}
+			while (parent < m_batchParents.size()) {
+				m_batchLevel.push_back(m_batchParents[parent++]);
+			}
+			m_batchParents.clear();
+			for (size_t i = 0; i < m_batchLevel.size(); ++i) {
+				size_t index = m_batchLevel[i];
+				size_t buddy = index ^ 0x1;
+				if (!layer) {
+					pushFree(index, layer);
+				} else if (i + 1 < m_batchLevel.size() && m_batchLevel[i + 1] == buddy) {
+					// both buddies are released by this batch
+					m_batchParents.push_back((uint32_t)(index >> 1));
+					++i;
+				} else if (m_nodeTable[buddy].free) {
+					unlinkFree(buddy, layer);
+					m_batchParents.push_back((uint32_t)(index >> 1));
+				} else {
+					pushFree(index, layer);
+				}
+			}
+			if (!m_batchParents.empty()) {
+				--layer;
+			} else if (cursor < m_batchPending.size()) {
+				layer = layerOfIndex(m_batchPending[cursor]);
 			} else {
-				parentNode.rightFree = false;
+				break;
 			}
 		}
+	}
 
-		size_t layer = _layer;
-		size_t index = _index;
-		while (layer) {
-			auto& leftNode = m_nodeTable[(index >> 1) << 1];
-			auto& rightNode = m_nodeTable[((index >> 1) << 1) + 1];
-			auto& parentNode = m_nodeTable[index / 2];
+	size_t BuddySystemAllocator::planCompaction(size_t _maxBytes, std::vector<BuddyMove>& moves_, const BuddyRelocateCB& _relocate) {
+		size_t planned = 0;
+		// deepest layer first : small blocks are cheap to move, and the parents they free up
+		// can be paired again when the layer above is visited
+		for (size_t layer = m_maxLayer; layer > 0; --layer) {
+			size_t blockSize = m_capacity >> layer;
+			if (planned + blockSize > _maxBytes) {
+				continue;
+			}
+			// a free node whose buddy is allocated marks a lonely block
+			m_compactCandidates.clear();
+			for (uint32_t index = m_freeHeads[layer]; index; index = m_freeNext[index]) {
+				if (m_nodeTable[index ^ 0x1].allocated) {
+					m_compactCandidates.push_back(index);
+				}
+			}
+			if (m_compactCandidates.size() < 2) {
+				continue;
+			}
+			std::sort(m_compactCandidates.begin(), m_compactCandidates.end());
+			// move the lonely blocks at the end of the heap into the holes at the front
+			size_t front = 0;
+			size_t back = m_compactCandidates.size() - 1;
+			while (front < back && planned + blockSize <= _maxBytes) {
+				size_t dst = m_compactCandidates[front++];
+				size_t src = m_compactCandidates[back--] ^ 0x1;
+				node_t& srcNode = m_nodeTable[src];
+				node_t& dstNode = m_nodeTable[dst];
+				BuddyMove move;
+				move.srcOffset = offsetOf(src);
+				move.dstOffset = offsetOf(dst);
+				move.size = blockSize;
+				move.oldHandle = makeHandle(src, srcNode.generation);
+				unlinkFree(dst, layer);
+				dstNode.allocated = true;
+				dstNode.hasChild = false;
+				dstNode.generation = dstNode.generation + 1;
+				move.newHandle = makeHandle(dst, dstNode.generation);
+				NIX_BUDDY_STAT(
+					m_requestedSizes[dst] = m_requestedSizes[src];
+					m_requestedSizes[src] = 0;
+				)
+				updateTableForFree(src, layer);
+				planned += blockSize;
+				moves_.push_back(move);
+				if (_relocate) {
+					_relocate(move);
+				}
+			}
+		}
+		return planned;
+	}
 
-			parentNode.leftFree = leftNode.free;
-			parentNode.rightFree = rightNode.free;
+	void BuddySystemAllocator::applyMoves(void* _heap, const BuddyMove* _moves, size_t _count) {
+		uint8_t* heap = (uint8_t*)_heap;
+		for (size_t i = 0; i < _count; ++i) {
+			memmove(heap + _moves[i].dstOffset, heap + _moves[i].srcOffset, _moves[i].size);
+		}
+	}
 
-			if (!leftNode.free && !rightNode.free) {
-				parentNode.free = false;
-				--layer;
-				index = index>>1;
+	bool BuddySystemAllocator::validate(BuddyHandle _handle) const {
+		size_t index = indexOfHandle(_handle);
+		if (!index || index > m_maxIndex) {
+			return false;
+		}
+		const node_t& node = m_nodeTable[index];
+		return node.allocated && node.generation == generationOfHandle(_handle);
+	}
+
+	BuddyHandle BuddySystemAllocator::handleOf(size_t _index) const {
+		if (!_index || _index > m_maxIndex || !m_nodeTable[_index].allocated) {
+			return InvalidBuddyHandle;
+		}
+		return makeHandle(_index, m_nodeTable[_index].generation);
+	}
+
+	BuddyAllocatorStats BuddySystemAllocator::stats() const {
+		BuddyAllocatorStats stats;
+		memset(&stats, 0, sizeof(stats));
+		stats.capacity = m_capacity;
+		stats.minBlockSize = m_minSize;
+		stats.layerCount = m_freeHeads.size();
+		for (size_t layer = 0; layer < m_freeHeads.size() && layer < BuddyAllocatorStats::MaxLayerCount; ++layer) {
+			size_t count = 0;
+			for (uint32_t index = m_freeHeads[layer]; index; index = m_freeNext[index]) {
+				++count;
 			}
-			else
-			{
-				break;
+			stats.freeBlocks[layer] = count;
+			if (count && !stats.largestFreeBlock) {
+				stats.largestFreeBlock = m_capacity >> layer;
 			}
 		}
-		return true;
+#if NIX_BUDDY_ALLOCATOR_STATS
+		stats.bytesInUse = m_bytesInUse;
+		stats.bytesRequested = m_bytesRequested;
+		stats.bytesWasted = m_bytesInUse - m_bytesRequested;
+		stats.liveAllocations = m_liveAllocations;
+		stats.allocationCount = m_allocationCount;
+		stats.failedAllocationCount = m_failedAllocationCount;
+		stats.freeCount = m_freeCount;
+#endif
+		return stats;
 	}
 
-	bool BuddySystemAllocator::updateTableForFree(node_t& _node, size_t _layer, size_t _index)
-	{
-		_node.free = true;
-		_node.hasChild = false;
-		//
-		if (_layer) {
-			node_t& parentNode = m_nodeTable[_index / 2];
-			if (_node.nodeType == LeftNode) {
-				parentNode.leftFree = true;
-			} else {
-				parentNode.rightFree = true;
+	void BuddySystemAllocator::snapshot(std::vector<uint8_t>& nodes_) const {
+		static_assert(sizeof(node_t) == 2, "node table is expected to be two bytes per node");
+		nodes_.resize(m_nodeTable.size() * sizeof(node_t));
+		if (!m_nodeTable.empty()) {
+			memcpy(nodes_.data(), m_nodeTable.data(), nodes_.size());
+		}
+	}
+
+	void BuddySystemAllocator::dumpNodeTable(FILE* _file) const {
+		BuddyAllocatorStats s = stats();
+		fprintf(_file, "buddy heap : capacity %zu, min block %zu, largest free block %zu\n", s.capacity, s.minBlockSize, s.largestFreeBlock);
+#if NIX_BUDDY_ALLOCATOR_STATS
+		fprintf(_file, "in use %zu, requested %zu, wasted %zu, live %zu, allocs %llu, failed %llu, frees %llu\n",
+			s.bytesInUse, s.bytesRequested, s.bytesWasted, s.liveAllocations,
+			(unsigned long long)s.allocationCount, (unsigned long long)s.failedAllocationCount, (unsigned long long)s.freeCount);
+#endif
+		// a node is only meaningful when all its ancestors are split
+		std::vector<uint8_t> visible(m_nodeTable.size(), 0);
+		if (visible.size() > 1) {
+			visible[1] = 1;
+		}
+		for (size_t layer = 0; layer <= m_maxLayer && !m_nodeTable.empty(); ++layer) {
+			fprintf(_file, "[%2zu] %10zu bytes, %6zu free : ", layer, m_capacity >> layer, layer < BuddyAllocatorStats::MaxLayerCount ? s.freeBlocks[layer] : 0);
+			size_t begin = (size_t)1 << layer;
+			size_t end = begin << 1;
+			for (size_t index = begin; index < end; ++index) {
+				const node_t& node = m_nodeTable[index];
+				char c = '.';
+				if (visible[index]) {
+					if (node.free) {
+						c = 'F';
+					} else if (node.allocated) {
+						c = 'A';
+					} else if (node.hasChild) {
+						c = 'S';
+						if (index * 2 + 1 < visible.size()) {
+							visible[index * 2] = visible[index * 2 + 1] = 1;
+						}
+					}
+				}
+				fputc(c, _file);
 			}
+			fputc('\n', _file);
 		}
-		//
+	}
+
+	void BuddySystemAllocator::recordFree(size_t _index) {
+		NIX_BUDDY_STAT(
+			m_bytesInUse -= m_capacity >> layerOfIndex(_index);
+			m_bytesRequested -= m_requestedSizes[_index];
+			m_requestedSizes[_index] = 0;
+			--m_liveAllocations;
+			++m_freeCount;
+		)
+		(void)_index;
+	}
+
+	size_t BuddySystemAllocator::layerForSize(size_t _size) const {
+		size_t layer = 0;
+		while (layer < m_maxLayer && (m_capacity >> (layer + 1)) >= _size) {
+			++layer;
+		}
+		return layer;
+	}
+
+	void BuddySystemAllocator::pushFree(size_t _index, size_t _layer) {
+		node_t& node = m_nodeTable[_index];
+		node.free = true;
+		node.hasChild = false;
+		node.allocated = false;
+		uint32_t head = m_freeHeads[_layer];
+		m_freePrev[_index] = 0;
+		m_freeNext[_index] = head;
+		if (head) {
+			m_freePrev[head] = (uint32_t)_index;
+		}
+		m_freeHeads[_layer] = (uint32_t)_index;
+	}
+
+	size_t BuddySystemAllocator::popFree(size_t _layer) {
+		size_t index = m_freeHeads[_layer];
+		assert(index);
+		unlinkFree(index, _layer);
+		return index;
+	}
+
+	void BuddySystemAllocator::unlinkFree(size_t _index, size_t _layer) {
+		uint32_t prev = m_freePrev[_index];
+		uint32_t next = m_freeNext[_index];
+		if (prev) {
+			m_freeNext[prev] = next;
+		} else {
+			m_freeHeads[_layer] = next;
+		}
+		if (next) {
+			m_freePrev[next] = prev;
+		}
+		m_freePrev[_index] = m_freeNext[_index] = 0;
+		m_nodeTable[_index].free = false;
+	}
+
+	bool BuddySystemAllocator::updateTableForAllocate(size_t _index, size_t _layer, size_t _targetLayer, size_t& index_)
+	{
+		// split the block down to the target layer, the right halves go back to the free lists
+		size_t index = _index;
 		size_t layer = _layer;
+		while (layer < _targetLayer) {
+			m_nodeTable[index].hasChild = true;
+			index <<= 1;
+			++layer;
+			pushFree(index + 1, layer);
+		}
+		node_t& node = m_nodeTable[index];
+		node.free = false;
+		node.hasChild = false;
+		node.allocated = true;
+		node.generation = node.generation + 1;
+		index_ = index;
+		return true;
+	}
+
+	bool BuddySystemAllocator::updateTableForFree(size_t _index, size_t _layer)
+	{
+		m_nodeTable[_index].allocated = false;
+		// merge with the buddy as long as the buddy is a whole free block
 		size_t index = _index;
+		size_t layer = _layer;
 		while (layer) {
-			auto& leftNode = m_nodeTable[(index >> 1) << 1];
-			auto& rightNode = m_nodeTable[((index >> 1) << 1) + 1];
-			auto& parentNode = m_nodeTable[index / 2];
-			if (leftNode.free && rightNode.free) {
-				parentNode.free = true;
-				parentNode.hasChild = false;
-				--layer;
-				index = index >> 1;
-			}
-			else
-			{
+			size_t buddy = index ^ 0x1;
+			if (!m_nodeTable[buddy].free) {
 				break;
 			}
+			unlinkFree(buddy, layer);
+			index >>= 1;
+			--layer;
 		}
+		pushFree(index, layer);
 		return true;
 	}
 
-}
\ No newline at end of file
+}
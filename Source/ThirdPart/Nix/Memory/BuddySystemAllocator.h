@@ -1,38 +1,170 @@
+#pragma once
+
 #include <vector>
 #include <list>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+
+// counters of BuddySystemAllocator::stats(), define to 0 to compile them out of allocate/free
+#ifndef NIX_BUDDY_ALLOCATOR_STATS
+#define NIX_BUDDY_ALLOCATOR_STATS 1
+#endif
 
 namespace Nix {
 
+	// allocation handle : node index in the low 56 bits, node generation in the high 8 bits
+	typedef uint64_t BuddyHandle;
+	static const BuddyHandle InvalidBuddyHandle = 0;
+
+	struct BuddyAllocation {
+		size_t offset;
+		size_t size;
+		BuddyHandle handle;
+	};
+
+	// one relocation of a compaction plan, the moves of a plan must be carried out in order
+	struct BuddyMove {
+		size_t srcOffset;
+		size_t dstOffset;
+		size_t size;
+		BuddyHandle oldHandle;
+		BuddyHandle newHandle;
+	};
+	// lets the owner of a block patch its offset and handle
+	typedef std::function<void(const BuddyMove&)> BuddyRelocateCB;
+
+	struct BuddyAllocatorStats {
+		static const size_t MaxLayerCount = 64;
+		size_t capacity;
+		size_t minBlockSize;
+		size_t largestFreeBlock;			// largest size a single allocate() can succeed with
+		size_t freeBlocks[MaxLayerCount];	// free block count per layer, layer 0 is the whole heap
+		size_t layerCount;
+		// the following are only counted when NIX_BUDDY_ALLOCATOR_STATS is on
+		size_t bytesInUse;					// sum of the handed out block sizes
+		size_t bytesRequested;				// sum of the sizes asked for by the live allocations
+		size_t bytesWasted;					// internal rounding : bytesInUse - bytesRequested
+		size_t liveAllocations;
+		uint64_t allocationCount;
+		uint64_t failedAllocationCount;
+		uint64_t freeCount;
+	};
+
 	class BuddySystemAllocator {
 		enum node_type_t {
 			LeftNode = 0,
 			RightNode
 		};
 		struct node_t {
-			uint8_t free : 1;
-			uint8_t hasChild : 1;
-			uint8_t leftFree : 1;
-			uint8_t rightFree : 1;
-			uint8_t nodeType : 1;
+			uint16_t free : 1;		// node is a whole free block and is linked in m_freeHeads[layer]
+			uint16_t hasChild : 1;	// node has been split into two buddies
+			uint16_t allocated : 1;	// node is handed out to a user
+			uint16_t nodeType : 1;
+			uint16_t generation : 8;	// bumped on every allocation of the node, the 8 bits a handle carries
 		};
+		static const uint64_t HandleIndexMask = ((uint64_t)1 << 56) - 1;
 	private:
 		std::vector<node_t> m_nodeTable; // m_nodeTable[0] is not used
+		// per-layer intrusive free lists, index 0 is the list terminator
+		std::vector<uint32_t> m_freeHeads;
+		std::vector<uint32_t> m_freePrev;
+		std::vector<uint32_t> m_freeNext;
+		// scratch space of the batch operations, kept to avoid heap traffic per frame
+		std::vector<size_t> m_batchOrder;
+		std::vector<uint32_t> m_batchPending;
+		std::vector<uint32_t> m_batchLevel;
+		std::vector<uint32_t> m_batchParents;
+		std::vector<uint32_t> m_compactCandidates;
 		//
 		size_t m_capacity;
 		size_t m_minSize;
 		size_t m_maxIndex;
+		size_t m_maxLayer;
+#if NIX_BUDDY_ALLOCATOR_STATS
+		std::vector<size_t> m_requestedSizes;	// per node, size asked for by the live allocation
+		size_t m_bytesInUse;
+		size_t m_bytesRequested;
+		size_t m_liveAllocations;
+		uint64_t m_allocationCount;
+		uint64_t m_failedAllocationCount;
+		uint64_t m_freeCount;
+#endif
 	public:
-		BuddySystemAllocator() 
+		BuddySystemAllocator()
 		: m_capacity(0)
 		, m_minSize(0)
-		, m_maxIndex(0) {
+		, m_maxIndex(0)
+		, m_maxLayer(0)
+#if NIX_BUDDY_ALLOCATOR_STATS
+		, m_bytesInUse(0)
+		, m_bytesRequested(0)
+		, m_liveAllocations(0)
+		, m_allocationCount(0)
+		, m_failedAllocationCount(0)
+		, m_freeCount(0)
+#endif
+		{
 		}
 		bool initialize(size_t _wholeSize, size_t _minSize );
-		bool allocate(size_t _size, size_t& offset_, uint16_t& _id );
-		bool free( uint16_t _id );
+		bool allocate(size_t _size, size_t& offset_, BuddyHandle& handle_ );
+		bool free( BuddyHandle _handle );
+		// Allocates all `_count` blocks or none of them, larger blocks are served first. On failure
+		// every handle is InvalidBuddyHandle and the heap and its stats are as before the call, but
+		// for one more failed allocation.
+		bool allocateBatch(const size_t* _sizes, size_t _count, BuddyAllocation* allocations_);
+		// frees the blocks layer by layer, so each tree node is visited once per batch
+		void freeBatch(const BuddyAllocation* _allocations, size_t _count);
+		// whether `_handle` refers to a block that is currently allocated
+		bool validate( BuddyHandle _handle ) const;
+		// handle of the block allocated at node `_index`, InvalidBuddyHandle when that node isn't allocated
+		BuddyHandle handleOf(size_t _index) const;
+		// Plans at most `_maxBytes` of moves that put lonely blocks (allocated blocks whose buddy is free)
+		// next to each other, so that their old places merge into larger free blocks. The moves are
+		// applied to the table right away, appended to `moves_` and reported to `_relocate`.
+		// Returns the number of bytes the plan moves.
+		size_t planCompaction(size_t _maxBytes, std::vector<BuddyMove>& moves_, const BuddyRelocateCB& _relocate = nullptr);
+		// carries a plan out on a CPU copy of the heap
+		static void applyMoves(void* _heap, const BuddyMove* _moves, size_t _count);
+		//
+		BuddyAllocatorStats stats() const;
+		// raw copy of the node table, two bytes per node (node_t is a 16 bit bitfield), cheap enough to take every frame
+		void snapshot(std::vector<uint8_t>& nodes_) const;
+		// prints the tree layer by layer : 'F' free, 'A' allocated, 'S' split, '.' inside a parent block
+		void dumpNodeTable(FILE* _file) const;
+		//
+		size_t capacity() const { return m_capacity; }
+		size_t layerCount() const { return m_maxLayer + 1; }
+		size_t layerForSize(size_t _size) const;
+		size_t offsetOf(size_t _index) const {
+			size_t layer = layerOfIndex(_index);
+			return (_index - ((size_t)1 << layer)) * (m_capacity >> layer);
+		}
 	private:
-		bool updateTableForAllocate( node_t& _node, size_t _layer, size_t _index);
-		bool updateTableForFree(node_t& _node, size_t _layer, size_t _index);
+		void pushFree(size_t _index, size_t _layer);
+		size_t popFree(size_t _layer);
+		void unlinkFree(size_t _index, size_t _layer);
+		bool updateTableForAllocate(size_t _index, size_t _layer, size_t _targetLayer, size_t& index_);
+		bool updateTableForFree(size_t _index, size_t _layer);
+		void recordFree(size_t _index);
+	public:
+		static size_t indexOfHandle(BuddyHandle _handle) {
+			return (size_t)(_handle & HandleIndexMask);
+		}
+		static BuddyHandle makeHandle(size_t _index, uint8_t _generation) {
+			return ((uint64_t)_generation << 56) | (uint64_t)_index;
+		}
+		static uint8_t generationOfHandle(BuddyHandle _handle) {
+			return (uint8_t)(_handle >> 56);
+		}
+		static size_t layerOfIndex(size_t _index) {
+			size_t layer = 0;
+			while (_index >>= 1) {
+				++layer;
+			}
+			return layer;
+		}
 	};
 
-}
\ No newline at end of file
+}
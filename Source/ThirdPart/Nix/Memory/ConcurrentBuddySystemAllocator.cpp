@@ -0,0 +1,160 @@
+#include "ConcurrentBuddySystemAllocator.h"
+#include <cassert>
+
+namespace Nix {
+
+	bool ConcurrentBuddySystemAllocator::initialize(size_t _wholeSize, size_t _minSize) {
+		{
+			std::lock_guard<std::mutex> treeLock(m_treeMutex);
+			if (!m_allocator.initialize(_wholeSize, _minSize)) {
+				return false;
+			}
+		}
+		// magazine locks are always taken before the tree lock
+		size_t layerCount = m_allocator.layerCount();
+		for (auto& magazine : m_magazines) {
+			std::lock_guard<std::mutex> lock(magazine.mutex);
+			magazine.blocks.assign(layerCount * MagazineDepth, 0);
+			magazine.counts.assign(layerCount, 0);
+		}
+		m_stateCount = (size_t)2 << (layerCount - 1);
+		m_states.reset(new std::atomic<uint16_t>[m_stateCount]);
+		for (size_t i = 0; i < m_stateCount; ++i) {
+			m_states[i].store(0, std::memory_order_relaxed);
+		}
+		return true;
+	}
+
+	bool ConcurrentBuddySystemAllocator::allocate(size_t _size, size_t& offset_, BuddyHandle& handle_) {
+		if (!_size || _size > m_allocator.capacity()) {
+			return false;
+		}
+		size_t layer = m_allocator.layerForSize(_size);
+		size_t owner = threadMagazine();
+		if (layer >= MagazineMinLayer) {
+			magazine_t& magazine = m_magazines[owner];
+			uint32_t index = 0;
+			{
+				std::lock_guard<std::mutex> lock(magazine.mutex);
+				uint8_t& count = magazine.counts[layer];
+				if (count) {
+					--count;
+					index = magazine.blocks[layer * MagazineDepth + count];
+				}
+			}
+			if (index) {
+				handle_ = claim(index, owner);
+				offset_ = m_allocator.offsetOf(index);
+				return true;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> treeLock(m_treeMutex);
+			if (m_allocator.allocate(_size, offset_, handle_)) {
+				handle_ = claim(BuddySystemAllocator::indexOfHandle(handle_), owner);
+				return true;
+			}
+		}
+		// the tree is exhausted, the missing space may be parked in the magazines
+		flush();
+		std::lock_guard<std::mutex> treeLock(m_treeMutex);
+		if (!m_allocator.allocate(_size, offset_, handle_)) {
+			return false;
+		}
+		handle_ = claim(BuddySystemAllocator::indexOfHandle(handle_), owner);
+		return true;
+	}
+
+	bool ConcurrentBuddySystemAllocator::free(BuddyHandle _handle) {
+		size_t index = BuddySystemAllocator::indexOfHandle(_handle);
+		if (!index || index >= m_stateCount) {
+			assert(false && "invalid buddy handle");
+			return false;
+		}
+		size_t layer = BuddySystemAllocator::layerOfIndex(index);
+		bool cache = layer >= MagazineMinLayer;
+		uint16_t expected = StateLive | BuddySystemAllocator::generationOfHandle(_handle);
+		// only one free can take the block out of the user's hands
+		std::atomic<uint16_t>& state = m_states[index];
+		uint16_t current = state.load(std::memory_order_acquire);
+		uint16_t released;
+		do {
+			if ((current & (StateLive | StateGenerationMask)) != expected) {
+				assert(false && "invalid buddy handle or double free");
+				return false;
+			}
+			released = (uint16_t)((current & ~StateLive) | (cache ? StateCached : 0));
+		} while (!state.compare_exchange_weak(current, released, std::memory_order_acq_rel, std::memory_order_acquire));
+		if (!cache) {
+			std::lock_guard<std::mutex> treeLock(m_treeMutex);
+			return m_allocator.free(m_allocator.handleOf(index));
+		}
+		magazine_t& magazine = m_magazines[released >> StateMagazineShift];
+		std::lock_guard<std::mutex> lock(magazine.mutex);
+		uint8_t& count = magazine.counts[layer];
+		uint32_t* blocks = &magazine.blocks[layer * MagazineDepth];
+		if (count == MagazineDepth) {
+			// magazine is full, return its older half to the tree in one go
+			size_t half = MagazineDepth / 2;
+			{
+				std::lock_guard<std::mutex> treeLock(m_treeMutex);
+				releaseCached(blocks, half);
+			}
+			for (size_t i = half; i < MagazineDepth; ++i) {
+				blocks[i - half] = blocks[i];
+			}
+			count = (uint8_t)(MagazineDepth - half);
+		}
+		blocks[count] = (uint32_t)index;
+		++count;
+		return true;
+	}
+
+	bool ConcurrentBuddySystemAllocator::validate(BuddyHandle _handle) const {
+		size_t index = BuddySystemAllocator::indexOfHandle(_handle);
+		if (!index || index >= m_stateCount) {
+			return false;
+		}
+		uint16_t state = m_states[index].load(std::memory_order_acquire);
+		return (state & (StateLive | StateGenerationMask)) == (StateLive | BuddySystemAllocator::generationOfHandle(_handle));
+	}
+
+	void ConcurrentBuddySystemAllocator::flush() {
+		for (auto& magazine : m_magazines) {
+			flushMagazine(magazine);
+		}
+	}
+
+	size_t ConcurrentBuddySystemAllocator::threadMagazine() const {
+		static std::atomic<uint32_t> threadCounter(0);
+		thread_local uint32_t threadIndex = threadCounter.fetch_add(1, std::memory_order_relaxed);
+		return threadIndex % MagazineCount;
+	}
+
+	BuddyHandle ConcurrentBuddySystemAllocator::claim(size_t _index, size_t _magazine) {
+		// nobody else can reach the block : it just left the tree or the magazine. Every hand out
+		// gets the next generation, whichever way the block came back, so the handles of earlier
+		// owners stop matching (the tree's own generation doesn't move while a block is cached)
+		std::atomic<uint16_t>& state = m_states[_index];
+		uint8_t generation = (uint8_t)((state.load(std::memory_order_relaxed) & StateGenerationMask) + 1);
+		state.store((uint16_t)(StateLive | generation | (_magazine << StateMagazineShift)), std::memory_order_release);
+		return BuddySystemAllocator::makeHandle(_index, generation);
+	}
+
+	void ConcurrentBuddySystemAllocator::releaseCached(const uint32_t* _blocks, size_t _count) {
+		for (size_t i = 0; i < _count; ++i) {
+			m_states[_blocks[i]].fetch_and((uint16_t)~StateCached, std::memory_order_relaxed);
+			m_allocator.free(m_allocator.handleOf(_blocks[i]));
+		}
+	}
+
+	void ConcurrentBuddySystemAllocator::flushMagazine(magazine_t& _magazine) {
+		std::lock_guard<std::mutex> lock(_magazine.mutex);
+		std::lock_guard<std::mutex> treeLock(m_treeMutex);
+		for (size_t layer = 0; layer < _magazine.counts.size(); ++layer) {
+			releaseCached(&_magazine.blocks[layer * MagazineDepth], _magazine.counts[layer]);
+			_magazine.counts[layer] = 0;
+		}
+	}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "BuddySystemAllocator.h"
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+namespace Nix {
+
+	// BuddySystemAllocator that can be shared by several threads.
+	// The tree is neither lock-free nor split : every tree operation takes the one `m_treeMutex`.
+	// What keeps that lock cold are the `MagazineCount` magazines in front of it, each with its own
+	// mutex and a few recently freed blocks per layer. A thread is given magazine
+	// (registration order % MagazineCount), so up to 16 threads each have one to themselves and
+	// more threads share them. Blocks that sit in a magazine are still marked as allocated in the
+	// tree, so the tree never hands them out a second time, and most allocate/free pairs of blocks
+	// up to (capacity >> MagazineMinLayer) never touch the tree lock.
+	// A freed block goes back to the magazine of the thread that allocated it, so blocks that
+	// workers allocate and the render thread frees are reused by the same workers.
+	// Who owns a block is tracked in one atomic word per node : a free moves the block out of
+	// the user's hands with a compare-exchange, so a double free is caught whichever threads
+	// the two frees come from, and handles are checked without taking the tree lock.
+	// ConcurrentBuddyAllocatorBenchmark compares it with the plain allocator behind one mutex.
+	class ConcurrentBuddySystemAllocator {
+	public:
+		static const size_t MagazineCount = 16;
+		static const size_t MagazineDepth = 8;
+		// blocks larger than (capacity >> MagazineMinLayer) always go straight back to the tree
+		static const size_t MagazineMinLayer = 4;
+	private:
+		// node state word
+		static const uint16_t StateGenerationMask = 0x00ff;	// generation of the outstanding handle
+		static const uint16_t StateLive = 0x0100;			// handed out to a user
+		static const uint16_t StateCached = 0x0200;			// parked in a magazine
+		static const uint16_t StateMagazineShift = 12;		// magazine of the thread that allocated the block
+		struct alignas(64) magazine_t {
+			std::mutex mutex;
+			std::vector<uint32_t> blocks;	// node indices, layerCount * MagazineDepth
+			std::vector<uint8_t> counts;	// layerCount
+		};
+	private:
+		BuddySystemAllocator m_allocator;
+		std::mutex m_treeMutex;
+		std::unique_ptr<std::atomic<uint16_t>[]> m_states;
+		size_t m_stateCount;
+		magazine_t m_magazines[MagazineCount];
+		static_assert(MagazineCount <= (0x10000 >> StateMagazineShift), "magazine index doesn't fit the node state");
+	public:
+		ConcurrentBuddySystemAllocator()
+		: m_stateCount(0) {
+		}
+		ConcurrentBuddySystemAllocator(const ConcurrentBuddySystemAllocator&) = delete;
+		ConcurrentBuddySystemAllocator& operator=(const ConcurrentBuddySystemAllocator&) = delete;
+
+		bool initialize(size_t _wholeSize, size_t _minSize);
+		bool allocate(size_t _size, size_t& offset_, BuddyHandle& handle_);
+		// a stale handle or a double free fails here, whichever thread the block went to
+		bool free(BuddyHandle _handle);
+		// whether `_handle` refers to a block that is currently handed out
+		bool validate(BuddyHandle _handle) const;
+		// give every cached block back to the tree, so that they can merge again
+		void flush();
+	private:
+		size_t threadMagazine() const;
+		BuddyHandle claim(size_t _index, size_t _magazine);
+		// gives the cached blocks back to the tree, the caller holds the magazine and the tree lock
+		void releaseCached(const uint32_t* _blocks, size_t _count);
+		void flushMagazine(magazine_t& _magazine);
+	};
+
+}
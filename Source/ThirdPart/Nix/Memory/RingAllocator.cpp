@@ -0,0 +1,81 @@
+#include "RingAllocator.h"
+#include <cassert>
+
+namespace Nix {
+
+	bool RingAllocator::initialize(size_t _wholeSize) {
+		if (!_wholeSize) {
+			return false;
+		}
+		m_frames.clear();
+		m_capacity = _wholeSize;
+		m_head = m_tail = 0;
+		m_used = 0;
+		m_frameSize = 0;
+		return true;
+	}
+
+	bool RingAllocator::allocate(size_t _size, size_t _alignment, size_t& offset_) {
+		assert(_alignment && !(_alignment & (_alignment - 1)));
+		if (!_size || _size > m_capacity) {
+			return false;
+		}
+		if (!m_used) {
+			// nothing in flight, start over from the beginning to get the longest free run
+			m_head = m_tail = 0;
+		}
+		size_t offset = (m_head + _alignment - 1) & ~(_alignment - 1);
+		if (m_head >= m_tail && m_used != m_capacity) {
+			// free space is [head, capacity) and [0, tail)
+			if (offset + _size > m_capacity) {
+				// does not fit at the end, skip the rest of the region and wrap around
+				offset = 0;
+				if (_size > m_tail) {
+					return false;
+				}
+			}
+		} else {
+			// free space is [head, tail)
+			if (m_used == m_capacity || offset + _size > m_tail) {
+				return false;
+			}
+		}
+		size_t end = offset + _size;
+		size_t taken = end >= m_head ? end - m_head : (m_capacity - m_head) + end;
+		m_head = end == m_capacity ? 0 : end;
+		m_used += taken;
+		m_frameSize += taken;
+		offset_ = offset;
+		return true;
+	}
+
+	void RingAllocator::finishFrame(uint64_t _fenceValue) {
+		frame_t frame;
+		frame.fenceValue = _fenceValue;
+		frame.end = m_head;
+		frame.size = m_frameSize;
+		m_frames.push_back(frame);
+		m_frameSize = 0;
+	}
+
+	void RingAllocator::retire(uint64_t _completedFenceValue) {
+		while (!m_frames.empty() && m_frames.front().fenceValue <= _completedFenceValue) {
+			const frame_t& frame = m_frames.front();
+			if (frame.size) {
+				// an empty frame may carry a head position from before the last rewind
+				m_tail = frame.end;
+			}
+			m_used -= frame.size;
+			m_frames.pop_front();
+		}
+	}
+
+	bool UploadHeapAllocator::initialize(size_t _wholeSize, size_t _ringSize, size_t _minBlockSize) {
+		if (_ringSize >= _wholeSize) {
+			return false;
+		}
+		m_ringSize = _ringSize;
+		return m_ring.initialize(_ringSize) && m_buddy.initialize(_wholeSize - _ringSize, _minBlockSize);
+	}
+
+}
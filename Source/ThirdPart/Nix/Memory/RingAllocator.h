@@ -0,0 +1,80 @@
+#pragma once
+
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+#include "BuddySystemAllocator.h"
+
+namespace Nix {
+
+	// Bump pointer allocator over one region, for data that lives exactly as long as its frame.
+	// Every frame is closed with the fence value the GPU signals when it is done with it,
+	// `retire` hands back all frames whose fence has completed in one step.
+	class RingAllocator {
+		struct frame_t {
+			uint64_t fenceValue;
+			size_t end;		// head position when the frame was closed
+			size_t size;	// bytes taken by the frame, including alignment and wrap padding
+		};
+	private:
+		std::deque<frame_t> m_frames;
+		size_t m_capacity;
+		size_t m_head;
+		size_t m_tail;
+		size_t m_used;
+		size_t m_frameSize;
+	public:
+		RingAllocator()
+		: m_capacity(0)
+		, m_head(0)
+		, m_tail(0)
+		, m_used(0)
+		, m_frameSize(0) {
+		}
+		bool initialize(size_t _wholeSize);
+		// `_alignment` must be a power of two, e.g. 256 for constant buffers
+		bool allocate(size_t _size, size_t _alignment, size_t& offset_);
+		// closes the current frame, its memory comes back once `_fenceValue` is retired
+		void finishFrame(uint64_t _fenceValue);
+		void retire(uint64_t _completedFenceValue);
+		//
+		size_t capacity() const { return m_capacity; }
+		size_t used() const { return m_used; }
+	};
+
+	// One upload heap split in two : the front part is a RingAllocator for per-frame data,
+	// the rest is a BuddySystemAllocator for the blocks that outlive their frame.
+	class UploadHeapAllocator {
+	private:
+		RingAllocator m_ring;
+		BuddySystemAllocator m_buddy;
+		size_t m_ringSize;
+	public:
+		UploadHeapAllocator()
+		: m_ringSize(0) {
+		}
+		bool initialize(size_t _wholeSize, size_t _ringSize, size_t _minBlockSize);
+		bool allocateTransient(size_t _size, size_t _alignment, size_t& offset_) {
+			return m_ring.allocate(_size, _alignment, offset_);
+		}
+		bool allocatePersistent(size_t _size, size_t& offset_, BuddyHandle& handle_) {
+			if (!m_buddy.allocate(_size, offset_, handle_)) {
+				return false;
+			}
+			offset_ += m_ringSize;
+			return true;
+		}
+		bool freePersistent(BuddyHandle _handle) {
+			return m_buddy.free(_handle);
+		}
+		void finishFrame(uint64_t _fenceValue) {
+			m_ring.finishFrame(_fenceValue);
+		}
+		void retire(uint64_t _completedFenceValue) {
+			m_ring.retire(_completedFenceValue);
+		}
+		RingAllocator& ring() { return m_ring; }
+		BuddySystemAllocator& buddy() { return m_buddy; }
+	};
+
+}
@@ -0,0 +1,240 @@
+#include "TLSFAllocator.h"
+#include <cassert>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Nix {
+
+	static inline uint32_t BitScanLow(uint64_t _v) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, _v);
+		return (uint32_t)index;
+#else
+		return (uint32_t)__builtin_ctzll(_v);
+#endif
+	}
+
+	static inline uint32_t BitScanHigh(uint64_t _v) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse64(&index, _v);
+		return (uint32_t)index;
+#else
+		return (uint32_t)(63 - __builtin_clzll(_v));
+#endif
+	}
+
+	bool TLSFAllocator::initialize(size_t _wholeSize, size_t _minSize, size_t _maxAllocations) {
+		if (!_minSize || (_minSize & (_minSize - 1)) || _wholeSize < _minSize || !_maxAllocations) {
+			return false;
+		}
+		size_t units = _wholeSize / _minSize;
+		if (BitScanHigh(units) >= 63) {
+			return false;
+		}
+		// headers for the live allocations and the free blocks between them, but never more than
+		// the `units` blocks the heap can be cut into
+		size_t blockCount = _maxAllocations < units / 2 ? _maxAllocations * 2 + 1 : units;
+		if (blockCount >= UINT32_MAX) {
+			return false;
+		}
+		m_capacity = units * _minSize;
+		m_minSize = _minSize;
+		m_usedBytes = 0;
+		m_flBitmap = 0;
+		memset(m_slBitmap, 0, sizeof(m_slBitmap));
+		memset(m_freeHeads, 0, sizeof(m_freeHeads));
+		m_blocks.assign(blockCount + 1, block_t());
+		m_unusedBlocks.resize(blockCount);
+		for (size_t i = 0; i < blockCount; ++i) {
+			m_unusedBlocks[i] = (uint32_t)(blockCount - i);
+		}
+		//
+		uint32_t whole = createBlock();
+		block_t& block = m_blocks[whole];
+		block.offset = 0;
+		block.size = m_capacity;
+		insertFree(whole);
+		return true;
+	}
+
+	bool TLSFAllocator::allocate(size_t _size, size_t& offset_, TLSFHandle& handle_) {
+		if (!_size || _size > m_capacity) {
+			return false;
+		}
+		size_t units = (_size + m_minSize - 1) / m_minSize;
+		uint32_t index = findFree(units);
+		if (!index) {
+			return false;
+		}
+		removeFree(index);
+		size_t size = units * m_minSize;
+		uint32_t rest = m_blocks[index].size > size ? createBlock() : 0;
+		if (rest) {
+			// split off the tail as a new free block
+			block_t& block = m_blocks[index];
+			block_t& restBlock = m_blocks[rest];
+			restBlock.offset = block.offset + size;
+			restBlock.size = block.size - size;
+			restBlock.prevPhys = index;
+			restBlock.nextPhys = block.nextPhys;
+			if (block.nextPhys) {
+				m_blocks[block.nextPhys].prevPhys = rest;
+			}
+			block.nextPhys = rest;
+			block.size = size;
+			insertFree(rest);
+		}
+		block_t& block = m_blocks[index];
+		block.free = false;
+		++block.generation;
+		m_usedBytes += block.size;
+		offset_ = block.offset;
+		handle_ = ((uint64_t)block.generation << 32) | index;
+		return true;
+	}
+
+	bool TLSFAllocator::free(TLSFHandle _handle) {
+		if (!validate(_handle)) {
+			assert(false && "invalid tlsf handle or double free");
+			return false;
+		}
+		uint32_t index = (uint32_t)_handle;
+		m_usedBytes -= m_blocks[index].size;
+		m_blocks[index].free = true;
+		// merge with the physical neighbours
+		uint32_t prev = m_blocks[index].prevPhys;
+		if (prev && m_blocks[prev].free) {
+			removeFree(prev);
+			block_t& prevBlock = m_blocks[prev];
+			block_t& block = m_blocks[index];
+			prevBlock.size += block.size;
+			prevBlock.nextPhys = block.nextPhys;
+			if (block.nextPhys) {
+				m_blocks[block.nextPhys].prevPhys = prev;
+			}
+			destroyBlock(index);
+			index = prev;
+		}
+		uint32_t next = m_blocks[index].nextPhys;
+		if (next && m_blocks[next].free) {
+			removeFree(next);
+			block_t& block = m_blocks[index];
+			block_t& nextBlock = m_blocks[next];
+			block.size += nextBlock.size;
+			block.nextPhys = nextBlock.nextPhys;
+			if (nextBlock.nextPhys) {
+				m_blocks[nextBlock.nextPhys].prevPhys = index;
+			}
+			destroyBlock(next);
+		}
+		insertFree(index);
+		return true;
+	}
+
+	bool TLSFAllocator::validate(TLSFHandle _handle) const {
+		uint32_t index = (uint32_t)_handle;
+		if (!index || index >= m_blocks.size()) {
+			return false;
+		}
+		const block_t& block = m_blocks[index];
+		return block.size && !block.free && block.generation == (uint32_t)(_handle >> 32);
+	}
+
+	void TLSFAllocator::mapping(size_t _units, uint32_t& fl_, uint32_t& sl_) const {
+		if (_units < SLCount) {
+			fl_ = 0;
+			sl_ = (uint32_t)_units;
+		} else {
+			uint32_t high = BitScanHigh(_units);
+			fl_ = high - SLLog2 + 1;
+			sl_ = (uint32_t)(_units >> (high - SLLog2)) - SLCount;
+		}
+	}
+
+	uint32_t TLSFAllocator::findFree(size_t _units) const {
+		// round up to the next size class, so that any block of the class found fits
+		if (_units >= SLCount) {
+			_units += ((size_t)1 << (BitScanHigh(_units) - SLLog2)) - 1;
+		}
+		uint32_t fl, sl;
+		mapping(_units, fl, sl);
+		if (fl >= FLCount) {
+			return 0;
+		}
+		uint32_t slMap = m_slBitmap[fl] & (~0u << sl);
+		if (!slMap) {
+			uint64_t flMap = fl + 1 < 64 ? m_flBitmap & (~0ull << (fl + 1)) : 0;
+			if (!flMap) {
+				return 0;
+			}
+			fl = BitScanLow(flMap);
+			slMap = m_slBitmap[fl];
+		}
+		sl = BitScanLow(slMap);
+		return m_freeHeads[fl][sl];
+	}
+
+	void TLSFAllocator::insertFree(uint32_t _block) {
+		block_t& block = m_blocks[_block];
+		uint32_t fl, sl;
+		mapping(block.size / m_minSize, fl, sl);
+		uint32_t head = m_freeHeads[fl][sl];
+		block.free = true;
+		block.prevFree = 0;
+		block.nextFree = head;
+		if (head) {
+			m_blocks[head].prevFree = _block;
+		}
+		m_freeHeads[fl][sl] = _block;
+		m_slBitmap[fl] |= 1u << sl;
+		m_flBitmap |= 1ull << fl;
+	}
+
+	void TLSFAllocator::removeFree(uint32_t _block) {
+		block_t& block = m_blocks[_block];
+		uint32_t fl, sl;
+		mapping(block.size / m_minSize, fl, sl);
+		if (block.prevFree) {
+			m_blocks[block.prevFree].nextFree = block.nextFree;
+		} else {
+			m_freeHeads[fl][sl] = block.nextFree;
+			if (!block.nextFree) {
+				m_slBitmap[fl] &= ~(1u << sl);
+				if (!m_slBitmap[fl]) {
+					m_flBitmap &= ~(1ull << fl);
+				}
+			}
+		}
+		if (block.nextFree) {
+			m_blocks[block.nextFree].prevFree = block.prevFree;
+		}
+		block.prevFree = block.nextFree = 0;
+		block.free = false;
+	}
+
+	uint32_t TLSFAllocator::createBlock() {
+		if (m_unusedBlocks.empty()) {
+			return 0;
+		}
+		uint32_t index = m_unusedBlocks.back();
+		m_unusedBlocks.pop_back();
+		block_t& block = m_blocks[index];
+		uint32_t generation = block.generation;
+		memset(&block, 0, sizeof(block));
+		block.generation = generation;
+		return index;
+	}
+
+	void TLSFAllocator::destroyBlock(uint32_t _block) {
+		block_t& block = m_blocks[_block];
+		block.size = 0;
+		block.free = false;
+		m_unusedBlocks.push_back(_block);
+	}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Nix {
+
+	// allocation handle : block index in the low 32 bits, block generation in the high 32 bits
+	typedef uint64_t TLSFHandle;
+	static const TLSFHandle InvalidTLSFHandle = 0;
+
+	// Two-level segregated fit allocator over an offset range, e.g. a GPU heap.
+	// Sizes are rounded to `_minSize` granules only, not to powers of two, and both allocate
+	// and free run in bounded time : two bitmap scans and a constant number of list updates.
+	// Block headers live in a side table, nothing is written into the managed memory. The table is
+	// sized once in initialize : free blocks are never physical neighbours, so `_maxAllocations` live
+	// allocations need at most 2 * _maxAllocations + 1 headers. Past that count a block is handed
+	// out without splitting off its tail, the table never grows.
+	class TLSFAllocator {
+		static const uint32_t SLLog2 = 4;
+		static const uint32_t SLCount = 1 << SLLog2;
+		static const uint32_t FLCount = 64 - SLLog2;
+
+		struct block_t {
+			size_t offset;
+			size_t size;
+			uint32_t prevPhys;	// physical neighbours, 0 when there is none
+			uint32_t nextPhys;
+			uint32_t prevFree;	// links in the free list of the block's size class
+			uint32_t nextFree;
+			uint32_t generation;
+			uint8_t free;
+		};
+	private:
+		std::vector<block_t> m_blocks;		// m_blocks[0] is not used
+		std::vector<uint32_t> m_unusedBlocks;	// free slots of m_blocks
+		uint64_t m_flBitmap;
+		uint32_t m_slBitmap[FLCount];
+		uint32_t m_freeHeads[FLCount][SLCount];
+		//
+		size_t m_capacity;
+		size_t m_minSize;
+		size_t m_usedBytes;
+	public:
+		TLSFAllocator()
+		: m_flBitmap(0)
+		, m_capacity(0)
+		, m_minSize(0)
+		, m_usedBytes(0) {
+		}
+		static const size_t DefaultMaxAllocations = 16 * 1024;
+		// `_minSize` is the allocation granularity and alignment
+		bool initialize(size_t _wholeSize, size_t _minSize, size_t _maxAllocations = DefaultMaxAllocations);
+		bool allocate(size_t _size, size_t& offset_, TLSFHandle& handle_);
+		bool free(TLSFHandle _handle);
+		bool validate(TLSFHandle _handle) const;
+		//
+		size_t capacity() const { return m_capacity; }
+		size_t usedBytes() const { return m_usedBytes; }
+	private:
+		void mapping(size_t _units, uint32_t& fl_, uint32_t& sl_) const;
+		uint32_t findFree(size_t _units) const;
+		void insertFree(uint32_t _block);
+		void removeFree(uint32_t _block);
+		uint32_t createBlock();
+		void destroyBlock(uint32_t _block);
+	};
+
+}
@@ -0,0 +1,220 @@
+#include "Profiler.h"
+#include "../Timer/Timer.h"
+#include "../IO/FileWriter.h"
+#include <atomic>
+#include <algorithm>
+#include <stdio.h>
+
+namespace Nix
+{
+    ProfileThread::ProfileThread( uint32_t _index )
+        : head(0)
+        , cachedTail(0)
+        , depth(0)
+        , tsc(Timer::ticksAreTsc())
+        , dropped(0)
+        , tail(0)
+        , index(_index)
+    {
+    }
+
+    static thread_local Profiler* LocalProfiler = nullptr;
+    static thread_local ProfileThread* LocalThread = nullptr;
+
+    Profiler::Profiler()
+    {
+    }
+
+    Profiler::~Profiler()
+    {
+    }
+
+    ProfileThread* Profiler::currentThread()
+    {
+        if( LocalProfiler == this )
+            return LocalThread;
+        std::lock_guard<std::mutex> lock( _threadsMutex );
+        _threads.emplace_back( new ProfileThread( (uint32_t)_threads.size() ) );
+        LocalProfiler = this;
+        LocalThread = _threads.back().get();
+        return LocalThread;
+    }
+
+    void Profiler::setThreadName( const char* _name )
+    {
+        ProfileThread* thread = currentThread();
+        std::lock_guard<std::mutex> lock( _threadsMutex );
+        thread->name = _name;
+    }
+
+    uint64_t Profiler::droppedEvents()
+    {
+        std::lock_guard<std::mutex> lock( _threadsMutex );
+        uint64_t dropped = 0;
+        for( auto& thread : _threads )
+            dropped += thread->dropped.load( std::memory_order_relaxed );
+        return dropped;
+    }
+
+    void Profiler::endFrame()
+    {
+        uint64_t now = Timer::ticks();
+        uint32_t caller = currentThread()->index;
+        _drained.clear();
+        {
+            std::lock_guard<std::mutex> lock( _threadsMutex );
+            for( auto& thread : _threads )
+            {
+                uint32_t tail = thread->tail.load( std::memory_order_relaxed );
+                uint32_t head = thread->head.load( std::memory_order_acquire );
+                for( ; tail != head; ++tail )
+                {
+                    _drained.push_back( thread->events[tail & ( ProfileRingSize - 1 )] );
+                    _drained.back().thread = thread->index;
+                }
+                thread->tail.store( tail, std::memory_order_release );
+            }
+        }
+        _lastFrameNs = _frameBegin ? (uint64_t)( ( now - _frameBegin ) * Timer::nanosecondsPerTick() ) : 0;
+        if( _capturing )
+        {
+            if( _frameBegin && _captured.size() < _captureLimit )
+            {
+                ProfileEvent frame = { "Frame", _frameBegin, now, 0, caller };
+                _captured.push_back( frame );
+            }
+            size_t room = _captureLimit - std::min( _captureLimit, _captured.size() );
+            size_t count = std::min( room, _drained.size() );
+            _captured.insert( _captured.end(), _drained.begin(), _drained.begin() + count );
+        }
+        buildFrame();
+        _frameBegin = now;
+        ++_frameIndex;
+    }
+
+    void Profiler::buildFrame()
+    {
+        _lastFrame.clear();
+        _nodeIndex.clear();
+        // parents start no later than their children and sit one level up
+        std::sort( _drained.begin(), _drained.end(), []( const ProfileEvent& _a, const ProfileEvent& _b ) {
+            if( _a.thread != _b.thread )
+                return _a.thread < _b.thread;
+            if( _a.begin != _b.begin )
+                return _a.begin < _b.begin;
+            return _a.depth < _b.depth;
+        });
+        double nsPerTick = Timer::nanosecondsPerTick();
+        std::vector<int32_t> open;  // node of each open depth
+        uint32_t thread = UINT32_MAX;
+        for( const ProfileEvent& event : _drained )
+        {
+            if( event.thread != thread )
+            {
+                open.clear();
+                thread = event.thread;
+            }
+            // zones whose parent is still running attach to the closest drained ancestor
+            open.resize( std::min<size_t>( event.depth, open.size() ) );
+            int32_t parent = open.empty() ? -1 : open.back();
+            ProfileNodeKey key = { event.name, parent, thread };
+            auto found = _nodeIndex.insert( std::make_pair( key, (int32_t)_lastFrame.size() ) );
+            int32_t node = found.first->second;
+            if( found.second )
+            {
+                ProfileNode added = { event.name, parent, thread, (uint32_t)open.size(), 0, 0, 0 };
+                _lastFrame.push_back( added );
+            }
+            uint64_t duration = event.end > event.begin ? (uint64_t)( ( event.end - event.begin ) * nsPerTick ) : 0;
+            _lastFrame[node].calls++;
+            _lastFrame[node].totalNs += duration;
+            open.push_back( node );
+        }
+        for( ProfileNode& node : _lastFrame )
+            node.selfNs = node.totalNs;
+        for( const ProfileNode& node : _lastFrame )
+        {
+            if( node.parent < 0 )
+                continue;
+            uint64_t& self = _lastFrame[node.parent].selfNs;
+            self -= std::min( self, node.totalNs );
+        }
+    }
+
+    void Profiler::beginCapture( size_t _maxEvents )
+    {
+        _captured.clear();
+        _captured.reserve( std::min<size_t>( _maxEvents, 1 << 16 ) );
+        _captureLimit = _maxEvents;
+        _capturing = true;
+    }
+
+    static void AppendJsonString( std::string& json_, const char* _text )
+    {
+        json_.push_back( '"' );
+        for( const char* c = _text; *c; ++c )
+        {
+            if( *c == '"' || *c == '\\' )
+                json_.push_back( '\\' );
+            if( (unsigned char)*c >= 0x20 )
+                json_.push_back( *c );
+        }
+        json_.push_back( '"' );
+    }
+
+    bool Profiler::endCapture( const std::string& _path )
+    {
+        if( !_capturing )
+            return false;
+        _capturing = false;
+        uint64_t origin = UINT64_MAX;
+        for( const ProfileEvent& event : _captured )
+            origin = std::min( origin, event.begin );
+        double usPerTick = Timer::nanosecondsPerTick() / 1000.0;
+        std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        char number[128];
+        bool first = true;
+        {
+            std::lock_guard<std::mutex> lock( _threadsMutex );
+            for( auto& thread : _threads )
+            {
+                if( thread->name.empty() )
+                    continue;
+                snprintf( number, sizeof(number), "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":", first ? "" : ",", thread->index );
+                json.append( number );
+                AppendJsonString( json, thread->name.c_str() );
+                json.append( "}}" );
+                first = false;
+            }
+        }
+        for( const ProfileEvent& event : _captured )
+        {
+            json.append( first ? "{\"name\":" : ",\n{\"name\":" );
+            AppendJsonString( json, event.name );
+            snprintf( number, sizeof(number), ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                event.thread, ( event.begin - origin ) * usPerTick, ( event.end - event.begin ) * usPerTick );
+            json.append( number );
+            first = false;
+        }
+        json.append( "]}\n" );
+        _captured.clear();
+        _captured.shrink_to_fit();
+        return SaveFileAtomic( _path, json.data(), json.size(), FileWriterNoSync );
+    }
+
+    Profiler& SharedProfiler()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    ProfileThread* ProfileRegisterThread()
+    {
+        return ProfileScopeThread() = SharedProfiler().currentThread();
+    }
+
+    uint64_t ProfileTicks()
+    {
+        return Timer::ticks();
+    }
+}
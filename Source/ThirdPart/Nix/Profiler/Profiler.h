@@ -0,0 +1,220 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NIX_PROFILE_TSC 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// Build with NIX_PROFILER_ENABLED=0 (cmake -DNIX_PROFILER=OFF) to compile every zone out.
+#ifndef NIX_PROFILER_ENABLED
+#define NIX_PROFILER_ENABLED 1
+#endif
+
+#define NIX_PROFILE_CONCAT_IMPL(a, b) a##b
+#define NIX_PROFILE_CONCAT(a, b) NIX_PROFILE_CONCAT_IMPL(a, b)
+
+#if NIX_PROFILER_ENABLED
+// times the enclosing scope, `name` must be a string literal (only its address is recorded)
+#define NIX_PROFILE_SCOPE(name) Nix::ProfileScope NIX_PROFILE_CONCAT(nixProfileScope, __LINE__)(name)
+// closes the current frame, called once per frame by the thread that reads the results
+#define NIX_PROFILE_FRAME() Nix::SharedProfiler().endFrame()
+#else
+#define NIX_PROFILE_SCOPE(name) do {} while (0)
+#define NIX_PROFILE_FRAME() do {} while (0)
+#endif
+
+namespace Nix
+{
+    struct ProfileEvent
+    {
+        const char *name;
+        uint64_t begin;         // Timer::ticks
+        uint64_t end;
+        uint32_t depth;         // zones open on the thread when it started
+        uint32_t thread;        // profiler thread index
+    };
+
+    // one zone of the per frame tree, zones with the same name under the same parent are merged
+    struct ProfileNode
+    {
+        const char *name;
+        int32_t parent;         // index into the frame nodes, -1 for the root zones of a thread
+        uint32_t thread;
+        uint32_t depth;
+        uint32_t calls;
+        uint64_t totalNs;
+        uint64_t selfNs;        // total minus the child zones
+    };
+
+    // a frame node is found again by its name under the same parent of the same thread
+    struct ProfileNodeKey
+    {
+        const char *name;
+        int32_t parent;
+        uint32_t thread;
+
+        bool operator==(const ProfileNodeKey &other) const
+        {
+            return name == other.name && parent == other.parent && thread == other.thread;
+        }
+    };
+
+    struct ProfileNodeKeyHash
+    {
+        size_t operator()(const ProfileNodeKey &key) const
+        {
+            uint64_t hash = (uint64_t)(uintptr_t)key.name * 0x9E3779B97F4A7C15ull;
+            hash ^= ((uint64_t)(uint32_t)key.parent << 32 | key.thread) * 0xC2B2AE3D27D4EB4Full;
+            return (size_t)(hash ^ hash >> 29);
+        }
+    };
+
+    static const uint32_t ProfileRingSize = 1 << 14;    // zones per thread, a power of two
+
+    // Single producer (the owning thread), single consumer (endFrame) ring. Defined here so that
+    // zones open and close inline, only the first zone of a thread calls into the profiler.
+    struct ProfileThread
+    {
+        ProfileEvent events[ProfileRingSize];
+        // written by the producer
+        std::atomic<uint32_t> head;
+        uint32_t cachedTail;        // last `tail` seen, reloaded only when the ring looks full
+        uint32_t depth;
+        bool tsc;                   // Timer::ticks is the TSC, zones read it inline
+        std::atomic<uint64_t> dropped;
+        // written by the consumer, a cache line away from the producer's fields
+        char padding[64];
+        std::atomic<uint32_t> tail;
+        uint32_t index;
+        std::string name;
+
+        explicit ProfileThread(uint32_t index);
+    };
+
+    // Scoped CPU zone profiler. A zone costs two Timer::ticks reads and one store into a ring
+    // owned by the recording thread, no lock is taken. `endFrame` drains every ring, builds the
+    // frame tree and, while capturing, keeps the raw zones for a Chrome trace export (the JSON
+    // also loads in Perfetto). A full ring drops zones rather than wait, see `droppedEvents`.
+    // endFrame, the frame accessors and the capture calls belong to a single thread.
+    class Profiler
+    {
+    private:
+        std::mutex _threadsMutex;
+        std::vector<std::unique_ptr<ProfileThread>> _threads;  // never shrinks, rings outlive their thread
+        std::vector<ProfileEvent> _drained;
+        std::vector<ProfileNode> _lastFrame;
+        std::unordered_map<ProfileNodeKey, int32_t, ProfileNodeKeyHash> _nodeIndex;  // of _lastFrame, kept for its buckets
+        uint64_t _frameBegin = 0;
+        uint64_t _lastFrameNs = 0;
+        uint64_t _frameIndex = 0;
+        // capture
+        bool _capturing = false;
+        size_t _captureLimit = 0;
+        std::vector<ProfileEvent> _captured;
+
+    public:
+        Profiler();
+        ~Profiler();
+
+        // the calling thread's ring, registered on first use
+        ProfileThread *currentThread();
+        // shows up as the thread name in the trace
+        void setThreadName(const char *name);
+
+        void endFrame();
+        const std::vector<ProfileNode> &lastFrame() const { return _lastFrame; }
+        uint64_t lastFrameNanoseconds() const { return _lastFrameNs; }
+        uint64_t frameIndex() const { return _frameIndex; }
+        uint64_t droppedEvents();
+
+        // keeps up to `maxEvents` zones from the following frames
+        void beginCapture(size_t maxEvents = 1 << 20);
+        // writes the captured zones as Chrome trace JSON, ends the capture
+        bool endCapture(const std::string &path);
+        bool capturing() const { return _capturing; }
+
+    private:
+        void buildFrame();
+    };
+
+    Profiler &SharedProfiler();
+
+    // the shared profiler's ring of the calling thread, null until its first zone
+    inline ProfileThread *&ProfileScopeThread()
+    {
+        static thread_local ProfileThread *thread = nullptr;
+        return thread;
+    }
+    // registers the calling thread with the shared profiler
+    ProfileThread *ProfileRegisterThread();
+    // Timer::ticks, read inline when it is the TSC
+    uint64_t ProfileTicks();
+
+    inline uint64_t ProfileZoneTicks(const ProfileThread *thread)
+    {
+#if NIX_PROFILE_TSC
+        if (thread->tsc)
+            return __rdtsc();
+#else
+        (void)thread;
+#endif
+        return ProfileTicks();
+    }
+
+    class ProfileScope
+    {
+    private:
+        ProfileThread *_thread;
+        const char *_name;
+        uint64_t _begin;
+
+    public:
+        explicit ProfileScope(const char *name)
+            : _thread(ProfileScopeThread())
+            , _name(name)
+        {
+            if (!_thread)
+                _thread = ProfileRegisterThread();
+            ++_thread->depth;
+            _begin = ProfileZoneTicks(_thread);
+        }
+
+        ~ProfileScope()
+        {
+            ProfileThread *thread = _thread;
+            uint64_t end = ProfileZoneTicks(thread);
+            uint32_t depth = --thread->depth;
+            uint32_t head = thread->head.load(std::memory_order_relaxed);
+            if (head - thread->cachedTail >= ProfileRingSize)
+            {
+                thread->cachedTail = thread->tail.load(std::memory_order_acquire);
+                if (head - thread->cachedTail >= ProfileRingSize)
+                {
+                    thread->dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+            }
+            // the thread index is filled in when the ring is drained
+            ProfileEvent &event = thread->events[head & (ProfileRingSize - 1)];
+            event.name = _name;
+            event.begin = _begin;
+            event.end = end;
+            event.depth = depth;
+            thread->head.store(head + 1, std::memory_order_release);
+        }
+
+        ProfileScope(const ProfileScope &) = delete;
+        ProfileScope &operator=(const ProfileScope &) = delete;
+    };
+} // namespace Nix
@@ -0,0 +1,121 @@
+#include "TimeHistogram.h"
+#include "../IO/FileWriter.h"
+#include <stdio.h>
+#include <math.h>
+
+namespace Nix
+{
+    static const uint32_t SubBucketBits = 8;
+    static const uint64_t SubBucketCount = 1ull << SubBucketBits;       // exact below this
+    static const uint64_t SubBucketHalf = SubBucketCount >> 1;          // buckets per power of two above
+    static const size_t BucketCount = (size_t)( SubBucketCount + ( 64 - SubBucketBits ) * SubBucketHalf );
+
+    static inline uint32_t HighestBit( uint64_t _value )
+    {
+        uint32_t bit = 0;
+        while( _value >>= 1 )
+            ++bit;
+        return bit;
+    }
+
+    static inline size_t BucketIndex( uint64_t _value )
+    {
+        if( _value < SubBucketCount )
+            return (size_t)_value;
+        // keeps the top SubBucketBits bits of the value
+        uint32_t shift = HighestBit( _value ) - ( SubBucketBits - 1 );
+        return (size_t)( SubBucketCount + ( shift - 1 ) * SubBucketHalf + ( ( _value >> shift ) - SubBucketHalf ) );
+    }
+
+    // largest value that lands in bucket `_index`
+    static inline uint64_t BucketUpperBound( size_t _index )
+    {
+        if( _index < SubBucketCount )
+            return _index;
+        uint64_t shift = ( _index - SubBucketCount ) / SubBucketHalf + 1;
+        uint64_t mantissa = ( _index - SubBucketCount ) % SubBucketHalf + SubBucketHalf;
+        return ( mantissa << shift ) + ( ( 1ull << shift ) - 1 );
+    }
+
+    TimeHistogram::TimeHistogram()
+        : _counts( BucketCount, 0 )
+    {
+    }
+
+    void TimeHistogram::record( uint64_t _nanoseconds )
+    {
+        ++_counts[BucketIndex( _nanoseconds )];
+        ++_count;
+        _total += _nanoseconds;
+        _min = _nanoseconds < _min ? _nanoseconds : _min;
+        _max = _nanoseconds > _max ? _nanoseconds : _max;
+    }
+
+    void TimeHistogram::reset()
+    {
+        _counts.assign( BucketCount, 0 );
+        _count = 0;
+        _total = 0;
+        _min = UINT64_MAX;
+        _max = 0;
+    }
+
+    uint64_t TimeHistogram::percentile( double _percent ) const
+    {
+        if( !_count )
+            return 0;
+        _percent = _percent < 0.0 ? 0.0 : ( _percent > 100.0 ? 100.0 : _percent );
+        uint64_t target = (uint64_t)ceil( _percent / 100.0 * (double)_count );
+        target = target ? target : 1;
+        uint64_t seen = 0;
+        for( size_t i = 0; i < BucketCount; ++i )
+        {
+            seen += _counts[i];
+            if( seen >= target )
+            {
+                uint64_t value = BucketUpperBound( i );
+                value = value > _max ? _max : value;
+                return value < _min ? _min : value;
+            }
+        }
+        return _max;
+    }
+
+    std::string TimeHistogram::summary() const
+    {
+        char text[256];
+        snprintf( text, sizeof(text), "frames %llu  mean %.2f ms  p50 %.2f ms  p95 %.2f ms  p99 %.2f ms  max %.2f ms",
+            (unsigned long long)_count, mean() * 1e-6, percentile( 50.0 ) * 1e-6, percentile( 95.0 ) * 1e-6,
+            percentile( 99.0 ) * 1e-6, max() * 1e-6 );
+        return text;
+    }
+
+    bool TimeHistogram::writeCsv( const std::string& _path ) const
+    {
+        char text[512];
+        int length = snprintf( text, sizeof(text), "frames,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n%llu,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+            (unsigned long long)_count, mean() * 1e-6, percentile( 50.0 ) * 1e-6, percentile( 95.0 ) * 1e-6,
+            percentile( 99.0 ) * 1e-6, max() * 1e-6 );
+        return SaveFileAtomic( _path, text, (size_t)length, FileWriterNoSync );
+    }
+
+    bool TimeHistogram::writeJson( const std::string& _path ) const
+    {
+        char text[512];
+        snprintf( text, sizeof(text), "{\"frames\":%llu,\"mean_ms\":%.4f,\"p50_ms\":%.4f,\"p95_ms\":%.4f,\"p99_ms\":%.4f,\"max_ms\":%.4f,\"buckets_ns\":[",
+            (unsigned long long)_count, mean() * 1e-6, percentile( 50.0 ) * 1e-6, percentile( 95.0 ) * 1e-6,
+            percentile( 99.0 ) * 1e-6, max() * 1e-6 );
+        std::string json = text;
+        bool first = true;
+        for( size_t i = 0; i < BucketCount; ++i )
+        {
+            if( !_counts[i] )
+                continue;
+            snprintf( text, sizeof(text), "%s[%llu,%llu]", first ? "" : ",", (unsigned long long)BucketUpperBound( i ), (unsigned long long)_counts[i] );
+            json.append( text );
+            first = false;
+        }
+        json.append( "]}\n" );
+        return SaveFileAtomic( _path, json.data(), json.size(), FileWriterNoSync );
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Nix
+{
+    // HDR histogram style store of nanosecond durations : values below 256 ns are exact, above
+    // that every power of two is split into 128 buckets, so a percentile is within 0.8% of the
+    // recorded value over the whole 64 bit range. Recording is a couple of shifts and one
+    // increment, nothing is allocated after construction.
+    class TimeHistogram
+    {
+    private:
+        std::vector<uint64_t> _counts;
+        uint64_t _count = 0;
+        uint64_t _total = 0;
+        uint64_t _min = UINT64_MAX;
+        uint64_t _max = 0;
+
+    public:
+        TimeHistogram();
+
+        void record(uint64_t nanoseconds);
+        void reset();
+
+        uint64_t count() const { return _count; }
+        uint64_t min() const { return _count ? _min : 0; }
+        uint64_t max() const { return _max; }
+        uint64_t mean() const { return _count ? _total / _count : 0; }
+        // smallest recorded value that `percent` percent of the samples do not exceed
+        uint64_t percentile(double percent) const;
+
+        // "frames 600  mean 16.67 ms  p50 16.60 ms  p95 17.10 ms  p99 18.02 ms  max 33.40 ms"
+        std::string summary() const;
+        // one header line and one line of values (milliseconds), easy to append across runs
+        bool writeCsv(const std::string &path) const;
+        // summary plus the non empty buckets as [upper bound ns, count] pairs
+        bool writeJson(const std::string &path) const;
+    };
+} // namespace Nix
@@ -58,8 +58,8 @@ namespace Nix
 		memcpy( dest, src, sizeof(char16_t) * count);
 	}
 
-    // 编码转换使用的缓存
-    static std::vector<unsigned char >	CONV_BUFF;
+    // 编码转换使用的缓存，每个线程一份
+    static thread_local std::vector<unsigned char >	CONV_BUFF;
 
     void adjust_conv_buffer( size_t size )
     {
@@ -139,26 +139,6 @@ namespace Nix
 
 #ifdef _WIN32
 // Win32 Api 版本
-	uint32_t utf82ucsle(const char* _pUTF8, uint32_t _nDataLen, char** _ppUnicode )
-	{
-		int bytes = ::MultiByteToWideChar( CP_UTF8, 0, _pUTF8, _nDataLen, NULL, 0) * 2;
-		adjust_conv_buffer(bytes + 2);
-		CONV_BUFF.assign(bytes + 2, 0);
-		MultiByteToWideChar( CP_UTF8, 0, _pUTF8, _nDataLen , (LPWSTR)CONV_BUFF.data(), bytes );
-		*_ppUnicode = (char*)CONV_BUFF.data();
-		return bytes+2;
-	}
-
-	uint32_t ucsle2utf8( const char * _pUnic, size_t _nDataLen, char ** _ppUTF )
-	{
-		int bytes = ::WideCharToMultiByte( CP_UTF8, 0, (LPCWSTR)_pUnic, (int)_nDataLen/2, NULL, 0, NULL, NULL );
-		adjust_conv_buffer(bytes+1);
-		CONV_BUFF.assign(bytes+1, 0);
-		::WideCharToMultiByte(CP_UTF8, 0, (LPCWSTR)_pUnic, (int)_nDataLen/2, (LPSTR)CONV_BUFF.data(), bytes, NULL, NULL);
-		*_ppUTF = (char*)CONV_BUFF.data();
-		return bytes+1;
-	}
-
 	uint32_t ucsle2gbk( const char * unic, size_t len, char ** ascii )
 	{
 		int bytes = ::WideCharToMultiByte( CP_OEMCP, 0,(LPCWSTR)unic, (int)len / 2, NULL, 0, NULL, NULL);
@@ -188,102 +168,40 @@ namespace Nix
 #endif
 
 
-#if __ANDROID__
-
-	static bool checkUtf8FollowChar(const uint8_t* src, int _size)
-	{
-		while (_size-- > 0)
-		{
-			const uint_t s = *++src;
-			if (s < 128 || s >= 192)
-				return false;
-		}
-		return true;
-	}
+#ifndef __APPLE__
+// Transcoder 版本，见 Transcoder.cpp
 	uint32_t utf82ucsle(const char* _pUTF8, uint32_t _nDataLen, char** _ppUnicode )
 	{
-		// utf8转unicode内码大小极端情况下内存占用是原来的2倍
-		
-		//char * utf8 = const_cast<char*>(_pUTF8);
-		
+		// utf8转unicode 字符数不会超过utf8的字节数
 		adjust_conv_buffer(_nDataLen * 2 + 2);
-		
-		const uint8_t *src = (const uint8_t*)_pUTF8;
-		const uint8_t *src_end = src + _nDataLen;
-		uint8_t *desc = (uint8_t*)CONV_BUFF.data();
-		while (src < src_end)
-		{
-			uint16_t d = 0;
-			const uint8_t s = *src;
-			if (s < 128)
-			{
-				d = s;
-				++src;
-			}
-			else if (s < 192)
-				break;
-			else if (s < 224)
-			{
-				if (src + 1 < src_end && checkUtf8FollowChar(src, 1))
-				{
-					d = ((s & 0x1f) << 6) + (src[1] & 0x3f);
-					src += 2;
-				}
-				else
-					break;
-			}
-			else if (s < 248)
-			{
-				if (src + 2 < src_end && checkUtf8FollowChar(src, 2))
-				{
-					d = ((s & 0xf) << 12) + ((src[1] & 0x3f) << 6) + (src[2] & 0x3f);
-					src += 3;
-				}
-				else
-					break;
-			}
-			else
-				break;
-
-			*(desc++) = d & 0xff;
-			*(desc++) = (d & 0xff00) >> 8;
-		}
-
-		*desc = 0;
-		*(desc + 1) = 0;
+		// malformed sequences become U+FFFD, as MultiByteToWideChar did
+		size_t count = utf8_to_ucsle_replace(_pUTF8, _nDataLen, (char16_t*)CONV_BUFF.data());
+		CONV_BUFF[count * 2] = 0;
+		CONV_BUFF[count * 2 + 1] = 0;
 		*_ppUnicode = (char*)CONV_BUFF.data();
-		return desc - (uint8_t*)(*_ppUnicode) + 2;
+		return (uint32_t)(count * 2 + 2);
 	}
 
 	uint32_t ucsle2utf8( const char * _pUnic, size_t _nDataLen, char ** _ppUTF )
 	{
 		if (_nDataLen & 0x1)
 			return 0;
-
 		// unicode转utf8内码大小极端情况下内存占用是原来的1.5倍
-		uint32_t origSize = _nDataLen*1.5 + 1;
-		adjust_conv_buffer(origSize);
-		const uint16_t *src = (const uint16_t*)_pUnic;
-		const uint16_t *src_end = (const uint16_t*)(_pUnic + _nDataLen);
-		uint8_t *desc = (uint8_t*)CONV_BUFF.data();
-		while (src < src_end)
-		{
-			const uint16_t s = *(src++);
-			if (s < 128)
-			{
-				*(desc++) = (uint8_t)s;
-			}
-			else if (s < 0x800)
-			{
-				*desc = 0xe0 | (s & 0x7c0);
-				*(desc + 1) = 0xc0 | (s & 0x3f);
-			}
-		}
-		*desc = 0;
+		adjust_conv_buffer(_nDataLen / 2 * 3 + 1);
+		size_t bytes = ucsle_to_utf8_replace((const char16_t*)_pUnic, _nDataLen / 2, (char*)CONV_BUFF.data());
+		CONV_BUFF[bytes] = 0;
 		*_ppUTF = (char*)CONV_BUFF.data();
-		return desc - (uint8_t*)(*_ppUTF) + 1;
+		return (uint32_t)(bytes + 1);
 	}
-	
+#endif
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+	uint32_t ucsle2gbk( const char * _pUnic, size_t _nDataLen, char ** _ppAscii )
+	{
+		assert(false && "not support ucsle2gbk");
+		return 0;
+	}
+
 	uint32_t gbk2utf8(const char * _gbk, size_t _nDataLen, char ** _ppUTF)
 	{
 		assert(false && "not support gbk2utf8");
@@ -36,8 +36,35 @@ namespace Nix
     uint32_t ucsle2gbk(const char *unic, size_t len, char **ascii);
     uint32_t gbk2utf8(const char *acsii, size_t len, char **utf);
 
+    // The legacy conversions above return a pointer into a per thread buffer, valid until the
+    // next conversion on the same thread. clear_conv frees the calling thread's buffer.
     void clear_conv();
 
+    // UTF-8 <-> UCS-2 little endian transcoders, surrogate pairs are accepted so full UTF-16 goes
+    // through as well. ASCII runs take a SIMD path (AVX2 picked at runtime, SSE2 or NEON
+    // otherwise), everything else goes through the validating scalar decoder. Malformed input
+    // (bad or overlong sequences, unpaired surrogates, truncated input) returns TranscodeInvalid.
+    // They only touch the caller's memory : safe on any thread, nothing is allocated, and the
+    // output is not null terminated.
+    static const size_t TranscodeInvalid = (size_t)-1;
+    // `ucs` must hold `len` units, returns the units written
+    size_t utf8_to_ucsle(const char *utf8, size_t len, char16_t *ucs);
+    // `utf8` must hold 3 * `len` bytes, returns the bytes written
+    size_t ucsle_to_utf8(const char16_t *ucs, size_t len, char *utf8);
+    // Same, malformed input is replaced by U+FFFD instead of failing, as MultiByteToWideChar and
+    // WideCharToMultiByte do : one per maximal ill-formed UTF-8 subpart, one per unpaired surrogate.
+    // Same output bounds as above.
+    size_t utf8_to_ucsle_replace(const char *utf8, size_t len, char16_t *ucs);
+    size_t ucsle_to_utf8_replace(const char16_t *ucs, size_t len, char *utf8);
+    // exact output sizes, in units and bytes
+    size_t utf8_to_ucsle_length(const char *utf8, size_t len);
+    size_t ucsle_to_utf8_length(const char16_t *ucs, size_t len);
+    // Bounded flavours : return the required output size and only write when it is no more than
+    // `capacity`, so a result above `capacity` means "call again with a bigger buffer". Malformed
+    // input returns TranscodeInvalid without writing anything.
+    size_t utf8_to_ucsle(const char *utf8, size_t len, char16_t *ucs, size_t capacity);
+    size_t ucsle_to_utf8(const char16_t *ucs, size_t len, char *utf8, size_t capacity);
+
     // 从网上抄的一段代码改的
     // 用于unicode字串查找，作用类似于 strstr/wcsstr
 	char16_t *ucsstr( const char16_t *s1, const char16_t *s2 );
@@ -0,0 +1,521 @@
+#include "Hash.h"
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NIX_HASH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define NIX_TARGET_AVX2
+#else
+#define NIX_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define NIX_HASH_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER) && ( defined(_M_X64) || defined(_M_ARM64) )
+#include <intrin.h>
+#endif
+
+namespace Nix
+{
+    static const uint64_t Prime64_1 = 0x9E3779B185EBCA87ull;
+    static const uint64_t Prime64_2 = 0xC2B2AE3D27D4EB4Full;
+    static const uint64_t Prime64_3 = 0x165667B19E3779F9ull;
+    static const uint64_t Prime64_4 = 0x85EBCA77C2B2AE63ull;
+    static const uint64_t Prime64_5 = 0x27D4EB2F165667C5ull;
+    static const uint32_t Prime32_1 = 0x9E3779B1u;
+    static const uint32_t Prime32_2 = 0x85EBCA77u;
+    static const uint32_t Prime32_3 = 0xC2B2AE3Du;
+
+    static const size_t ShortInputLength = 256;     // up to this, XXH64
+    static const size_t StripeLength = 64;
+    static const uint64_t StripesPerBlock = 16;     // the accumulators are scrambled once per block
+    // key words : stripe i of a block uses [i, i + 8), the scramble [16, 24), the last stripe
+    // [9, 17), the low and high merges [3, 11) and [13, 21)
+    static const size_t KeyWords = 24;
+    static const uint64_t LastStripeKey = 9;
+    static const size_t ScrambleKey = 16;
+    static const size_t LowMergeKey = 3;
+    static const size_t HighMergeKey = 13;
+
+    // splitmix64 output, the key of seed 0
+    static const uint64_t DefaultKey[KeyWords] = {
+        0x8c9ff21eb4943e94ull, 0x529bcfd80991254cull, 0x12b8eb6d931b5e6eull, 0xcec50c5d0c1fcc21ull,
+        0x31f5796e26ef1ca1ull, 0x6fad0e5ad91dff82ull, 0x061c22c6f5405433ull, 0xacebed3be37886a1ull,
+        0x0d81e8485a2713a6ull, 0xa3e600f8f1fd238cull, 0xef1382c779e55f8eull, 0xfe2c41ff60885d40ull,
+        0x94cbb826dac34bb2ull, 0xb502428724a731f6ull, 0xd0bec29520b72715ull, 0x81335f7cacfebd80ull,
+        0xe34be0aababd1d08ull, 0x25c86b4d7ef8431aull, 0x889c2b2a461ffb7eull, 0x6a810fe6190b977eull,
+        0xa24c7ba4f2058340ull, 0xba5c108702350f86ull, 0x73b2efd68e1c6856ull, 0xc539d9c263ee450aull,
+    };
+
+    static inline uint64_t read64( const uint8_t *p )
+    {
+        uint64_t v;
+        memcpy( &v, p, sizeof(v) );
+        return v;
+    }
+
+    static inline uint32_t read32( const uint8_t *p )
+    {
+        uint32_t v;
+        memcpy( &v, p, sizeof(v) );
+        return v;
+    }
+
+    static inline uint64_t rotl64( uint64_t v, int bits )
+    {
+        return ( v << bits ) | ( v >> ( 64 - bits ) );
+    }
+
+    // low 64 bits of the 128 bit product xor its high 64 bits
+    static inline uint64_t mul128_fold64( uint64_t a, uint64_t b )
+    {
+#if defined(__SIZEOF_INT128__)
+        __uint128_t product = (__uint128_t)a * b;
+        return (uint64_t)product ^ (uint64_t)( product >> 64 );
+#elif defined(_MSC_VER) && defined(_M_X64)
+        uint64_t high;
+        uint64_t low = _umul128( a, b, &high );
+        return low ^ high;
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+        return ( a * b ) ^ __umulh( a, b );
+#else
+        uint64_t lowLow = ( a & 0xFFFFFFFF ) * ( b & 0xFFFFFFFF );
+        uint64_t highLow = ( a >> 32 ) * ( b & 0xFFFFFFFF );
+        uint64_t lowHigh = ( a & 0xFFFFFFFF ) * ( b >> 32 );
+        uint64_t highHigh = ( a >> 32 ) * ( b >> 32 );
+        uint64_t cross = ( lowLow >> 32 ) + ( highLow & 0xFFFFFFFF ) + lowHigh;
+        uint64_t high = ( highLow >> 32 ) + ( cross >> 32 ) + highHigh;
+        uint64_t low = ( cross << 32 ) | ( lowLow & 0xFFFFFFFF );
+        return low ^ high;
+#endif
+    }
+
+    //
+    // XXH64, short input
+    //
+
+    static inline uint64_t xxh64_round( uint64_t acc, uint64_t input )
+    {
+        acc += input * Prime64_2;
+        acc = rotl64( acc, 31 );
+        return acc * Prime64_1;
+    }
+
+    static inline uint64_t xxh64_merge_round( uint64_t acc, uint64_t v )
+    {
+        acc ^= xxh64_round( 0, v );
+        return acc * Prime64_1 + Prime64_4;
+    }
+
+    static uint64_t xxh64( const uint8_t *p, size_t length, uint64_t seed )
+    {
+        const uint8_t *end = p + length;
+        uint64_t h;
+        if ( length >= 32 )
+        {
+            uint64_t v1 = seed + Prime64_1 + Prime64_2;
+            uint64_t v2 = seed + Prime64_2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - Prime64_1;
+            const uint8_t *limit = end - 32;
+            do
+            {
+                v1 = xxh64_round( v1, read64( p ) );
+                v2 = xxh64_round( v2, read64( p + 8 ) );
+                v3 = xxh64_round( v3, read64( p + 16 ) );
+                v4 = xxh64_round( v4, read64( p + 24 ) );
+                p += 32;
+            } while ( p <= limit );
+            h = rotl64( v1, 1 ) + rotl64( v2, 7 ) + rotl64( v3, 12 ) + rotl64( v4, 18 );
+            h = xxh64_merge_round( h, v1 );
+            h = xxh64_merge_round( h, v2 );
+            h = xxh64_merge_round( h, v3 );
+            h = xxh64_merge_round( h, v4 );
+        }
+        else
+        {
+            h = seed + Prime64_5;
+        }
+        h += (uint64_t)length;
+        while ( end - p >= 8 )
+        {
+            h ^= xxh64_round( 0, read64( p ) );
+            h = rotl64( h, 27 ) * Prime64_1 + Prime64_4;
+            p += 8;
+        }
+        if ( end - p >= 4 )
+        {
+            h ^= (uint64_t)read32( p ) * Prime64_1;
+            h = rotl64( h, 23 ) * Prime64_2 + Prime64_3;
+            p += 4;
+        }
+        while ( p < end )
+        {
+            h ^= *p * Prime64_5;
+            h = rotl64( h, 11 ) * Prime64_1;
+            ++p;
+        }
+        h ^= h >> 33;
+        h *= Prime64_2;
+        h ^= h >> 29;
+        h *= Prime64_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    //
+    // Long input, the kernels consume `stripes` stripes starting at stripe `index` of the input.
+    // Per 64 bit lane : acc[i ^ 1] += data[i], acc[i] += lo32(data[i] ^ key) * hi32(data[i] ^ key),
+    // the last stripe of every block scrambles the lanes.
+    //
+
+    typedef void (*accumulate_kernel_t)( uint64_t *acc, const uint8_t *input, size_t stripes, const uint64_t *key, uint64_t index );
+
+#if !NIX_HASH_X86 && !NIX_HASH_NEON
+    static void accumulate_scalar( uint64_t *acc, const uint8_t *input, size_t stripes, const uint64_t *key, uint64_t index )
+    {
+        for ( size_t s = 0; s < stripes; ++s, ++index, input += StripeLength )
+        {
+            const uint64_t *stripeKey = key + index % StripesPerBlock;
+            for ( size_t i = 0; i < 8; ++i )
+            {
+                uint64_t data = read64( input + 8 * i );
+                uint64_t mixed = data ^ stripeKey[i];
+                acc[i ^ 1] += data;
+                acc[i] += ( mixed & 0xFFFFFFFF ) * ( mixed >> 32 );
+            }
+            if ( index % StripesPerBlock == StripesPerBlock - 1 )
+            {
+                for ( size_t i = 0; i < 8; ++i )
+                {
+                    uint64_t lane = acc[i];
+                    lane ^= lane >> 47;
+                    lane ^= key[ScrambleKey + i];
+                    acc[i] = lane * Prime32_1;
+                }
+            }
+        }
+    }
+#endif
+
+#if NIX_HASH_X86
+    static inline __m128i scramble_sse2( __m128i lane, __m128i key )
+    {
+        const __m128i prime = _mm_set1_epi32( (int)Prime32_1 );
+        lane = _mm_xor_si128( lane, _mm_srli_epi64( lane, 47 ) );
+        lane = _mm_xor_si128( lane, key );
+        // 64 x 32 bit multiply out of two 32 x 32 bit ones
+        __m128i low = _mm_mul_epu32( lane, prime );
+        __m128i high = _mm_mul_epu32( _mm_srli_epi64( lane, 32 ), prime );
+        return _mm_add_epi64( low, _mm_slli_epi64( high, 32 ) );
+    }
+
+    static void accumulate_sse2( uint64_t *acc, const uint8_t *input, size_t stripes, const uint64_t *key, uint64_t index )
+    {
+        __m128i lanes[4];
+        for ( size_t i = 0; i < 4; ++i )
+            lanes[i] = _mm_loadu_si128( (const __m128i*)( acc + 2 * i ) );
+        for ( size_t s = 0; s < stripes; ++s, ++index, input += StripeLength )
+        {
+            const uint64_t *stripeKey = key + index % StripesPerBlock;
+            for ( size_t i = 0; i < 4; ++i )
+            {
+                __m128i data = _mm_loadu_si128( (const __m128i*)( input + 16 * i ) );
+                __m128i mixed = _mm_xor_si128( data, _mm_loadu_si128( (const __m128i*)( stripeKey + 2 * i ) ) );
+                __m128i product = _mm_mul_epu32( mixed, _mm_srli_epi64( mixed, 32 ) );
+                __m128i swapped = _mm_shuffle_epi32( data, _MM_SHUFFLE( 1, 0, 3, 2 ) );
+                lanes[i] = _mm_add_epi64( lanes[i], _mm_add_epi64( product, swapped ) );
+            }
+            if ( index % StripesPerBlock == StripesPerBlock - 1 )
+            {
+                for ( size_t i = 0; i < 4; ++i )
+                    lanes[i] = scramble_sse2( lanes[i], _mm_loadu_si128( (const __m128i*)( key + ScrambleKey + 2 * i ) ) );
+            }
+        }
+        for ( size_t i = 0; i < 4; ++i )
+            _mm_storeu_si128( (__m128i*)( acc + 2 * i ), lanes[i] );
+    }
+
+    NIX_TARGET_AVX2 static inline __m256i scramble_avx2( __m256i lane, __m256i key )
+    {
+        const __m256i prime = _mm256_set1_epi32( (int)Prime32_1 );
+        lane = _mm256_xor_si256( lane, _mm256_srli_epi64( lane, 47 ) );
+        lane = _mm256_xor_si256( lane, key );
+        __m256i low = _mm256_mul_epu32( lane, prime );
+        __m256i high = _mm256_mul_epu32( _mm256_srli_epi64( lane, 32 ), prime );
+        return _mm256_add_epi64( low, _mm256_slli_epi64( high, 32 ) );
+    }
+
+    NIX_TARGET_AVX2 static void accumulate_avx2( uint64_t *acc, const uint8_t *input, size_t stripes, const uint64_t *key, uint64_t index )
+    {
+        __m256i lanes[2];
+        for ( size_t i = 0; i < 2; ++i )
+            lanes[i] = _mm256_loadu_si256( (const __m256i*)( acc + 4 * i ) );
+        for ( size_t s = 0; s < stripes; ++s, ++index, input += StripeLength )
+        {
+            const uint64_t *stripeKey = key + index % StripesPerBlock;
+            for ( size_t i = 0; i < 2; ++i )
+            {
+                __m256i data = _mm256_loadu_si256( (const __m256i*)( input + 32 * i ) );
+                __m256i mixed = _mm256_xor_si256( data, _mm256_loadu_si256( (const __m256i*)( stripeKey + 4 * i ) ) );
+                __m256i product = _mm256_mul_epu32( mixed, _mm256_srli_epi64( mixed, 32 ) );
+                __m256i swapped = _mm256_shuffle_epi32( data, _MM_SHUFFLE( 1, 0, 3, 2 ) );
+                lanes[i] = _mm256_add_epi64( lanes[i], _mm256_add_epi64( product, swapped ) );
+            }
+            if ( index % StripesPerBlock == StripesPerBlock - 1 )
+            {
+                for ( size_t i = 0; i < 2; ++i )
+                    lanes[i] = scramble_avx2( lanes[i], _mm256_loadu_si256( (const __m256i*)( key + ScrambleKey + 4 * i ) ) );
+            }
+        }
+        for ( size_t i = 0; i < 2; ++i )
+            _mm256_storeu_si256( (__m256i*)( acc + 4 * i ), lanes[i] );
+    }
+
+    static bool cpu_has_avx2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid( info, 0 );
+        if ( info[0] < 7 )
+            return false;
+        __cpuid( info, 1 );
+        // the OS must save the ymm registers too
+        if ( !( info[2] & ( 1 << 27 ) ) || !( info[2] & ( 1 << 28 ) ) || ( _xgetbv( 0 ) & 6 ) != 6 )
+            return false;
+        __cpuidex( info, 7, 0 );
+        return ( info[1] & ( 1 << 5 ) ) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "avx2" ) != 0;
+#endif
+    }
+#endif
+
+#if NIX_HASH_NEON
+    static inline uint64x2_t scramble_neon( uint64x2_t lane, uint64x2_t key )
+    {
+        const uint32x2_t prime = vdup_n_u32( Prime32_1 );
+        lane = veorq_u64( lane, vshrq_n_u64( lane, 47 ) );
+        lane = veorq_u64( lane, key );
+        uint64x2_t low = vmull_u32( vmovn_u64( lane ), prime );
+        uint64x2_t high = vmull_u32( vshrn_n_u64( lane, 32 ), prime );
+        return vaddq_u64( low, vshlq_n_u64( high, 32 ) );
+    }
+
+    static void accumulate_neon( uint64_t *acc, const uint8_t *input, size_t stripes, const uint64_t *key, uint64_t index )
+    {
+        uint64x2_t lanes[4];
+        for ( size_t i = 0; i < 4; ++i )
+            lanes[i] = vld1q_u64( acc + 2 * i );
+        for ( size_t s = 0; s < stripes; ++s, ++index, input += StripeLength )
+        {
+            const uint64_t *stripeKey = key + index % StripesPerBlock;
+            for ( size_t i = 0; i < 4; ++i )
+            {
+                uint64x2_t data = vreinterpretq_u64_u8( vld1q_u8( input + 16 * i ) );
+                uint64x2_t mixed = veorq_u64( data, vld1q_u64( stripeKey + 2 * i ) );
+                uint64x2_t product = vmull_u32( vmovn_u64( mixed ), vshrn_n_u64( mixed, 32 ) );
+                uint64x2_t swapped = vextq_u64( data, data, 1 );
+                lanes[i] = vaddq_u64( lanes[i], vaddq_u64( product, swapped ) );
+            }
+            if ( index % StripesPerBlock == StripesPerBlock - 1 )
+            {
+                for ( size_t i = 0; i < 4; ++i )
+                    lanes[i] = scramble_neon( lanes[i], vld1q_u64( key + ScrambleKey + 2 * i ) );
+            }
+        }
+        for ( size_t i = 0; i < 4; ++i )
+            vst1q_u64( acc + 2 * i, lanes[i] );
+    }
+#endif
+
+    static accumulate_kernel_t select_kernel()
+    {
+#if NIX_HASH_X86
+        if ( cpu_has_avx2() )
+            return accumulate_avx2;
+        return accumulate_sse2;
+#elif NIX_HASH_NEON
+        return accumulate_neon;
+#else
+        return accumulate_scalar;
+#endif
+    }
+
+    static accumulate_kernel_t kernel()
+    {
+        static const accumulate_kernel_t selected = select_kernel();
+        return selected;
+    }
+
+    static void init_acc( uint64_t *acc )
+    {
+        acc[0] = Prime32_3;
+        acc[1] = Prime64_1;
+        acc[2] = Prime64_2;
+        acc[3] = Prime64_3;
+        acc[4] = Prime64_4;
+        acc[5] = Prime32_2;
+        acc[6] = Prime64_5;
+        acc[7] = Prime32_1;
+    }
+
+    static const uint64_t *derive_key( uint64_t seed, uint64_t *key_ )
+    {
+        if ( !seed )
+            return DefaultKey;
+        for ( size_t i = 0; i < KeyWords; i += 2 )
+        {
+            key_[i] = DefaultKey[i] + seed;
+            key_[i + 1] = DefaultKey[i + 1] - seed;
+        }
+        return key_;
+    }
+
+    static uint64_t avalanche( uint64_t h )
+    {
+        h ^= h >> 37;
+        h *= 0x165667919E3779F9ull;
+        h ^= h >> 32;
+        return h;
+    }
+
+    static uint64_t merge_acc( const uint64_t *acc, const uint64_t *key, uint64_t start )
+    {
+        uint64_t result = start;
+        for ( size_t i = 0; i < 4; ++i )
+            result += mul128_fold64( acc[2 * i] ^ key[2 * i], acc[2 * i + 1] ^ key[2 * i + 1] );
+        return avalanche( result );
+    }
+
+    // the stripes before the last byte, then the last 64 bytes (overlapping) with their own key
+    static void hash_long( const uint8_t *input, size_t length, const uint64_t *key, uint64_t *acc_ )
+    {
+        accumulate_kernel_t accumulate = kernel();
+        init_acc( acc_ );
+        accumulate( acc_, input, ( length - 1 ) / StripeLength, key, 0 );
+        accumulate( acc_, input + length - StripeLength, 1, key, LastStripeKey );
+    }
+
+    uint64_t Hash64( const void *data, size_t length, uint64_t seed )
+    {
+        const uint8_t *input = (const uint8_t*)data;
+        if ( length <= ShortInputLength )
+            return xxh64( input, length, seed );
+        uint64_t keyStorage[KeyWords];
+        const uint64_t *key = derive_key( seed, keyStorage );
+        uint64_t acc[8];
+        hash_long( input, length, key, acc );
+        return merge_acc( acc, key + LowMergeKey, (uint64_t)length * Prime64_1 );
+    }
+
+    hash128_t Hash128( const void *data, size_t length, uint64_t seed )
+    {
+        const uint8_t *input = (const uint8_t*)data;
+        hash128_t result;
+        if ( length <= ShortInputLength )
+        {
+            result.low = xxh64( input, length, seed );
+            result.high = xxh64( input, length, seed + Prime64_3 );
+            return result;
+        }
+        uint64_t keyStorage[KeyWords];
+        const uint64_t *key = derive_key( seed, keyStorage );
+        uint64_t acc[8];
+        hash_long( input, length, key, acc );
+        result.low = merge_acc( acc, key + LowMergeKey, (uint64_t)length * Prime64_1 );
+        result.high = merge_acc( acc, key + HighMergeKey, ~( (uint64_t)length * Prime64_2 ) );
+        return result;
+    }
+
+    void StreamHasher::reset( uint64_t seed )
+    {
+        _seed = seed;
+        _buffered = 0;
+        _total = 0;
+        _stripes = 0;
+        init_acc( _acc );
+        const uint64_t *key = derive_key( seed, _key );
+        if ( key != _key )
+            memcpy( _key, key, sizeof(_key) );
+    }
+
+    void StreamHasher::hash( const void *data, size_t length )
+    {
+        const uint8_t *input = (const uint8_t*)data;
+        _total += length;
+        if ( _buffered + length <= BufferSize )
+        {
+            memcpy( _buffer + _buffered, input, length );
+            _buffered += length;
+            return;
+        }
+        accumulate_kernel_t accumulate = kernel();
+        // a stripe is only consumed once more input follows it, the final stripe is special
+        if ( _buffered )
+        {
+            size_t fill = BufferSize - _buffered;
+            memcpy( _buffer + _buffered, input, fill );
+            input += fill;
+            length -= fill;
+            accumulate( _acc, _buffer, BufferSize / StripeLength, _key, _stripes );
+            _stripes += BufferSize / StripeLength;
+            memcpy( _previous, _buffer + BufferSize - StripeLength, StripeLength );
+            _buffered = 0;
+        }
+        size_t stripes = ( length - 1 ) / StripeLength;
+        if ( stripes )
+        {
+            accumulate( _acc, input, stripes, _key, _stripes );
+            _stripes += stripes;
+            input += stripes * StripeLength;
+            length -= stripes * StripeLength;
+            memcpy( _previous, input - StripeLength, StripeLength );
+        }
+        memcpy( _buffer, input, length );
+        _buffered = length;
+    }
+
+    uint64_t StreamHasher::digest() const
+    {
+        if ( _total <= ShortInputLength )
+            return xxh64( _buffer, (size_t)_total, _seed );
+        return digest128().low;
+    }
+
+    hash128_t StreamHasher::digest128() const
+    {
+        hash128_t result;
+        if ( _total <= ShortInputLength )
+        {
+            result.low = xxh64( _buffer, (size_t)_total, _seed );
+            result.high = xxh64( _buffer, (size_t)_total, _seed + Prime64_3 );
+            return result;
+        }
+        accumulate_kernel_t accumulate = kernel();
+        uint64_t acc[8];
+        memcpy( acc, _acc, sizeof(acc) );
+        accumulate( acc, _buffer, ( _buffered - 1 ) / StripeLength, _key, _stripes );
+        // the last 64 bytes of the input, part of them may already be consumed
+        uint8_t last[StripeLength];
+        if ( _buffered >= StripeLength )
+        {
+            memcpy( last, _buffer + _buffered - StripeLength, StripeLength );
+        }
+        else
+        {
+            size_t carried = StripeLength - _buffered;
+            memcpy( last, _previous + StripeLength - carried, carried );
+            memcpy( last + carried, _buffer, _buffered );
+        }
+        accumulate( acc, last, 1, _key, LastStripeKey );
+        result.low = merge_acc( acc, _key + LowMergeKey, _total * Prime64_1 );
+        result.high = merge_acc( acc, _key + HighMergeKey, ~( _total * Prime64_2 ) );
+        return result;
+    }
+} // namespace Nix
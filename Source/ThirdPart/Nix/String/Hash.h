@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace Nix
+{
+    struct hash128_t
+    {
+        uint64_t low;
+        uint64_t high;
+
+        bool operator == (const hash128_t &other) const { return low == other.low && high == other.high; }
+        bool operator != (const hash128_t &other) const { return !(*this == other); }
+    };
+
+    // Fast non cryptographic hashes for content keys (meshes, shader blobs, cache entries).
+    // Up to 256 bytes the 64 bit hash is XXH64. Longer input goes through an xxHash3 style
+    // accumulator : 8 lanes of 64 bits fed a 64 byte stripe at a time and scrambled every
+    // 1 KB, vectorized with AVX2 (picked at runtime), SSE2 or NEON. Every path gives the same
+    // value on every platform. Long input values are not those of the reference XXH3, they
+    // must not be mixed with hashes from another xxHash implementation.
+    // PathHash (Path.h) is Hash64 of the normalized path.
+    uint64_t Hash64(const void *data, size_t length, uint64_t seed = 0);
+    hash128_t Hash128(const void *data, size_t length, uint64_t seed = 0);
+
+    // Streaming flavour, feeding the data in any number of pieces gives the one shot value.
+    class StreamHasher
+    {
+    private:
+        static const size_t BufferSize = 256;
+
+        uint64_t _acc[8];
+        uint64_t _key[24];
+        uint8_t _buffer[BufferSize];
+        uint8_t _previous[64];          // last stripe consumed, the final stripe may reach into it
+        size_t _buffered;
+        uint64_t _total;
+        uint64_t _stripes;              // stripes consumed so far
+        uint64_t _seed;
+
+    public:
+        StreamHasher(uint64_t seed = 0) { reset(seed); }
+
+        void reset(uint64_t seed = 0);
+        void hash(const void *data, size_t length);
+        // the state is not changed, more data can still be added afterwards
+        uint64_t digest() const;
+        hash128_t digest128() const;
+        operator uint64_t () const { return digest(); }
+    };
+} // namespace Nix
@@ -1,59 +1,172 @@
 #include "Path.h"
+#include "Hash.h"
+#include <string.h>
+#include <mutex>
 
 namespace Nix
 {
     std::string FormatFilePath(const std::string &filePath)
     {
-        auto nSec = 0;
-        std::string curSec = "";
-        std::string fPath = ""; 
-        if(filePath[0] == '/') { fPath.push_back('/'); }
+        std::string fPath = filePath;
+        if (fPath.empty()) return fPath;
+        fPath.resize(NormalizePath(&fPath[0], fPath.length()));
+        return fPath;
+    }
+
+    static inline bool IsSeparator(char c)
+    {
+        return c == '/' || c == '\\';
+    }
 
-        const char *ptr = filePath.c_str();
-        while (*ptr != 0)
+    size_t NormalizePath(char *path, size_t length)
+    {
+        // segments are moved down over the input, the output never overtakes the read position
+        size_t in = 0;
+        size_t out = 0;
+        // output before `floor` is never popped : the root, a drive or leading ".." segments
+        size_t floor = 0;
+        bool rooted = false;
+        if (length && IsSeparator(path[0]))
         {
-            if(*ptr == '\\' || *ptr == '/')
+            path[out++] = '/';
+            floor = out;
+            rooted = true;
+        }
+        while (in < length)
+        {
+            while (in < length && IsSeparator(path[in])) ++in;
+            if (in == length) break;
+            size_t begin = in;
+            while (in < length && !IsSeparator(path[in])) ++in;
+            size_t segment = in - begin;
+            if (segment == 1 && path[begin] == '.') continue;
+            bool parent = segment == 2 && path[begin] == '.' && path[begin + 1] == '.';
+            if (parent)
             {
-                if(curSec.length() > 0)
+                if (out > floor)
                 {
-                    if(curSec == ".") {}
-                    else if(curSec == ".." && nSec >= 2)
-                    {
-                        int secleft = 2;
-                        while (!(fPath.empty() && secleft == 0))
-                        {
-                            if(fPath.back() == '\\' || fPath.back() == '/')
-                            {
-                                --secleft;
-                                break;
-                            }
-                            fPath.pop_back();
-                        }
-                        fPath.pop_back();
-                    }
-                    else 
-                    {
-                        if(!fPath.empty() && fPath.back() != '/') fPath.push_back('/');
-                        fPath.append(curSec);
-                        ++nSec;
-                    }
-                    curSec.clear();
+                    while (out > floor && path[out - 1] != '/') --out;
+                    if (out > floor) --out;
+                    continue;
                 }
+                // nothing above the root
+                if (rooted) continue;
             }
-            else 
+            if (out && path[out - 1] != '/') path[out++] = '/';
+            memmove(path + out, path + begin, segment);
+            out += segment;
+            if (parent)
             {
-                curSec.push_back(*ptr);
-                if(*ptr == ':') --nSec;
+                floor = out;
+            }
+            else if (path[out - 1] == ':' && out == segment)
+            {
+                // drive letter
+                floor = out;
+                rooted = true;
             }
-            ++ptr;
         }
+        // a relative path that cancels out is the current directory, not an empty root
+        if (!out && length) path[out++] = '.';
+        if (out < length) path[out] = 0;
+        return out;
+    }
 
-        if(curSec.length() > 0)
+    uint64_t PathHash(const char *path, size_t length)
+    {
+        return Hash64(path, length);
+    }
+
+    PathId PathTable::findNormalized(const char *path, size_t length, uint64_t hash) const
+    {
+        auto range = _lookup.equal_range(hash);
+        for (auto iter = range.first; iter != range.second; ++iter)
         {
-            if(!fPath.empty() && fPath.back() != '/') fPath.push_back('/');
-            fPath.append(curSec);
+            const std::string &candidate = _entries[iter->second - 1].path;
+            if (candidate.length() == length && !memcmp(candidate.c_str(), path, length))
+                return iter->second;
         }
+        return InvalidPathId;
+    }
 
-        return fPath;
+    // copies `path` into `local` when it fits, into `heap` otherwise, and normalizes the copy
+    static char *NormalizeCopy(const char *path, size_t &length, char (&local)[256], std::string &heap)
+    {
+        char *buffer = local;
+        if (length >= sizeof(local))
+        {
+            heap.assign(path, length);
+            buffer = &heap[0];
+        }
+        else
+        {
+            memcpy(local, path, length);
+        }
+        length = NormalizePath(buffer, length);
+        return buffer;
+    }
+
+    PathId PathTable::intern(const char *path, size_t length)
+    {
+        // short paths are normalized on the stack
+        char local[256];
+        std::string heap;
+        size_t normalized = length;
+        char *buffer = NormalizeCopy(path, normalized, local, heap);
+        uint64_t hash = PathHash(buffer, normalized);
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+            PathId id = findNormalized(buffer, normalized, hash);
+            if (id != InvalidPathId) return id;
+        }
+        std::unique_lock<std::shared_timed_mutex> lock(_mutex);
+        // another thread may have interned it in between
+        PathId id = findNormalized(buffer, normalized, hash);
+        if (id != InvalidPathId) return id;
+        entry_t entry;
+        entry.path.assign(buffer, normalized);
+        entry.hash = hash;
+        _entries.push_back(std::move(entry));
+        id = (PathId)_entries.size();
+        _lookup.emplace(hash, id);
+        return id;
+    }
+
+    PathId PathTable::find(const char *path, size_t length) const
+    {
+        char local[256];
+        std::string heap;
+        size_t normalized = length;
+        char *buffer = NormalizeCopy(path, normalized, local, heap);
+        uint64_t hash = PathHash(buffer, normalized);
+        std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+        return findNormalized(buffer, normalized, hash);
+    }
+
+    const std::string &PathTable::path(PathId id) const
+    {
+        static const std::string empty;
+        std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+        if (id == InvalidPathId || id > _entries.size()) return empty;
+        return _entries[id - 1].path;
+    }
+
+    uint64_t PathTable::hash(PathId id) const
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+        if (id == InvalidPathId || id > _entries.size()) return 0;
+        return _entries[id - 1].hash;
+    }
+
+    size_t PathTable::size() const
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(_mutex);
+        return _entries.size();
+    }
+
+    PathTable &SharedPathTable()
+    {
+        static PathTable table;
+        return table;
     }
-} // namespace Nix
\ No newline at end of file
+} // namespace Nix
@@ -1,6 +1,57 @@
+#pragma once
+
 #include <string>
+#include <deque>
+#include <unordered_map>
+#include <shared_mutex>
+#include <stdint.h>
 
 namespace Nix
 {
     std::string FormatFilePath(const std::string &filePath);
-}
\ No newline at end of file
+
+    // Normalizes `length` chars of `path` in place, without allocating : '\' becomes '/',
+    // repeated separators, "." segments and trailing separators go away, ".." removes the
+    // segment before it (a leading ".." of a relative path is kept, one above the root is
+    // dropped, one that cancels out becomes "."). Returns the new length, the result is null
+    // terminated when it got shorter.
+    size_t NormalizePath(char *path, size_t length);
+    // hash of a normalized path, the one the pak table is sorted by
+    uint64_t PathHash(const char *path, size_t length);
+
+    typedef uint32_t PathId;
+    static const PathId InvalidPathId = 0;
+
+    // Interns normalized paths : every spelling of a path maps to one PathId, which keeps the
+    // normalized string and its hash, so comparing paths is comparing integers and opening by
+    // id skips normalization. Ids are never recycled. Safe to use from several threads.
+    class PathTable
+    {
+    private:
+        struct entry_t
+        {
+            std::string path;
+            uint64_t hash;
+        };
+
+        mutable std::shared_timed_mutex _mutex;
+        std::deque<entry_t> _entries;                       // id - 1, references stay valid as it grows
+        std::unordered_multimap<uint64_t, PathId> _lookup;  // hash -> ids
+
+    public:
+        PathId intern(const char *path, size_t length);
+        PathId intern(const std::string &path) { return intern(path.c_str(), path.length()); }
+        // InvalidPathId when the path was never interned
+        PathId find(const char *path, size_t length) const;
+        // the normalized path, empty for an invalid id
+        const std::string &path(PathId id) const;
+        uint64_t hash(PathId id) const;
+        size_t size() const;
+
+    private:
+        PathId findNormalized(const char *path, size_t length, uint64_t hash) const;
+    };
+
+    // the table IArchive::open(PathId) resolves ids with
+    PathTable &SharedPathTable();
+}
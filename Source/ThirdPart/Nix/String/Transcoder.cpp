@@ -0,0 +1,443 @@
+#include "Encoding.h"
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NIX_TRANSCODE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define NIX_TARGET_AVX2
+#else
+#define NIX_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define NIX_TRANSCODE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace Nix
+{
+    // A kernel converts whole blocks of ASCII and stops at the first block holding anything
+    // else, it returns the units it consumed.
+    typedef size_t (*widen_kernel_t)( const uint8_t *src, size_t len, char16_t *dst );
+    typedef size_t (*narrow_kernel_t)( const char16_t *src, size_t len, uint8_t *dst );
+
+#if !NIX_TRANSCODE_X86 && !NIX_TRANSCODE_NEON
+    static size_t widen_ascii_scalar( const uint8_t *src, size_t len, char16_t *dst )
+    {
+        size_t done = 0;
+        while ( done < len && src[done] < 0x80 )
+        {
+            dst[done] = src[done];
+            ++done;
+        }
+        return done;
+    }
+
+    static size_t narrow_ascii_scalar( const char16_t *src, size_t len, uint8_t *dst )
+    {
+        size_t done = 0;
+        while ( done < len && src[done] < 0x80 )
+        {
+            dst[done] = (uint8_t)src[done];
+            ++done;
+        }
+        return done;
+    }
+#endif
+
+#if NIX_TRANSCODE_X86
+    static size_t widen_ascii_sse2( const uint8_t *src, size_t len, char16_t *dst )
+    {
+        const __m128i zero = _mm_setzero_si128();
+        size_t done = 0;
+        while ( len - done >= 16 )
+        {
+            __m128i v = _mm_loadu_si128( (const __m128i*)( src + done ) );
+            if ( _mm_movemask_epi8( v ) )
+                break;
+            _mm_storeu_si128( (__m128i*)( dst + done ), _mm_unpacklo_epi8( v, zero ) );
+            _mm_storeu_si128( (__m128i*)( dst + done + 8 ), _mm_unpackhi_epi8( v, zero ) );
+            done += 16;
+        }
+        return done;
+    }
+
+    static size_t narrow_ascii_sse2( const char16_t *src, size_t len, uint8_t *dst )
+    {
+        const __m128i nonAscii = _mm_set1_epi16( (short)0xff80 );
+        const __m128i zero = _mm_setzero_si128();
+        size_t done = 0;
+        while ( len - done >= 16 )
+        {
+            __m128i a = _mm_loadu_si128( (const __m128i*)( src + done ) );
+            __m128i b = _mm_loadu_si128( (const __m128i*)( src + done + 8 ) );
+            __m128i high = _mm_and_si128( _mm_or_si128( a, b ), nonAscii );
+            if ( _mm_movemask_epi8( _mm_cmpeq_epi16( high, zero ) ) != 0xffff )
+                break;
+            _mm_storeu_si128( (__m128i*)( dst + done ), _mm_packus_epi16( a, b ) );
+            done += 16;
+        }
+        return done;
+    }
+
+    NIX_TARGET_AVX2 static size_t widen_ascii_avx2( const uint8_t *src, size_t len, char16_t *dst )
+    {
+        size_t done = 0;
+        while ( len - done >= 32 )
+        {
+            __m256i v = _mm256_loadu_si256( (const __m256i*)( src + done ) );
+            if ( _mm256_movemask_epi8( v ) )
+                break;
+            _mm256_storeu_si256( (__m256i*)( dst + done ), _mm256_cvtepu8_epi16( _mm256_castsi256_si128( v ) ) );
+            _mm256_storeu_si256( (__m256i*)( dst + done + 16 ), _mm256_cvtepu8_epi16( _mm256_extracti128_si256( v, 1 ) ) );
+            done += 32;
+        }
+        return done + widen_ascii_sse2( src + done, len - done, dst + done );
+    }
+
+    NIX_TARGET_AVX2 static size_t narrow_ascii_avx2( const char16_t *src, size_t len, uint8_t *dst )
+    {
+        const __m256i nonAscii = _mm256_set1_epi16( (short)0xff80 );
+        size_t done = 0;
+        while ( len - done >= 32 )
+        {
+            __m256i a = _mm256_loadu_si256( (const __m256i*)( src + done ) );
+            __m256i b = _mm256_loadu_si256( (const __m256i*)( src + done + 16 ) );
+            if ( !_mm256_testz_si256( _mm256_or_si256( a, b ), nonAscii ) )
+                break;
+            // packus works per 128 bit lane, the permute puts the quarters back in order
+            __m256i packed = _mm256_permute4x64_epi64( _mm256_packus_epi16( a, b ), 0xd8 );
+            _mm256_storeu_si256( (__m256i*)( dst + done ), packed );
+            done += 32;
+        }
+        return done + narrow_ascii_sse2( src + done, len - done, dst + done );
+    }
+
+    static bool cpu_has_avx2()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid( info, 0 );
+        if ( info[0] < 7 )
+            return false;
+        __cpuid( info, 1 );
+        // the OS must save the ymm registers too
+        if ( !( info[2] & ( 1 << 27 ) ) || !( info[2] & ( 1 << 28 ) ) || ( _xgetbv( 0 ) & 6 ) != 6 )
+            return false;
+        __cpuidex( info, 7, 0 );
+        return ( info[1] & ( 1 << 5 ) ) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "avx2" ) != 0;
+#endif
+    }
+#endif
+
+#if NIX_TRANSCODE_NEON
+    static size_t widen_ascii_neon( const uint8_t *src, size_t len, char16_t *dst )
+    {
+        size_t done = 0;
+        while ( len - done >= 16 )
+        {
+            uint8x16_t v = vld1q_u8( src + done );
+            if ( vmaxvq_u8( v ) >= 0x80 )
+                break;
+            vst1q_u16( (uint16_t*)( dst + done ), vmovl_u8( vget_low_u8( v ) ) );
+            vst1q_u16( (uint16_t*)( dst + done + 8 ), vmovl_u8( vget_high_u8( v ) ) );
+            done += 16;
+        }
+        return done;
+    }
+
+    static size_t narrow_ascii_neon( const char16_t *src, size_t len, uint8_t *dst )
+    {
+        size_t done = 0;
+        while ( len - done >= 16 )
+        {
+            uint16x8_t a = vld1q_u16( (const uint16_t*)( src + done ) );
+            uint16x8_t b = vld1q_u16( (const uint16_t*)( src + done + 8 ) );
+            if ( vmaxvq_u16( vorrq_u16( a, b ) ) >= 0x80 )
+                break;
+            vst1q_u8( dst + done, vcombine_u8( vmovn_u16( a ), vmovn_u16( b ) ) );
+            done += 16;
+        }
+        return done;
+    }
+#endif
+
+    struct transcode_kernels_t
+    {
+        widen_kernel_t widen;
+        narrow_kernel_t narrow;
+    };
+
+    static transcode_kernels_t select_kernels()
+    {
+#if NIX_TRANSCODE_X86
+        if ( cpu_has_avx2() )
+            return { widen_ascii_avx2, narrow_ascii_avx2 };
+        return { widen_ascii_sse2, narrow_ascii_sse2 };
+#elif NIX_TRANSCODE_NEON
+        return { widen_ascii_neon, narrow_ascii_neon };
+#else
+        return { widen_ascii_scalar, narrow_ascii_scalar };
+#endif
+    }
+
+    static const transcode_kernels_t& kernels()
+    {
+        static const transcode_kernels_t selected = select_kernels();
+        return selected;
+    }
+
+    // decodes one sequence at `src`, false when it is malformed
+    static inline bool decode_utf8( const uint8_t *&src, const uint8_t *end, char16_t *&dst )
+    {
+        uint32_t c = src[0];
+        if ( c < 0x80 )
+        {
+            *dst++ = (char16_t)c;
+            ++src;
+            return true;
+        }
+        // continuation bytes can't lead, 0xc0 and 0xc1 only start overlong forms
+        if ( c < 0xc2 || c > 0xf4 )
+            return false;
+        size_t follow = c < 0xe0 ? 1 : ( c < 0xf0 ? 2 : 3 );
+        if ( (size_t)( end - src ) <= follow )
+            return false;
+        uint32_t codepoint = c & ( 0x3f >> follow );
+        for ( size_t i = 1; i <= follow; ++i )
+        {
+            if ( ( src[i] & 0xc0 ) != 0x80 )
+                return false;
+            codepoint = ( codepoint << 6 ) | ( src[i] & 0x3f );
+        }
+        if ( follow == 2 && ( codepoint < 0x800 || ( codepoint >= 0xd800 && codepoint <= 0xdfff ) ) )
+            return false;
+        if ( follow == 3 )
+        {
+            if ( codepoint < 0x10000 || codepoint > 0x10ffff )
+                return false;
+            codepoint -= 0x10000;
+            *dst++ = (char16_t)( 0xd800 + ( codepoint >> 10 ) );
+            *dst++ = (char16_t)( 0xdc00 + ( codepoint & 0x3ff ) );
+        }
+        else
+        {
+            *dst++ = (char16_t)codepoint;
+        }
+        src += follow + 1;
+        return true;
+    }
+
+    // encodes one unit, or one surrogate pair, at `src`, false on an unpaired surrogate
+    static inline bool encode_utf8( const char16_t *&src, const char16_t *end, uint8_t *&dst )
+    {
+        uint32_t c = *src++;
+        if ( c < 0x80 )
+        {
+            *dst++ = (uint8_t)c;
+        }
+        else if ( c < 0x800 )
+        {
+            *dst++ = (uint8_t)( 0xc0 | ( c >> 6 ) );
+            *dst++ = (uint8_t)( 0x80 | ( c & 0x3f ) );
+        }
+        else if ( c < 0xd800 || c > 0xdfff )
+        {
+            *dst++ = (uint8_t)( 0xe0 | ( c >> 12 ) );
+            *dst++ = (uint8_t)( 0x80 | ( ( c >> 6 ) & 0x3f ) );
+            *dst++ = (uint8_t)( 0x80 | ( c & 0x3f ) );
+        }
+        else
+        {
+            if ( c > 0xdbff || src == end || *src < 0xdc00 || *src > 0xdfff )
+                return false;
+            uint32_t codepoint = 0x10000 + ( ( c - 0xd800 ) << 10 ) + ( *src++ - 0xdc00 );
+            *dst++ = (uint8_t)( 0xf0 | ( codepoint >> 18 ) );
+            *dst++ = (uint8_t)( 0x80 | ( ( codepoint >> 12 ) & 0x3f ) );
+            *dst++ = (uint8_t)( 0x80 | ( ( codepoint >> 6 ) & 0x3f ) );
+            *dst++ = (uint8_t)( 0x80 | ( codepoint & 0x3f ) );
+        }
+        return true;
+    }
+
+    static const char16_t ReplacementCharacter = 0xfffd;
+
+    // length of the malformed sequence at `src` that one U+FFFD replaces : the lead byte and the
+    // continuation bytes that could still have completed it (the "maximal subpart")
+    static inline size_t invalid_utf8_length( const uint8_t *src, const uint8_t *end )
+    {
+        uint32_t c = src[0];
+        if ( c < 0xc2 || c > 0xf4 )
+            return 1;
+        size_t follow = c < 0xe0 ? 1 : ( c < 0xf0 ? 2 : 3 );
+        // the second byte range excludes overlong forms, surrogates and code points past U+10FFFF
+        uint8_t low = c == 0xe0 ? 0xa0 : ( c == 0xf0 ? 0x90 : 0x80 );
+        uint8_t high = c == 0xed ? 0x9f : ( c == 0xf4 ? 0x8f : 0xbf );
+        size_t length = 1;
+        while ( length <= follow && src + length < end )
+        {
+            uint8_t b = src[length];
+            if ( length == 1 ? ( b < low || b > high ) : ( b & 0xc0 ) != 0x80 )
+                break;
+            ++length;
+        }
+        return length;
+    }
+
+    // the scalar decoder covers at least this many units before the SIMD kernel is tried again,
+    // so that mixed text doesn't bounce between the two on every character
+    static const size_t ScalarRun = 16;
+
+    static size_t widen( const char *utf8, size_t len, char16_t *ucs, bool replace )
+    {
+        widen_kernel_t kernel = kernels().widen;
+        const uint8_t *src = (const uint8_t*)utf8;
+        const uint8_t *end = src + len;
+        char16_t *dst = ucs;
+        while ( src < end )
+        {
+            size_t ascii = kernel( src, (size_t)( end - src ), dst );
+            src += ascii;
+            dst += ascii;
+            const uint8_t *scalarEnd = (size_t)( end - src ) > ScalarRun ? src + ScalarRun : end;
+            while ( src < scalarEnd )
+            {
+                if ( decode_utf8( src, end, dst ) )
+                    continue;
+                if ( !replace )
+                    return TranscodeInvalid;
+                src += invalid_utf8_length( src, end );
+                *dst++ = ReplacementCharacter;
+            }
+        }
+        return (size_t)( dst - ucs );
+    }
+
+    static size_t narrow( const char16_t *ucs, size_t len, char *utf8, bool replace )
+    {
+        narrow_kernel_t kernel = kernels().narrow;
+        const char16_t *src = ucs;
+        const char16_t *end = src + len;
+        uint8_t *dst = (uint8_t*)utf8;
+        while ( src < end )
+        {
+            size_t ascii = kernel( src, (size_t)( end - src ), dst );
+            src += ascii;
+            dst += ascii;
+            const char16_t *scalarEnd = (size_t)( end - src ) > ScalarRun ? src + ScalarRun : end;
+            while ( src < scalarEnd )
+            {
+                if ( encode_utf8( src, end, dst ) )
+                    continue;
+                if ( !replace )
+                    return TranscodeInvalid;
+                // the unpaired surrogate was consumed, U+FFFD is EF BF BD
+                *dst++ = 0xef;
+                *dst++ = 0xbf;
+                *dst++ = 0xbd;
+            }
+        }
+        return (size_t)( dst - (uint8_t*)utf8 );
+    }
+
+    size_t utf8_to_ucsle( const char *utf8, size_t len, char16_t *ucs )
+    {
+        return widen( utf8, len, ucs, false );
+    }
+
+    size_t ucsle_to_utf8( const char16_t *ucs, size_t len, char *utf8 )
+    {
+        return narrow( ucs, len, utf8, false );
+    }
+
+    size_t utf8_to_ucsle_replace( const char *utf8, size_t len, char16_t *ucs )
+    {
+        return widen( utf8, len, ucs, true );
+    }
+
+    size_t ucsle_to_utf8_replace( const char16_t *ucs, size_t len, char *utf8 )
+    {
+        return narrow( ucs, len, utf8, true );
+    }
+
+    size_t utf8_to_ucsle_length( const char *utf8, size_t len )
+    {
+        const uint8_t *src = (const uint8_t*)utf8;
+        const uint8_t *end = src + len;
+        size_t count = 0;
+        char16_t scratch[2];
+        while ( src < end )
+        {
+            uint64_t word;
+            if ( end - src >= 8 && ( memcpy( &word, src, 8 ), !( word & 0x8080808080808080ull ) ) )
+            {
+                src += 8;
+                count += 8;
+                continue;
+            }
+            if ( *src < 0x80 )
+            {
+                ++src;
+                ++count;
+                continue;
+            }
+            char16_t *dst = scratch;
+            if ( !decode_utf8( src, end, dst ) )
+                return TranscodeInvalid;
+            count += (size_t)( dst - scratch );
+        }
+        return count;
+    }
+
+    size_t ucsle_to_utf8_length( const char16_t *ucs, size_t len )
+    {
+        const char16_t *src = ucs;
+        const char16_t *end = src + len;
+        size_t count = 0;
+        uint8_t scratch[4];
+        while ( src < end )
+        {
+            uint64_t word;
+            if ( end - src >= 4 && ( memcpy( &word, src, 8 ), !( word & 0xff80ff80ff80ff80ull ) ) )
+            {
+                src += 4;
+                count += 4;
+                continue;
+            }
+            if ( *src < 0x80 )
+            {
+                ++src;
+                ++count;
+                continue;
+            }
+            uint8_t *dst = scratch;
+            if ( !encode_utf8( src, end, dst ) )
+                return TranscodeInvalid;
+            count += (size_t)( dst - scratch );
+        }
+        return count;
+    }
+
+    // The size pass also validates, so malformed input is reported before anything is written :
+    // the unbounded flavours stop mid way and would leave a partial prefix in the caller's buffer.
+    // Once the exact size is known to fit, they write exactly that much.
+    size_t utf8_to_ucsle( const char *utf8, size_t len, char16_t *ucs, size_t capacity )
+    {
+        size_t required = utf8_to_ucsle_length( utf8, len );
+        if ( required == TranscodeInvalid || required > capacity )
+            return required;
+        return utf8_to_ucsle( utf8, len, ucs );
+    }
+
+    size_t ucsle_to_utf8( const char16_t *ucs, size_t len, char *utf8, size_t capacity )
+    {
+        size_t required = ucsle_to_utf8_length( ucs, len );
+        if ( required == TranscodeInvalid || required > capacity )
+            return required;
+        return ucsle_to_utf8( ucs, len, utf8 );
+    }
+}
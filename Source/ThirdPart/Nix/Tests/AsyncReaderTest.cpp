@@ -0,0 +1,151 @@
+#include "NixTest.h"
+#include <IO/AsyncReader.h>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+// Reads ranges of a file through AsyncReader : callbacks only run from poll, on the polling thread,
+// cancelled requests never call back and a cancelled future resolves to nullptr.
+
+namespace {
+
+	const char* FileName = "AsyncReaderTest.bin";
+	const size_t FileSize = 1 << 20;
+
+	uint8_t Pattern(size_t _offset) {
+		return (uint8_t)(_offset * 31 + (_offset >> 8));
+	}
+
+	bool Holds(Nix::IFile* _file, size_t _offset, size_t _length) {
+		if (!_file || _file->size() != _length) {
+			return false;
+		}
+		const uint8_t* data = (const uint8_t*)_file->constData();
+		for (size_t i = 0; i < _length; ++i) {
+			if (data[i] != Pattern(_offset + i)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// polls like a frame loop until `_done` requests called back
+	void PollUntil(Nix::AsyncReader& _reader, const size_t& _done, size_t _count) {
+		for (int frame = 0; frame < 5000 && _done < _count; ++frame) {
+			_reader.poll();
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	void CallbackTest(Nix::IArchive* _archive) {
+		Nix::AsyncReader reader;
+		NIX_CHECK(reader.initialize(_archive, 2));
+		std::thread::id pollThread = std::this_thread::get_id();
+		const size_t count = 64;
+		size_t done = 0;
+		for (size_t i = 0; i < count; ++i) {
+			size_t offset = i * 4096 + i;
+			size_t length = 1000 + i * 100;
+			reader.readAsync(FileName, offset, length, [&, offset, length](uint64_t, Nix::IFile* _file) {
+				NIX_CHECK(std::this_thread::get_id() == pollThread);
+				NIX_CHECK(Holds(_file, offset, length));
+				if (_file) {
+					_file->release();
+				}
+				++done;
+			}, (Nix::AsyncPriority)(i % 3));
+		}
+		// whole file, and a missing one fails with nullptr
+		reader.readAsync(FileName, 0, 0, [&](uint64_t, Nix::IFile* _file) {
+			NIX_CHECK(Holds(_file, 0, FileSize));
+			if (_file) {
+				_file->release();
+			}
+			++done;
+		});
+		reader.readAsync("AsyncReaderTest.missing", 0, 0, [&](uint64_t, Nix::IFile* _file) {
+			NIX_CHECK(_file == nullptr);
+			++done;
+		});
+		PollUntil(reader, done, count + 2);
+		NIX_CHECK(done == count + 2);
+		reader.shutdown();
+	}
+
+	void CancelTest(Nix::IArchive* _archive) {
+		Nix::AsyncReader reader;
+		NIX_CHECK(reader.initialize(_archive, 1));
+		// the single worker is busy with whole file reads, the later requests wait in the queue
+		size_t done = 0;
+		for (int i = 0; i < 8; ++i) {
+			reader.readAsync(FileName, 0, 0, [&](uint64_t, Nix::IFile* _file) {
+				if (_file) {
+					_file->release();
+				}
+				++done;
+			}, Nix::AsyncPriorityHigh);
+		}
+		bool cancelledCalledBack = false;
+		uint64_t callbackId = reader.readAsync(FileName, 0, 16, [&](uint64_t, Nix::IFile* _file) {
+			cancelledCalledBack = true;
+			if (_file) {
+				_file->release();
+			}
+		}, Nix::AsyncPriorityLow);
+		uint64_t futureId = 0;
+		std::future<Nix::IFile*> future = reader.readAsync(FileName, 0, 16, futureId, Nix::AsyncPriorityLow);
+		NIX_CHECK(futureId && futureId != callbackId);
+		NIX_CHECK(reader.cancel(callbackId));
+		NIX_CHECK(reader.cancel(futureId));
+		NIX_CHECK(!reader.cancel(futureId));
+		// resolved by cancel, not by the worker reaching the request
+		NIX_CHECK(future.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+		NIX_CHECK(future.get() == nullptr);
+		PollUntil(reader, done, 8);
+		NIX_CHECK(done == 8);
+		// the cancelled requests are popped and dropped by now
+		std::future<Nix::IFile*> last = reader.readAsync(FileName, 100, 50, Nix::AsyncPriorityLow);
+		Nix::IFile* file = last.get();
+		NIX_CHECK(Holds(file, 100, 50));
+		if (file) {
+			file->release();
+		}
+		reader.poll();
+		NIX_CHECK(!cancelledCalledBack);
+		reader.shutdown();
+	}
+
+	// requests still queued at shutdown resolve their futures to nullptr
+	void ShutdownTest(Nix::IArchive* _archive) {
+		Nix::AsyncReader reader;
+		NIX_CHECK(reader.initialize(_archive, 1));
+		std::vector<std::future<Nix::IFile*>> futures;
+		for (int i = 0; i < 32; ++i) {
+			futures.push_back(reader.readAsync(FileName, 0, 0));
+		}
+		reader.shutdown();
+		for (auto& future : futures) {
+			NIX_CHECK(future.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+			Nix::IFile* file = future.get();
+			if (file) {
+				file->release();
+			}
+		}
+	}
+
+}
+
+int main() {
+	Nix::IArchive* archive = Nix::CreateStdArchieve(".");
+	std::vector<uint8_t> content(FileSize);
+	for (size_t i = 0; i < FileSize; ++i) {
+		content[i] = Pattern(i);
+	}
+	NIX_CHECK(archive->save(FileName, content.data(), content.size()));
+	CallbackTest(archive);
+	CancelTest(archive);
+	ShutdownTest(archive);
+	remove(FileName);
+	archive->release();
+	return NIX_TEST_RESULT();
+}
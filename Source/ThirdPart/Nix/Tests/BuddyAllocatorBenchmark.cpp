@@ -0,0 +1,222 @@
+#include "NixTest.h"
+#include <Memory/BuddySystemAllocator.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+// Allocate/free cost on heaps of 10^3 - 10^6 minimum blocks, the per-layer free lists
+// of BuddySystemAllocator against the depth-first tree walk it replaced (kept below as a reference).
+
+namespace {
+
+	class TreeWalkBuddyAllocator {
+		struct node_t {
+			uint8_t free : 1;
+			uint8_t hasChild : 1;
+			uint8_t leftFree : 1;
+			uint8_t rightFree : 1;
+			uint8_t nodeType : 1;
+		};
+		std::vector<node_t> m_nodeTable;
+		size_t m_capacity = 0;
+		size_t m_minSize = 0;
+		size_t m_maxIndex = 0;
+	public:
+		bool initialize(size_t _wholeSize, size_t _minSize) {
+			size_t layer = 0;
+			size_t miniCount = 1;
+			while (miniCount < (_wholeSize / _minSize)) {
+				++layer;
+				miniCount = (size_t)1 << layer;
+			}
+			size_t fullCount = miniCount * 2;
+			m_minSize = _minSize;
+			m_maxIndex = fullCount - 1;
+			m_capacity = _wholeSize;
+			m_nodeTable.assign(fullCount, node_t());
+			m_nodeTable[0].hasChild = false;
+			m_nodeTable[0].free = true;
+			m_nodeTable[1] = m_nodeTable[0];
+			for (size_t i = 0; i < m_nodeTable.size(); ++i) {
+				m_nodeTable[i].nodeType = (i & 0x1);
+			}
+			return true;
+		}
+		bool allocate(size_t _size, size_t& offset_, size_t& id_) {
+			struct alloc_t {
+				size_t layer;
+				size_t index;
+			};
+			std::vector<alloc_t> allocs;
+			allocs.push_back({ 0, 1 });
+			while (!allocs.empty()) {
+				alloc_t alloc = allocs.back();
+				allocs.pop_back();
+				node_t& node = m_nodeTable[alloc.index];
+				if (!node.free) {
+					continue;
+				}
+				size_t nodeSize = m_capacity >> alloc.layer;
+				if (_size < nodeSize >> 1 && (nodeSize >> 1) >= m_minSize) {
+					if (!node.hasChild) {
+						node.hasChild = true;
+						node.leftFree = node.rightFree = true;
+						m_nodeTable[alloc.index * 2].free = true;
+						m_nodeTable[alloc.index * 2].hasChild = false;
+						m_nodeTable[alloc.index * 2 + 1].free = true;
+						m_nodeTable[alloc.index * 2 + 1].hasChild = false;
+					}
+					if (node.rightFree) {
+						allocs.push_back({ alloc.layer + 1, alloc.index * 2 + 1 });
+					}
+					if (node.leftFree) {
+						allocs.push_back({ alloc.layer + 1, alloc.index * 2 });
+					}
+				} else if (!node.hasChild) {
+					if (alloc.index > m_maxIndex) {
+						return false;
+					}
+					size_t layerStartIndex = ((size_t)1 << alloc.layer);
+					offset_ = (alloc.index - layerStartIndex) * (m_capacity / layerStartIndex);
+					id_ = alloc.index;
+					updateTableForAllocate(m_nodeTable[alloc.index], alloc.layer, alloc.index);
+					return true;
+				}
+			}
+			return false;
+		}
+		bool free(size_t _id) {
+			size_t layer = 0;
+			for (size_t v = _id; v != 1; v >>= 1) {
+				++layer;
+			}
+			updateTableForFree(m_nodeTable[_id], layer, _id);
+			return true;
+		}
+	private:
+		void updateTableForAllocate(node_t& _node, size_t _layer, size_t _index) {
+			_node.free = false;
+			_node.hasChild = false;
+			_node.leftFree = _node.rightFree = false;
+			if (_layer) {
+				node_t& parentNode = m_nodeTable[_index / 2];
+				if (_node.nodeType == 0) {
+					parentNode.leftFree = false;
+				} else {
+					parentNode.rightFree = false;
+				}
+			}
+			size_t layer = _layer;
+			size_t index = _index;
+			while (layer) {
+				auto& leftNode = m_nodeTable[(index >> 1) << 1];
+				auto& rightNode = m_nodeTable[((index >> 1) << 1) + 1];
+				auto& parentNode = m_nodeTable[index / 2];
+				parentNode.leftFree = leftNode.free;
+				parentNode.rightFree = rightNode.free;
+				if (leftNode.free || rightNode.free) {
+					break;
+				}
+				parentNode.free = false;
+				--layer;
+				index >>= 1;
+			}
+		}
+		void updateTableForFree(node_t& _node, size_t _layer, size_t _index) {
+			_node.free = true;
+			_node.hasChild = false;
+			if (_layer) {
+				node_t& parentNode = m_nodeTable[_index / 2];
+				if (_node.nodeType == 0) {
+					parentNode.leftFree = true;
+				} else {
+					parentNode.rightFree = true;
+				}
+			}
+			size_t layer = _layer;
+			size_t index = _index;
+			while (layer) {
+				auto& leftNode = m_nodeTable[(index >> 1) << 1];
+				auto& rightNode = m_nodeTable[((index >> 1) << 1) + 1];
+				auto& parentNode = m_nodeTable[index / 2];
+				if (!leftNode.free || !rightNode.free) {
+					break;
+				}
+				parentNode.free = true;
+				parentNode.hasChild = false;
+				--layer;
+				index >>= 1;
+			}
+		}
+	};
+
+	struct FreeListBuddyAllocator {
+		Nix::BuddySystemAllocator allocator;
+		bool initialize(size_t _wholeSize, size_t _minSize) {
+			return allocator.initialize(_wholeSize, _minSize);
+		}
+		bool allocate(size_t _size, size_t& offset_, Nix::BuddyHandle& handle_) {
+			return allocator.allocate(_size, offset_, handle_);
+		}
+		bool free(Nix::BuddyHandle _handle) {
+			return allocator.free(_handle);
+		}
+	};
+
+	// per frame pattern : fills half of the heap with 1-4 block allocations, then frees them all in
+	// random order, until `_operations` blocks went through, returns nanoseconds per allocate/free pair
+	template<class Allocator, class Handle>
+	double Churn(size_t _blockCount, size_t _operations, size_t& failures_) {
+		const size_t minSize = 256;
+		Allocator allocator;
+		allocator.initialize(_blockCount * minSize, minSize);
+		std::mt19937 random(7);
+		std::vector<size_t> sizes(_blockCount / 5);
+		for (auto& size : sizes) {
+			size = minSize * (1 + random() % 4);
+		}
+		std::vector<Handle> live(sizes.size());
+		std::vector<char> allocated(sizes.size());
+		std::vector<size_t> order(sizes.size());
+		for (size_t i = 0; i < order.size(); ++i) {
+			order[i] = i;
+		}
+		std::shuffle(order.begin(), order.end(), random);
+		failures_ = 0;
+		size_t done = 0;
+		size_t offset;
+		double begin = NixSeconds();
+		while (done < _operations) {
+			for (size_t i = 0; i < sizes.size(); ++i) {
+				allocated[i] = allocator.allocate(sizes[i], offset, live[i]);
+				failures_ += !allocated[i];
+			}
+			for (size_t i : order) {
+				if (allocated[i]) {
+					allocator.free(live[i]);
+				}
+			}
+			done += sizes.size();
+		}
+		return (NixSeconds() - begin) * 1e9 / (double)done;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	bool quick = NixBenchQuick(argc, argv);
+	const size_t blockCounts[] = { 1000, 10000, 100000, 1000000 };
+	printf("%10s %16s %16s %8s %16s\n", "blocks", "tree walk ns/op", "free list ns/op", "speedup", "failed allocs");
+	for (size_t blockCount : blockCounts) {
+		if (quick && blockCount > 100000) {
+			break;
+		}
+		size_t operations = quick ? 2000 : 50000;
+		size_t walkFailures = 0;
+		size_t listFailures = 0;
+		double walk = Churn<TreeWalkBuddyAllocator, size_t>(blockCount, operations, walkFailures);
+		double list = Churn<FreeListBuddyAllocator, Nix::BuddyHandle>(blockCount, operations, listFailures);
+		printf("%10zu %16.1f %16.1f %7.1fx %8zu / %zu\n", blockCount, walk, list, walk / list, walkFailures, listFailures);
+	}
+	return NIX_TEST_RESULT();
+}
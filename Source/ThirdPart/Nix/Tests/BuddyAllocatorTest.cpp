@@ -0,0 +1,211 @@
+#include "NixTest.h"
+#include <Memory/BuddySystemAllocator.h>
+#include <Memory/ConcurrentBuddySystemAllocator.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <string.h>
+
+namespace {
+
+	// handles carry 8 generation bits, a stale handle stays invalid for 255 reallocations of its node
+	void StaleHandleTest() {
+		Nix::BuddySystemAllocator allocator;
+		NIX_CHECK(allocator.initialize(1 << 20, 256));
+		size_t offset;
+		Nix::BuddyHandle stale;
+		NIX_CHECK(allocator.allocate(256, offset, stale));
+		NIX_CHECK(allocator.free(stale));
+		for (size_t i = 0; i < 255; ++i) {
+			size_t again;
+			Nix::BuddyHandle handle;
+			NIX_CHECK(allocator.allocate(256, again, handle));
+			NIX_CHECK(again == offset);
+			NIX_CHECK(Nix::BuddySystemAllocator::indexOfHandle(handle) == Nix::BuddySystemAllocator::indexOfHandle(stale));
+			NIX_CHECK(!allocator.validate(stale));
+			NIX_CHECK(allocator.free(handle));
+		}
+	}
+
+	// a block reused from a magazine gets a new generation, the previous owner's handle is dead
+	void MagazineReuseTest() {
+		Nix::ConcurrentBuddySystemAllocator allocator;
+		NIX_CHECK(allocator.initialize(1 << 20, 256));
+		size_t offset;
+		Nix::BuddyHandle stale;
+		NIX_CHECK(allocator.allocate(256, offset, stale));
+		NIX_CHECK(allocator.free(stale));
+		for (size_t i = 0; i < 255; ++i) {
+			size_t again;
+			Nix::BuddyHandle handle;
+			NIX_CHECK(allocator.allocate(256, again, handle));
+			NIX_CHECK(again == offset);
+			NIX_CHECK(handle != stale);
+			NIX_CHECK(!allocator.validate(stale));
+			NIX_CHECK(allocator.free(handle));
+			// every other round the block goes back through the tree
+			if (i & 1) {
+				allocator.flush();
+			}
+		}
+	}
+
+	// more than 64K nodes : a 256 MB heap with 4 KB blocks, and a 4 GB one on 64-bit builds
+	void LargeHeapTest() {
+		Nix::BuddySystemAllocator allocator;
+		NIX_CHECK(allocator.initialize((size_t)256 << 20, 4096));
+		size_t offset;
+		Nix::BuddyHandle handle;
+		NIX_CHECK(allocator.allocate(4096, offset, handle));
+		NIX_CHECK(Nix::BuddySystemAllocator::indexOfHandle(handle) > 0xffff);
+		NIX_CHECK(allocator.offsetOf(Nix::BuddySystemAllocator::indexOfHandle(handle)) == offset);
+		NIX_CHECK(allocator.free(handle));
+		if (sizeof(size_t) == 8) {
+			size_t capacity = (size_t)4 << 30;
+			NIX_CHECK(allocator.initialize(capacity, 4096));
+			NIX_CHECK(allocator.allocate(capacity / 2 + 1, offset, handle));
+			NIX_CHECK(allocator.stats().largestFreeBlock == 0);
+			NIX_CHECK(allocator.free(handle));
+			NIX_CHECK(allocator.allocate(4096, offset, handle));
+			NIX_CHECK(allocator.stats().largestFreeBlock == capacity / 2);
+		}
+	}
+
+	// the node table is a 16 bit bitfield per node, the snapshot copies two bytes of each
+	void SnapshotTest() {
+		Nix::BuddySystemAllocator allocator;
+		NIX_CHECK(allocator.initialize(1 << 20, 256));
+		std::vector<uint8_t> before;
+		allocator.snapshot(before);
+		NIX_CHECK(before.size() == 2 * ((size_t)1 << allocator.layerCount()));
+		size_t offset;
+		Nix::BuddyHandle handle;
+		NIX_CHECK(allocator.allocate(256, offset, handle));
+		std::vector<uint8_t> after;
+		allocator.snapshot(after);
+		NIX_CHECK(after.size() == before.size() && after != before);
+	}
+
+	// every field the same, but `_b` may count `_failures` more failed allocations
+	bool SameStats(const Nix::BuddyAllocatorStats& _a, const Nix::BuddyAllocatorStats& _b, uint64_t _failures) {
+		Nix::BuddyAllocatorStats b = _b;
+		b.failedAllocationCount -= NIX_BUDDY_ALLOCATOR_STATS ? _failures : 0;
+		return !memcmp(&_a, &b, sizeof(b));
+	}
+
+	// a batch that runs out of room half way leaves the heap as it found it
+	void BatchRollbackTest() {
+		const size_t capacity = 1 << 20;
+		Nix::BuddySystemAllocator allocator;
+		NIX_CHECK(allocator.initialize(capacity, 256));
+		size_t offset;
+		Nix::BuddyHandle half, eighth;
+		NIX_CHECK(allocator.allocate(capacity / 2, offset, half));
+		NIX_CHECK(allocator.allocate(capacity / 8, offset, eighth));
+		Nix::BuddyAllocatorStats before = allocator.stats();
+		// three of the five eighths fit, the small blocks after them are never attempted
+		std::vector<size_t> sizes(5, capacity / 8);
+		sizes.insert(sizes.begin() + 2, 10, 300);
+		std::vector<Nix::BuddyAllocation> allocations(sizes.size());
+		for (auto& allocation : allocations) {
+			allocation.handle = 0xdeadbeef;
+		}
+		NIX_CHECK(!allocator.allocateBatch(sizes.data(), sizes.size(), allocations.data()));
+		bool invalid = true;
+		for (auto& allocation : allocations) {
+			invalid = invalid && allocation.handle == Nix::InvalidBuddyHandle;
+		}
+		NIX_CHECK(invalid);
+		Nix::BuddyAllocatorStats after = allocator.stats();
+		NIX_CHECK(SameStats(before, after, 1));
+		// the blocks the rollback gave back are whole again
+		sizes.assign(3, capacity / 8);
+		NIX_CHECK(allocator.allocateBatch(sizes.data(), sizes.size(), allocations.data()));
+		NIX_CHECK(allocator.stats().largestFreeBlock == 0);
+		allocator.freeBatch(allocations.data(), 3);
+		NIX_CHECK(allocator.stats().largestFreeBlock == capacity / 4);
+		NIX_CHECK(allocator.stats().freeBlocks[2] == 1 && allocator.stats().freeBlocks[3] == 1);
+
+		// random batches on a random heap, the failing ones must not leave a trace
+		std::mt19937 random(9);
+		std::vector<Nix::BuddyHandle> live;
+		size_t failed = 0;
+		for (int round = 0; round < 500; ++round) {
+			if (live.size() > 20 || (live.size() && random() % 3 == 0)) {
+				size_t victim = random() % live.size();
+				NIX_CHECK(allocator.free(live[victim]));
+				live[victim] = live.back();
+				live.pop_back();
+			}
+			sizes.resize(1 + random() % 12);
+			for (auto& size : sizes) {
+				size = 256 + random() % (capacity / 16);
+			}
+			allocations.resize(sizes.size());
+			before = allocator.stats();
+			if (allocator.allocateBatch(sizes.data(), sizes.size(), allocations.data())) {
+				for (auto& allocation : allocations) {
+					live.push_back(allocation.handle);
+				}
+			} else {
+				++failed;
+				NIX_CHECK(SameStats(before, allocator.stats(), 1));
+			}
+		}
+		NIX_CHECK(failed > 10);
+	}
+
+	// freeing a batch layer by layer ends in the same heap as freeing its blocks one by one
+	void FreeBatchTest() {
+		const size_t capacity = 4 << 20;
+		Nix::BuddySystemAllocator batched;
+		Nix::BuddySystemAllocator single;
+		std::mt19937 random(13);
+		std::vector<Nix::BuddyAllocation> blocks;
+		for (int round = 0; round < 50; ++round) {
+			// two fresh heaps see the same allocations and hand out the same blocks
+			NIX_CHECK(batched.initialize(capacity, 256));
+			NIX_CHECK(single.initialize(capacity, 256));
+			blocks.clear();
+			for (int i = 0; i < 200; ++i) {
+				Nix::BuddyAllocation block;
+				block.size = 256 << (random() % 9);
+				size_t offset;
+				Nix::BuddyHandle handle;
+				bool allocated = batched.allocate(block.size, block.offset, block.handle);
+				NIX_CHECK(allocated == single.allocate(block.size, offset, handle));
+				if (allocated) {
+					NIX_CHECK(offset == block.offset && handle == block.handle);
+					blocks.push_back(block);
+				}
+			}
+			// a random part of the blocks, buddies and far apart ones, goes back
+			std::shuffle(blocks.begin(), blocks.end(), random);
+			size_t count = random() % (blocks.size() + 1);
+			batched.freeBatch(blocks.data(), count);
+			for (size_t i = 0; i < count; ++i) {
+				NIX_CHECK(single.free(blocks[i].handle));
+			}
+			NIX_CHECK(SameStats(batched.stats(), single.stats(), 0));
+			// the freed handles are dead, and the rest of the blocks merge back into the whole heap
+			NIX_CHECK(count == 0 || !batched.validate(blocks[0].handle));
+			batched.freeBatch(blocks.data() + count, blocks.size() - count);
+			Nix::BuddyAllocatorStats whole = batched.stats();
+			NIX_CHECK(whole.freeBlocks[0] == 1 && whole.largestFreeBlock == capacity && whole.liveAllocations == 0 && whole.bytesInUse == 0);
+			// an empty batch changes nothing
+			batched.freeBatch(nullptr, 0);
+			NIX_CHECK(SameStats(whole, batched.stats(), 0));
+		}
+	}
+
+}
+
+int main() {
+	StaleHandleTest();
+	MagazineReuseTest();
+	LargeHeapTest();
+	SnapshotTest();
+	BatchRollbackTest();
+	FreeBatchTest();
+	return NIX_TEST_RESULT();
+}
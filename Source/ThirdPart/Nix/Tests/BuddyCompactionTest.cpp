@@ -0,0 +1,115 @@
+#include "NixTest.h"
+#include <Memory/BuddySystemAllocator.h>
+#include <vector>
+#include <unordered_map>
+#include <random>
+#include <algorithm>
+
+// Fragments a buddy heap that backs a plain byte array, then compacts it a few kilobytes per "frame" :
+// the moves are carried out on the array with applyMoves, the owners patch their offsets from the
+// relocation callback, and afterwards every live block still holds its own bytes.
+
+namespace {
+
+	const size_t Capacity = 256 * 1024;
+	const size_t MinSize = 256;
+
+	struct owner_t {
+		size_t offset;
+		size_t size;
+		Nix::BuddyHandle handle;
+		uint8_t seed;
+	};
+
+	void Fill(std::vector<uint8_t>& _heap, const owner_t& _owner) {
+		for (size_t i = 0; i < _owner.size; ++i) {
+			_heap[_owner.offset + i] = (uint8_t)(_owner.seed + i * 7);
+		}
+	}
+
+	bool Intact(const std::vector<uint8_t>& _heap, const owner_t& _owner) {
+		for (size_t i = 0; i < _owner.size; ++i) {
+			if (_heap[_owner.offset + i] != (uint8_t)(_owner.seed + i * 7)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void CompactionTest(uint32_t _seed) {
+		Nix::BuddySystemAllocator allocator;
+		NIX_CHECK(allocator.initialize(Capacity, MinSize));
+		std::vector<uint8_t> heap(Capacity, 0xcd);
+		std::mt19937 random(_seed);
+		std::vector<owner_t> owners;
+		for (;;) {
+			owner_t owner;
+			owner.size = MinSize << (random() % 3);
+			owner.seed = (uint8_t)random();
+			if (!allocator.allocate(owner.size, owner.offset, owner.handle)) {
+				break;
+			}
+			Fill(heap, owner);
+			owners.push_back(owner);
+		}
+		// free every other block : lots of free space, no large free block
+		std::shuffle(owners.begin(), owners.end(), random);
+		size_t half = owners.size() / 2;
+		for (size_t i = half; i < owners.size(); ++i) {
+			NIX_CHECK(allocator.free(owners[i].handle));
+		}
+		owners.resize(half);
+		size_t largestBefore = allocator.stats().largestFreeBlock;
+
+		std::unordered_map<Nix::BuddyHandle, size_t> byHandle;
+		for (size_t i = 0; i < owners.size(); ++i) {
+			byHandle[owners[i].handle] = i;
+		}
+		size_t frames = 0;
+		size_t movedBytes = 0;
+		std::vector<Nix::BuddyMove> moves;
+		for (;;) {
+			moves.clear();
+			size_t planned = allocator.planCompaction(8 * 1024, moves, [&](const Nix::BuddyMove& _move) {
+				auto it = byHandle.find(_move.oldHandle);
+				NIX_CHECK(it != byHandle.end());
+				if (it == byHandle.end()) {
+					return;
+				}
+				owner_t& owner = owners[it->second];
+				NIX_CHECK(owner.offset == _move.srcOffset);
+				owner.offset = _move.dstOffset;
+				owner.handle = _move.newHandle;
+				byHandle[_move.newHandle] = it->second;
+				byHandle.erase(it);
+			});
+			NIX_CHECK(planned <= 8 * 1024);
+			if (!planned) {
+				break;
+			}
+			Nix::BuddySystemAllocator::applyMoves(heap.data(), moves.data(), moves.size());
+			movedBytes += planned;
+			++frames;
+		}
+		for (const owner_t& owner : owners) {
+			NIX_CHECK(allocator.validate(owner.handle));
+			NIX_CHECK(Intact(heap, owner));
+		}
+		size_t largestAfter = allocator.stats().largestFreeBlock;
+		NIX_CHECK(largestAfter > largestBefore);
+		// the freed space can be handed out in one piece now
+		size_t offset;
+		Nix::BuddyHandle handle;
+		NIX_CHECK(allocator.allocate(largestAfter, offset, handle));
+		printf("%zu live blocks, %zu bytes moved in %zu frames, largest free block %zu -> %zu\n",
+			owners.size(), movedBytes, frames, largestBefore, largestAfter);
+	}
+
+}
+
+int main() {
+	CompactionTest(1);
+	CompactionTest(2);
+	CompactionTest(3);
+	return NIX_TEST_RESULT();
+}
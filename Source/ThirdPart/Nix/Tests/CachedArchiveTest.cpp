@@ -0,0 +1,150 @@
+#include "NixTest.h"
+#include <IO/CachedArchive.h>
+#include <IO/Directory.h>
+#include <vector>
+#include <string>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A disk backed cache across several "runs" (cache instances on the same directory) : indexed
+// paths are served from the disk copy while the source is unchanged, a source file that changed
+// or a path that was invalidated goes back to the source.
+
+namespace {
+
+	const char* SourceDirectory = "CachedArchiveTest.src";
+	const char* CacheDirectory = "CachedArchiveTest.cache";
+
+	void MakeDirectory(const char* _path) {
+#ifdef _WIN32
+		_mkdir(_path);
+#else
+		mkdir(_path, 0755);
+#endif
+	}
+
+	void RemoveDirectory(const std::string& _path) {
+		std::vector<Nix::DirectoryEntry> entries;
+		Nix::ListDirectory(_path, "", false, entries);
+		for (auto& entry : entries) {
+			remove((_path + "/" + entry.path).c_str());
+		}
+#ifdef _WIN32
+		_rmdir(_path.c_str());
+#else
+		rmdir(_path.c_str());
+#endif
+	}
+
+	std::string Read(Nix::IArchive* _archive, const std::string& _path) {
+		Nix::IFile* file = _archive->open(_path);
+		if (!file) {
+			return std::string();
+		}
+		std::string content(file->size(), 0);
+		NIX_CHECK(file->read(content.size(), &content[0]) == content.size());
+		file->release();
+		return content;
+	}
+
+	// one run of the application : opens `_path` once and returns how it was served
+	struct run_t {
+		std::string content;
+		Nix::CachedArchiveStats stats;
+	};
+
+	run_t Run(Nix::IArchive* _source, const std::string& _path, bool _invalidate = false) {
+		Nix::CachedArchive* cache = Nix::CreateCachedArchive(_source, 1 << 20, CacheDirectory);
+		run_t run;
+		run.content = Read(cache, _path);
+		if (_invalidate) {
+			cache->invalidate(_path);
+		}
+		run.stats = cache->stats();
+		cache->release();
+		return run;
+	}
+
+	void DiskIndexTest() {
+		MakeDirectory(SourceDirectory);
+		Nix::IArchive* source = Nix::CreateStdArchieve(SourceDirectory);
+		std::string first = "first version of the asset";
+		NIX_CHECK(source->save("asset.txt", first.data(), first.size()));
+		NIX_CHECK(source->save("other.txt", "other", 5));
+
+		// first run loads from the source, a second open in the same run stays in memory
+		Nix::CachedArchive* cache = Nix::CreateCachedArchive(source, 1 << 20, CacheDirectory);
+		NIX_CHECK(Read(cache, "asset.txt") == first);
+		NIX_CHECK(Read(cache, "./asset.txt") == first);
+		NIX_CHECK(Read(cache, "other.txt") == "other");
+		Nix::CachedArchiveStats stats = cache->stats();
+		NIX_CHECK(stats.misses == 2 && stats.hits == 1 && stats.diskHits == 0);
+		Nix::FileInfo info;
+		NIX_CHECK(cache->fileInfo("asset.txt", info) && info.size == first.size());
+		cache->release();
+
+		// unchanged source : served from the disk copy
+		run_t run = Run(source, "asset.txt");
+		NIX_CHECK(run.content == first);
+		NIX_CHECK(run.stats.diskHits == 1 && run.stats.misses == 0);
+
+		// the source changed : the indexed copy is stale and skipped
+		std::string second = "second, longer version of the asset";
+		NIX_CHECK(source->save("asset.txt", second.data(), second.size()));
+		run = Run(source, "asset.txt");
+		NIX_CHECK(run.content == second);
+		NIX_CHECK(run.stats.diskHits == 0 && run.stats.misses == 1);
+		run = Run(source, "asset.txt");
+		NIX_CHECK(run.content == second && run.stats.diskHits == 1);
+
+		// invalidated : the next run goes to the source even though nothing changed
+		run = Run(source, "asset.txt", true);
+		NIX_CHECK(run.stats.diskHits == 1);
+		run = Run(source, "asset.txt");
+		NIX_CHECK(run.content == second && run.stats.diskHits == 0 && run.stats.misses == 1);
+
+		// removed from the source : not served from the cache either
+		remove((std::string(SourceDirectory) + "/other.txt").c_str());
+		run = Run(source, "other.txt");
+		NIX_CHECK(run.content.empty() && run.stats.diskHits == 0);
+
+		source->release();
+		RemoveDirectory(SourceDirectory);
+		RemoveDirectory(CacheDirectory);
+	}
+
+	// index lines without size and time can't be checked and are ignored
+	void OldIndexTest() {
+		MakeDirectory(SourceDirectory);
+		MakeDirectory(CacheDirectory);
+		Nix::IArchive* source = Nix::CreateStdArchieve(SourceDirectory);
+		NIX_CHECK(source->save("asset.txt", "fresh", 5));
+		FILE* index = fopen((std::string(CacheDirectory) + "/index.txt").c_str(), "wb");
+		NIX_CHECK(index != nullptr);
+		if (index) {
+			fprintf(index, "%016llx asset.txt\n", (unsigned long long)Nix::HashFileContent("stale", 5));
+			fclose(index);
+		}
+		Nix::IArchive* blobs = Nix::CreateStdArchieve(CacheDirectory);
+		char blobName[32];
+		snprintf(blobName, sizeof(blobName), "%016llx.blob", (unsigned long long)Nix::HashFileContent("stale", 5));
+		NIX_CHECK(blobs->save(blobName, "stale", 5));
+		blobs->release();
+		run_t run = Run(source, "asset.txt");
+		NIX_CHECK(run.content == "fresh" && run.stats.diskHits == 0);
+		source->release();
+		RemoveDirectory(SourceDirectory);
+		RemoveDirectory(CacheDirectory);
+	}
+
+}
+
+int main() {
+	DiskIndexTest();
+	OldIndexTest();
+	return NIX_TEST_RESULT();
+}
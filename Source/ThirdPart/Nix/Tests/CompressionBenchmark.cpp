@@ -0,0 +1,121 @@
+#include "NixTest.h"
+#include <IO/Compression.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+
+// DecompressToMemory, which decodes on the shared pool, against the previous scheme that started
+// hardware_concurrency() threads for every call. Small containers are the pak entries and streamed
+// chunks read every frame, where starting threads used to cost more than the decode itself.
+
+namespace {
+
+	const uint32_t BlockSize = Nix::DefaultCompressedBlockSize;
+	volatile size_t Sink;
+
+	std::vector<uint8_t> Content(size_t _size) {
+		std::mt19937 random(1);
+		std::vector<uint8_t> content(_size);
+		static const char words[] = "vertex index buffer texture shader pipeline ";
+		for (size_t i = 0; i < _size; ++i) {
+			content[i] = random() % 8 ? (uint8_t)words[i % (sizeof(words) - 1)] : (uint8_t)random();
+		}
+		return content;
+	}
+
+	// the decode before the shared pool, one batch of threads per call
+	bool SpawnDecode(const std::vector<uint8_t>& _compressed, uint8_t* raw_) {
+		Nix::compressed_header_t header;
+		memcpy(&header, _compressed.data(), sizeof(header));
+		const uint64_t* offsets = (const uint64_t*)(_compressed.data() + sizeof(header));
+		const uint8_t* blocks = _compressed.data() + sizeof(header) + sizeof(uint64_t) * (header.blockCount + 1);
+		auto decode = [&](uint32_t _block) -> bool {
+			size_t storedSize = (size_t)(offsets[_block + 1] - offsets[_block]);
+			size_t rawSize = (size_t)std::min<uint64_t>(header.blockSize, header.rawSize - (uint64_t)_block * header.blockSize);
+			uint8_t* dst = raw_ + (size_t)_block * header.blockSize;
+			if (storedSize == rawSize) {
+				memcpy(dst, blocks + offsets[_block], rawSize);
+				return true;
+			}
+			return Nix::Lz4DecompressBlock(blocks + offsets[_block], storedSize, dst, rawSize);
+		};
+		uint32_t threadCount = std::min<uint32_t>(std::max<uint32_t>(std::thread::hardware_concurrency(), 1), header.blockCount);
+		std::atomic<uint32_t> next(0);
+		std::atomic<bool> failed(false);
+		auto worker = [&]() {
+			for (uint32_t i = next++; i < header.blockCount && !failed; i = next++) {
+				if (!decode(i)) {
+					failed = true;
+				}
+			}
+		};
+		std::vector<std::thread> threads;
+		for (uint32_t i = 1; i < threadCount; ++i) {
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		return !failed;
+	}
+
+	void Measure(size_t _rawSize, size_t _iterations) {
+		std::vector<uint8_t> raw = Content(_rawSize);
+		std::vector<uint8_t> compressed;
+		NIX_CHECK(Nix::CompressBlocks(raw.data(), raw.size(), BlockSize, compressed));
+		std::vector<uint8_t> out(raw.size());
+		double begin = NixSeconds();
+		for (size_t i = 0; i < _iterations; ++i) {
+			NIX_CHECK(SpawnDecode(compressed, out.data()));
+			Sink = out[i % out.size()];
+		}
+		double spawn = (NixSeconds() - begin) / _iterations;
+		NIX_CHECK(out == raw);
+		begin = NixSeconds();
+		for (size_t i = 0; i < _iterations; ++i) {
+			Nix::IFile* file = Nix::DecompressToMemory(compressed.data(), compressed.size());
+			NIX_CHECK(file != nullptr);
+			if (file) {
+				Sink = ((const uint8_t*)file->constData())[i % raw.size()];
+				file->release();
+			}
+		}
+		double pool = (NixSeconds() - begin) / _iterations;
+		printf("%8zu KB %6zu blocks  %9.1f us %8.0f MB/s  %9.1f us %8.0f MB/s\n",
+			_rawSize >> 10, (_rawSize + BlockSize - 1) / BlockSize,
+			spawn * 1e6, _rawSize / spawn / 1048576.0, pool * 1e6, _rawSize / pool / 1048576.0);
+	}
+
+	// one thread decoding one block after another, the cost of a cold start before any pool helps
+	void MeasureBlock(size_t _iterations) {
+		std::vector<uint8_t> raw = Content(BlockSize);
+		std::vector<uint8_t> packed(Nix::Lz4CompressBound(raw.size()));
+		size_t packedSize = Nix::Lz4CompressBlock(raw.data(), raw.size(), packed.data(), packed.size());
+		NIX_CHECK(packedSize != 0);
+		std::vector<uint8_t> out(raw.size());
+		double begin = NixSeconds();
+		for (size_t i = 0; i < _iterations; ++i) {
+			NIX_CHECK(Nix::Lz4DecompressBlock(packed.data(), packedSize, out.data(), out.size()));
+		}
+		double seconds = NixSeconds() - begin;
+		NIX_CHECK(out == raw);
+		printf("Lz4DecompressBlock, one thread : %.0f MB/s\n", raw.size() * (double)_iterations / seconds / 1048576.0);
+	}
+
+}
+
+int main(int argc, char** argv) {
+	bool quick = NixBenchQuick(argc, argv);
+	MeasureBlock(quick ? 64 : 2048);
+	printf("%d hardware threads\n", (int)std::thread::hardware_concurrency());
+	printf("%11s %13s  %24s  %24s\n", "size", "", "thread per call", "shared pool");
+	const size_t sizes[] = { 2 * BlockSize, 4 * BlockSize, 16 * BlockSize, 256 * BlockSize };
+	for (size_t size : sizes) {
+		size_t iterations = std::max<size_t>((quick ? (16 << 20) : (512 << 20)) / size, 4);
+		Measure(size, iterations);
+	}
+	return NIX_TEST_RESULT();
+}
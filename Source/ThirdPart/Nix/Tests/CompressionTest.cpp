@@ -0,0 +1,193 @@
+#include "NixTest.h"
+#include <IO/Compression.h>
+#include <vector>
+#include <thread>
+#include <random>
+
+// Block compressed containers : round trips around the block boundaries, streaming reads with
+// seeks, corrupted and truncated input, and several threads decoding at once through the shared
+// decode pool.
+
+namespace {
+
+	const uint32_t BlockSize = Nix::DefaultCompressedBlockSize;
+
+	// text like runs with some noise, compresses to about a third
+	std::vector<uint8_t> Content(size_t _size, uint32_t _seed) {
+		std::mt19937 random(_seed);
+		std::vector<uint8_t> content(_size);
+		static const char words[] = "vertex index buffer texture shader pipeline ";
+		for (size_t i = 0; i < _size; ++i) {
+			content[i] = random() % 8 ? (uint8_t)words[(i + _seed) % (sizeof(words) - 1)] : (uint8_t)random();
+		}
+		return content;
+	}
+
+	bool Decodes(const std::vector<uint8_t>& _compressed, const std::vector<uint8_t>& _raw) {
+		Nix::IFile* file = Nix::DecompressToMemory(_compressed.data(), _compressed.size());
+		if (!file) {
+			return false;
+		}
+		bool equal = file->size() == _raw.size() && (_raw.empty() || memcmp(file->constData(), _raw.data(), _raw.size()) == 0);
+		file->release();
+		return equal;
+	}
+
+	void RoundTripTest() {
+		const size_t sizes[] = { 0, 1, 100, BlockSize - 1, BlockSize, BlockSize + 1, 3 * BlockSize, 40 * BlockSize + 17 };
+		for (size_t size : sizes) {
+			std::vector<uint8_t> raw = Content(size, (uint32_t)size);
+			std::vector<uint8_t> compressed;
+			NIX_CHECK(Nix::CompressBlocks(raw.data(), raw.size(), BlockSize, compressed));
+			NIX_CHECK(Nix::IsCompressedContainer(compressed.data(), compressed.size()));
+			NIX_CHECK(Decodes(compressed, raw));
+		}
+		// noise is stored as is and still decodes
+		std::mt19937 random(5);
+		std::vector<uint8_t> noise(5 * BlockSize);
+		for (uint8_t& byte : noise) {
+			byte = (uint8_t)random();
+		}
+		std::vector<uint8_t> compressed;
+		NIX_CHECK(Nix::CompressBlocks(noise.data(), noise.size(), BlockSize, compressed));
+		NIX_CHECK(Decodes(compressed, noise));
+	}
+
+	// periodic content : matches that overlap their own output at every offset the decoder
+	// special cases, and long ones near the end of the block
+	void PeriodTest() {
+		for (size_t period = 1; period <= 40; ++period) {
+			for (size_t size : { (size_t)20, (size_t)100, (size_t)5000 }) {
+				std::vector<uint8_t> raw(size);
+				for (size_t i = 0; i < size; ++i) {
+					raw[i] = i < 3 ? (uint8_t)('x' + i) : (uint8_t)('a' + (i % period));
+				}
+				std::vector<uint8_t> packed(Nix::Lz4CompressBound(size));
+				size_t packedSize = Nix::Lz4CompressBlock(raw.data(), size, packed.data(), packed.size());
+				NIX_CHECK(packedSize != 0);
+				std::vector<uint8_t> out(size);
+				NIX_CHECK(Nix::Lz4DecompressBlock(packed.data(), packedSize, out.data(), out.size()));
+				NIX_CHECK(out == raw);
+			}
+		}
+	}
+
+	void StreamTest() {
+		std::vector<uint8_t> raw = Content(20 * BlockSize + 999, 7);
+		std::vector<uint8_t> compressed;
+		NIX_CHECK(Nix::CompressBlocks(raw.data(), raw.size(), BlockSize, compressed));
+		void* copy = malloc(compressed.size());
+		memcpy(copy, compressed.data(), compressed.size());
+		Nix::IFile* file = Nix::CreateCompressedFile(Nix::CreateMemoryBuffer(copy, compressed.size(), [](void* _ptr) { free(_ptr); }));
+		NIX_CHECK(file && file->size() == raw.size());
+		if (!file) {
+			return;
+		}
+		std::mt19937 random(9);
+		std::vector<uint8_t> out;
+		for (int i = 0; i < 200; ++i) {
+			// small reads inside a block and large ones over many whole blocks
+			size_t offset = random() % raw.size();
+			size_t length = i % 4 ? random() % 3000 : random() % (8 * BlockSize);
+			if (i % 5 == 0) {
+				offset = (offset / BlockSize) * BlockSize;
+			}
+			size_t expected = std::min(length, raw.size() - offset);
+			NIX_CHECK(file->seek(Nix::SeekSet, (int64_t)offset));
+			out.assign(length, 0);
+			NIX_CHECK(file->read(length, out.data()) == expected);
+			NIX_CHECK(memcmp(out.data(), raw.data() + offset, expected) == 0);
+			NIX_CHECK(file->tell() == offset + expected);
+		}
+		file->release();
+	}
+
+	// damaged containers are refused or decode to the right size, they never read or write out of bounds
+	void CorruptionTest() {
+		std::vector<uint8_t> raw = Content(8 * BlockSize, 3);
+		std::vector<uint8_t> compressed;
+		NIX_CHECK(Nix::CompressBlocks(raw.data(), raw.size(), BlockSize, compressed));
+		for (size_t length = 0; length < compressed.size(); length += 1 + length / 2) {
+			NIX_CHECK(Nix::DecompressToMemory(compressed.data(), length) == nullptr);
+		}
+		std::mt19937 random(4);
+		for (int i = 0; i < 500; ++i) {
+			std::vector<uint8_t> damaged = compressed;
+			for (int flips = 1 + i % 4; flips; --flips) {
+				damaged[random() % damaged.size()] ^= (uint8_t)(1 + random() % 255);
+			}
+			Nix::IFile* file = Nix::DecompressToMemory(damaged.data(), damaged.size());
+			if (file) {
+				NIX_CHECK(file->size() == raw.size());
+				file->release();
+			}
+		}
+	}
+
+	// headers whose sizes don't add up, some of them overflowing, are refused before anything is
+	// allocated or indexed
+	void MalformedHeaderTest() {
+		std::vector<uint8_t> raw = Content(3 * BlockSize + 5, 2);
+		std::vector<uint8_t> compressed;
+		NIX_CHECK(Nix::CompressBlocks(raw.data(), raw.size(), BlockSize, compressed));
+		Nix::compressed_header_t valid;
+		memcpy(&valid, compressed.data(), sizeof(valid));
+		struct {
+			uint64_t rawSize;
+			uint32_t blockSize;
+			uint32_t blockCount;
+		} headers[] = {
+			{ ~0ull - 10, BlockSize, 0 },           // wrapped around to 0 blocks
+			{ ~0ull, 1, 0 },
+			{ 1ull << 40, BlockSize, 4 },           // more than the blocks hold
+			{ 1, BlockSize, 0 },
+			{ 0, BlockSize, 1 },                    // an empty last block
+			{ 3 * (uint64_t)BlockSize, BlockSize, 4 },
+			{ raw.size(), 0, 4 },
+			{ raw.size(), BlockSize, 0xffffffffu },  // a table past the end of the data
+		};
+		for (auto& test : headers) {
+			std::vector<uint8_t> damaged = compressed;
+			Nix::compressed_header_t header = valid;
+			header.rawSize = test.rawSize;
+			header.blockSize = test.blockSize;
+			header.blockCount = test.blockCount;
+			memcpy(damaged.data(), &header, sizeof(header));
+			NIX_CHECK(!Nix::IsCompressedContainer(damaged.data(), damaged.size()));
+			NIX_CHECK(Nix::DecompressToMemory(damaged.data(), damaged.size()) == nullptr);
+			NIX_CHECK(Nix::CreateCompressedFile(Nix::CreateMemoryBuffer(damaged.data(), damaged.size())) == nullptr);
+		}
+		// an empty container is fine
+		std::vector<uint8_t> empty;
+		NIX_CHECK(Nix::CompressBlocks(nullptr, 0, BlockSize, empty));
+		NIX_CHECK(Decodes(empty, std::vector<uint8_t>()));
+	}
+
+	void ConcurrentTest() {
+		std::vector<uint8_t> raw = Content(64 * BlockSize, 11);
+		std::vector<uint8_t> compressed;
+		NIX_CHECK(Nix::CompressBlocks(raw.data(), raw.size(), BlockSize, compressed));
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 8; ++t) {
+			threads.emplace_back([&]() {
+				for (int i = 0; i < 10; ++i) {
+					NIX_CHECK(Decodes(compressed, raw));
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+	}
+
+}
+
+int main() {
+	RoundTripTest();
+	PeriodTest();
+	StreamTest();
+	CorruptionTest();
+	MalformedHeaderTest();
+	ConcurrentTest();
+	return NIX_TEST_RESULT();
+}
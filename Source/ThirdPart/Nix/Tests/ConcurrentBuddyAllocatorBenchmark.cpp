@@ -0,0 +1,105 @@
+#include "NixTest.h"
+#include <Memory/ConcurrentBuddySystemAllocator.h>
+#include <thread>
+#include <vector>
+#include <random>
+#include <mutex>
+#include <atomic>
+
+// Allocate/free throughput of 1 - 16 threads sharing one heap : ConcurrentBuddySystemAllocator
+// against BuddySystemAllocator behind one mutex, the way a shared heap is guarded without it.
+// Every thread allocates a batch of 256 B - 8 KB blocks (a command list's worth of uploads) and
+// frees it again. The numbers only show contention on a machine with that many cores.
+
+namespace {
+
+	const size_t MinSize = 256;
+	const size_t Capacity = 64 << 20;
+	const size_t BatchSize = 16;
+
+	struct LockedBuddyAllocator {
+		Nix::BuddySystemAllocator allocator;
+		std::mutex mutex;
+
+		bool initialize(size_t _wholeSize, size_t _minSize) {
+			return allocator.initialize(_wholeSize, _minSize);
+		}
+		bool allocate(size_t _size, size_t& offset_, Nix::BuddyHandle& handle_) {
+			std::lock_guard<std::mutex> lock(mutex);
+			return allocator.allocate(_size, offset_, handle_);
+		}
+		bool free(Nix::BuddyHandle _handle) {
+			std::lock_guard<std::mutex> lock(mutex);
+			return allocator.free(_handle);
+		}
+	};
+
+	// millions of allocate/free pairs per second over all threads
+	template<class Allocator>
+	double Run(size_t _threadCount, size_t _batches, size_t& failures_) {
+		Allocator allocator;
+		allocator.initialize(Capacity, MinSize);
+		std::atomic<size_t> ready(0);
+		std::atomic<bool> start(false);
+		std::atomic<size_t> failures(0);
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < _threadCount; ++t) {
+			threads.emplace_back([&, t]() {
+				std::mt19937 random((uint32_t)t + 1);
+				size_t sizes[BatchSize];
+				for (auto& size : sizes) {
+					size = MinSize << (random() % 6);
+				}
+				Nix::BuddyHandle handles[BatchSize];
+				size_t offset;
+				size_t failed = 0;
+				++ready;
+				while (!start.load()) {
+					std::this_thread::yield();
+				}
+				for (size_t batch = 0; batch < _batches; ++batch) {
+					for (size_t i = 0; i < BatchSize; ++i) {
+						if (!allocator.allocate(sizes[i], offset, handles[i])) {
+							handles[i] = Nix::InvalidBuddyHandle;
+							++failed;
+						}
+					}
+					for (size_t i = 0; i < BatchSize; ++i) {
+						if (handles[i] != Nix::InvalidBuddyHandle) {
+							allocator.free(handles[i]);
+						}
+					}
+				}
+				failures += failed;
+			});
+		}
+		while (ready.load() != _threadCount) {
+			std::this_thread::yield();
+		}
+		double begin = NixSeconds();
+		start = true;
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		double seconds = NixSeconds() - begin;
+		failures_ = failures.load();
+		return (double)(_threadCount * _batches * BatchSize) / seconds * 1e-6;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	bool quick = NixBenchQuick(argc, argv);
+	size_t batches = quick ? 500 : 50000;
+	const size_t threadCounts[] = { 1, 2, 4, 8, 16 };
+	printf("%d hardware threads\n%8s %18s %18s %8s\n", (int)std::thread::hardware_concurrency(), "threads", "locked Mpairs/s", "concurrent Mpairs/s", "speedup");
+	for (size_t threadCount : threadCounts) {
+		size_t lockedFailures = 0;
+		size_t concurrentFailures = 0;
+		double locked = Run<LockedBuddyAllocator>(threadCount, batches, lockedFailures);
+		double concurrent = Run<Nix::ConcurrentBuddySystemAllocator>(threadCount, batches, concurrentFailures);
+		printf("%8zu %18.2f %18.2f %7.2fx\n", threadCount, locked, concurrent, concurrent / locked);
+		NIX_CHECK(!lockedFailures && !concurrentFailures);
+	}
+	return NIX_TEST_RESULT();
+}
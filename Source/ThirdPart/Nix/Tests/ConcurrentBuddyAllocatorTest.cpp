@@ -0,0 +1,192 @@
+#include "NixTest.h"
+#include <Memory/ConcurrentBuddySystemAllocator.h>
+#include <thread>
+#include <vector>
+#include <random>
+#include <mutex>
+#include <atomic>
+
+// Workers allocate and free at the same time while a "render thread" frees blocks the workers hand
+// over. Every handed out range is stamped in a per minimum block owner map, an overlap means the
+// allocator gave one block to two owners.
+
+namespace {
+
+	const size_t MinSize = 256;
+	const size_t Capacity = 16 << 20;
+
+	struct block_t {
+		size_t offset;
+		size_t size;
+		Nix::BuddyHandle handle;
+	};
+
+	struct Shared {
+		Nix::ConcurrentBuddySystemAllocator allocator;
+		std::vector<std::atomic<uint32_t>> owners;
+		std::mutex handOverMutex;
+		std::vector<block_t> handOver;
+		std::atomic<bool> workersDone;
+		std::atomic<size_t> overlaps;
+		std::atomic<size_t> failedFrees;
+
+		Shared()
+		: owners(Capacity / MinSize)
+		, workersDone(false)
+		, overlaps(0)
+		, failedFrees(0) {
+			for (auto& owner : owners) {
+				owner.store(0);
+			}
+		}
+
+		void stamp(const block_t& _block, uint32_t _owner) {
+			for (size_t slot = _block.offset / MinSize; slot < (_block.offset + _block.size + MinSize - 1) / MinSize; ++slot) {
+				uint32_t expected = 0;
+				if (!owners[slot].compare_exchange_strong(expected, _owner)) {
+					++overlaps;
+				}
+			}
+		}
+
+		void release(const block_t& _block) {
+			for (size_t slot = _block.offset / MinSize; slot < (_block.offset + _block.size + MinSize - 1) / MinSize; ++slot) {
+				owners[slot].store(0);
+			}
+			if (!allocator.free(_block.handle)) {
+				++failedFrees;
+			}
+		}
+	};
+
+	void Worker(Shared& _shared, uint32_t _id) {
+		std::mt19937 random(_id);
+		std::vector<block_t> live;
+		for (size_t i = 0; i < 20000; ++i) {
+			if (live.size() < 64 && random() % 3) {
+				block_t block;
+				block.size = MinSize << (random() % 6);
+				block.size -= random() % MinSize;
+				if (_shared.allocator.allocate(block.size, block.offset, block.handle)) {
+					_shared.stamp(block, _id);
+					live.push_back(block);
+				}
+			} else if (!live.empty()) {
+				size_t victim = random() % live.size();
+				block_t block = live[victim];
+				live[victim] = live.back();
+				live.pop_back();
+				if (random() % 2) {
+					_shared.release(block);
+				} else {
+					// the render thread clears the stamp and frees it
+					std::lock_guard<std::mutex> lock(_shared.handOverMutex);
+					_shared.handOver.push_back(block);
+				}
+			}
+		}
+		for (auto& block : live) {
+			_shared.release(block);
+		}
+	}
+
+	void RenderThread(Shared& _shared) {
+		std::vector<block_t> blocks;
+		for (;;) {
+			bool done = _shared.workersDone.load();
+			{
+				std::lock_guard<std::mutex> lock(_shared.handOverMutex);
+				blocks.swap(_shared.handOver);
+			}
+			for (auto& block : blocks) {
+				_shared.release(block);
+			}
+			blocks.clear();
+			if (done) {
+				break;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	void StressTest(size_t _workerCount) {
+		Shared shared;
+		NIX_CHECK(shared.allocator.initialize(Capacity, MinSize));
+		std::thread render(RenderThread, std::ref(shared));
+		std::vector<std::thread> workers;
+		for (size_t i = 0; i < _workerCount; ++i) {
+			workers.emplace_back(Worker, std::ref(shared), (uint32_t)i + 1);
+		}
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		shared.workersDone.store(true);
+		render.join();
+		NIX_CHECK(shared.overlaps.load() == 0);
+		NIX_CHECK(shared.failedFrees.load() == 0);
+		// everything is back : after a flush the whole heap is one block again
+		shared.allocator.flush();
+		size_t offset;
+		Nix::BuddyHandle handle;
+		NIX_CHECK(shared.allocator.allocate(Capacity, offset, handle) && offset == 0);
+		printf("%zu workers : %zu overlaps, %zu failed frees\n", _workerCount, shared.overlaps.load(), shared.failedFrees.load());
+	}
+
+	// a block freed by another thread goes back to the magazine of the thread that allocated it
+	void CrossThreadFreeTest() {
+		Nix::ConcurrentBuddySystemAllocator allocator;
+		NIX_CHECK(allocator.initialize(Capacity, MinSize));
+		std::thread worker([&allocator]() {
+			size_t first;
+			Nix::BuddyHandle handle;
+			NIX_CHECK(allocator.allocate(MinSize, first, handle));
+			std::thread([&allocator, handle]() {
+				NIX_CHECK(allocator.free(handle));
+				NIX_CHECK(!allocator.validate(handle));
+			}).join();
+			size_t second;
+			NIX_CHECK(allocator.allocate(MinSize, second, handle));
+			NIX_CHECK(second == first);
+			NIX_CHECK(allocator.free(handle));
+		});
+		worker.join();
+	}
+
+#ifdef NDEBUG
+	// free() asserts on a double free, the race is only run when asserts are compiled out
+	void DoubleFreeTest() {
+		Nix::ConcurrentBuddySystemAllocator allocator;
+		NIX_CHECK(allocator.initialize(Capacity, MinSize));
+		for (size_t i = 0; i < 1000; ++i) {
+			size_t offset;
+			Nix::BuddyHandle handle;
+			NIX_CHECK(allocator.allocate(MinSize, offset, handle));
+			std::atomic<int> succeeded(0);
+			std::thread a([&]() { succeeded += allocator.free(handle); });
+			std::thread b([&]() { succeeded += allocator.free(handle); });
+			a.join();
+			b.join();
+			NIX_CHECK(succeeded.load() == 1);
+		}
+		// a double free must not have cached the block twice : two allocations never share it
+		size_t a, b;
+		Nix::BuddyHandle handleA, handleB;
+		NIX_CHECK(allocator.allocate(MinSize, a, handleA));
+		NIX_CHECK(allocator.allocate(MinSize, b, handleB));
+		NIX_CHECK(a != b);
+	}
+#endif
+
+}
+
+int main() {
+	CrossThreadFreeTest();
+#ifdef NDEBUG
+	DoubleFreeTest();
+#endif
+	StressTest(8);
+	StressTest(16);
+	// more threads than magazines, threads share them
+	StressTest(24);
+	return NIX_TEST_RESULT();
+}
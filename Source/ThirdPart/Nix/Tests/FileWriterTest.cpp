@@ -0,0 +1,230 @@
+#include "NixTest.h"
+#include <IO/FileWriter.h>
+#include <IO/Compression.h>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// FileWriter, SaveFileAtomic and AsyncWriter : a committed file holds exactly what was written,
+// compressed or not, an aborted or failed write leaves the previous file and no temp file behind,
+// and async saves complete in order, through shutdown too.
+
+namespace {
+
+	const char* FileName = "FileWriterTest.bin";
+	const char* TempName = "FileWriterTest.bin.tmp";
+	const char* BlocksName = "FileWriterTest.bin.blocks.tmp";
+
+	std::vector<uint8_t> Content(size_t _size, uint32_t _seed) {
+		std::vector<uint8_t> content(_size);
+		uint32_t state = _seed;
+		for (size_t i = 0; i < _size; ++i) {
+			state = state * 1664525 + 1013904223;
+			// runs of text like bytes and noise, so blocks compress by different amounts
+			content[i] = (i >> 14) & 1 ? (uint8_t)(state >> 24) : (uint8_t)('a' + (i / 7) % 26);
+		}
+		return content;
+	}
+
+	bool Exists(const char* _path) {
+		FILE* file = fopen(_path, "rb");
+		if (file) {
+			fclose(file);
+		}
+		return file != nullptr;
+	}
+
+	std::vector<uint8_t> Load(const char* _path) {
+		std::vector<uint8_t> content;
+		FILE* file = fopen(_path, "rb");
+		if (!file) {
+			return content;
+		}
+		uint8_t block[65536];
+		size_t bytes;
+		while ((bytes = fread(block, 1, sizeof(block), file)) > 0) {
+			content.insert(content.end(), block, block + bytes);
+		}
+		fclose(file);
+		return content;
+	}
+
+	bool MakeDirectory(const char* _path) {
+#ifdef _WIN32
+		return _mkdir(_path) == 0;
+#else
+		return mkdir(_path, 0755) == 0;
+#endif
+	}
+
+	bool RemoveDirectory(const char* _path) {
+#ifdef _WIN32
+		return _rmdir(_path) == 0;
+#else
+		return rmdir(_path) == 0;
+#endif
+	}
+
+	// writes `_content` in uneven pieces
+	bool WritePieces(Nix::FileWriter& _writer, const std::vector<uint8_t>& _content) {
+		size_t done = 0;
+		for (size_t piece = 1; done < _content.size(); piece = piece * 3 + 1) {
+			size_t bytes = std::min(piece % 300000, _content.size() - done);
+			if (!_writer.write(_content.data() + done, bytes)) {
+				return false;
+			}
+			done += bytes;
+		}
+		return true;
+	}
+
+	void PlainTest() {
+		std::vector<uint8_t> content = Content((3 << 20) + 77, 1);
+		Nix::FileWriter writer;
+		NIX_CHECK(writer.open(FileName, Nix::FileWriterNoSync));
+		NIX_CHECK(writer.opened() && Exists(TempName));
+		NIX_CHECK(WritePieces(writer, content));
+		// headers known at the end, past the write buffer and inside it
+		uint32_t header = 0x12345678;
+		NIX_CHECK(writer.patch(8, &header, sizeof(header)));
+		NIX_CHECK(writer.patch(content.size() - 4, &header, sizeof(header)));
+		NIX_CHECK(writer.write("tail", 4));
+		NIX_CHECK(writer.commit());
+		NIX_CHECK(!writer.opened() && !Exists(TempName));
+		memcpy(&content[8], &header, sizeof(header));
+		memcpy(&content[content.size() - 4], &header, sizeof(header));
+		content.insert(content.end(), { 't', 'a', 'i', 'l' });
+		NIX_CHECK(Load(FileName) == content);
+		// a second commit of a committed writer fails
+		NIX_CHECK(!writer.commit());
+	}
+
+	void CompressTest() {
+		const size_t sizes[] = { 0, 1, Nix::DefaultCompressedBlockSize, Nix::DefaultCompressedBlockSize + 1, (5 << 20) + 1234 };
+		for (size_t size : sizes) {
+			std::vector<uint8_t> content = Content(size, (uint32_t)size);
+			Nix::FileWriter writer;
+			NIX_CHECK(writer.open(FileName, Nix::FileWriterCompress | Nix::FileWriterNoSync));
+			// the block scratch file is already unlinked, nothing to clean up by name
+#ifndef _WIN32
+			NIX_CHECK(!Exists(BlocksName));
+#endif
+			NIX_CHECK(WritePieces(writer, content));
+			NIX_CHECK(!writer.patch(0, "x", 1));
+			NIX_CHECK(writer.commit());
+			NIX_CHECK(!Exists(TempName) && !Exists(BlocksName));
+			// the same container CompressBlocks builds in memory
+			std::vector<uint8_t> stored = Load(FileName);
+			std::vector<uint8_t> expected;
+			NIX_CHECK(Nix::CompressBlocks(content.data(), content.size(), Nix::DefaultCompressedBlockSize, expected));
+			NIX_CHECK(stored == expected);
+			Nix::IFile* file = Nix::DecompressToMemory(stored.data(), stored.size());
+			NIX_CHECK(file && file->size() == size && (!size || !memcmp(file->constData(), content.data(), size)));
+			if (file) {
+				file->release();
+			}
+		}
+	}
+
+	// an abort, a destroyed writer and a failed commit all keep the previous file
+	void FailureTest() {
+		std::vector<uint8_t> previous = Content(1000, 2);
+		NIX_CHECK(Nix::SaveFileAtomic(FileName, previous.data(), previous.size()));
+		std::vector<uint8_t> content = Content(100000, 3);
+		const uint32_t modes[] = { Nix::FileWriterNoSync, Nix::FileWriterCompress | Nix::FileWriterNoSync };
+		for (uint32_t flags : modes) {
+			{
+				Nix::FileWriter writer;
+				NIX_CHECK(writer.open(FileName, flags) && writer.write(content.data(), content.size()));
+				writer.abort();
+				NIX_CHECK(!writer.opened() && !writer.write(content.data(), 1) && !writer.commit());
+			}
+			NIX_CHECK(!Exists(TempName) && !Exists(BlocksName));
+			{
+				Nix::FileWriter writer;
+				NIX_CHECK(writer.open(FileName, flags) && writer.write(content.data(), content.size()));
+			}
+			NIX_CHECK(!Exists(TempName) && !Exists(BlocksName));
+			NIX_CHECK(Load(FileName) == previous);
+		}
+
+		// the rename can't replace a directory : the commit fails and removes its temp file
+		const char* directory = "FileWriterTest.dir";
+		NIX_CHECK(MakeDirectory(directory));
+		std::string temp = std::string(directory) + ".tmp";
+		std::string blocks = std::string(directory) + ".blocks.tmp";
+		for (uint32_t flags : modes) {
+			Nix::FileWriter writer;
+			NIX_CHECK(writer.open(directory, flags) && writer.write(content.data(), content.size()));
+			NIX_CHECK(!writer.commit());
+			NIX_CHECK(!Exists(temp.c_str()) && !Exists(blocks.c_str()));
+			NIX_CHECK(!Nix::SaveFileAtomic(directory, content.data(), content.size(), flags));
+			NIX_CHECK(!Exists(temp.c_str()) && !Exists(blocks.c_str()));
+		}
+		NIX_CHECK(RemoveDirectory(directory));
+		// nowhere to put the temp file
+		Nix::FileWriter writer;
+		NIX_CHECK(!writer.open("FileWriterTest.missing/file.bin") && !writer.opened());
+		NIX_CHECK(!Nix::SaveFileAtomic("FileWriterTest.missing/file.bin", content.data(), content.size()));
+		remove(FileName);
+	}
+
+	void AsyncTest() {
+		Nix::AsyncWriter writer;
+		std::vector<uint8_t> content = Content(200000, 4);
+		// not running yet
+		NIX_CHECK(!writer.saveAsync(FileName, content.data(), content.size()).get());
+		NIX_CHECK(writer.initialize());
+		NIX_CHECK(!writer.initialize());
+
+		// saves of one path land in submission order, the last one wins
+		std::vector<std::future<bool>> saves;
+		for (uint8_t i = 0; i < 20; ++i) {
+			content[0] = i;
+			saves.push_back(writer.saveAsync(FileName, content.data(), content.size(), Nix::FileWriterNoSync));
+		}
+		std::vector<uint8_t> moved = content;
+		moved[0] = 0xff;
+		saves.push_back(writer.saveAsync("FileWriterTest.moved", std::move(moved), Nix::FileWriterCompress | Nix::FileWriterNoSync));
+		saves.push_back(writer.saveAsync("FileWriterTest.missing/file.bin", content.data(), content.size()));
+		writer.flush();
+		for (size_t i = 0; i + 1 < saves.size(); ++i) {
+			NIX_CHECK(saves[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready && saves[i].get());
+		}
+		NIX_CHECK(!saves.back().get());
+		content[0] = 19;
+		NIX_CHECK(Load(FileName) == content);
+		std::vector<uint8_t> stored = Load("FileWriterTest.moved");
+		Nix::IFile* file = Nix::DecompressToMemory(stored.data(), stored.size());
+		NIX_CHECK(file && file->size() == content.size() && ((const uint8_t*)file->constData())[0] == 0xff);
+		if (file) {
+			file->release();
+		}
+
+		// shutdown carries out what is still queued, later saves fail
+		content[0] = 42;
+		std::future<bool> queued = writer.saveAsync(FileName, content.data(), content.size(), Nix::FileWriterNoSync);
+		writer.shutdown();
+		NIX_CHECK(queued.get());
+		NIX_CHECK(Load(FileName) == content);
+		NIX_CHECK(!writer.saveAsync(FileName, content.data(), content.size()).get());
+		NIX_CHECK(!Exists(TempName));
+		remove(FileName);
+		remove("FileWriterTest.moved");
+	}
+
+}
+
+int main() {
+	PlainTest();
+	CompressTest();
+	FailureTest();
+	AsyncTest();
+	return NIX_TEST_RESULT();
+}
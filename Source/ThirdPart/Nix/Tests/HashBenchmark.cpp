@@ -0,0 +1,58 @@
+#include "NixTest.h"
+#include <String/Hash.h>
+#include <String/Encoding.h>
+#include <vector>
+
+// Hash64 against APHasher, the byte at a time hash content keys used before, on path sized keys
+// and on blobs the size of meshes and shader caches. Also StreamHasher fed in 64 KB pieces, the
+// way file content is hashed while it is read.
+
+namespace {
+
+	volatile uint64_t Sink;
+
+	// returns GB/s over `_rounds` hashes of `_length` bytes
+	template<class Hash>
+	double Measure(size_t _length, size_t _rounds, Hash _hash) {
+		double begin = NixSeconds();
+		for (size_t round = 0; round < _rounds; ++round) {
+			Sink = _hash();
+		}
+		return (double)_length * _rounds / (NixSeconds() - begin) / 1e9;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	bool quick = NixBenchQuick(argc, argv);
+	size_t largest = quick ? (1 << 20) : (64 << 20);
+	// about as many bytes hashed for every size
+	size_t volume = quick ? (4 << 20) : (512 << 20);
+	std::vector<uint8_t> content(largest);
+	uint32_t state = 1;
+	for (auto& byte : content) {
+		state = state * 1664525 + 1013904223;
+		byte = (uint8_t)(state >> 24);
+	}
+	printf("%10s %14s %14s %14s\n", "bytes", "APHasher GB/s", "Hash64 GB/s", "stream GB/s");
+	for (size_t length = 32; length <= largest; length *= 8) {
+		size_t rounds = volume / length;
+		// the byte at a time hash gets fewer rounds, its numbers are steady long before
+		double ap = Measure(length, rounds / 8 + 1, [&]() {
+			Nix::APHasher hasher;
+			hasher.hash(content.data(), length);
+			return (uint64_t)hasher;
+		});
+		double hash = Measure(length, rounds, [&]() { return Nix::Hash64(content.data(), length); });
+		double stream = Measure(length, rounds, [&]() {
+			Nix::StreamHasher hasher;
+			for (size_t offset = 0; offset < length; offset += 65536) {
+				hasher.hash(content.data() + offset, length - offset < 65536 ? length - offset : 65536);
+			}
+			return hasher.digest();
+		});
+		printf("%10zu %14.2f %14.2f %14.2f\n", length, ap, hash, stream);
+	}
+	NIX_CHECK(Nix::Hash64(content.data(), largest) != Nix::Hash64(content.data(), largest - 1));
+	return NIX_TEST_RESULT();
+}
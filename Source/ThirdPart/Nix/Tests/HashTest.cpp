@@ -0,0 +1,92 @@
+#include "NixTest.h"
+#include <String/Hash.h>
+#include <vector>
+#include <string.h>
+
+// Hash64 / Hash128 vectors : short input is XXH64 and checked against its published values, long
+// input pins the values of this implementation (the scalar, SSE2 and AVX2 kernels all give them,
+// so a kernel that drifts fails here). StreamHasher must match the one shot hash however the
+// data is split.
+
+namespace {
+
+	std::vector<uint8_t> Content(size_t _size) {
+		std::vector<uint8_t> content(_size);
+		uint32_t state = 1;
+		for (auto& byte : content) {
+			state = state * 1664525 + 1013904223;
+			byte = (uint8_t)(state >> 24);
+		}
+		return content;
+	}
+
+	void Xxh64Test() {
+		NIX_CHECK(Nix::Hash64("", 0) == 0xef46db3751d8e999ull);
+		NIX_CHECK(Nix::Hash64("abc", 3) == 0x44bc2cf5ad770999ull);
+		const char* text = "Nobody inspects the spammish repetition";
+		NIX_CHECK(Nix::Hash64(text, strlen(text)) == 0xfbcea83c8a378bf1ull);
+	}
+
+	struct vector_t {
+		size_t length;
+		uint64_t hash;
+		uint64_t high;
+		uint64_t seeded;
+	};
+
+	// Hash128 low is Hash64, `seeded` is Hash64 with seed 42
+	const vector_t Vectors[] = {
+		{ 0, 0xef46db3751d8e999ull, 0x766b3308c7fd7d49ull, 0x98b1582b0977e704ull },
+		{ 3, 0x08df8be3658d3d95ull, 0xefb762694ef8fd8dull, 0x7bc891d3b842b1e7ull },
+		{ 255, 0xfe73dadb3dfd5a83ull, 0x1a72854f628787ceull, 0x230fff703e166fdfull },
+		{ 256, 0xf0ccb841a5ee8918ull, 0xacdebebfe0c1884dull, 0x6a3c612a5570a219ull },
+		{ 257, 0x89e63111d23c5685ull, 0x438c7d9659263661ull, 0x1d3affff44869343ull },
+		{ 1024, 0xb77ae79b4eb7d8e5ull, 0xf80f29079dc52a55ull, 0x6dbf47dc0c4ebaf9ull },
+		{ 4096 + 7, 0x96e0731f3d55ae8full, 0xd693e515c707c983ull, 0x5c72f3e276738becull },
+		{ 1 << 20, 0x543703f49b2fe9fcull, 0x8c2636206aabc56bull, 0x79ca7df62197227bull },
+	};
+
+	void VectorTest() {
+		std::vector<uint8_t> content = Content(1 << 20);
+		for (auto& test : Vectors) {
+			NIX_CHECK(Nix::Hash64(content.data(), test.length) == test.hash);
+			Nix::hash128_t wide = Nix::Hash128(content.data(), test.length);
+			NIX_CHECK(wide.low == test.hash && wide.high == test.high);
+			NIX_CHECK(Nix::Hash64(content.data(), test.length, 42) == test.seeded);
+		}
+	}
+
+	// pieces of every size around the buffer and stripe boundaries
+	void StreamTest() {
+		std::vector<uint8_t> content = Content(300000);
+		const size_t pieces[] = { 1, 7, 63, 64, 65, 255, 256, 257, 1000, 4096, 65536 };
+		for (size_t length : { (size_t)0, (size_t)100, (size_t)256, (size_t)257, (size_t)1024, (size_t)5000, content.size() }) {
+			for (size_t piece : pieces) {
+				for (uint64_t seed : { 0ull, 42ull }) {
+					Nix::StreamHasher hasher(seed);
+					for (size_t offset = 0; offset < length; offset += piece) {
+						hasher.hash(content.data() + offset, length - offset < piece ? length - offset : piece);
+					}
+					NIX_CHECK(hasher.digest() == Nix::Hash64(content.data(), length, seed));
+					NIX_CHECK(hasher.digest128() == Nix::Hash128(content.data(), length, seed));
+				}
+			}
+		}
+		// digest leaves the state alone
+		Nix::StreamHasher hasher;
+		hasher.hash(content.data(), 1000);
+		NIX_CHECK(hasher.digest() == Nix::Hash64(content.data(), 1000));
+		hasher.hash(content.data() + 1000, 1000);
+		NIX_CHECK(hasher.digest() == Nix::Hash64(content.data(), 2000));
+		hasher.reset();
+		NIX_CHECK(hasher.digest() == Nix::Hash64("", 0));
+	}
+
+}
+
+int main() {
+	Xxh64Test();
+	VectorTest();
+	StreamTest();
+	return NIX_TEST_RESULT();
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+// Minimal helpers shared by the Nix tests and benchmarks. A failed check prints its location and
+// makes the test return non zero, benchmarks take `--quick` so ctest runs them on small inputs.
+
+static int NixTestFailures = 0;
+
+#define NIX_CHECK(cond) do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed : %s\n", __FILE__, __LINE__, #cond); ++NixTestFailures; } } while (0)
+#define NIX_TEST_RESULT() (NixTestFailures ? 1 : 0)
+
+inline bool NixBenchQuick(int argc, char** argv) {
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--quick")) {
+			return true;
+		}
+	}
+	return false;
+}
+
+inline double NixSeconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,259 @@
+#include "NixTest.h"
+#include <IO/PakArchive.h>
+#include <IO/FileWriter.h>
+#include <IO/Compression.h>
+#include <String/Encoding.h>
+#include <String/Path.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Packs a directory, plain and compressed, reads every entry back through the pak, and rebuilds
+// over an existing pak that is still open. Paks from before version 3 keep opening.
+
+namespace {
+
+	const char* SourceDirectory = "PakArchiveTest.dir";
+	const char* PakPath = "PakArchiveTest.pak";
+
+	void MakeDirectory(const char* _path) {
+#ifdef _WIN32
+		_mkdir(_path);
+#else
+		mkdir(_path, 0755);
+#endif
+	}
+
+	bool Exists(const std::string& _path) {
+		FILE* file = fopen(_path.c_str(), "rb");
+		if (file) {
+			fclose(file);
+		}
+		return file != nullptr;
+	}
+
+	std::vector<uint8_t> Load(const std::string& _path) {
+		std::vector<uint8_t> bytes;
+		FILE* file = fopen(_path.c_str(), "rb");
+		if (!file) {
+			return bytes;
+		}
+		uint8_t chunk[4096];
+		for (size_t read; (read = fread(chunk, 1, sizeof(chunk), file)) != 0;) {
+			bytes.insert(bytes.end(), chunk, chunk + read);
+		}
+		fclose(file);
+		return bytes;
+	}
+
+	void Save(const std::string& _path, const std::vector<uint8_t>& _bytes) {
+		FILE* file = fopen(_path.c_str(), "wb");
+		NIX_CHECK(file && fwrite(_bytes.data(), 1, _bytes.size(), file) == _bytes.size());
+		if (file) {
+			fclose(file);
+		}
+	}
+
+	std::vector<uint8_t> Content(size_t _index) {
+		// compressible text followed by noise
+		std::vector<uint8_t> content((_index * 7919) % 300000);
+		uint32_t state = (uint32_t)_index + 1;
+		for (size_t i = 0; i < content.size(); ++i) {
+			state = state * 1664525 + 1013904223;
+			content[i] = i < content.size() / 2 ? (uint8_t)"pak archive "[i % 12] : (uint8_t)(state >> 24);
+		}
+		return content;
+	}
+
+	std::string Name(size_t _index) {
+		return "file" + std::to_string(_index) + ".bin";
+	}
+
+	void ReadBack(const std::string& _pakPath, size_t _fileCount) {
+		Nix::IArchive* pak = Nix::CreatePakArchive(_pakPath, true);
+		NIX_CHECK(pak != nullptr);
+		if (!pak) {
+			return;
+		}
+		std::vector<Nix::FileInfo> files;
+		NIX_CHECK(pak->list("", files, Nix::ListRecursive));
+		NIX_CHECK(files.size() == _fileCount);
+		for (size_t i = 0; i < _fileCount; ++i) {
+			std::vector<uint8_t> expected = Content(i);
+			for (uint8_t mode = Nix::MemoryModeStream; mode <= Nix::MemoryModeMapped; ++mode) {
+				Nix::IFile* file = pak->open(Name(i), mode);
+				NIX_CHECK(file && file->size() == expected.size());
+				if (!file) {
+					continue;
+				}
+				std::vector<uint8_t> bytes(expected.size());
+				NIX_CHECK(file->read(bytes.size(), bytes.data()) == bytes.size());
+				NIX_CHECK(bytes == expected);
+				file->release();
+			}
+		}
+		NIX_CHECK(pak->open("missing.bin") == nullptr);
+		// listed content hashes match the content `open` serves, stored or compressed
+		files.clear();
+		NIX_CHECK(pak->list("", files, Nix::ListRecursive | Nix::ListContentHash));
+		for (auto& info : files) {
+			std::vector<uint8_t> expected = Content((size_t)atoi(info.path.c_str() + 4));
+			NIX_CHECK(info.size == expected.size());
+			NIX_CHECK(info.hash == Nix::HashFileContent(expected.data(), expected.size()));
+		}
+		pak->release();
+	}
+
+	// a compressed entry too small to hold its container header makes the pak invalid
+	void TruncatedEntryTest(const std::string& _pakPath) {
+		std::vector<uint8_t> bytes = Load(_pakPath);
+		NIX_CHECK(bytes.size() >= sizeof(Nix::pak_header_t));
+		if (bytes.size() < sizeof(Nix::pak_header_t)) {
+			return;
+		}
+		Nix::pak_header_t header;
+		memcpy(&header, bytes.data(), sizeof(header));
+		Nix::pak_entry_t* entries = (Nix::pak_entry_t*)(bytes.data() + header.tocOffset);
+		bool patched = false;
+		for (uint32_t i = 0; i < header.entryCount && !patched; ++i) {
+			if (entries[i].flags & Nix::PakEntryCompressed) {
+				entries[i].size = sizeof(Nix::compressed_header_t) - 1;
+				patched = true;
+			}
+		}
+		NIX_CHECK(patched);
+		std::string damagedPath = _pakPath + ".damaged";
+		Save(damagedPath, bytes);
+		NIX_CHECK(Nix::CreatePakArchive(damagedPath) == nullptr);
+		remove(damagedPath.c_str());
+	}
+
+	// a version 2 pak sorts its table by the APHasher of the path, lookups by name and by PathId
+	// still find its entries
+	void LegacyPathHashTest(const std::string& _pakPath, size_t _fileCount) {
+		std::vector<uint8_t> bytes = Load(_pakPath);
+		NIX_CHECK(bytes.size() >= sizeof(Nix::pak_header_t));
+		if (bytes.size() < sizeof(Nix::pak_header_t)) {
+			return;
+		}
+		Nix::pak_header_t* header = (Nix::pak_header_t*)bytes.data();
+		NIX_CHECK(header->version == Nix::PakVersion);
+		header->version = 2;
+		Nix::pak_entry_t* entries = (Nix::pak_entry_t*)(bytes.data() + header->tocOffset);
+		const char* names = (const char*)bytes.data() + header->namesOffset;
+		for (uint32_t i = 0; i < header->entryCount; ++i) {
+			Nix::APHasher hasher;
+			hasher.hash(names + entries[i].nameOffset, entries[i].nameLength);
+			entries[i].hash = hasher;
+		}
+		std::sort(entries, entries + header->entryCount, [](const Nix::pak_entry_t& _a, const Nix::pak_entry_t& _b) {
+			return _a.hash < _b.hash;
+		});
+		std::string legacyPath = _pakPath + ".v2";
+		Save(legacyPath, bytes);
+		ReadBack(legacyPath, _fileCount);
+		Nix::IArchive* pak = Nix::CreatePakArchive(legacyPath);
+		NIX_CHECK(pak != nullptr);
+		if (pak) {
+			Nix::PathId id = Nix::SharedPathTable().intern("./" + Name(3));
+			Nix::IFile* file = pak->open(id);
+			NIX_CHECK(file && file->size() == Content(3).size());
+			if (file) {
+				file->release();
+			}
+			pak->release();
+		}
+		remove(legacyPath.c_str());
+	}
+
+	void RoundTripTest() {
+		const size_t fileCount = 24;
+		MakeDirectory(SourceDirectory);
+		Nix::IArchive* source = Nix::CreateStdArchieve(SourceDirectory);
+		for (size_t i = 0; i < fileCount; ++i) {
+			std::vector<uint8_t> content = Content(i);
+			NIX_CHECK(source->save(Name(i), content.data(), content.size()));
+			// the plain archive serves the same bytes in every mode, and frees them (run under ASan)
+			for (uint8_t mode = Nix::MemoryModeStream; mode <= Nix::MemoryModeMapped; ++mode) {
+				Nix::IFile* file = source->open(Name(i), mode);
+				NIX_CHECK(file && file->size() == content.size());
+				if (file) {
+					std::vector<uint8_t> bytes(content.size());
+					NIX_CHECK(file->read(bytes.size(), bytes.data()) == bytes.size() && bytes == content);
+					file->release();
+				}
+			}
+		}
+		NIX_CHECK(Nix::BuildPakArchive(SourceDirectory, PakPath, 64, true, false));
+		NIX_CHECK(!Exists(std::string(PakPath) + ".tmp"));
+		ReadBack(PakPath, fileCount);
+		// rebuilt compressed while a reader still maps the previous pak
+		Nix::IArchive* previous = Nix::CreatePakArchive(PakPath);
+		NIX_CHECK(Nix::BuildPakArchive(SourceDirectory, PakPath, 4096, true, true));
+		NIX_CHECK(!Exists(std::string(PakPath) + ".tmp"));
+		ReadBack(PakPath, fileCount);
+		TruncatedEntryTest(PakPath);
+		LegacyPathHashTest(PakPath, fileCount);
+		if (previous) {
+			previous->release();
+		}
+		// nothing to pack from : the pak from before stays
+		NIX_CHECK(!Nix::BuildPakArchive("PakArchiveTest.missing", PakPath));
+		ReadBack(PakPath, fileCount);
+		for (size_t i = 0; i < fileCount; ++i) {
+			remove((std::string(SourceDirectory) + "/" + Name(i)).c_str());
+		}
+		source->release();
+		remove(SourceDirectory);
+		remove(PakPath);
+	}
+
+	// the header written last over the placeholder written first
+	void PatchTest() {
+		const char* path = "PakArchiveTest.patch";
+		std::vector<uint8_t> body(3 << 20);
+		for (size_t i = 0; i < body.size(); ++i) {
+			body[i] = (uint8_t)(i * 13);
+		}
+		uint64_t header = 0;
+		Nix::FileWriter writer;
+		NIX_CHECK(writer.open(path, Nix::FileWriterNoSync));
+		NIX_CHECK(writer.write(&header, sizeof(header)));
+		NIX_CHECK(writer.write(body.data(), body.size()));
+		header = 0x1122334455667788ull;
+		NIX_CHECK(writer.patch(0, &header, sizeof(header)));
+		NIX_CHECK(writer.write("tail", 4));
+		NIX_CHECK(writer.commit());
+		FILE* file = fopen(path, "rb");
+		NIX_CHECK(file != nullptr);
+		if (!file) {
+			return;
+		}
+		std::vector<uint8_t> bytes(sizeof(header) + body.size() + 4 + 1);
+		size_t size = fread(bytes.data(), 1, bytes.size(), file);
+		fclose(file);
+		NIX_CHECK(size == bytes.size() - 1);
+		uint64_t stored;
+		memcpy(&stored, bytes.data(), sizeof(stored));
+		NIX_CHECK(stored == header);
+		NIX_CHECK(memcmp(bytes.data() + sizeof(header), body.data(), body.size()) == 0);
+		NIX_CHECK(memcmp(bytes.data() + sizeof(header) + body.size(), "tail", 4) == 0);
+		remove(path);
+		// compressed containers can't be patched
+		NIX_CHECK(writer.open(path, Nix::FileWriterCompress | Nix::FileWriterNoSync));
+		NIX_CHECK(!writer.patch(0, &header, sizeof(header)));
+		writer.abort();
+	}
+
+}
+
+int main() {
+	RoundTripTest();
+	PatchTest();
+	return NIX_TEST_RESULT();
+}
@@ -0,0 +1,112 @@
+#include "NixTest.h"
+#include <String/Path.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Path normalization and resolution the way the archives did it before PathTable : FormatFilePath
+// building a new string char by char, then a lookup keyed by that string. Against the in place
+// NormalizePath, PathTable::find and resolving an interned PathId.
+
+namespace {
+
+	volatile size_t Sink;
+
+	// FormatFilePath before NormalizePath
+	std::string PushBackFormat(const std::string& _filePath) {
+		auto nSec = 0;
+		std::string curSec = "";
+		std::string fPath = "";
+		if (_filePath[0] == '/') { fPath.push_back('/'); }
+		const char* ptr = _filePath.c_str();
+		while (*ptr != 0) {
+			if (*ptr == '\\' || *ptr == '/') {
+				if (curSec.length() > 0) {
+					if (curSec == ".") {}
+					else if (curSec == ".." && nSec >= 2) {
+						int secleft = 2;
+						while (!(fPath.empty() && secleft == 0)) {
+							if (fPath.back() == '\\' || fPath.back() == '/') {
+								--secleft;
+								break;
+							}
+							fPath.pop_back();
+						}
+						fPath.pop_back();
+					}
+					else {
+						if (!fPath.empty() && fPath.back() != '/') fPath.push_back('/');
+						fPath.append(curSec);
+						++nSec;
+					}
+					curSec.clear();
+				}
+			}
+			else {
+				curSec.push_back(*ptr);
+				if (*ptr == ':') --nSec;
+			}
+			++ptr;
+		}
+		if (curSec.length() > 0) {
+			if (!fPath.empty() && fPath.back() != '/') fPath.push_back('/');
+			fPath.append(curSec);
+		}
+		return fPath;
+	}
+
+	std::vector<std::string> Paths(size_t _count) {
+		static const char* directories[] = { "assets", "textures", "meshes\\characters", "shaders/./common", "sounds/sfx/../audio" };
+		std::vector<std::string> paths;
+		for (size_t i = 0; i < _count; ++i) {
+			paths.push_back(std::string(directories[i % 5]) + "/level" + std::to_string(i % 7) + "/item" + std::to_string(i) + ".bin");
+		}
+		return paths;
+	}
+
+	// returns millions of paths per second
+	template<class Body>
+	double Measure(size_t _paths, int _rounds, Body _body) {
+		double begin = NixSeconds();
+		for (int round = 0; round < _rounds; ++round) {
+			for (size_t i = 0; i < _paths; ++i) {
+				Sink = _body(i);
+			}
+		}
+		return (double)_paths * _rounds / (NixSeconds() - begin) / 1e6;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	bool quick = NixBenchQuick(argc, argv);
+	size_t count = quick ? 2000 : 100000;
+	int rounds = quick ? 2 : 20;
+	std::vector<std::string> paths = Paths(count);
+	Nix::PathTable table;
+	std::vector<Nix::PathId> ids;
+	std::unordered_map<std::string, size_t> byName;
+	for (auto& path : paths) {
+		ids.push_back(table.intern(path));
+		byName.emplace(Nix::FormatFilePath(path), byName.size());
+		// the old and new normalizers agree on the paths measured (the old one can't pop a first segment)
+		NIX_CHECK(PushBackFormat(path) == Nix::FormatFilePath(path));
+	}
+	NIX_CHECK(table.size() == count);
+
+	printf("%zu paths, M paths/s\n", count);
+	double oldFormat = Measure(count, rounds, [&](size_t _i) { return PushBackFormat(paths[_i]).length(); });
+	double newFormat = Measure(count, rounds, [&](size_t _i) { return Nix::FormatFilePath(paths[_i]).length(); });
+	double inPlace = Measure(count, rounds, [&](size_t _i) {
+		char buffer[256];
+		memcpy(buffer, paths[_i].c_str(), paths[_i].length());
+		return Nix::NormalizePath(buffer, paths[_i].length());
+	});
+	printf("%-36s %10.2f\n%-36s %10.2f\n%-36s %10.2f\n", "push_back FormatFilePath", oldFormat, "FormatFilePath", newFormat, "NormalizePath in place", inPlace);
+
+	double oldResolve = Measure(count, rounds, [&](size_t _i) { return byName.find(PushBackFormat(paths[_i]))->second; });
+	double find = Measure(count, rounds, [&](size_t _i) { return (size_t)table.find(paths[_i].c_str(), paths[_i].length()); });
+	double byId = Measure(count, rounds, [&](size_t _i) { return table.path(ids[_i]).length(); });
+	printf("%-36s %10.2f\n%-36s %10.2f\n%-36s %10.2f\n", "push_back format + string map", oldResolve, "PathTable::find", find, "PathTable::path( PathId )", byId);
+	return NIX_TEST_RESULT();
+}
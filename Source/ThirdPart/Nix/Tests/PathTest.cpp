@@ -0,0 +1,121 @@
+#include "NixTest.h"
+#include <String/Path.h>
+#include <IO/Archive.h>
+#include <string>
+#include <vector>
+#include <thread>
+
+// NormalizePath vectors, and PathTable mapping every spelling of a path to one id, from several
+// threads at once.
+
+namespace {
+
+	struct normalize_case_t {
+		const char* path;
+		const char* normalized;
+	};
+
+	const normalize_case_t NormalizeCases[] = {
+		{ "", "" },
+		{ "a/b/c", "a/b/c" },
+		{ "a\\b\\c", "a/b/c" },
+		{ "a//b/./c/", "a/b/c" },
+		{ "./a", "a" },
+		{ "./", "." },
+		{ "a/b/../c", "a/c" },
+		{ "a/..", "." },
+		{ ".", "." },
+		{ "textures/../shaders/./basic.hlsl", "shaders/basic.hlsl" },
+		// a relative path keeps the ".." it can't resolve, a rooted one drops them
+		{ "../a/../../b", "../../b" },
+		{ "/../a", "/a" },
+		{ "/", "/" },
+		{ "\\\\a\\", "/a" },
+		{ "C:\\x\\..\\..\\y", "C:/y" },
+	};
+
+	void NormalizeTest() {
+		for (auto& test : NormalizeCases) {
+			std::string path = test.path;
+			path.resize(Nix::NormalizePath(&path[0], path.length()));
+			NIX_CHECK(path == test.normalized);
+			NIX_CHECK(Nix::FormatFilePath(test.path) == test.normalized);
+		}
+		// a shorter result is terminated in place
+		char buffer[] = "a/./b";
+		NIX_CHECK(Nix::NormalizePath(buffer, 5) == 3 && !strcmp(buffer, "a/b"));
+	}
+
+	// an archive on "." stays in the working directory
+	void CurrentDirectoryTest() {
+		Nix::IArchive* archive = Nix::CreateStdArchieve(".");
+		NIX_CHECK(archive->save("PathTest.tmp", "here", 4));
+		FILE* file = fopen("PathTest.tmp", "rb");
+		NIX_CHECK(file != nullptr);
+		if (file) {
+			fclose(file);
+		}
+		remove("PathTest.tmp");
+		archive->release();
+	}
+
+	void TableTest() {
+		Nix::PathTable table;
+		NIX_CHECK(table.size() == 0);
+		NIX_CHECK(table.find("a/b", 3) == Nix::InvalidPathId);
+		Nix::PathId id = table.intern("a\\b");
+		NIX_CHECK(id != Nix::InvalidPathId);
+		NIX_CHECK(table.intern("./a//b/") == id);
+		NIX_CHECK(table.intern("a/c/../b") == id);
+		NIX_CHECK(table.find("a\\b", 3) == id);
+		NIX_CHECK(table.path(id) == "a/b");
+		NIX_CHECK(table.hash(id) == Nix::PathHash("a/b", 3));
+		Nix::PathId other = table.intern("a/b/c");
+		NIX_CHECK(other != id && table.size() == 2);
+		NIX_CHECK(table.path(Nix::InvalidPathId).empty() && table.path(other + 1).empty());
+		// past the stack buffer intern normalizes short paths in
+		std::string longPath;
+		for (int i = 0; i < 40; ++i) {
+			longPath += "directory" + std::to_string(i) + "/./";
+		}
+		Nix::PathId longId = table.intern(longPath + "file");
+		NIX_CHECK(table.path(longId).length() > 256);
+		NIX_CHECK(table.intern(table.path(longId)) == longId);
+	}
+
+	// threads intern overlapping spellings : each path gets exactly one id
+	void ConcurrentTest() {
+		const int threadCount = 4;
+		const int pathCount = 2000;
+		Nix::PathTable table;
+		std::vector<std::vector<Nix::PathId>> ids(threadCount, std::vector<Nix::PathId>(pathCount));
+		std::vector<std::thread> threads;
+		for (int t = 0; t < threadCount; ++t) {
+			threads.emplace_back([&table, &ids, t]() {
+				for (int i = 0; i < pathCount; ++i) {
+					std::string path = t & 1 ? "./assets\\mesh" + std::to_string(i) + ".bin" : "assets/mesh" + std::to_string(i) + ".bin";
+					ids[t][i] = table.intern(path);
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		NIX_CHECK(table.size() == pathCount);
+		for (int t = 1; t < threadCount; ++t) {
+			NIX_CHECK(ids[t] == ids[0]);
+		}
+		for (int i = 0; i < pathCount; ++i) {
+			NIX_CHECK(table.path(ids[0][i]) == "assets/mesh" + std::to_string(i) + ".bin");
+		}
+	}
+
+}
+
+int main() {
+	NormalizeTest();
+	CurrentDirectoryTest();
+	TableTest();
+	ConcurrentTest();
+	return NIX_TEST_RESULT();
+}
@@ -0,0 +1,101 @@
+#include "NixTest.h"
+#include <Profiler/Profiler.h>
+#include <Timer/Timer.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+// Cost of one NIX_PROFILE_SCOPE zone, opened and closed in a loop with the frame drained between
+// batches the way an application does it : alone, nested, and while other threads record too.
+// The zone budget is 50 ns, the empty loop is measured and taken off.
+
+namespace {
+
+	// relaxed stores keep the loops from being optimized away, from any number of threads
+	std::atomic<uint64_t> Sink;
+	// frames drained so far, recording threads pace themselves on it
+	std::atomic<uint64_t> Frames;
+
+	// zones per frame, below the ring size so nothing is dropped
+	const size_t ZonesPerFrame = 8192;
+
+	void Flat(size_t _zones) {
+		for (size_t i = 0; i < _zones; ++i) {
+			NIX_PROFILE_SCOPE("flat");
+			Sink.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	void Nested(size_t _zones) {
+		for (size_t i = 0; i < _zones; i += 4) {
+			NIX_PROFILE_SCOPE("outer");
+			Sink.store(i, std::memory_order_relaxed);
+			{
+				NIX_PROFILE_SCOPE("middle");
+				{
+					NIX_PROFILE_SCOPE("inner");
+					Sink.store(i, std::memory_order_relaxed);
+				}
+				NIX_PROFILE_SCOPE("sibling");
+				Sink.store(i, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void Empty(size_t _zones) {
+		for (size_t i = 0; i < _zones; ++i) {
+			Sink.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	// ns per zone of `_body` over `_frames` frames
+	double Measure(void (*_body)(size_t), size_t _frames) {
+		Nix::Profiler& profiler = Nix::SharedProfiler();
+		double seconds = 0.0;
+		for (size_t frame = 0; frame < _frames; ++frame) {
+			double begin = NixSeconds();
+			_body(ZonesPerFrame);
+			seconds += NixSeconds() - begin;
+			profiler.endFrame();
+			++Frames;
+		}
+		return seconds * 1e9 / (double)(ZonesPerFrame * _frames);
+	}
+
+}
+
+int main(int argc, char** argv) {
+	size_t frames = NixBenchQuick(argc, argv) ? 20 : 2000;
+	Nix::Profiler& profiler = Nix::SharedProfiler();
+	profiler.endFrame();
+	// warms the thread registration and the tick calibration up
+	Measure(&Flat, 2);
+	double empty = Measure(&Empty, frames);
+	double flat = Measure(&Flat, frames) - empty;
+	double nested = Measure(&Nested, frames) - empty;
+	// other threads recording into their own rings at the same time, a batch per frame so their
+	// rings are drained before they fill up however slow the frames are
+	std::atomic<bool> running(true);
+	std::vector<std::thread> others;
+	for (int i = 0; i < 2; ++i) {
+		others.emplace_back([&running]() {
+			while (running) {
+				uint64_t frame = Frames;
+				Flat(256);
+				while (running && Frames == frame) {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	double contended = Measure(&Flat, frames) - empty;
+	running = false;
+	for (auto& thread : others) {
+		thread.join();
+	}
+	profiler.endFrame();
+	printf("ns per zone : flat %.1f  nested %.1f  with 2 recording threads %.1f  (budget 50)\n", flat, nested, contended);
+	printf("tick : %.3f ns, dropped zones %llu\n", Nix::Timer::nanosecondsPerTick(), (unsigned long long)profiler.droppedEvents());
+	NIX_CHECK(profiler.droppedEvents() == 0);
+	return NIX_TEST_RESULT();
+}
@@ -0,0 +1,214 @@
+#include "NixTest.h"
+#include <Profiler/Profiler.h>
+#include <Timer/Timer.h>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+
+// Profiler : zones of every thread come out of their rings at endFrame, a full ring counts its
+// drops instead of blocking, the frame tree merges zones by name under the same parent and takes
+// the child time off the parent's self time, and a capture is written as Chrome trace JSON.
+
+namespace {
+
+	void Spin(int64_t _nanoseconds) {
+		int64_t begin = Nix::Timer::now();
+		while (Nix::Timer::now() - begin < _nanoseconds) {
+		}
+	}
+
+	const Nix::ProfileNode* Find(const char* _name, int32_t _parent = -2) {
+		for (auto& node : Nix::SharedProfiler().lastFrame()) {
+			if (node.name == _name && (_parent == -2 || node.parent == _parent)) {
+				return &node;
+			}
+		}
+		return nullptr;
+	}
+
+	int32_t IndexOf(const Nix::ProfileNode* _node) {
+		return (int32_t)(_node - Nix::SharedProfiler().lastFrame().data());
+	}
+
+	void TreeTest() {
+		Nix::Profiler& profiler = Nix::SharedProfiler();
+		profiler.endFrame();
+		for (int i = 0; i < 2; ++i) {
+			NIX_PROFILE_SCOPE("outer");
+			Spin(20000);
+			for (int j = 0; j < 3; ++j) {
+				NIX_PROFILE_SCOPE("inner");
+				Spin(50000);
+			}
+		}
+		{
+			NIX_PROFILE_SCOPE("other");
+			NIX_PROFILE_SCOPE("inner");
+		}
+		std::thread worker([]() {
+			NIX_PROFILE_SCOPE("outer");
+		});
+		worker.join();
+		profiler.endFrame();
+
+		NIX_CHECK(profiler.lastFrame().size() == 5);
+		NIX_CHECK(profiler.lastFrameNanoseconds() >= 6 * 50000);
+		const Nix::ProfileNode* outer = nullptr;
+		const Nix::ProfileNode* workerOuter = nullptr;
+		for (auto& node : profiler.lastFrame()) {
+			if (node.name == std::string("outer")) {
+				(node.calls == 2 ? outer : workerOuter) = &node;
+			}
+		}
+		NIX_CHECK(outer && workerOuter);
+		if (!outer || !workerOuter) {
+			return;
+		}
+		NIX_CHECK(outer->parent == -1 && outer->depth == 0);
+		NIX_CHECK(workerOuter->parent == -1 && workerOuter->calls == 1 && workerOuter->thread != outer->thread);
+		const Nix::ProfileNode* inner = Find("inner", IndexOf(outer));
+		const Nix::ProfileNode* other = Find("other");
+		NIX_CHECK(inner && other);
+		if (!inner || !other) {
+			return;
+		}
+		NIX_CHECK(inner->calls == 6 && inner->depth == 1 && inner->thread == outer->thread);
+		NIX_CHECK(inner->totalNs >= 6 * 50000 && inner->selfNs == inner->totalNs);
+		NIX_CHECK(outer->totalNs >= inner->totalNs + 2 * 20000);
+		NIX_CHECK(outer->selfNs == outer->totalNs - inner->totalNs);
+		// the same name under another parent is its own node
+		const Nix::ProfileNode* otherInner = Find("inner", IndexOf(other));
+		NIX_CHECK(otherInner && otherInner->calls == 1 && otherInner != inner);
+
+		// the next frame starts empty
+		profiler.endFrame();
+		NIX_CHECK(profiler.lastFrame().empty());
+	}
+
+	// one thread records while another drains, every zone shows up in exactly one frame
+	void RingTest() {
+		Nix::Profiler& profiler = Nix::SharedProfiler();
+		profiler.endFrame();
+		const uint32_t zones = 200000;
+		std::atomic<bool> done(false);
+		std::thread producer([&done, zones]() {
+			for (uint32_t i = 0; i < zones; ++i) {
+				NIX_PROFILE_SCOPE("ring");
+				if (i % 1024 == 0) {
+					std::this_thread::yield();
+				}
+			}
+			done = true;
+		});
+		uint64_t dropped = profiler.droppedEvents();
+		uint64_t seen = 0;
+		for (bool last = false; !last;) {
+			last = done;
+			profiler.endFrame();
+			const Nix::ProfileNode* ring = Find("ring");
+			seen += ring ? ring->calls : 0;
+		}
+		producer.join();
+		NIX_CHECK(seen + (profiler.droppedEvents() - dropped) == zones);
+	}
+
+	void DroppedTest() {
+		Nix::Profiler& profiler = Nix::SharedProfiler();
+		profiler.endFrame();
+		uint64_t dropped = profiler.droppedEvents();
+		for (uint32_t i = 0; i < Nix::ProfileRingSize + 100; ++i) {
+			NIX_PROFILE_SCOPE("flood");
+		}
+		NIX_CHECK(profiler.droppedEvents() == dropped + 100);
+		profiler.endFrame();
+		const Nix::ProfileNode* flood = Find("flood");
+		NIX_CHECK(flood && flood->calls == Nix::ProfileRingSize);
+		// drained, the ring takes zones again
+		{
+			NIX_PROFILE_SCOPE("flood");
+		}
+		profiler.endFrame();
+		flood = Find("flood");
+		NIX_CHECK(flood && flood->calls == 1);
+		NIX_CHECK(profiler.droppedEvents() == dropped + 100);
+	}
+
+	std::string Load(const char* _path) {
+		std::string text;
+		FILE* file = fopen(_path, "rb");
+		if (!file) {
+			return text;
+		}
+		char block[4096];
+		size_t bytes;
+		while ((bytes = fread(block, 1, sizeof(block), file)) > 0) {
+			text.append(block, bytes);
+		}
+		fclose(file);
+		return text;
+	}
+
+	size_t Count(const std::string& _text, const char* _pattern) {
+		size_t count = 0;
+		for (size_t at = _text.find(_pattern); at != std::string::npos; at = _text.find(_pattern, at + 1)) {
+			++count;
+		}
+		return count;
+	}
+
+	void CaptureTest() {
+		const char* path = "ProfilerTest.json";
+		Nix::Profiler& profiler = Nix::SharedProfiler();
+		NIX_CHECK(!profiler.endCapture(path));
+		profiler.setThreadName("main \"thread\"");
+		profiler.endFrame();
+		profiler.beginCapture();
+		NIX_CHECK(profiler.capturing());
+		{
+			NIX_PROFILE_SCOPE("capture");
+			NIX_PROFILE_SCOPE("quoted \"zone\"");
+			Spin(10000);
+		}
+		profiler.endFrame();
+		NIX_CHECK(profiler.endCapture(path));
+		NIX_CHECK(!profiler.capturing());
+		std::string json = Load(path);
+		NIX_CHECK(json.compare(0, 40, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[{") == 0);
+		NIX_CHECK(json.size() > 3 && json.compare(json.size() - 3, 3, "]}\n") == 0);
+		NIX_CHECK(Count(json, "\"name\":\"thread_name\",\"args\":{\"name\":\"main \\\"thread\\\"\"}") == 1);
+		// the frame and the two zones
+		NIX_CHECK(Count(json, "\"ph\":\"X\"") == 3);
+		NIX_CHECK(Count(json, "{\"name\":\"Frame\",\"ph\":\"X\"") == 1);
+		NIX_CHECK(Count(json, "{\"name\":\"capture\",\"ph\":\"X\"") == 1);
+		NIX_CHECK(Count(json, "{\"name\":\"quoted \\\"zone\\\"\",\"ph\":\"X\"") == 1);
+		// zones of frames after endCapture are not kept
+		{
+			NIX_PROFILE_SCOPE("late");
+		}
+		profiler.endFrame();
+		NIX_CHECK(!profiler.endCapture(path));
+
+		// the limit counts the frame events too
+		profiler.beginCapture(2);
+		for (int i = 0; i < 5; ++i) {
+			NIX_PROFILE_SCOPE("limited");
+		}
+		profiler.endFrame();
+		profiler.endFrame();
+		NIX_CHECK(profiler.endCapture(path));
+		json = Load(path);
+		NIX_CHECK(Count(json, "\"ph\":\"X\"") == 2);
+		NIX_CHECK(Count(json, "{\"name\":\"limited\",\"ph\":\"X\"") == 1);
+		remove(path);
+	}
+
+}
+
+int main() {
+	TreeTest();
+	RingTest();
+	DroppedTest();
+	CaptureTest();
+	return NIX_TEST_RESULT();
+}
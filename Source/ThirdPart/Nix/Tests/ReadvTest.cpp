@@ -0,0 +1,197 @@
+#include "NixTest.h"
+#include <IO/Archive.h>
+#include <IO/Compression.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include <stdlib.h>
+#include <stdint.h>
+
+// IFile::readv on every kind of file : the std file (adjacent ranges coalesced into one preadv,
+// a read cut short by the end of the file finished range by range), the copied and the mapped
+// memory files, a blob view at an offset and a compressed file going through the default
+// seek + read. Every range must come back as the file content at its offset, clipped at the
+// end of the file, and the seek cursor must not move.
+
+namespace {
+
+	const size_t FileSize = (1 << 20) + 333;
+	const char* FileName = "ReadvTest.bin";
+
+	std::vector<uint8_t> Content(size_t _size) {
+		std::vector<uint8_t> content(_size);
+		uint32_t state = 7;
+		for (auto& byte : content) {
+			state = state * 1664525 + 1013904223;
+			byte = (uint8_t)(state >> 24);
+		}
+		return content;
+	}
+
+	struct range_t {
+		uint64_t offset;
+		size_t size;
+	};
+
+	// reads `_ranges` in one readv, with the cursor parked mid file, and checks every range
+	bool ReadRanges(Nix::IFile* _file, const std::vector<uint8_t>& _content, const std::vector<range_t>& _ranges) {
+		std::vector<std::vector<uint8_t>> buffers(_ranges.size());
+		std::vector<Nix::IoRange> ranges(_ranges.size());
+		for (size_t i = 0; i < _ranges.size(); ++i) {
+			// one byte past the range, a read past `size` would overwrite the guard
+			buffers[i].assign(_ranges[i].size + 1, 0xcd);
+			ranges[i].offset = _ranges[i].offset;
+			ranges[i].size = _ranges[i].size;
+			ranges[i].buffer = buffers[i].data();
+			ranges[i].bytesRead = (size_t)-1;
+		}
+		_file->seek(Nix::SeekSet, 12345);
+		size_t total = _file->readv(ranges.data(), ranges.size());
+		bool same = _file->tell() == 12345;
+		size_t expectedTotal = 0;
+		for (size_t i = 0; i < _ranges.size(); ++i) {
+			uint64_t offset = _ranges[i].offset;
+			size_t expected = offset >= _content.size() ? 0 : (size_t)std::min<uint64_t>(_ranges[i].size, _content.size() - offset);
+			expectedTotal += expected;
+			same = same && ranges[i].bytesRead == expected && buffers[i][_ranges[i].size] == 0xcd;
+			same = same && (!expected || !memcmp(buffers[i].data(), &_content[(size_t)offset], expected));
+		}
+		// the cursor still reads from where it was
+		uint8_t next[16];
+		same = same && _file->read(sizeof(next), next) == sizeof(next) && !memcmp(next, &_content[12345], sizeof(next));
+		return same && total == expectedTotal;
+	}
+
+	// back to back ranges of `_size` bytes from `_offset`
+	std::vector<range_t> Run(uint64_t _offset, size_t _size, size_t _count) {
+		std::vector<range_t> ranges;
+		for (size_t i = 0; i < _count; ++i) {
+			ranges.push_back({ _offset + i * _size, _size });
+		}
+		return ranges;
+	}
+
+	void FileTest(const char* _kind, Nix::IFile* _file, const std::vector<uint8_t>& _content) {
+		NIX_CHECK(_file && _file->size() == _content.size());
+		if (!_file) {
+			return;
+		}
+		size_t failures = NixTestFailures;
+		// scattered, unsorted and overlapping ranges
+		std::mt19937 random(11);
+		std::vector<range_t> scattered;
+		for (int i = 0; i < 200; ++i) {
+			scattered.push_back({ random() % FileSize, (size_t)(random() % 9000) });
+		}
+		NIX_CHECK(ReadRanges(_file, _content, scattered));
+		// adjacent ranges, more than go down in one vectored read, with empty ones in between
+		std::vector<range_t> adjacent = Run(4096, 1000, 150);
+		adjacent.insert(adjacent.begin() + 70, { adjacent[70].offset, 0 });
+		NIX_CHECK(ReadRanges(_file, _content, adjacent));
+		// adjacent ranges that run over the end of the file : the one across it is cut short,
+		// the ones after it read nothing
+		NIX_CHECK(ReadRanges(_file, _content, Run(FileSize - 2500, 1000, 6)));
+		NIX_CHECK(ReadRanges(_file, _content, Run(FileSize - 3000, 1000, 3)));
+		// ranges at and past the end of the file, alone and mixed with good ones
+		NIX_CHECK(ReadRanges(_file, _content, { { FileSize, 100 }, { FileSize + 1, 10 }, { FileSize - 1, 1 }, { 0, 0 }, { UINT64_MAX - 8, 4 } }));
+		NIX_CHECK(ReadRanges(_file, _content, { { 0, FileSize + 4096 } }));
+		NIX_CHECK(ReadRanges(_file, _content, {}));
+		if ((size_t)NixTestFailures != failures) {
+			fprintf(stderr, "readv failed on the %s file\n", _kind);
+		}
+	}
+
+	// readv is allowed from several threads at once on the files that override it
+	void ThreadTest(Nix::IFile* _file, const std::vector<uint8_t>& _content) {
+		std::vector<std::thread> threads;
+		std::vector<char> results(4, 0);
+		for (size_t t = 0; t < results.size(); ++t) {
+			threads.emplace_back([&, t]() {
+				std::mt19937 random((uint32_t)t);
+				bool same = true;
+				for (int i = 0; i < 200; ++i) {
+					std::vector<uint8_t> block(1 + random() % 5000);
+					Nix::IoRange ranges[2];
+					uint64_t offset = random() % (FileSize - block.size());
+					size_t half = block.size() / 2;
+					ranges[0] = { offset, half, block.data(), 0 };
+					ranges[1] = { offset + half, block.size() - half, block.data() + half, 0 };
+					same = same && _file->readv(ranges, 2) == block.size() && !memcmp(block.data(), &_content[(size_t)offset], block.size());
+				}
+				results[t] = same;
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		for (char result : results) {
+			NIX_CHECK(result);
+		}
+	}
+
+}
+
+int main() {
+	std::vector<uint8_t> content = Content(FileSize);
+	Nix::IArchive* archive = Nix::CreateStdArchieve(".");
+	NIX_CHECK(archive->save(FileName, content.data(), content.size()));
+
+	Nix::IFile* stream = archive->open(FileName, Nix::MemoryModeStream);
+	FileTest("std", stream, content);
+	if (stream) {
+		ThreadTest(stream, content);
+		stream->release();
+	}
+	Nix::IFile* copy = archive->open(FileName, Nix::MemoryModeCopy);
+	FileTest("memory", copy, content);
+	if (copy) {
+		ThreadTest(copy, content);
+		copy->release();
+	}
+	Nix::IFile* mapped = archive->open(FileName, Nix::MemoryModeMapped);
+	FileTest("mapped", mapped, content);
+	if (mapped) {
+		mapped->release();
+	}
+
+	// a view that starts inside the blob, offsets are relative to the view
+	std::string path = std::string(archive->root()) + "/" + FileName;
+	Nix::IBlob* blob = Nix::MapFileToMemory(path);
+	NIX_CHECK(blob);
+	if (blob) {
+		Nix::IFile* view = Nix::CreateBlobView(blob, 333, FileSize - 333);
+		std::vector<uint8_t> viewContent(content.begin() + 333, content.end());
+		NIX_CHECK(view && view->size() == viewContent.size());
+		if (view) {
+			std::vector<uint8_t> block(1000);
+			Nix::IoRange ranges[] = {
+				{ 0, 500, block.data(), 0 },
+				{ 500, 500, block.data() + 500, 0 },
+				{ FileSize - 333 - 10, 100, nullptr, 0 },
+			};
+			std::vector<uint8_t> last(100);
+			ranges[2].buffer = last.data();
+			NIX_CHECK(view->readv(ranges, 3) == 1010);
+			NIX_CHECK(!memcmp(block.data(), &viewContent[0], 1000));
+			NIX_CHECK(ranges[2].bytesRead == 10 && !memcmp(last.data(), &viewContent[viewContent.size() - 10], 10));
+			view->release();
+		}
+		blob->release();
+	}
+
+	// a file without its own readv, the default seeks and reads range by range
+	std::vector<uint8_t> compressed;
+	NIX_CHECK(Nix::CompressBlocks(content.data(), content.size(), Nix::DefaultCompressedBlockSize, compressed));
+	void* packed = malloc(compressed.size());
+	memcpy(packed, compressed.data(), compressed.size());
+	Nix::IFile* decoder = Nix::CreateCompressedFile(Nix::CreateMemoryBuffer(packed, compressed.size(), [](void* _ptr) { free(_ptr); }));
+	FileTest("compressed", decoder, content);
+	if (decoder) {
+		decoder->release();
+	}
+
+	remove(FileName);
+	archive->release();
+	return NIX_TEST_RESULT();
+}
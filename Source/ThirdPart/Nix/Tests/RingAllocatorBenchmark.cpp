@@ -0,0 +1,77 @@
+#include "NixTest.h"
+#include <Memory/RingAllocator.h>
+#include <vector>
+
+// The object constant buffer pattern of Shapes::updateObjectConstantBuffers : every frame each render
+// item gets a 256 byte aligned constant block that is dropped once the frame's fence completes, with
+// three frames in flight. RingAllocator against per-block BuddySystemAllocator allocate/free.
+
+namespace {
+
+	const uint64_t FlightCount = 3;
+	const size_t ConstantSize = 64;		// one float4x4
+	const size_t ConstantAlignment = 256;
+	volatile size_t Sink;	// keeps the offsets alive
+
+	double RingFrames(size_t _itemCount, size_t _frameCount) {
+		Nix::RingAllocator ring;
+		ring.initialize(_itemCount * ConstantAlignment * (FlightCount + 1));
+		size_t checksum = 0;
+		double begin = NixSeconds();
+		for (uint64_t fence = 1; fence <= _frameCount; ++fence) {
+			if (fence > FlightCount) {
+				ring.retire(fence - FlightCount);
+			}
+			for (size_t i = 0; i < _itemCount; ++i) {
+				size_t offset = 0;
+				ring.allocate(ConstantSize, ConstantAlignment, offset);
+				checksum += offset;
+			}
+			ring.finishFrame(fence);
+		}
+		double seconds = NixSeconds() - begin;
+		Sink = checksum;
+		return seconds * 1e9 / (double)(_itemCount * _frameCount);
+	}
+
+	double BuddyFrames(size_t _itemCount, size_t _frameCount) {
+		Nix::BuddySystemAllocator buddy;
+		buddy.initialize(_itemCount * ConstantAlignment * (FlightCount + 1) * 2, ConstantAlignment);
+		std::vector<std::vector<Nix::BuddyHandle>> frames(FlightCount);
+		size_t checksum = 0;
+		double begin = NixSeconds();
+		for (uint64_t fence = 1; fence <= _frameCount; ++fence) {
+			// the blocks of the frame FlightCount frames ago, its fence has completed
+			std::vector<Nix::BuddyHandle>& frame = frames[fence % frames.size()];
+			for (Nix::BuddyHandle handle : frame) {
+				buddy.free(handle);
+			}
+			frame.clear();
+			for (size_t i = 0; i < _itemCount; ++i) {
+				size_t offset = 0;
+				Nix::BuddyHandle handle;
+				if (buddy.allocate(ConstantSize, offset, handle)) {
+					frame.push_back(handle);
+				}
+				checksum += offset;
+			}
+		}
+		double seconds = NixSeconds() - begin;
+		Sink = checksum;
+		return seconds * 1e9 / (double)(_itemCount * _frameCount);
+	}
+
+}
+
+int main(int argc, char** argv) {
+	bool quick = NixBenchQuick(argc, argv);
+	const size_t itemCounts[] = { 22, 1000, 10000 };	// 22 is the Shapes scene
+	printf("%8s %16s %16s\n", "items", "ring ns/block", "buddy ns/block");
+	for (size_t itemCount : itemCounts) {
+		size_t frameCount = (quick ? 200000 : 2000000) / itemCount;
+		double ring = RingFrames(itemCount, frameCount);
+		double buddy = BuddyFrames(itemCount, frameCount);
+		printf("%8zu %16.1f %16.1f\n", itemCount, ring, buddy);
+	}
+	return NIX_TEST_RESULT();
+}
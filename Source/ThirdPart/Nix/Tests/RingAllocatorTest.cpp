@@ -0,0 +1,129 @@
+#include "NixTest.h"
+#include <Memory/RingAllocator.h>
+#include <vector>
+#include <deque>
+#include <random>
+
+// Frames of random transient allocations with three frames in flight, the GPU side is a fence that
+// completes three frames late. Every live byte is owned by its frame, an overlap or an unaligned
+// offset fails the test, and the ring has to wrap around many times on the way.
+
+namespace {
+
+	const size_t Capacity = 64 * 1024;
+	const uint64_t FlightCount = 3;
+
+	struct range_t {
+		size_t offset;
+		size_t size;
+	};
+
+	void FrameTest() {
+		Nix::RingAllocator ring;
+		NIX_CHECK(ring.initialize(Capacity));
+		std::vector<uint64_t> owners(Capacity, 0);
+		std::deque<std::vector<range_t>> inFlight;
+		std::mt19937 random(3);
+		size_t wraps = 0;
+		size_t failures = 0;
+		for (uint64_t fence = 1; fence <= 2000; ++fence) {
+			// the GPU finished the frame submitted FlightCount frames ago
+			if (fence > FlightCount) {
+				ring.retire(fence - FlightCount);
+				for (const range_t& range : inFlight.front()) {
+					for (size_t i = range.offset; i < range.offset + range.size; ++i) {
+						owners[i] = 0;
+					}
+				}
+				inFlight.pop_front();
+			}
+			inFlight.emplace_back();
+			size_t last = 0;
+			size_t count = 1 + random() % 40;
+			for (size_t i = 0; i < count; ++i) {
+				size_t alignment = (size_t)1 << (random() % 9);
+				size_t size = 1 + random() % 1200;
+				size_t offset;
+				if (!ring.allocate(size, alignment, offset)) {
+					++failures;
+					continue;
+				}
+				NIX_CHECK(offset % alignment == 0);
+				NIX_CHECK(offset + size <= Capacity);
+				for (size_t b = offset; b < offset + size; ++b) {
+					NIX_CHECK(owners[b] == 0);
+					owners[b] = fence;
+				}
+				wraps += offset < last;
+				last = offset + size;
+				inFlight.back().push_back({ offset, size });
+			}
+			ring.finishFrame(fence);
+			NIX_CHECK(ring.used() <= Capacity);
+		}
+		// the last frames retire, the ring is empty again
+		ring.retire(UINT64_MAX);
+		NIX_CHECK(ring.used() == 0);
+		NIX_CHECK(wraps > 10);
+		printf("%zu wraps, %zu allocations didn't fit\n", wraps, failures);
+	}
+
+	// a full ring refuses until the fence of the oldest frame completes
+	void FullRingTest() {
+		Nix::RingAllocator ring;
+		NIX_CHECK(ring.initialize(1024));
+		size_t offset;
+		NIX_CHECK(ring.allocate(512, 256, offset) && offset == 0);
+		ring.finishFrame(1);
+		NIX_CHECK(ring.allocate(512, 256, offset) && offset == 512);
+		ring.finishFrame(2);
+		NIX_CHECK(!ring.allocate(1, 1, offset));
+		ring.retire(0);
+		NIX_CHECK(!ring.allocate(1, 1, offset));
+		// frame 1 done : its 512 bytes at the front come back
+		ring.retire(1);
+		NIX_CHECK(ring.used() == 512);
+		NIX_CHECK(ring.allocate(256, 256, offset) && offset == 0);
+		NIX_CHECK(ring.allocate(256, 256, offset) && offset == 256);
+		NIX_CHECK(!ring.allocate(1, 1, offset));
+		ring.finishFrame(3);
+		// frame 2 done : frame 3 holds [0, 512), only [512, 1024) is free and nothing may wrap
+		ring.retire(2);
+		NIX_CHECK(!ring.allocate(600, 1, offset));
+		NIX_CHECK(ring.allocate(384, 128, offset) && offset == 512);
+		ring.finishFrame(4);
+		// frame 3 done : 200 bytes don't fit behind frame 4, the head wraps and the skipped
+		// end of the region is charged to frame 5
+		ring.retire(3);
+		NIX_CHECK(ring.used() == 384);
+		NIX_CHECK(ring.allocate(200, 1, offset) && offset == 0);
+		NIX_CHECK(ring.used() == 384 + (1024 - 896) + 200);
+		ring.finishFrame(5);
+		ring.retire(4);
+		NIX_CHECK(ring.used() == (1024 - 896) + 200);
+		ring.retire(5);
+		NIX_CHECK(ring.used() == 0);
+	}
+
+	// persistent blocks sit behind the ring in the same heap
+	void UploadHeapTest() {
+		Nix::UploadHeapAllocator heap;
+		NIX_CHECK(heap.initialize(1 << 20, 1 << 16, 256));
+		size_t transient, persistent;
+		Nix::BuddyHandle handle;
+		NIX_CHECK(heap.allocateTransient(1000, 256, transient) && transient < (1 << 16));
+		NIX_CHECK(heap.allocatePersistent(1000, persistent, handle) && persistent >= (1 << 16));
+		heap.finishFrame(1);
+		heap.retire(1);
+		NIX_CHECK(heap.ring().used() == 0);
+		NIX_CHECK(heap.freePersistent(handle));
+	}
+
+}
+
+int main() {
+	FrameTest();
+	FullRingTest();
+	UploadHeapTest();
+	return NIX_TEST_RESULT();
+}
@@ -0,0 +1,106 @@
+#include "NixTest.h"
+#include <IO/Archive.h>
+#include <vector>
+#include <random>
+#include <stdint.h>
+
+// StdFile reads, positional I/O on the native handle behind a 64 KB read buffer, against the
+// stdio FILE the files used before (fseek + fread). Small reads at random offsets are the pak and
+// index lookups, large sequential reads are whole assets. The file is read once beforehand so both
+// run from the OS cache.
+
+namespace {
+
+	const char* FileName = "StdFileBenchmark.bin";
+
+	// the read of the stdio StdFile : seek then fread at the FILE's cursor
+	struct stdio_reader_t {
+		FILE* file;
+
+		size_t read(uint64_t _offset, size_t _bytes, void* out_) {
+#ifdef _WIN32
+			_fseeki64(file, (int64_t)_offset, SEEK_SET);
+#else
+			fseeko(file, (off_t)_offset, SEEK_SET);
+#endif
+			return fread(out_, 1, _bytes, file);
+		}
+	};
+
+	struct std_file_reader_t {
+		Nix::IFile* file;
+
+		size_t read(uint64_t _offset, size_t _bytes, void* out_) {
+			file->seek(Nix::SeekSet, (int64_t)_offset);
+			return file->read(_bytes, out_);
+		}
+	};
+
+	// returns MB/s, reads `_count` blocks of `_bytes` at `_offsets` and checks them against `_content`
+	template<class Reader>
+	double Run(Reader& _reader, const std::vector<uint8_t>& _content, const std::vector<uint64_t>& _offsets, size_t _bytes) {
+		std::vector<uint8_t> block(_bytes);
+		size_t total = 0;
+		bool same = true;
+		double begin = NixSeconds();
+		for (uint64_t offset : _offsets) {
+			size_t readReal = _reader.read(offset, _bytes, block.data());
+			total += readReal;
+			same = same && readReal == _bytes && block[0] == _content[(size_t)offset] && block[_bytes - 1] == _content[(size_t)offset + _bytes - 1];
+		}
+		double seconds = NixSeconds() - begin;
+		NIX_CHECK(same && total == _offsets.size() * _bytes);
+		return total / seconds / 1048576.0;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	bool quick = NixBenchQuick(argc, argv);
+	size_t size = quick ? (8 << 20) : (256 << 20);
+	std::vector<uint8_t> content(size);
+	for (size_t i = 0; i < size; ++i) {
+		content[i] = (uint8_t)(i * 2654435761u >> 24);
+	}
+	Nix::IArchive* archive = Nix::CreateStdArchieve(".");
+	NIX_CHECK(archive->save(FileName, content.data(), content.size()));
+	FILE* stdio = fopen(FileName, "rb");
+	Nix::IFile* file = archive->open(FileName);
+	NIX_CHECK(stdio && file);
+	if (!stdio || !file) {
+		return NIX_TEST_RESULT();
+	}
+	stdio_reader_t stdioReader = { stdio };
+	std_file_reader_t fileReader = { file };
+	std::vector<uint8_t> warm(size);
+	NIX_CHECK(fileReader.read(0, size, warm.data()) == size && warm == content);
+
+	struct {
+		const char* name;
+		size_t bytes;
+		bool sequential;
+	} cases[] = {
+		{ "random 256 B", 256, false },
+		{ "random 4 KB", 4096, false },
+		{ "sequential 256 B", 256, true },
+		{ "sequential 64 KB", 64 << 10, true },
+		{ "sequential 1 MB", 1 << 20, true },
+	};
+	printf("%zu MB\n%18s %14s %14s\n", size >> 20, "", "stdio MB/s", "StdFile MB/s");
+	std::mt19937_64 random(1);
+	for (auto& test : cases) {
+		size_t count = test.sequential ? size / test.bytes : (quick ? 20000 : 400000);
+		std::vector<uint64_t> offsets(count);
+		for (size_t i = 0; i < count; ++i) {
+			offsets[i] = test.sequential ? (uint64_t)i * test.bytes : random() % (size - test.bytes);
+		}
+		double old = Run(stdioReader, content, offsets, test.bytes);
+		double now = Run(fileReader, content, offsets, test.bytes);
+		printf("%18s %14.0f %14.0f\n", test.name, old, now);
+	}
+	fclose(stdio);
+	file->release();
+	remove(FileName);
+	archive->release();
+	return NIX_TEST_RESULT();
+}
@@ -0,0 +1,229 @@
+#include "NixTest.h"
+#include <Memory/TLSFAllocator.h>
+#include <Memory/BuddySystemAllocator.h>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+// Replays an allocation trace through TLSFAllocator and BuddySystemAllocator and reports the memory
+// lost to rounding, failed allocations, throughput and the latency of single operations (which
+// includes a clock read, and the worst case includes whatever the OS did in between).
+// Without arguments the trace is synthesized from the vertex and index buffer sizes GeometryGenerator
+// produces for boxes, spheres, geospheres, cylinders and grids, streamed in and out over time.
+// `--trace <file>` replays a recorded trace instead, one operation per line :
+//   a <id> <size>     allocate `size` bytes as allocation `id`
+//   f <id>            free allocation `id`
+
+namespace {
+
+	const size_t HeapSize = 256 << 20;
+	const size_t Granularity = 256;
+	const size_t VertexSize = 44;		// GeometryGenerator's Vertex : position, normal, tangent, uv
+	const size_t IndexSize = 4;
+
+	struct op_t {
+		uint32_t id;
+		uint32_t size;	// 0 frees `id`
+	};
+
+	void AddMesh(std::vector<op_t>& _trace, uint32_t& nextId_, std::vector<uint32_t>& live_, size_t _vertices, size_t _indices) {
+		_trace.push_back({ nextId_, (uint32_t)(_vertices * VertexSize) });
+		live_.push_back(nextId_++);
+		_trace.push_back({ nextId_, (uint32_t)(_indices * IndexSize) });
+		live_.push_back(nextId_++);
+	}
+
+	std::vector<op_t> GeometryTrace(size_t _meshCount) {
+		std::mt19937 random(11);
+		std::vector<op_t> trace;
+		std::vector<uint32_t> live;
+		uint32_t nextId = 1;
+		for (size_t mesh = 0; mesh < _meshCount; ++mesh) {
+			switch (random() % 5) {
+			case 0: {
+				size_t subdivisions = random() % 4;
+				AddMesh(trace, nextId, live, 24 << (2 * subdivisions), 36 << (2 * subdivisions));
+				break;
+			}
+			case 1: {
+				size_t slices = 8 + random() % 56, stacks = 8 + random() % 56;
+				AddMesh(trace, nextId, live, (stacks - 1) * (slices + 1) + 2, 6 * slices * (stacks - 1));
+				break;
+			}
+			case 2: {
+				size_t subdivisions = random() % 6;
+				AddMesh(trace, nextId, live, (10 << (2 * subdivisions)) + 2, 60 << (2 * subdivisions));
+				break;
+			}
+			case 3: {
+				size_t slices = 8 + random() % 40, stacks = 1 + random() % 20;
+				AddMesh(trace, nextId, live, (stacks + 1) * (slices + 1) + 2 * (slices + 2), 6 * slices * stacks + 6 * slices);
+				break;
+			}
+			default: {
+				size_t m = 2 + random() % 200, n = 2 + random() % 200;
+				AddMesh(trace, nextId, live, m * n, 6 * (m - 1) * (n - 1));
+				break;
+			}
+			}
+			// keep a working set of about 500 meshes, the oldest ones are the likeliest to go
+			while (live.size() > 1000) {
+				size_t victim = std::min(live.size() - 1, (size_t)(random() % 400));
+				victim &= ~(size_t)1;
+				trace.push_back({ live[victim], 0 });
+				trace.push_back({ live[victim + 1], 0 });
+				live.erase(live.begin() + victim, live.begin() + victim + 2);
+			}
+		}
+		for (uint32_t id : live) {
+			trace.push_back({ id, 0 });
+		}
+		return trace;
+	}
+
+	bool LoadTrace(const char* _path, std::vector<op_t>& trace_) {
+		FILE* file = fopen(_path, "r");
+		if (!file) {
+			return false;
+		}
+		char kind;
+		unsigned id, size;
+		int fields;
+		while ((fields = fscanf(file, " %c %u", &kind, &id)) == 2) {
+			if (kind == 'a' && fscanf(file, "%u", &size) == 1) {
+				trace_.push_back({ id, size });
+			} else if (kind == 'f') {
+				trace_.push_back({ id, 0 });
+			}
+		}
+		fclose(file);
+		return !trace_.empty();
+	}
+
+	struct TLSFBackend {
+		typedef Nix::TLSFHandle Handle;
+		Nix::TLSFAllocator allocator;
+		static const char* name() { return "tlsf"; }
+		bool initialize() { return allocator.initialize(HeapSize, Granularity, 1 << 16); }
+		bool allocate(size_t _size, size_t& offset_, Handle& handle_) { return allocator.allocate(_size, offset_, handle_); }
+		void free(Handle _handle) { allocator.free(_handle); }
+		size_t granted(size_t _size) const { return (_size + Granularity - 1) / Granularity * Granularity; }
+	};
+
+	struct BuddyBackend {
+		typedef Nix::BuddyHandle Handle;
+		Nix::BuddySystemAllocator allocator;
+		static const char* name() { return "buddy"; }
+		bool initialize() { return allocator.initialize(HeapSize, Granularity); }
+		bool allocate(size_t _size, size_t& offset_, Handle& handle_) { return allocator.allocate(_size, offset_, handle_); }
+		void free(Handle _handle) { allocator.free(_handle); }
+		size_t granted(size_t _size) const { return allocator.capacity() >> allocator.layerForSize(_size); }
+	};
+
+	template<class Backend>
+	void Replay(const std::vector<op_t>& _trace, uint32_t _idCount) {
+		typedef typename Backend::Handle Handle;
+		std::vector<Handle> handles(_idCount + 1);
+		std::vector<uint32_t> sizes(_idCount + 1, 0);
+		// first pass : rounding waste, failures and per operation latency
+		Backend backend;
+		NIX_CHECK(backend.initialize());
+		size_t requested = 0, granted = 0, peakRequested = 0, peakGranted = 0, failures = 0;
+		double worst = 0.0;
+		std::vector<float> latencies;
+		latencies.reserve(_trace.size());
+		for (const op_t& op : _trace) {
+			double begin = NixSeconds();
+			if (op.size) {
+				size_t offset;
+				if (backend.allocate(op.size, offset, handles[op.id])) {
+					sizes[op.id] = op.size;
+				} else {
+					++failures;
+				}
+			} else if (sizes[op.id]) {
+				backend.free(handles[op.id]);
+			}
+			double elapsed = NixSeconds() - begin;
+			latencies.push_back((float)elapsed);
+			worst = std::max(worst, elapsed);
+			if (op.size && sizes[op.id]) {
+				requested += op.size;
+				granted += backend.granted(op.size);
+				if (granted > peakGranted) {
+					peakGranted = granted;
+					peakRequested = requested;
+				}
+			} else if (!op.size && sizes[op.id]) {
+				requested -= sizes[op.id];
+				granted -= backend.granted(sizes[op.id]);
+				sizes[op.id] = 0;
+			}
+		}
+		std::sort(latencies.begin(), latencies.end());
+		double p99 = latencies.empty() ? 0.0 : latencies[latencies.size() * 99 / 100];
+		double p999 = latencies.empty() ? 0.0 : latencies[latencies.size() * 999 / 1000];
+		// second pass : throughput without the clock reads
+		Backend timed;
+		timed.initialize();
+		std::fill(sizes.begin(), sizes.end(), 0);
+		double begin = NixSeconds();
+		for (const op_t& op : _trace) {
+			if (op.size) {
+				size_t offset;
+				sizes[op.id] = timed.allocate(op.size, offset, handles[op.id]);
+			} else if (sizes[op.id]) {
+				timed.free(handles[op.id]);
+				sizes[op.id] = 0;
+			}
+		}
+		double seconds = NixSeconds() - begin;
+		printf("%6s  peak %7.1f MB for %7.1f MB requested (%5.1f%% waste)  %zu failed  %6.1f Mops/s  p99 %4.0f ns  p99.9 %5.0f ns  worst %7.0f ns\n",
+			Backend::name(), peakGranted / 1048576.0, peakRequested / 1048576.0,
+			peakGranted ? 100.0 * (peakGranted - peakRequested) / peakGranted : 0.0, failures,
+			_trace.size() / seconds * 1e-6, p99 * 1e9, p999 * 1e9, worst * 1e9);
+	}
+
+	// the header table is sized in initialize : 2 * maxAllocations + 1 headers, once they are all in
+	// use the next block is handed out whole instead of being split
+	void PoolTest() {
+		Nix::TLSFAllocator allocator;
+		NIX_CHECK(allocator.initialize(1 << 20, Granularity, 4));
+		std::vector<Nix::TLSFHandle> handles;
+		size_t offset;
+		Nix::TLSFHandle handle;
+		while (allocator.allocate(Granularity, offset, handle)) {
+			handles.push_back(handle);
+		}
+		NIX_CHECK(handles.size() == 2 * 4 + 1);
+		NIX_CHECK(allocator.usedBytes() == allocator.capacity());
+		for (Nix::TLSFHandle live : handles) {
+			NIX_CHECK(allocator.free(live));
+		}
+		NIX_CHECK(allocator.usedBytes() == 0);
+		NIX_CHECK(allocator.allocate(allocator.capacity(), offset, handle) && offset == 0);
+	}
+
+}
+
+int main(int argc, char** argv) {
+	PoolTest();
+	std::vector<op_t> trace;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (!strcmp(argv[i], "--trace") && !LoadTrace(argv[i + 1], trace)) {
+			fprintf(stderr, "can't read trace %s\n", argv[i + 1]);
+			return 1;
+		}
+	}
+	if (trace.empty()) {
+		trace = GeometryTrace(NixBenchQuick(argc, argv) ? 20000 : 200000);
+	}
+	uint32_t idCount = 0;
+	for (const op_t& op : trace) {
+		idCount = std::max(idCount, op.id);
+	}
+	printf("%zu operations\n", trace.size());
+	Replay<TLSFBackend>(trace, idCount);
+	Replay<BuddyBackend>(trace, idCount);
+	return NIX_TEST_RESULT();
+}
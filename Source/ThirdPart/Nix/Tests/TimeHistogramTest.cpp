@@ -0,0 +1,180 @@
+#include "NixTest.h"
+#include <Profiler/TimeHistogram.h>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <stdint.h>
+
+// TimeHistogram : values below 256 ns are kept exactly, above that a bucket is at most 1/128 of
+// its values wide, percentiles of known distributions land within that precision, and the CSV and
+// JSON files read back to what was recorded.
+
+namespace {
+
+	// upper bound of the bucket `_value` lands in : with a larger sample next to it, p50 is the
+	// first sample's bucket
+	uint64_t UpperBound(uint64_t _value) {
+		Nix::TimeHistogram histogram;
+		histogram.record(_value);
+		histogram.record(UINT64_MAX);
+		return histogram.percentile(50.0);
+	}
+
+	bool Near(uint64_t _value, uint64_t _expected) {
+		uint64_t error = _value > _expected ? _value - _expected : _expected - _value;
+		return error <= (_expected >> 7) + 1;
+	}
+
+	void BucketTest() {
+		for (uint64_t value = 0; value < 256; ++value) {
+			NIX_CHECK(UpperBound(value) == value);
+		}
+		std::vector<uint64_t> values;
+		for (uint32_t bit = 8; bit < 64; ++bit) {
+			uint64_t power = 1ull << bit;
+			values.push_back(power - 1);
+			values.push_back(power);
+			values.push_back(power + 1);
+			values.push_back(power + (power >> 1));
+		}
+		values.push_back(UINT64_MAX - 1);
+		std::mt19937_64 random(3);
+		for (int i = 0; i < 2000; ++i) {
+			values.push_back(random() >> (random() % 56));
+		}
+		std::sort(values.begin(), values.end());
+		uint64_t previous = 0;
+		bool bounded = true;
+		bool ordered = true;
+		bool closed = true;
+		for (uint64_t value : values) {
+			uint64_t upper = UpperBound(value);
+			// at most 1/128 of the value above it, bucket bounds grow with the values
+			bounded = bounded && upper >= value && upper - value <= value >> 7;
+			ordered = ordered && upper >= previous;
+			// the bound is the last value of its bucket, the next value opens another one
+			closed = closed && UpperBound(upper) == upper && (upper == UINT64_MAX - 1 || upper == UINT64_MAX || UpperBound(upper + 1) > upper);
+			previous = upper;
+		}
+		NIX_CHECK(bounded && ordered && closed);
+	}
+
+	void DistributionTest() {
+		// uniform 1 us - 100 us
+		Nix::TimeHistogram uniform;
+		for (uint64_t value = 1000; value <= 100000; ++value) {
+			uniform.record(value);
+		}
+		NIX_CHECK(uniform.count() == 99001);
+		NIX_CHECK(uniform.min() == 1000 && uniform.max() == 100000);
+		NIX_CHECK(uniform.mean() == 50500);
+		NIX_CHECK(Near(uniform.percentile(50.0), 50500));
+		NIX_CHECK(Near(uniform.percentile(95.0), 95050));
+		NIX_CHECK(Near(uniform.percentile(99.0), 99010));
+
+		// frames of ~16.6 ms with a 1% tail of 50 ms hitches
+		Nix::TimeHistogram frames;
+		std::mt19937 random(5);
+		for (int i = 0; i < 9900; ++i) {
+			frames.record(16600000 + random() % 100000);
+		}
+		for (int i = 0; i < 100; ++i) {
+			frames.record(50000000);
+		}
+		NIX_CHECK(frames.percentile(50.0) >= 16600000 && frames.percentile(50.0) <= 16700000 + (16700000 >> 7));
+		NIX_CHECK(frames.percentile(99.0) >= 16600000 && frames.percentile(99.0) <= 16700000 + (16700000 >> 7));
+		NIX_CHECK(frames.percentile(99.5) == 50000000);
+		NIX_CHECK(frames.max() == 50000000);
+	}
+
+	void ClampTest() {
+		Nix::TimeHistogram histogram;
+		NIX_CHECK(histogram.count() == 0 && histogram.percentile(50.0) == 0);
+		NIX_CHECK(histogram.min() == 0 && histogram.max() == 0 && histogram.mean() == 0);
+		// percentages clamp to 0 - 100, and the bucket bound of 3001 lies past the max, which clamps it
+		histogram.record(1001);
+		histogram.record(2000);
+		histogram.record(3001);
+		NIX_CHECK(histogram.percentile(-10.0) == histogram.percentile(0.0));
+		NIX_CHECK(histogram.percentile(0.0) >= 1001 && Near(histogram.percentile(0.0), 1001));
+		NIX_CHECK(histogram.percentile(100.0) == 3001);
+		NIX_CHECK(histogram.percentile(250.0) == 3001);
+		NIX_CHECK(Near(histogram.percentile(50.0), 2000));
+
+		// exact below 256 ns
+		histogram.reset();
+		NIX_CHECK(histogram.count() == 0 && histogram.percentile(99.0) == 0);
+		for (uint64_t value = 0; value < 256; ++value) {
+			histogram.record(value);
+		}
+		NIX_CHECK(histogram.percentile(50.0) == 127);
+		NIX_CHECK(histogram.percentile(95.0) == 243);
+		NIX_CHECK(histogram.percentile(99.0) == 253);
+		NIX_CHECK(histogram.min() == 0 && histogram.max() == 255);
+	}
+
+	std::string Load(const char* _path) {
+		std::string text;
+		FILE* file = fopen(_path, "rb");
+		if (!file) {
+			return text;
+		}
+		char block[4096];
+		size_t bytes;
+		while ((bytes = fread(block, 1, sizeof(block), file)) > 0) {
+			text.append(block, bytes);
+		}
+		fclose(file);
+		return text;
+	}
+
+	void FileTest() {
+		Nix::TimeHistogram histogram;
+		for (int i = 0; i < 99; ++i) {
+			histogram.record(16000000);
+		}
+		histogram.record(40000000);
+
+		const char* csvPath = "TimeHistogramTest.csv";
+		NIX_CHECK(histogram.writeCsv(csvPath));
+		std::string csv = Load(csvPath);
+		const char* header = "frames,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+		NIX_CHECK(csv.compare(0, strlen(header), header) == 0);
+		unsigned long long frames = 0;
+		double mean, p50, p95, p99, max;
+		NIX_CHECK(sscanf(csv.c_str() + strlen(header), "%llu,%lf,%lf,%lf,%lf,%lf", &frames, &mean, &p50, &p95, &p99, &max) == 6);
+		NIX_CHECK(frames == 100);
+		NIX_CHECK(mean > 16.2399 && mean < 16.2401);
+		NIX_CHECK(p50 == p95 && p95 == p99 && Near((uint64_t)(p99 * 1e6), 16000000));
+		NIX_CHECK(max > 39.9999 && max < 40.0001);
+		remove(csvPath);
+
+		const char* jsonPath = "TimeHistogramTest.json";
+		NIX_CHECK(histogram.writeJson(jsonPath));
+		std::string json = Load(jsonPath);
+		NIX_CHECK(sscanf(json.c_str(), "{\"frames\":%llu,\"mean_ms\":%lf,\"p50_ms\":%lf,\"p95_ms\":%lf,\"p99_ms\":%lf,\"max_ms\":%lf", &frames, &mean, &p50, &p95, &p99, &max) == 6);
+		NIX_CHECK(frames == 100 && max > 39.9999 && max < 40.0001);
+		// two non empty buckets, holding the values and counts recorded
+		size_t buckets = json.find("\"buckets_ns\":[");
+		NIX_CHECK(buckets != std::string::npos);
+		if (buckets == std::string::npos) {
+			return;
+		}
+		unsigned long long first, firstCount, second, secondCount;
+		NIX_CHECK(sscanf(json.c_str() + buckets, "\"buckets_ns\":[[%llu,%llu],[%llu,%llu]]}", &first, &firstCount, &second, &secondCount) == 4);
+		NIX_CHECK(first >= 16000000 && Near(first, 16000000) && firstCount == 99);
+		NIX_CHECK(second >= 40000000 && Near(second, 40000000) && secondCount == 1);
+		NIX_CHECK(json.size() > 4 && json.compare(json.size() - 4, 4, "]]}\n") == 0);
+		remove(jsonPath);
+	}
+
+}
+
+int main() {
+	BucketTest();
+	DistributionTest();
+	ClampTest();
+	FileTest();
+	return NIX_TEST_RESULT();
+}
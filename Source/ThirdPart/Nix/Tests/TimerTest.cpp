@@ -0,0 +1,89 @@
+#include "NixTest.h"
+#include <Timer/Timer.h>
+#include <thread>
+#include <chrono>
+
+// Timer : `now` never goes back, a stopped timer leaves the pause out of its total time, and
+// `ticks` scaled by `nanosecondsPerTick` follows `now`.
+
+namespace {
+
+	void Sleep(int _milliseconds) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(_milliseconds));
+	}
+
+	void MonotonicTest() {
+		int64_t previous = Nix::Timer::now();
+		bool forward = true;
+		for (int i = 0; i < 100000; ++i) {
+			int64_t now = Nix::Timer::now();
+			forward = forward && now >= previous;
+			previous = now;
+		}
+		NIX_CHECK(forward);
+		int64_t begin = Nix::Timer::now();
+		Sleep(20);
+		int64_t slept = Nix::Timer::now() - begin;
+		NIX_CHECK(slept >= 20000000 && slept < 2000000000);
+	}
+
+	void PauseTest() {
+		Nix::Timer timer;
+		timer.reset();
+		NIX_CHECK(timer.totalNanoseconds() == 0);
+		Sleep(20);
+		timer.tick();
+		int64_t running = timer.totalNanoseconds();
+		NIX_CHECK(running >= 20000000);
+		NIX_CHECK(timer.deltaNanoseconds() == running);
+
+		// the stopped time is not counted, and a stopped timer doesn't move
+		timer.stop();
+		int64_t stopped = timer.totalNanoseconds();
+		NIX_CHECK(stopped >= running);
+		Sleep(200);
+		timer.tick();
+		NIX_CHECK(timer.deltaNanoseconds() == 0);
+		NIX_CHECK(timer.totalNanoseconds() == stopped);
+		timer.stop();
+		NIX_CHECK(timer.totalNanoseconds() == stopped);
+
+		timer.start();
+		Sleep(20);
+		timer.tick();
+		int64_t total = timer.totalNanoseconds();
+		// the first delta after start counts from start, not from the last tick before stop
+		NIX_CHECK(timer.deltaNanoseconds() >= 20000000 && timer.deltaNanoseconds() < 200000000);
+		NIX_CHECK(total == stopped + timer.deltaNanoseconds());
+		NIX_CHECK(timer.totalTime() > 0.99f * (float)(total * 1e-9) && timer.totalTime() < 1.01f * (float)(total * 1e-9));
+		timer.start();
+		NIX_CHECK(timer.totalNanoseconds() == total);
+	}
+
+	void TicksTest() {
+		double nsPerTick = Nix::Timer::nanosecondsPerTick();
+		NIX_CHECK(nsPerTick > 0.0);
+		if (!Nix::Timer::ticksAreTsc()) {
+			NIX_CHECK(nsPerTick == 1.0);
+		}
+		uint64_t ticksBegin = Nix::Timer::ticks();
+		int64_t begin = Nix::Timer::now();
+		Sleep(100);
+		uint64_t ticksEnd = Nix::Timer::ticks();
+		int64_t end = Nix::Timer::now();
+		NIX_CHECK(ticksEnd > ticksBegin);
+		double byTicks = (double)(ticksEnd - ticksBegin) * nsPerTick;
+		double byNow = (double)(end - begin);
+		// a calibration off by more than a few percent would skew every profiler zone
+		NIX_CHECK(byTicks > byNow * 0.95 && byTicks < byNow * 1.05);
+		printf("ticks : %.3f ns, %.0f ns measured against %.0f ns\n", nsPerTick, byTicks, byNow);
+	}
+
+}
+
+int main() {
+	MonotonicTest();
+	PauseTest();
+	TicksTest();
+	return NIX_TEST_RESULT();
+}
@@ -0,0 +1,101 @@
+#include "NixTest.h"
+#include <String/Encoding.h>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <locale>
+#include <codecvt>
+#endif
+
+// utf8_to_ucsle / ucsle_to_utf8 against the conversions the legacy wrappers made before, the Win32
+// MultiByteToWideChar / WideCharToMultiByte calls. Other platforms have no such call, the
+// standard codecvt_utf8_utf16 facet stands in for it there. ASCII text takes the SIMD path,
+// the mixed text is mostly CJK and runs through the scalar decoder.
+
+namespace {
+
+	volatile size_t Sink;
+
+	std::string Text(size_t _size, bool _ascii) {
+		static const char* words[] = { "vertex ", "index ", "buffer ", "texture ", "\xe7\x9d\x80\xe8\x89\xb2\xe5\x99\xa8 ", "\xe7\xba\xb9\xe7\x90\x86 ", "\xc3\xa9t\xc3\xa9 " };
+		size_t wordCount = _ascii ? 4 : sizeof(words) / sizeof(words[0]);
+		std::string text;
+		uint32_t state = 1;
+		while (text.size() < _size) {
+			state = state * 1664525 + 1013904223;
+			text += words[(state >> 24) % wordCount];
+		}
+		return text;
+	}
+
+#ifdef _WIN32
+	const char* BaselineName = "Win32";
+
+	size_t BaselineWiden(const std::string& _utf8, char16_t* ucs_) {
+		return (size_t)MultiByteToWideChar(CP_UTF8, 0, _utf8.data(), (int)_utf8.size(), (LPWSTR)ucs_, (int)_utf8.size());
+	}
+
+	size_t BaselineNarrow(const std::u16string& _ucs, char* utf8_) {
+		return (size_t)WideCharToMultiByte(CP_UTF8, 0, (LPCWSTR)_ucs.data(), (int)_ucs.size(), utf8_, (int)_ucs.size() * 3, NULL, NULL);
+	}
+#else
+	const char* BaselineName = "codecvt";
+
+	size_t BaselineWiden(const std::string& _utf8, char16_t* ucs_) {
+		std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> convert;
+		std::u16string ucs = convert.from_bytes(_utf8);
+		memcpy(ucs_, ucs.data(), ucs.size() * 2);
+		return ucs.size();
+	}
+
+	size_t BaselineNarrow(const std::u16string& _ucs, char* utf8_) {
+		std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> convert;
+		std::string utf8 = convert.to_bytes(_ucs);
+		memcpy(utf8_, utf8.data(), utf8.size());
+		return utf8.size();
+	}
+#endif
+
+	// returns GB/s of UTF-8 text, over `_rounds` conversions
+	template<class Convert>
+	double Measure(size_t _bytes, int _rounds, Convert _convert) {
+		double begin = NixSeconds();
+		for (int round = 0; round < _rounds; ++round) {
+			Sink = _convert();
+		}
+		double seconds = NixSeconds() - begin;
+		return (double)_bytes * _rounds / seconds / 1e9;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	bool quick = NixBenchQuick(argc, argv);
+	size_t size = quick ? (256 << 10) : (16 << 20);
+	int rounds = quick ? 2 : 20;
+	printf("%zu KB\n%8s %16s %16s %16s %16s\n", size >> 10, "", "widen base GB/s", "widen GB/s", "narrow base GB/s", "narrow GB/s");
+	for (int ascii = 1; ascii >= 0; --ascii) {
+		std::string utf8 = Text(size, ascii != 0);
+		std::u16string expected(utf8.size(), 0);
+		expected.resize(Nix::utf8_to_ucsle(utf8.data(), utf8.size(), &expected[0]));
+		// both produce the same text before anything is timed
+		std::u16string ucs(utf8.size(), 0);
+		NIX_CHECK(BaselineWiden(utf8, &ucs[0]) == expected.size());
+		NIX_CHECK(memcmp(ucs.data(), expected.data(), expected.size() * 2) == 0);
+		std::string narrowed(expected.size() * 3, 0);
+		NIX_CHECK(BaselineNarrow(expected, &narrowed[0]) == utf8.size());
+		NIX_CHECK(memcmp(narrowed.data(), utf8.data(), utf8.size()) == 0);
+		NIX_CHECK(Nix::ucsle_to_utf8(expected.data(), expected.size(), &narrowed[0]) == utf8.size());
+		NIX_CHECK(memcmp(narrowed.data(), utf8.data(), utf8.size()) == 0);
+
+		double widenBase = Measure(utf8.size(), rounds, [&]() { return BaselineWiden(utf8, &ucs[0]); });
+		double widen = Measure(utf8.size(), rounds, [&]() { return Nix::utf8_to_ucsle(utf8.data(), utf8.size(), &ucs[0]); });
+		double narrowBase = Measure(utf8.size(), rounds, [&]() { return BaselineNarrow(expected, &narrowed[0]); });
+		double narrow = Measure(utf8.size(), rounds, [&]() { return Nix::ucsle_to_utf8(expected.data(), expected.size(), &narrowed[0]); });
+		printf("%8s %16.2f %16.2f %16.2f %16.2f\n", ascii ? "ascii" : "mixed", widenBase, widen, narrowBase, narrow);
+	}
+	printf("baseline : %s\n", BaselineName);
+	return NIX_TEST_RESULT();
+}
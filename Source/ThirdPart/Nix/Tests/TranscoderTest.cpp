@@ -0,0 +1,125 @@
+#include "NixTest.h"
+#include <String/Encoding.h>
+#include <string>
+#include <vector>
+
+// UTF-8 <-> UCS-2 vectors for the strict transcoders and the replacing flavours the legacy
+// utf82ucsle / ucsle2utf8 wrappers go through, long inputs cross the SIMD blocks.
+
+namespace {
+
+	std::u16string Widen(const std::string& _utf8, bool _replace) {
+		std::u16string ucs(_utf8.size(), 0);
+		size_t count = _replace ? Nix::utf8_to_ucsle_replace(_utf8.data(), _utf8.size(), &ucs[0]) : Nix::utf8_to_ucsle(_utf8.data(), _utf8.size(), &ucs[0]);
+		if (count == Nix::TranscodeInvalid) {
+			return u"<invalid>";
+		}
+		ucs.resize(count);
+		return ucs;
+	}
+
+	std::string Narrow(const std::u16string& _ucs, bool _replace) {
+		std::string utf8(_ucs.size() * 3, 0);
+		size_t bytes = _replace ? Nix::ucsle_to_utf8_replace(_ucs.data(), _ucs.size(), &utf8[0]) : Nix::ucsle_to_utf8(_ucs.data(), _ucs.size(), &utf8[0]);
+		if (bytes == Nix::TranscodeInvalid) {
+			return "<invalid>";
+		}
+		utf8.resize(bytes);
+		return utf8;
+	}
+
+	void ValidTest() {
+		struct {
+			const char* utf8;
+			const char16_t* ucs;
+		} vectors[] = {
+			{ "", u"" },
+			{ "ascii", u"ascii" },
+			{ "\xc2\xa9 \xe4\xb8\xad\xe6\x96\x87", u"© 中文" },
+			{ "\xf0\x9f\x98\x80!", u"\U0001f600!" },
+			{ "\xef\xbf\xbf\xf4\x8f\xbf\xbf", u"\xffff\U0010ffff" },
+		};
+		for (auto& test : vectors) {
+			NIX_CHECK(Widen(test.utf8, false) == test.ucs);
+			NIX_CHECK(Widen(test.utf8, true) == test.ucs);
+			NIX_CHECK(Narrow(test.ucs, false) == test.utf8);
+			NIX_CHECK(Narrow(test.ucs, true) == test.utf8);
+			NIX_CHECK(Nix::utf8_to_ucsle_length(test.utf8, strlen(test.utf8)) == std::u16string(test.ucs).size());
+		}
+		// ASCII around a multi byte character, so the SIMD kernels hand over mid block
+		std::string utf8 = std::string(100, 'a') + "\xe4\xb8\xad" + std::string(37, 'b');
+		std::u16string ucs = std::u16string(100, u'a') + u"中" + std::u16string(37, u'b');
+		NIX_CHECK(Widen(utf8, false) == ucs);
+		NIX_CHECK(Narrow(ucs, false) == utf8);
+	}
+
+	void ReplaceTest() {
+		struct {
+			const char* utf8;
+			const char16_t* ucs;
+		} vectors[] = {
+			// lone continuation byte
+			{ "a\x80z", u"a\xfffdz" },
+			// overlong, neither byte can start a sequence
+			{ "a\xc0\xafz", u"a\xfffd\xfffdz" },
+			// truncated, one replacement for the whole subpart
+			{ "a\xe4\xb8z", u"a\xfffdz" },
+			{ "a\xf0\x9f\x98", u"a\xfffd" },
+			// encoded surrogate and past U+10FFFF, the second byte is already out of range
+			{ "a\xed\xa0\x80z", u"a\xfffd\xfffd\xfffdz" },
+			{ "a\xf4\x90\x80\x80z", u"a\xfffd\xfffd\xfffd\xfffdz" },
+			{ "\xff\xe4\xb8\xad", u"\xfffd中" },
+		};
+		for (auto& test : vectors) {
+			NIX_CHECK(Widen(test.utf8, false) == u"<invalid>");
+			NIX_CHECK(Widen(test.utf8, true) == test.ucs);
+		}
+		// unpaired surrogates, high at the end, low alone, high before a non surrogate
+		NIX_CHECK(Narrow(u"a\xd83d", false) == "<invalid>");
+		NIX_CHECK(Narrow(u"a\xd83d", true) == "a\xef\xbf\xbd");
+		NIX_CHECK(Narrow(u"\xde00z", true) == "\xef\xbf\xbdz");
+		NIX_CHECK(Narrow(u"\xd83dz\U0001f600", true) == "\xef\xbf\xbdz\xf0\x9f\x98\x80");
+		// the legacy wrappers keep the text around the bad byte, as the Win32 calls did
+		char* ucs = nullptr;
+		uint32_t bytes = Nix::utf82ucsle("ok\x80ok", 5, &ucs);
+		NIX_CHECK(bytes == 5 * 2 + 2 && std::u16string((char16_t*)ucs) == u"ok\xfffdok");
+		std::u16string surrogate = u"ok\xdc00";
+		char* utf8 = nullptr;
+		bytes = Nix::ucsle2utf8((const char*)surrogate.data(), surrogate.size() * 2, &utf8);
+		NIX_CHECK(bytes == 5 + 1 && std::string(utf8) == "ok\xef\xbf\xbd");
+		Nix::clear_conv();
+	}
+
+	// the bounded flavours write nothing unless the whole output fits, malformed input included
+	void BoundedTest() {
+		std::string utf8 = std::string(40, 'a') + "\xe4\xb8\xad" + std::string(40, 'b');
+		std::u16string ucs(utf8.size(), u'#');
+		NIX_CHECK(Nix::utf8_to_ucsle(utf8.data(), utf8.size(), &ucs[0], 80) == 81);
+		NIX_CHECK(ucs == std::u16string(utf8.size(), u'#'));
+		NIX_CHECK(Nix::utf8_to_ucsle(utf8.data(), utf8.size(), &ucs[0], 81) == 81);
+		NIX_CHECK(ucs.substr(0, 81) == std::u16string(40, u'a') + u"中" + std::u16string(40, u'b'));
+		std::string bad = std::string(64, 'a') + "\x80";
+		ucs.assign(bad.size(), u'#');
+		NIX_CHECK(Nix::utf8_to_ucsle(bad.data(), bad.size(), &ucs[0], ucs.size()) == Nix::TranscodeInvalid);
+		NIX_CHECK(ucs == std::u16string(bad.size(), u'#'));
+
+		std::u16string text = std::u16string(40, u'a') + u"中";
+		std::string out(text.size() * 3, '#');
+		NIX_CHECK(Nix::ucsle_to_utf8(text.data(), text.size(), &out[0], 42) == 43);
+		NIX_CHECK(out == std::string(text.size() * 3, '#'));
+		NIX_CHECK(Nix::ucsle_to_utf8(text.data(), text.size(), &out[0], 43) == 43);
+		NIX_CHECK(out.substr(0, 43) == std::string(40, 'a') + "\xe4\xb8\xad");
+		std::u16string unpaired = std::u16string(64, u'a') + u"\xd800";
+		out.assign(unpaired.size() * 3, '#');
+		NIX_CHECK(Nix::ucsle_to_utf8(unpaired.data(), unpaired.size(), &out[0], out.size()) == Nix::TranscodeInvalid);
+		NIX_CHECK(out == std::string(unpaired.size() * 3, '#'));
+	}
+
+}
+
+int main() {
+	ValidTest();
+	ReplaceTest();
+	BoundedTest();
+	return NIX_TEST_RESULT();
+}
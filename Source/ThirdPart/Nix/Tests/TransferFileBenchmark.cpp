@@ -0,0 +1,91 @@
+#include "NixTest.h"
+#include <IO/Archive.h>
+#include <vector>
+#include <string>
+
+// IFile to IFile copies through TransferFile against the 64 byte bounce buffer loop the files used
+// before, between std files (copy_file_range on Linux), from a std file into memory and from
+// memory into a std file. The source file is read once beforehand so both run from the OS cache.
+
+namespace {
+
+	const char* SourceName = "TransferFileBenchmark.src";
+	const char* TargetName = "TransferFileBenchmark.dst";
+
+	// the loop of StdFile::read( size_t, IFile* ) before TransferFile
+	size_t Bounce64(Nix::IFile* _dst, Nix::IFile* _src, size_t _bytes) {
+		char chunk[64];
+		size_t bytesLeft = _bytes;
+		do {
+			size_t round = bytesLeft > sizeof(chunk) ? sizeof(chunk) : bytesLeft;
+			size_t readReal = _src->read(round, chunk);
+			bytesLeft -= _dst->write(readReal, chunk);
+			if (readReal != round) {
+				break;
+			}
+		} while (bytesLeft);
+		return _bytes - bytesLeft;
+	}
+
+	typedef size_t (*Transfer)(Nix::IFile*, Nix::IFile*, size_t);
+
+	bool Same(Nix::IFile* _file, const std::vector<uint8_t>& _content) {
+		std::vector<uint8_t> bytes(_content.size());
+		_file->seek(Nix::SeekSet, 0);
+		return _file->read(bytes.size(), bytes.data()) == bytes.size() && bytes == _content;
+	}
+
+	// returns MB/s, `_toMemory` / `_fromMemory` pick the memory end
+	double Run(Nix::IArchive* _archive, const std::vector<uint8_t>& _content, Transfer _transfer, bool _fromMemory, bool _toMemory) {
+		Nix::IFile* src = _fromMemory ? Nix::CreateMemoryBuffer((void*)_content.data(), _content.size()) : _archive->open(SourceName);
+		NIX_CHECK(_archive->save(TargetName, nullptr, 0));
+		Nix::IFile* dst = _toMemory ? Nix::CreateMemoryBuffer(_content.size()) : _archive->open(TargetName);
+		NIX_CHECK(src && dst);
+		if (!src || !dst) {
+			return 0.0;
+		}
+		double begin = NixSeconds();
+		size_t moved = _transfer(dst, src, _content.size());
+		double seconds = NixSeconds() - begin;
+		NIX_CHECK(moved == _content.size());
+		NIX_CHECK(Same(dst, _content));
+		src->release();
+		dst->release();
+		return _content.size() / seconds / 1048576.0;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	size_t size = NixBenchQuick(argc, argv) ? (8 << 20) : (256 << 20);
+	std::vector<uint8_t> content(size);
+	for (size_t i = 0; i < size; ++i) {
+		content[i] = (uint8_t)(i * 2654435761u >> 24);
+	}
+	Nix::IArchive* archive = Nix::CreateStdArchieve(".");
+	NIX_CHECK(archive->save(SourceName, content.data(), content.size()));
+	Nix::IFile* warm = archive->open(SourceName);
+	NIX_CHECK(warm && Same(warm, content));
+	if (warm) {
+		warm->release();
+	}
+	struct {
+		const char* name;
+		bool fromMemory;
+		bool toMemory;
+	} cases[] = {
+		{ "file -> file", false, false },
+		{ "file -> memory", false, true },
+		{ "memory -> file", true, false },
+	};
+	printf("%zu MB\n%16s %18s %18s\n", size >> 20, "", "64 B bounce MB/s", "TransferFile MB/s");
+	for (auto& test : cases) {
+		double bounce = Run(archive, content, &Bounce64, test.fromMemory, test.toMemory);
+		double transfer = Run(archive, content, &Nix::TransferFile, test.fromMemory, test.toMemory);
+		printf("%16s %18.0f %18.0f\n", test.name, bounce, transfer);
+	}
+	remove(SourceName);
+	remove(TargetName);
+	archive->release();
+	return NIX_TEST_RESULT();
+}
@@ -0,0 +1,113 @@
+#include "NixTest.h"
+#include <IO/WorkerPool.h>
+#include <IO/Archive.h>
+#include <IO/Directory.h>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ParallelFor runs every index exactly once whatever the helper limit, from several threads and
+// from inside its own tasks, and the archive calls built on it (prefetch, content hashes) give the
+// same results as doing the work one file at a time.
+
+namespace {
+
+	const char* Directory = "WorkerPoolTest.dir";
+
+	void CoverageTest() {
+		const size_t counts[] = { 0, 1, 2, 7, 1000 };
+		const uint32_t helperLimits[] = { 0, 1, 3, UINT32_MAX };
+		for (size_t count : counts) {
+			for (uint32_t helpers : helperLimits) {
+				std::vector<std::atomic<uint32_t>> runs(count);
+				for (auto& run : runs) {
+					run = 0;
+				}
+				Nix::ParallelFor(count, [&](size_t _index) {
+					++runs[_index];
+				}, helpers);
+				bool once = true;
+				for (auto& run : runs) {
+					once = once && run.load() == 1;
+				}
+				NIX_CHECK(once);
+			}
+		}
+		// no helper at all runs on the calling thread
+		std::thread::id caller = std::this_thread::get_id();
+		bool inline_ = true;
+		Nix::ParallelFor(100, [&](size_t) {
+			inline_ = inline_ && std::this_thread::get_id() == caller;
+		}, 0);
+		NIX_CHECK(inline_);
+	}
+
+	// loops from several threads at once and loops inside loops share the same helpers
+	void NestedTest() {
+		std::atomic<size_t> total(0);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; ++t) {
+			threads.emplace_back([&total]() {
+				Nix::ParallelFor(16, [&total](size_t) {
+					Nix::ParallelFor(64, [&total](size_t _index) {
+						total += _index;
+					});
+				});
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		NIX_CHECK(total.load() == 4 * 16 * (63 * 64 / 2));
+	}
+
+	void ArchiveTest() {
+#ifdef _WIN32
+		_mkdir(Directory);
+#else
+		mkdir(Directory, 0755);
+#endif
+		Nix::IArchive* archive = Nix::CreateStdArchieve(Directory);
+		std::vector<std::string> paths;
+		for (int i = 0; i < 40; ++i) {
+			std::string path = "file" + std::to_string(i) + ".bin";
+			std::vector<uint8_t> content((size_t)i * 5000 + 1, (uint8_t)i);
+			NIX_CHECK(archive->save(path, content.data(), content.size()));
+			paths.push_back(path);
+		}
+		paths.push_back("missing.bin");
+		archive->prefetch(paths);
+		std::vector<Nix::FileInfo> files;
+		NIX_CHECK(archive->list("", files, Nix::ListContentHash));
+		NIX_CHECK(files.size() == 40);
+		for (auto& info : files) {
+			Nix::IFile* file = archive->open(info.path, Nix::MemoryModeCopy);
+			NIX_CHECK(file && info.hash == Nix::HashFileContent(file->constData(), file->size()));
+			if (file) {
+				file->release();
+			}
+			remove((std::string(Directory) + "/" + info.path).c_str());
+		}
+		archive->release();
+#ifdef _WIN32
+		_rmdir(Directory);
+#else
+		rmdir(Directory);
+#endif
+	}
+
+}
+
+int main() {
+	CoverageTest();
+	NestedTest();
+	ArchiveTest();
+	return NIX_TEST_RESULT();
+}
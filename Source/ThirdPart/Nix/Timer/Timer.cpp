@@ -1,14 +1,25 @@
 #include "Timer.h"
 
+#ifdef _WIN32
 #include <Windows.h>
-#include <new>
+#else
+#include <time.h>
+#endif
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NIX_TIMER_TSC 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+#endif
 
  
 namespace Nix {
 
     Timer::Timer()
-    :_secondsPerCount(0.0)
-    ,_deltaTime(0.0)
+    :_deltaTime(0)
     ,_baseTime(0)
     ,_pausedTime(0)
     ,_stopTime(0)
@@ -16,9 +27,6 @@ namespace Nix {
     ,_currTime(0)
     ,_stopped(false)
     {
-        int64_t countsPreSec = 0;
-        QueryPerformanceFrequency((LARGE_INTEGER *)&countsPreSec);
-        _secondsPerCount = 1.0 / (double)countsPreSec;
     }
 
     Timer::~Timer()
@@ -26,34 +34,137 @@ namespace Nix {
 
     }
 
+    int64_t Timer::now()
+    {
+#ifdef _WIN32
+        static const int64_t countsPerSec = []() {
+            LARGE_INTEGER frequency;
+            QueryPerformanceFrequency(&frequency);
+            return (int64_t)frequency.QuadPart;
+        }();
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        // split so that counter * 1e9 can't overflow
+        int64_t seconds = counter.QuadPart / countsPerSec;
+        int64_t remainder = counter.QuadPart % countsPerSec;
+        return seconds * 1000000000 + remainder * 1000000000 / countsPerSec;
+#else
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+    }
+
+#if NIX_TIMER_TSC
+    // a TSC that runs at a constant rate through frequency and power state changes
+    static bool HasInvariantTsc()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0x80000000);
+        if ((unsigned)info[0] < 0x80000007) return false;
+        __cpuid(info, 0x80000007);
+        return (info[3] & (1 << 8)) != 0;
+#else
+        unsigned eax, ebx, ecx, edx;
+        if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) return false;
+        return (edx & (1 << 8)) != 0;
+#endif
+    }
+
+    struct TickSource
+    {
+        bool tsc;
+        double nanosecondsPerTick;
+    };
+
+    static TickSource CalibrateTicks()
+    {
+        TickSource source = { false, 1.0 };
+        if (!HasInvariantTsc()) return source;
+        // a couple of milliseconds against the OS clock is enough for profiling precision
+        int64_t begin = Timer::now();
+        uint64_t tscBegin = __rdtsc();
+        int64_t end = begin;
+        while (end - begin < 2000000) end = Timer::now();
+        uint64_t tscEnd = __rdtsc();
+        if (tscEnd <= tscBegin) return source;
+        source.tsc = true;
+        source.nanosecondsPerTick = (double)(end - begin) / (double)(tscEnd - tscBegin);
+        return source;
+    }
+
+    static const TickSource &Ticks()
+    {
+        static const TickSource source = CalibrateTicks();
+        return source;
+    }
+#endif
+
+    uint64_t Timer::ticks()
+    {
+#if NIX_TIMER_TSC
+        if (Ticks().tsc) return __rdtsc();
+#endif
+        return (uint64_t)now();
+    }
+
+    double Timer::nanosecondsPerTick()
+    {
+#if NIX_TIMER_TSC
+        return Ticks().nanosecondsPerTick;
+#else
+        return 1.0;
+#endif
+    }
+
+    bool Timer::ticksAreTsc()
+    {
+#if NIX_TIMER_TSC
+        return Ticks().tsc;
+#else
+        return false;
+#endif
+    }
+
     float Timer::totalTime() const 
+    {
+        return (float)(totalNanoseconds() * 1e-9);
+    }
+
+    float Timer::deltaTime() const
+    {
+        return (float)(_deltaTime * 1e-9);
+    }
+
+    int64_t Timer::totalNanoseconds() const
     {
         if(_stopped) 
-            return (float)(((_stopTime - _pausedTime) - _baseTime) * _secondsPerCount);
+            return (_stopTime - _pausedTime) - _baseTime;
         else
-            return (float)(((_currTime - _pausedTime) - _baseTime) * _secondsPerCount);
+            return (_currTime - _pausedTime) - _baseTime;
     }
 
-    float Timer::deltaTime() const
+    int64_t Timer::deltaNanoseconds() const
     {
-        return (float)_deltaTime;
+        return _deltaTime;
     }
 
     void Timer::reset()
     {
-        int64_t currTime = 0;
-        QueryPerformanceCounter((LARGE_INTEGER *) &currTime);
+        int64_t currTime = now();
 
         _baseTime = currTime;
         _prevTime = currTime;
+        _currTime = currTime;
+        _pausedTime = 0;
         _stopTime = 0;
         _stopped = false;
     }
 
     void Timer::start()
     {
-        int64_t startTime = 0;
-        QueryPerformanceCounter((LARGE_INTEGER *) &startTime);
+        int64_t startTime = now();
 
         if(!_stopped) return;
 
@@ -67,22 +178,18 @@ namespace Nix {
     {
         if(_stopped) return;
 
-        int64_t currTime = 0;
-        QueryPerformanceCounter((LARGE_INTEGER *) &currTime);
-        _stopTime = currTime;
+        _stopTime = now();
         _stopped = true;
     }
 
     void Timer::tick()
     {
-        if(_stopped) { _deltaTime = 0.0; return; }
+        if(_stopped) { _deltaTime = 0; return; }
 
-        int64_t currTime = 0;
-        QueryPerformanceCounter((LARGE_INTEGER *) &currTime);
-        _currTime = currTime;
-        _deltaTime = (_currTime - _prevTime) * _secondsPerCount;
+        _currTime = now();
+        _deltaTime = _currTime - _prevTime;
         _prevTime = _currTime;
-        if(_deltaTime < 0.0) _deltaTime = 0.0;
+        if(_deltaTime < 0) _deltaTime = 0;
     }
 
-}
\ No newline at end of file
+}
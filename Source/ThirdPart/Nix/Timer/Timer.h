@@ -6,11 +6,13 @@
 
 namespace Nix {
 
+    // Frame timer over the monotonic OS clock (QueryPerformanceCounter on Windows,
+    // clock_gettime(CLOCK_MONOTONIC) elsewhere). Times are kept as integer nanoseconds so long
+    // sessions accumulate without drift, the float accessors are conversions of them.
     class Timer
     {
         private:
-            double _secondsPerCount;
-            double _deltaTime;
+            int64_t _deltaTime;
             int64_t _baseTime;
             int64_t _pausedTime;
             int64_t _stopTime;
@@ -24,11 +26,23 @@ namespace Nix {
 
             float totalTime() const;
             float deltaTime() const;
+            // same as above, in nanoseconds
+            int64_t totalNanoseconds() const;
+            int64_t deltaNanoseconds() const;
 
             void reset();
             void start();
             void stop();
             void tick();
+
+            // monotonic clock in nanoseconds, from an unspecified origin
+            static int64_t now();
+            // Raw counter for hot paths such as profiler zones : the TSC when the CPU has an
+            // invariant one (calibrated against `now` on first use), `now` otherwise.
+            static uint64_t ticks();
+            static double nanosecondsPerTick();
+            // true when `ticks` is the TSC, hot paths can then read __rdtsc inline
+            static bool ticksAreTsc();
     };
 
 }
@@ -36,4 +50,4 @@ namespace Nix {
 
 
 
-#endif
\ No newline at end of file
+#endif
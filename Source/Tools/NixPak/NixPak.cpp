@@ -0,0 +1,36 @@
+#include <IO/PakArchive.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// NixPak <directory> <output.pak> [-a alignment] [-n] [-c]
+//   -a : alignment of every entry in the pak, 64 by default, 4096 to map entries one by one
+//   -n : don't store content checksums
+//   -c : store entries block compressed when it makes them smaller
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        printf("usage : NixPak <directory> <output.pak> [-a alignment] [-n] [-c]\n");
+        return 1;
+    }
+    uint32_t alignment = 64;
+    bool checksums = true;
+    bool compress = false;
+    for (int i = 3; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-a") && i + 1 < argc)
+            alignment = (uint32_t)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-n"))
+            checksums = false;
+        else if (!strcmp(argv[i], "-c"))
+            compress = true;
+    }
+    if (!Nix::BuildPakArchive(argv[1], argv[2], alignment, checksums, compress))
+    {
+        printf("failed to pack %s into %s\n", argv[1], argv[2]);
+        return 1;
+    }
+    printf("packed %s into %s\n", argv[1], argv[2]);
+    return 0;
+}